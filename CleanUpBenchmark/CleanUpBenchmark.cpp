@@ -0,0 +1,338 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Runs Model::cleanUp() next to the brute force T-junction split it replaced on synthetic grids and
+	checks that both give the same model, bit for bit.
+
+	Usage: CleanUpBenchmark [maxSize] [oldMaxSize]
+
+	Each model is an n x n quad grid with a 2n x 2n grid of half the spacing next to it, in a batch of
+	its own, so every other vertex along the shared border is a T-junction on the coarse side. Every
+	vertex has texture coordinates, which get interpolated at the splits. Sizes double from 8 up to
+	maxSize, 128 by default, once flat along the axes and once rotated. The old version tests every
+	edge against every vertex, so it only runs up to oldMaxSize, 32 by default. Returns non-zero if
+	any result differs.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Util/Model.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct OldTriangle {
+	vec3 pos[3];
+	float *attributes[3];
+	int batch;
+};
+
+static int compareOldTriangles(const OldTriangle &elem0, const OldTriangle &elem1){
+	return elem0.batch - elem1.batch;
+}
+
+class ReferenceModel : public Model {
+public:
+	// Model::cleanUp() as it was before the spatial hash. It sorted with a quicksort that left the
+	// order within each batch arbitrary; the stable sort here keeps it the same as cleanUp() does now.
+	void oldCleanUp(){
+		StreamID vertexStream = findStream(TYPE_VERTEX);
+		if (vertexStream < 0) return;
+
+		optimizeStream(vertexStream);
+
+		vec3 *vertices = (vec3 *) streams[vertexStream].vertices;
+		uint *indices   = streams[vertexStream].indices;
+		uint nVertices  = streams[vertexStream].nVertices;
+
+		Array <OldTriangle> triangles;
+
+		uint nAttrib = getComponentCount();
+
+		for (uint n = 0; n < batches.getCount(); n++){
+			uint endIndex = batches[n].startIndex + batches[n].nIndices;
+			for (uint i = batches[n].startIndex; i < endIndex; i += 3){
+				OldTriangle tri;
+				tri.batch = n;
+
+				for (uint j = 0; j < 3; j++){
+					tri.pos[j] = vertices[indices[i + j]];
+					tri.attributes[j] = new float[nAttrib];
+
+					float *dest = tri.attributes[j];
+					for (uint k = 0; k < streams.getCount(); k++){
+						if (signed(k) != vertexStream){
+							int nComp = streams[k].nComponents;
+							memcpy(dest, streams[k].vertices + nComp * streams[k].indices[i + j], nComp * sizeof(float));
+							dest += nComp;
+						}
+					}
+				}
+
+				triangles.add(tri);
+			}
+		}
+
+		for (uint i = 0; i < triangles.getCount(); i++){
+
+restart:
+
+			uint prev = 2;
+			for (uint j = 0; j < 3; j++){
+				vec3 v0 = triangles[i].pos[prev];
+				vec3 v1 = triangles[i].pos[j];
+
+				for (uint k = 0; k < nVertices; k++){
+					vec3 vVec = v1 - v0;
+					vec3 lVec = vertices[k] - v0;
+
+					float c = dot(lVec, vVec) / dot(vVec, vVec);
+					if (c > 0.00001f && c < 0.99999f){
+						vec3 pl = c * vVec - lVec;
+						if (dot(pl, pl) < 0.0001f){
+
+							// Copy current triangle
+							OldTriangle tri;
+							tri.batch = triangles[i].batch;
+							for (uint x = 0; x < 3; x++){
+								tri.pos[x] = triangles[i].pos[x];
+								tri.attributes[x] = new float[nAttrib];
+								memcpy(tri.attributes[x], triangles[i].attributes[x], nAttrib * sizeof(float));
+							}
+
+							// Assign new position for the splitted edge
+							triangles[i].pos[j] = vertices[k];
+							tri.pos[prev] = vertices[k];
+
+							// Interpolate the other attributes
+							for (uint x = 0; x < nAttrib; x++){
+								float ip = lerp(tri.attributes[prev][x], tri.attributes[j][x], c);
+
+								triangles[i].attributes[j][x] = ip;
+								tri.attributes[prev][x] = ip;
+							}
+
+							triangles.add(tri);
+
+							goto restart;
+						}
+					}
+				}
+
+				prev = j;
+			}
+		}
+
+		triangles.stableSort(compareOldTriangles);
+
+		nIndices = 3 * triangles.getCount();
+
+		uint currComp = 0;
+		for (uint i = 0; i < streams.getCount(); i++){
+			delete streams[i].vertices;
+			delete streams[i].indices;
+
+			if (signed(i) == vertexStream){
+				streams[i].vertices = new float[nIndices * 3];
+				for (uint j = 0; j < triangles.getCount(); j++){
+					for (uint k = 0; k < 3; k++){
+						((vec3 *) streams[i].vertices)[3 * j + k] = triangles[j].pos[k];
+					}
+				}
+
+			} else {
+				int nComp = streams[i].nComponents;
+
+				streams[i].vertices = new float[nIndices * nComp];
+
+				float *dest = streams[i].vertices;
+				for (uint j = 0; j < triangles.getCount(); j++){
+					for (uint k = 0; k < 3; k++){
+						memcpy(dest, triangles[j].attributes[k] + currComp, nComp * sizeof(float));
+						dest += nComp;
+					}
+				}
+
+				currComp += nComp;
+			}
+
+			uint *indices = new uint[nIndices];
+			for (uint j = 0; j < nIndices; j++){
+				indices[j] = j;
+			}
+
+			streams[i].indices = indices;
+			streams[i].nVertices = nIndices;
+			streams[i].optimized = false;
+		}
+
+		// Fix the batches
+		int currBatch = 0;
+		uint i = 0;
+		uint startIndex = 0;
+		while (i < triangles.getCount()){
+			while (i < triangles.getCount() && triangles[i].batch == currBatch){
+				for (int j = 0; j < 3; j++){
+					delete triangles[i].attributes[j];
+				}
+				i++;
+			}
+
+			batches[currBatch].startIndex = startIndex;
+			batches[currBatch].nIndices = 3 * i - startIndex;
+			startIndex = 3 * i;
+			currBatch++;
+		}
+	}
+};
+
+// Adds an n x n quad grid with the given spacing, starting at x0, as a batch of its own
+static void addGrid(Array <vec3> &positions, Array <vec2> &texCoords, Array <uint> &indices, Model &model, const uint n, const float x0, const float spacing){
+	uint base = positions.getCount();
+	for (uint y = 0; y <= n; y++){
+		for (uint x = 0; x <= n; x++){
+			positions.add(vec3(x0 + x * spacing, y * spacing, 0));
+			texCoords.add(vec2(x * spacing * 0.37f, y * spacing * 0.21f));
+		}
+	}
+
+	uint startIndex = indices.getCount();
+	for (uint y = 0; y < n; y++){
+		for (uint x = 0; x < n; x++){
+			uint i0 = base + y * (n + 1) + x;
+			uint i1 = i0 + n + 1;
+
+			indices.add(i0);
+			indices.add(i0 + 1);
+			indices.add(i1 + 1);
+
+			indices.add(i0);
+			indices.add(i1 + 1);
+			indices.add(i1);
+		}
+	}
+	model.addBatch(startIndex, indices.getCount() - startIndex);
+}
+
+static void createGrids(Model &model, const uint n, const bool rotated){
+	Array <vec3> positions;
+	Array <vec2> texCoords;
+	Array <uint> indices;
+
+	addGrid(positions, texCoords, indices, model, n, 0, 2.0f);
+	addGrid(positions, texCoords, indices, model, 2 * n, 2.0f * n, 1.0f);
+
+	if (rotated){
+		mat3 rotation = mat3(rotateXY(0.5f, 0.3f));
+		for (uint i = 0; i < positions.getCount(); i++){
+			positions[i] = rotation * positions[i];
+		}
+	}
+
+	uint nVertices = positions.getCount();
+	uint nIndices = indices.getCount();
+
+	float *vertices = new float[3 * nVertices];
+	float *coords = new float[2 * nVertices];
+	memcpy(vertices, positions.getArray(), 3 * nVertices * sizeof(float));
+	memcpy(coords, texCoords.getArray(), 2 * nVertices * sizeof(float));
+
+	uint *vertexIndices = new uint[nIndices];
+	uint *coordIndices = new uint[nIndices];
+	memcpy(vertexIndices, indices.getArray(), nIndices * sizeof(uint));
+	memcpy(coordIndices, indices.getArray(), nIndices * sizeof(uint));
+
+	model.addStream(TYPE_VERTEX, 3, nVertices, vertices, vertexIndices, false);
+	model.addStream(TYPE_TEXCOORD, 2, nVertices, coords, coordIndices, false);
+	model.setIndexCount(nIndices);
+}
+
+static bool isEqual(const Model &model0, const Model &model1){
+	if (model0.getIndexCount() != model1.getIndexCount() || model0.getStreamCount() != model1.getStreamCount() || model0.getBatchCount() != model1.getBatchCount()) return false;
+
+	for (uint i = 0; i < model0.getStreamCount(); i++){
+		const Stream &stream0 = model0.getStream(i);
+		const Stream &stream1 = model1.getStream(i);
+
+		if (stream0.nVertices != stream1.nVertices || stream0.nComponents != stream1.nComponents) return false;
+		if (memcmp(stream0.vertices, stream1.vertices, stream0.nVertices * stream0.nComponents * sizeof(float)) != 0) return false;
+		if (memcmp(stream0.indices, stream1.indices, model0.getIndexCount() * sizeof(uint)) != 0) return false;
+	}
+
+	for (uint i = 0; i < model0.getBatchCount(); i++){
+		if (model0.getBatch(i).startIndex != model1.getBatch(i).startIndex || model0.getBatch(i).nIndices != model1.getBatch(i).nIndices) return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint maxSize = (argc > 1)? atoi(argv[1]) : 128;
+	uint oldMaxSize = (argc > 2)? atoi(argv[2]) : 32;
+
+	initJobSystem();
+
+	printf("%5s %8s %10s %8s %12s %12s %8s\n", "size", "layout", "triangles", "splits", "old", "new", "result");
+
+	uint nFailures = 0;
+	for (uint n = 8; n <= maxSize; n *= 2){
+		for (uint rotated = 0; rotated < 2; rotated++){
+			Model source;
+			createGrids(source, n, rotated != 0);
+
+			Model model;
+			model.copy(&source);
+			timestamp start = getCurrentTime();
+			model.cleanUp();
+			float newTime = getTimeDifference(start, getCurrentTime());
+
+			uint nTriangles = source.getIndexCount() / 3;
+			printf("%5u %8s %10u %8u", n, rotated? "rotated" : "flat", nTriangles, model.getIndexCount() / 3 - nTriangles);
+
+			if (n <= oldMaxSize){
+				ReferenceModel reference;
+				reference.copy(&source);
+				start = getCurrentTime();
+				reference.oldCleanUp();
+				float oldTime = getTimeDifference(start, getCurrentTime());
+
+				bool equal = isEqual(model, reference);
+				if (!equal) nFailures++;
+
+				printf(" %9.2f ms %9.2f ms %8s\n", oldTime * 1000.0f, newTime * 1000.0f, equal? "same" : "DIFFERS");
+			} else {
+				printf(" %12s %9.2f ms %8s\n", "-", newTime * 1000.0f, "-");
+			}
+		}
+	}
+
+	shutdownJobSystem();
+
+	if (nFailures > 0) printf("%u results differ\n", nFailures);
+
+	return (nFailures > 0)? 1 : 0;
+}
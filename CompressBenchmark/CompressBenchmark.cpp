@@ -0,0 +1,291 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Encodes a reference set of textures with Image::compress() at each quality and reports the
+	throughput and the PSNR of the result.
+
+	Usage: CompressBenchmark [textureDir] [workers]
+
+	Textures are read from ../Textures by default. Compressed files are decoded first and mipmaps are
+	generated where missing. The DXT3/5 source takes its alpha from a height map, and the ATI2N source
+	is a normal map made from one. Throughput counts the pixels of all mipmaps with the best of 5 runs.
+	PSNR is for the top level against the channels the format stores: RGB for DXT1, RGBA for DXT3/5,
+	the first channel for ATI1N and the first two for ATI2N. Blocks are decoded here the way hardware
+	does it, expanding 565 colors with bit replication, which is what the encoder fits the endpoints
+	for. Returns non-zero if a texture fails to load or compress, or comes out below 30 dB.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Imaging/Image.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define N_RUNS 5
+#define MIN_PSNR 30.0
+
+struct Reference {
+	const char *fileName;
+	const char *alphaFileName;
+	FORMAT format;
+	bool normalMap;
+};
+
+static const Reference references[] = {
+	{ "brick01.dds",     NULL,             FORMAT_DXT1,  false },
+	{ "stone08.dds",     NULL,             FORMAT_DXT1,  false },
+	{ "Sandstone.tga",   NULL,             FORMAT_DXT1,  false },
+	{ "Leaves.dds",      "LeavesBump.dds", FORMAT_DXT3,  false },
+	{ "Leaves.dds",      "LeavesBump.dds", FORMAT_DXT5,  false },
+	{ "Perlin.tga",      NULL,             FORMAT_ATI1N, false },
+	{ "stone08Bump.dds", NULL,             FORMAT_ATI2N, true  },
+};
+
+static const char *getFormatName(const FORMAT format){
+	switch (format){
+		case FORMAT_DXT1:  return "DXT1";
+		case FORMAT_DXT3:  return "DXT3";
+		case FORMAT_DXT5:  return "DXT5";
+		case FORMAT_ATI1N: return "ATI1N";
+		case FORMAT_ATI2N: return "ATI2N";
+		default: return "?";
+	}
+}
+
+static void decodeColorBlock(ubyte *rgba, const ubyte *src, const bool threeColor){
+	uint c0 = src[0] | (src[1] << 8);
+	uint c1 = src[2] | (src[3] << 8);
+
+	int colors[4][3];
+	for (uint k = 0; k < 2; k++){
+		uint c = (k == 0)? c0 : c1;
+		colors[k][0] = ((c >> 11) << 3) | (c >> 13);
+		colors[k][1] = (((c >> 5) & 0x3F) << 2) | ((c >> 9) & 0x3);
+		colors[k][2] = ((c & 0x1F) << 3) | ((c >> 2) & 0x7);
+	}
+	for (uint i = 0; i < 3; i++){
+		if (c0 > c1 || !threeColor){
+			colors[2][i] = (2 * colors[0][i] +     colors[1][i] + 1) / 3;
+			colors[3][i] = (    colors[0][i] + 2 * colors[1][i] + 1) / 3;
+		} else {
+			colors[2][i] = (colors[0][i] + colors[1][i] + 1) >> 1;
+			colors[3][i] = 0;
+		}
+	}
+
+	for (uint i = 0; i < 16; i++){
+		uint index = (src[4 + (i >> 2)] >> (2 * (i & 3))) & 0x3;
+		for (uint c = 0; c < 3; c++){
+			rgba[4 * i + c] = colors[index][c];
+		}
+	}
+}
+
+static void decodeAlphaBlock(ubyte *dest, const ubyte *src){
+	int a0 = src[0];
+	int a1 = src[1];
+
+	uint64 bits = 0;
+	for (uint i = 0; i < 6; i++){
+		bits |= uint64(src[2 + i]) << (8 * i);
+	}
+
+	for (uint i = 0; i < 16; i++){
+		int k = int(bits >> (3 * i)) & 0x7;
+		if (k == 0){
+			dest[4 * i] = a0;
+		} else if (k == 1){
+			dest[4 * i] = a1;
+		} else if (a0 > a1){
+			dest[4 * i] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		} else if (k >= 6){
+			dest[4 * i] = (k == 6)? 0 : 255;
+		} else {
+			dest[4 * i] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+		}
+	}
+}
+
+// Decodes the top level into RGBA8, with the channels in the order Image::uncompressImage() gives them
+static void decodeTopLevel(ubyte *dest, const Image &image){
+	FORMAT format = image.getFormat();
+	int width = image.getWidth();
+	int height = image.getHeight();
+	int blockSize = getBytesPerBlock(format);
+
+	const ubyte *src = image.getPixels();
+	for (int y = 0; y < height; y += 4){
+		for (int x = 0; x < width; x += 4){
+			ubyte rgba[64];
+			memset(rgba, 255, sizeof(rgba));
+
+			switch (format){
+				case FORMAT_DXT1:
+					decodeColorBlock(rgba, src, true);
+					break;
+				case FORMAT_DXT3:
+					for (uint i = 0; i < 16; i++){
+						rgba[4 * i + 3] = ((src[i >> 1] >> (4 * (i & 1))) & 0xF) * 17;
+					}
+					decodeColorBlock(rgba, src + 8, false);
+					break;
+				case FORMAT_DXT5:
+					decodeAlphaBlock(rgba + 3, src);
+					decodeColorBlock(rgba, src + 8, false);
+					break;
+				case FORMAT_ATI1N:
+					decodeAlphaBlock(rgba, src);
+					break;
+				default:
+					// ATI2N stores the second channel first
+					decodeAlphaBlock(rgba, src + 8);
+					decodeAlphaBlock(rgba + 1, src);
+					break;
+			}
+			src += blockSize;
+
+			for (int j = 0; j < 4 && y + j < height; j++){
+				for (int i = 0; i < 4 && x + i < width; i++){
+					memcpy(dest + 4 * ((y + j) * width + x + i), rgba + 4 * (4 * j + i), 4);
+				}
+			}
+		}
+	}
+}
+
+// PSNR of the top level of the compressed image against the channels of the source the format stores
+static double getPSNR(const Image &source, const Image &compressed){
+	FORMAT format = compressed.getFormat();
+	int nSrcChannels = getChannelCount(source.getFormat());
+	int nChannels = (format == FORMAT_DXT1)? 3 : (format == FORMAT_ATI1N)? 1 : (format == FORMAT_ATI2N)? 2 : 4;
+
+	int nPixels = source.getWidth() * source.getHeight();
+	ubyte *decoded = new ubyte[4 * nPixels];
+	decodeTopLevel(decoded, compressed);
+
+	const ubyte *src = source.getPixels();
+
+	double error = 0;
+	for (int i = 0; i < nPixels; i++){
+		for (int c = 0; c < nChannels; c++){
+			// Sources without alpha are opaque
+			int s = (c < nSrcChannels)? src[i * nSrcChannels + c] : 255;
+			int d = decoded[4 * i + c];
+			error += (s - d) * (s - d);
+		}
+	}
+	delete [] decoded;
+
+	double mse = error / (double(nPixels) * nChannels);
+
+	return (mse > 0)? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+// Loads a reference as 8-bit pixels with mipmaps
+static bool loadReference(Image &image, const Reference &reference, const char *textureDir){
+	char fileName[256];
+	snprintf(fileName, sizeof(fileName), "%s/%s", textureDir, reference.fileName);
+
+	if (!image.loadImage(fileName)) return false;
+	if (isCompressedFormat(image.getFormat())) image.uncompressImage();
+	if (image.getMipMapCount() > 1) image.removeMipMaps(0, 1);
+
+	if (reference.normalMap){
+		if (!image.toNormalMap(FORMAT_RGBA8)) return false;
+	}
+
+	if (reference.alphaFileName){
+		Image alpha;
+		snprintf(fileName, sizeof(fileName), "%s/%s", textureDir, reference.alphaFileName);
+		if (!alpha.loadImage(fileName) || !image.convert(FORMAT_RGBA8)) return false;
+		if (alpha.getFormat() != FORMAT_I8 || alpha.getWidth() != image.getWidth() || alpha.getHeight() != image.getHeight()) return false;
+
+		ubyte *dest = image.getPixels();
+		const ubyte *src = alpha.getPixels();
+		for (int i = 0; i < image.getWidth() * image.getHeight(); i++){
+			dest[4 * i + 3] = src[i];
+		}
+	}
+
+	return image.createMipMaps(ALL_MIPMAPS, MIPMAP_BOX, reference.normalMap? MIPMAP_NORMALMAP : 0);
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	const char *textureDir = (argc > 1)? argv[1] : "../Textures";
+	uint nWorkers = (argc > 2)? atoi(argv[2]) : 0;
+
+	initJobSystem(nWorkers);
+
+	printf("%u workers, best of %u runs, MP/s and PSNR of the top level\n", getWorkerCount(), N_RUNS);
+	printf("%-16s %-6s %20s %20s %20s\n", "", "", "FAST", "NORMAL", "HIGH");
+
+	uint nFailures = 0;
+	for (uint i = 0; i < elementsOf(references); i++){
+		Image source;
+		if (!loadReference(source, references[i], textureDir)){
+			printf("%-16s couldn't be loaded\n", references[i].fileName);
+			nFailures++;
+			continue;
+		}
+
+		FORMAT format = references[i].format;
+		printf("%-16s %-6s", references[i].fileName, getFormatName(format));
+
+		for (int quality = COMPRESS_FAST; quality <= COMPRESS_HIGH; quality++){
+			float best = 1e10f;
+			double psnr = 0;
+			bool compressed = true;
+			for (uint run = 0; run < N_RUNS && compressed; run++){
+				Image image(source);
+
+				timestamp start = getCurrentTime();
+				compressed = image.compress(format, quality);
+				float time = getTimeDifference(start, getCurrentTime());
+				if (time < best) best = time;
+
+				if (compressed && run == 0) psnr = getPSNR(source, image);
+			}
+
+			if (!compressed){
+				printf(" %20s", "failed");
+				nFailures++;
+			} else {
+				printf(" %7.1f MP/s %6.2f dB", source.getPixelCount() / best * 1e-6f, psnr);
+				if (psnr < MIN_PSNR) nFailures++;
+			}
+		}
+		printf("\n");
+	}
+
+	shutdownJobSystem();
+
+	if (nFailures > 0) printf("%u failures\n", nFailures);
+
+	return (nFailures > 0)? 1 : 0;
+}
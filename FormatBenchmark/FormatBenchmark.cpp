@@ -0,0 +1,218 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Measures convertPixels() for every pair of the plain 8 and 16-bit unsigned, half and float
+	formats, next to the per pixel loop Image::convert() used before, and checks that both give
+	the same bytes.
+
+	Usage: FormatBenchmark [size] [workers]
+
+	Converts size x size pixels, 1024 by default, of random data with the best of 5 runs. The float
+	sources include zero, denormals, values out of the 0-1 range and values too large for a half.
+	It prints a matrix of MP/s with the source formats down and the destination formats across, then
+	the speedup over the per pixel loop. Pairs from a two channel source to another channel count are
+	left out of the comparison, as the old loop read an uninitialized blue there. The Makefile builds
+	without -ffast-math, which would let the two round differently. Returns non-zero if any pair differs.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Imaging/FormatConvert.h"
+#include "../Framework3/Math/Vector.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_FORMATS 16
+#define N_RUNS 5
+
+static FORMAT getPlainFormat(const uint index){
+	// R8 to RGBA16, then R16F to RGBA32F, skipping the signed formats between them
+	return FORMAT(FORMAT_R8 + index + ((index >= 8)? 8 : 0));
+}
+
+static uint randomState = 12345;
+static uint nextRandom(){
+	randomState = randomState * 1664525 + 1013904223;
+	return randomState >> 8;
+}
+
+static void fillRandom(ubyte *data, const FORMAT format, const uint nPixels){
+	uint size = nPixels * getBytesPerPixel(format);
+
+	if (format >= FORMAT_R32F){
+		float *values = (float *) data;
+		for (uint i = 0; i < size / 4; i++){
+			uint r = nextRandom();
+			switch (r % 64){
+				case 0:  values[i] = 0.0f; break;
+				case 1:  values[i] = 1e-40f; break;
+				case 2:  values[i] = 1e-6f; break;
+				case 3:  values[i] = 70000.0f; break;
+				default: values[i] = (r % 1000) / 800.0f - 0.1f;
+			}
+		}
+	} else if (format >= FORMAT_R16F){
+		half *values = (half *) data;
+		for (uint i = 0; i < size / 2; i++){
+			values[i] = (nextRandom() % 1000) / 800.0f - 0.1f;
+		}
+	} else {
+		for (uint i = 0; i < size; i++){
+			data[i] = ubyte(nextRandom());
+		}
+	}
+}
+
+// The loop of Image::convert() before convertPixels(), with blue cleared for two channel sources
+static void convertPerPixel(ubyte *dest, const FORMAT destFormat, const ubyte *src, const FORMAT srcFormat, uint nPixels){
+	int srcSize = getBytesPerPixel(srcFormat);
+	int nSrcChannels = getChannelCount(srcFormat);
+
+	int destSize = getBytesPerPixel(destFormat);
+	int nDestChannels = getChannelCount(destFormat);
+
+	do {
+		float rgba[4];
+
+		if (isFloatFormat(srcFormat)){
+			if (srcFormat <= FORMAT_RGBA16F){
+				for (int i = 0; i < nSrcChannels; i++) rgba[i] = ((half *) src)[i];
+			} else {
+				for (int i = 0; i < nSrcChannels; i++) rgba[i] = ((float *) src)[i];
+			}
+		} else if (srcFormat >= FORMAT_R16 && srcFormat <= FORMAT_RGBA16){
+			for (int i = 0; i < nSrcChannels; i++) rgba[i] = ((ushort *) src)[i] * (1.0f / 65535.0f);
+		} else {
+			for (int i = 0; i < nSrcChannels; i++) rgba[i] = src[i] * (1.0f / 255.0f);
+		}
+		if (nSrcChannels == 2) rgba[2] = 0.0f;
+		if (nSrcChannels  < 4) rgba[3] = 1.0f;
+		if (nSrcChannels == 1) rgba[2] = rgba[1] = rgba[0];
+
+		if (nDestChannels == 1) rgba[0] = 0.30f * rgba[0] + 0.59f * rgba[1] + 0.11f * rgba[2];
+
+		if (isFloatFormat(destFormat)){
+			if (destFormat <= FORMAT_RGBA16F){
+				for (int i = 0; i < nDestChannels; i++) ((half *) dest)[i] = rgba[i];
+			} else {
+				for (int i = 0; i < nDestChannels; i++) ((float *) dest)[i] = rgba[i];
+			}
+		} else if (destFormat >= FORMAT_R16 && destFormat <= FORMAT_RGBA16){
+			for (int i = 0; i < nDestChannels; i++) ((ushort *) dest)[i] = (ushort) (65535 * saturate(rgba[i]) + 0.5f);
+		} else {
+			for (int i = 0; i < nDestChannels; i++) dest[i] = (unsigned char) (255 * saturate(rgba[i]) + 0.5f);
+		}
+
+		src += srcSize;
+		dest += destSize;
+	} while (--nPixels);
+}
+
+static void printHeader(const char *title){
+	printf("\n%-9s", title);
+	for (uint d = 0; d < N_FORMATS; d++){
+		printf("%8s", getFormatString(getPlainFormat(d)));
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint size = (argc > 1)? atoi(argv[1]) : 1024;
+	uint nWorkers = (argc > 2)? atoi(argv[2]) : 0;
+	if (size < 1) size = 1;
+	uint nPixels = size * size;
+
+	initJobSystem(nWorkers);
+
+	// Room for the largest format, RGBA32F
+	ubyte *src = new ubyte[nPixels * 16];
+	ubyte *dest = new ubyte[nPixels * 16];
+	ubyte *reference = new ubyte[nPixels * 16];
+
+	float rates[N_FORMATS][N_FORMATS];
+	float speedups[N_FORMATS][N_FORMATS];
+	uint nDiffering = 0;
+
+	for (uint s = 0; s < N_FORMATS; s++){
+		FORMAT srcFormat = getPlainFormat(s);
+		fillRandom(src, srcFormat, nPixels);
+
+		for (uint d = 0; d < N_FORMATS; d++){
+			FORMAT destFormat = getPlainFormat(d);
+			rates[s][d] = speedups[s][d] = 0;
+			if (!canConvertPixels(srcFormat, destFormat)) continue;
+
+			float best = 1e10f, bestPerPixel = 1e10f;
+			for (uint run = 0; run < N_RUNS; run++){
+				timestamp start = getCurrentTime();
+				convertPixels(dest, destFormat, src, srcFormat, nPixels);
+				float time = getTimeDifference(start, getCurrentTime());
+				if (time < best) best = time;
+
+				start = getCurrentTime();
+				convertPerPixel(reference, destFormat, src, srcFormat, nPixels);
+				time = getTimeDifference(start, getCurrentTime());
+				if (time < bestPerPixel) bestPerPixel = time;
+			}
+			rates[s][d] = nPixels / best * 1e-6f;
+			speedups[s][d] = bestPerPixel / best;
+
+			bool comparable = (getChannelCount(srcFormat) != 2 || getChannelCount(destFormat) == 2);
+			if (comparable && memcmp(dest, reference, nPixels * getBytesPerPixel(destFormat)) != 0){
+				printf("%s -> %s differs from the per pixel loop\n", getFormatString(srcFormat), getFormatString(destFormat));
+				nDiffering++;
+			}
+		}
+	}
+
+	printf("%ux%u pixels, %u workers, best of %u runs\n", size, size, getWorkerCount(), N_RUNS);
+
+	printHeader("MP/s");
+	for (uint s = 0; s < N_FORMATS; s++){
+		printf("%-9s", getFormatString(getPlainFormat(s)));
+		for (uint d = 0; d < N_FORMATS; d++) printf("%8.0f", rates[s][d]);
+		printf("\n");
+	}
+
+	printHeader("Speedup");
+	for (uint s = 0; s < N_FORMATS; s++){
+		printf("%-9s", getFormatString(getPlainFormat(s)));
+		for (uint d = 0; d < N_FORMATS; d++) printf("%8.1f", speedups[s][d]);
+		printf("\n");
+	}
+
+	printf("\n%u pairs differ\n", nDiffering);
+
+	delete [] src;
+	delete [] dest;
+	delete [] reference;
+
+	shutdownJobSystem();
+
+	return (nDiffering > 0)? 1 : 0;
+}
@@ -0,0 +1,727 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "BlockCompress.h"
+#include "../Util/JobSystem.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Weight of the first endpoint for each index, or -1 for entries that aren't interpolated
+static const float fourColorWeights[4]  = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+static const float threeColorWeights[4] = { 1.0f, 0.0f, 0.5f, -1.0f };
+static const float eightAlphaWeights[8] = { 1.0f, 0.0f, 6.0f / 7.0f, 5.0f / 7.0f, 4.0f / 7.0f, 3.0f / 7.0f, 2.0f / 7.0f, 1.0f / 7.0f };
+static const float sixAlphaWeights[8]   = { 1.0f, 0.0f, 4.0f / 5.0f, 3.0f / 5.0f, 2.0f / 5.0f, 1.0f / 5.0f, -1.0f, -1.0f };
+
+// The pixels of a block by channel. Pixels with zero weight are transparent and don't affect the fit.
+struct ColorBlock {
+	alignment(16) float color[3][16];
+	alignment(16) float weight[16];
+};
+
+struct ColorFit {
+	uint16 c0, c1;
+	uint indices[16];
+	float error;
+};
+
+static uint16 packColor(const float *color){
+	int r = (int) (color[0] * (31.0f / 255.0f) + 0.5f);
+	int g = (int) (color[1] * (63.0f / 255.0f) + 0.5f);
+	int b = (int) (color[2] * (31.0f / 255.0f) + 0.5f);
+	r = (r < 0)? 0 : (r > 31)? 31 : r;
+	g = (g < 0)? 0 : (g > 63)? 63 : g;
+	b = (b < 0)? 0 : (b > 31)? 31 : b;
+
+	return (uint16) ((r << 11) | (g << 5) | b);
+}
+
+static void unpackColor(int *color, const uint16 c){
+	color[0] = ((c >> 11) << 3) | (c >> 13);
+	color[1] = (((c >> 5) & 0x3F) << 2) | ((c >> 9) & 0x3);
+	color[2] = ((c & 0x1F) << 3) | ((c >> 2) & 0x7);
+}
+
+// The colors the decoder produces for the endpoints, with c0 > c1 selecting the four color mode
+static void getColorPalette(float palette[4][3], const uint16 c0, const uint16 c1){
+	int col[4][3];
+	unpackColor(col[0], c0);
+	unpackColor(col[1], c1);
+	for (int i = 0; i < 3; i++){
+		if (c0 > c1){
+			col[2][i] = (2 * col[0][i] +     col[1][i] + 1) / 3;
+			col[3][i] = (    col[0][i] + 2 * col[1][i] + 1) / 3;
+		} else {
+			col[2][i] = (col[0][i] + col[1][i] + 1) >> 1;
+			col[3][i] = 0;
+		}
+	}
+	for (int k = 0; k < 4; k++){
+		for (int i = 0; i < 3; i++){
+			palette[k][i] = (float) col[k][i];
+		}
+	}
+}
+
+// Picks the closest of the first nColors palette entries for each pixel and returns the weighted squared error
+static float selectColorIndices(uint *indices, const ColorBlock &block, const float palette[4][3], const int nColors){
+	float error = 0;
+#ifdef USE_SSE2
+	for (int i = 0; i < 16; i += 4){
+		__m128 r = _mm_load_ps(block.color[0] + i);
+		__m128 g = _mm_load_ps(block.color[1] + i);
+		__m128 b = _mm_load_ps(block.color[2] + i);
+
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int k = 0; k < nColors; k++){
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)), _mm_andnot_si128(closer, bestIndex));
+			best = _mm_min_ps(d, best);
+		}
+		_mm_storeu_si128((__m128i *) (indices + i), bestIndex);
+
+		alignment(16) float e[4];
+		_mm_store_ps(e, _mm_mul_ps(best, _mm_load_ps(block.weight + i)));
+		error += (e[0] + e[1]) + (e[2] + e[3]);
+	}
+#else
+	for (int i = 0; i < 16; i++){
+		float best = FLT_MAX;
+		uint bestIndex = 0;
+		for (int k = 0; k < nColors; k++){
+			float dr = block.color[0][i] - palette[k][0];
+			float dg = block.color[1][i] - palette[k][1];
+			float db = block.color[2][i] - palette[k][2];
+			float d = dr * dr + dg * dg + db * db;
+			if (d < best){
+				best = d;
+				bestIndex = k;
+			}
+		}
+		indices[i] = bestIndex;
+		error += best * block.weight[i];
+	}
+#endif
+	return error;
+}
+
+// Quantizes the endpoints and picks the indices. Endpoints are ordered for the requested mode, equal endpoints
+// can only be decoded in the three color mode, in which case every opaque pixel uses the first index.
+static void evaluateColors(ColorFit &fit, const ColorBlock &block, const float *e0, const float *e1, const bool fourColor, const bool transparent){
+	uint16 c0 = packColor(e0);
+	uint16 c1 = packColor(e1);
+	if ((c0 < c1) == fourColor){
+		uint16 c = c0;
+		c0 = c1;
+		c1 = c;
+	}
+	fit.c0 = c0;
+	fit.c1 = c1;
+
+	float palette[4][3];
+	getColorPalette(palette, c0, c1);
+
+	// In the three color mode the last entry is black unless it's needed for transparency
+	int nColors = (c0 == c1)? 1 : (fourColor || !transparent)? 4 : 3;
+	fit.error = selectColorIndices(fit.indices, block, palette, nColors);
+}
+
+// Solves for the endpoints that best reproduce the pixels with their current indices in the least squares sense
+static bool fitColorEndpoints(float *e0, float *e1, const ColorBlock &block, const uint *indices, const float *weights){
+	float aa = 0, bb = 0, ab = 0;
+	float ax[3] = { 0, 0, 0 };
+	float bx[3] = { 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++){
+		float w = block.weight[i];
+		float a = weights[indices[i]];
+		if (w == 0 || a < 0) continue;
+
+		float b = 1.0f - a;
+		aa += w * a * a;
+		bb += w * b * b;
+		ab += w * a * b;
+		for (int c = 0; c < 3; c++){
+			ax[c] += w * a * block.color[c][i];
+			bx[c] += w * b * block.color[c][i];
+		}
+	}
+
+	float det = aa * bb - ab * ab;
+	if (det < 1e-4f) return false;
+
+	float invDet = 1.0f / det;
+	for (int c = 0; c < 3; c++){
+		e0[c] = (ax[c] * bb - bx[c] * ab) * invDet;
+		e1[c] = (bx[c] * aa - ax[c] * ab) * invDet;
+	}
+
+	return true;
+}
+
+static void refineColors(ColorFit &fit, const ColorBlock &block, const bool fourColor, const bool transparent, const int nIterations){
+	const float *weights = fourColor? fourColorWeights : threeColorWeights;
+
+	for (int i = 0; i < nIterations; i++){
+		float e0[3], e1[3];
+		if (!fitColorEndpoints(e0, e1, block, fit.indices, weights)) break;
+
+		ColorFit newFit;
+		evaluateColors(newFit, block, e0, e1, fourColor, transparent);
+		if (newFit.error >= fit.error) break;
+
+		fit = newFit;
+	}
+}
+
+// Weighted mean, bounds and covariance (xx xy xz yy yz zz) of the colors
+static void getColorStatistics(const ColorBlock &block, float *mean, float *minColor, float *maxColor, float *cov){
+#ifdef USE_SSE2
+	__m128 sum = _mm_setzero_ps();
+	__m128 s[3], lo[3], hi[3];
+	for (int c = 0; c < 3; c++){
+		s[c] = _mm_setzero_ps();
+		lo[c] = _mm_set1_ps(255.0f);
+		hi[c] = _mm_setzero_ps();
+	}
+	for (int i = 0; i < 16; i += 4){
+		__m128 w = _mm_load_ps(block.weight + i);
+		__m128 used = _mm_cmpgt_ps(w, _mm_setzero_ps());
+		sum = _mm_add_ps(sum, w);
+		for (int c = 0; c < 3; c++){
+			__m128 v = _mm_load_ps(block.color[c] + i);
+			s[c] = _mm_add_ps(s[c], _mm_mul_ps(w, v));
+			lo[c] = _mm_min_ps(lo[c], _mm_or_ps(_mm_and_ps(used, v), _mm_andnot_ps(used, _mm_set1_ps(255.0f))));
+			hi[c] = _mm_max_ps(hi[c], _mm_and_ps(used, v));
+		}
+	}
+	alignment(16) float t[4];
+	_mm_store_ps(t, sum);
+	float invSum = 1.0f / ((t[0] + t[1]) + (t[2] + t[3]));
+
+	__m128 m[3];
+	for (int c = 0; c < 3; c++){
+		_mm_store_ps(t, s[c]);
+		mean[c] = ((t[0] + t[1]) + (t[2] + t[3])) * invSum;
+		m[c] = _mm_set1_ps(mean[c]);
+
+		__m128 l = _mm_min_ps(lo[c], _mm_shuffle_ps(lo[c], lo[c], _MM_SHUFFLE(1, 0, 3, 2)));
+		__m128 h = _mm_max_ps(hi[c], _mm_shuffle_ps(hi[c], hi[c], _MM_SHUFFLE(1, 0, 3, 2)));
+		minColor[c] = _mm_cvtss_f32(_mm_min_ss(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 3, 0, 1))));
+		maxColor[c] = _mm_cvtss_f32(_mm_max_ss(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1))));
+	}
+
+	__m128 cv[6];
+	for (int k = 0; k < 6; k++){
+		cv[k] = _mm_setzero_ps();
+	}
+	for (int i = 0; i < 16; i += 4){
+		__m128 w = _mm_load_ps(block.weight + i);
+		__m128 r = _mm_sub_ps(_mm_load_ps(block.color[0] + i), m[0]);
+		__m128 g = _mm_sub_ps(_mm_load_ps(block.color[1] + i), m[1]);
+		__m128 b = _mm_sub_ps(_mm_load_ps(block.color[2] + i), m[2]);
+		__m128 wr = _mm_mul_ps(w, r);
+		__m128 wg = _mm_mul_ps(w, g);
+		cv[0] = _mm_add_ps(cv[0], _mm_mul_ps(wr, r));
+		cv[1] = _mm_add_ps(cv[1], _mm_mul_ps(wr, g));
+		cv[2] = _mm_add_ps(cv[2], _mm_mul_ps(wr, b));
+		cv[3] = _mm_add_ps(cv[3], _mm_mul_ps(wg, g));
+		cv[4] = _mm_add_ps(cv[4], _mm_mul_ps(wg, b));
+		cv[5] = _mm_add_ps(cv[5], _mm_mul_ps(_mm_mul_ps(w, b), b));
+	}
+	for (int k = 0; k < 6; k++){
+		_mm_store_ps(t, cv[k]);
+		cov[k] = (t[0] + t[1]) + (t[2] + t[3]);
+	}
+#else
+	float sum = 0;
+	for (int c = 0; c < 3; c++){
+		mean[c] = 0;
+		minColor[c] = 255;
+		maxColor[c] = 0;
+	}
+	for (int i = 0; i < 16; i++){
+		float w = block.weight[i];
+		if (w == 0) continue;
+
+		sum += w;
+		for (int c = 0; c < 3; c++){
+			float v = block.color[c][i];
+			mean[c] += w * v;
+			if (v < minColor[c]) minColor[c] = v;
+			if (v > maxColor[c]) maxColor[c] = v;
+		}
+	}
+	for (int c = 0; c < 3; c++){
+		mean[c] /= sum;
+	}
+
+	for (int k = 0; k < 6; k++){
+		cov[k] = 0;
+	}
+	for (int i = 0; i < 16; i++){
+		float w = block.weight[i];
+		float r = block.color[0][i] - mean[0];
+		float g = block.color[1][i] - mean[1];
+		float b = block.color[2][i] - mean[2];
+		cov[0] += w * r * r;
+		cov[1] += w * r * g;
+		cov[2] += w * r * b;
+		cov[3] += w * g * g;
+		cov[4] += w * g * b;
+		cov[5] += w * b * b;
+	}
+#endif
+}
+
+// Finds the initial endpoints along the direction of largest variance
+static void getColorAxis(float *e0, float *e1, const ColorBlock &block, const int quality){
+	float mean[3], minColor[3], maxColor[3], cov[6];
+	getColorStatistics(block, mean, minColor, maxColor, cov);
+
+	if (quality == COMPRESS_FAST){
+		// The bounding box diagonal, flipped to follow the correlation with the channel of largest range, and inset a bit
+		static const int covIndex[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+		int ref = 0;
+		for (int c = 1; c < 3; c++){
+			if (maxColor[c] - minColor[c] > maxColor[ref] - minColor[ref]) ref = c;
+		}
+		for (int c = 0; c < 3; c++){
+			float inset = (maxColor[c] - minColor[c]) * (1.0f / 16.0f);
+			e0[c] = maxColor[c] - inset;
+			e1[c] = minColor[c] + inset;
+			if (cov[covIndex[ref][c]] < 0){
+				float t = e0[c];
+				e0[c] = e1[c];
+				e1[c] = t;
+			}
+		}
+		return;
+	}
+
+	// Power iteration from the box diagonal, which is close enough to converge in a few steps
+	float axis[3] = { maxColor[0] - minColor[0], maxColor[1] - minColor[1], maxColor[2] - minColor[2] };
+	if (cov[1] < 0) axis[1] = -axis[1];
+	if (cov[2] < 0) axis[2] = -axis[2];
+	for (int i = 0; i < 4; i++){
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float m = fabsf(x);
+		if (fabsf(y) > m) m = fabsf(y);
+		if (fabsf(z) > m) m = fabsf(z);
+		if (m < 1e-6f) break;
+
+		float s = 1.0f / m;
+		axis[0] = x * s;
+		axis[1] = y * s;
+		axis[2] = z * s;
+	}
+	float len = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+	float minT = 0, maxT = 0;
+	if (len > 1e-12f){
+		// Projections onto the axis scaled so that mean + t * axis is the projected point
+		float invLen = 1.0f / len;
+		float dir[3] = { axis[0] * invLen, axis[1] * invLen, axis[2] * invLen };
+#ifdef USE_SSE2
+		__m128 lo = _mm_set1_ps(FLT_MAX);
+		__m128 hi = _mm_set1_ps(-FLT_MAX);
+		for (int i = 0; i < 16; i += 4){
+			__m128 used = _mm_cmpgt_ps(_mm_load_ps(block.weight + i), _mm_setzero_ps());
+			__m128 t = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.color[0] + i), _mm_set1_ps(mean[0])), _mm_set1_ps(dir[0]));
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.color[1] + i), _mm_set1_ps(mean[1])), _mm_set1_ps(dir[1])));
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(block.color[2] + i), _mm_set1_ps(mean[2])), _mm_set1_ps(dir[2])));
+			lo = _mm_min_ps(lo, _mm_or_ps(_mm_and_ps(used, t), _mm_andnot_ps(used, _mm_set1_ps(FLT_MAX))));
+			hi = _mm_max_ps(hi, _mm_or_ps(_mm_and_ps(used, t), _mm_andnot_ps(used, _mm_set1_ps(-FLT_MAX))));
+		}
+		lo = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+		hi = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+		minT = _mm_cvtss_f32(_mm_min_ss(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 3, 0, 1))));
+		maxT = _mm_cvtss_f32(_mm_max_ss(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 3, 0, 1))));
+#else
+		minT = FLT_MAX;
+		maxT = -FLT_MAX;
+		for (int i = 0; i < 16; i++){
+			if (block.weight[i] == 0) continue;
+
+			float t = (block.color[0][i] - mean[0]) * dir[0] + (block.color[1][i] - mean[1]) * dir[1] + (block.color[2][i] - mean[2]) * dir[2];
+			if (t < minT) minT = t;
+			if (t > maxT) maxT = t;
+		}
+#endif
+	}
+
+	// Pulling the ends in a little lets the interpolated colors cover the bulk of the pixels rather than outliers
+	float inset = (maxT - minT) * (1.0f / 16.0f);
+	minT += inset;
+	maxT -= inset;
+	for (int c = 0; c < 3; c++){
+		e0[c] = mean[c] + maxT * axis[c];
+		e1[c] = mean[c] + minT * axis[c];
+	}
+}
+
+void compressColorBlock(ubyte *dest, const ubyte *rgba, const int quality, const bool threeColor, const bool punchThrough){
+	ColorBlock block;
+	bool transparent = false;
+	bool opaque = false;
+	for (int i = 0; i < 16; i++){
+		block.color[0][i] = rgba[4 * i];
+		block.color[1][i] = rgba[4 * i + 1];
+		block.color[2][i] = rgba[4 * i + 2];
+		if (punchThrough && rgba[4 * i + 3] < 128){
+			block.weight[i] = 0;
+			transparent = true;
+		} else {
+			block.weight[i] = 1;
+			opaque = true;
+		}
+	}
+
+	ColorFit fit;
+	if (opaque){
+		float e0[3], e1[3];
+		getColorAxis(e0, e1, block, quality);
+
+		int nIterations = (quality == COMPRESS_FAST)? 0 : (quality == COMPRESS_NORMAL)? 1 : 8;
+
+		// Transparency is only available in the three color mode
+		bool fourColor = !transparent;
+		evaluateColors(fit, block, e0, e1, fourColor, transparent);
+		refineColors(fit, block, fourColor, transparent, nIterations);
+
+		// The three color mode wins on blocks with a cluster in the middle or with pure black pixels
+		if (fourColor && threeColor && quality == COMPRESS_HIGH){
+			ColorFit threeFit;
+			evaluateColors(threeFit, block, e0, e1, false, false);
+			refineColors(threeFit, block, false, false, nIterations);
+			if (threeFit.error < fit.error) fit = threeFit;
+		}
+	} else {
+		fit.c0 = fit.c1 = 0;
+	}
+
+	dest[0] = (ubyte) (fit.c0 & 0xFF);
+	dest[1] = (ubyte) (fit.c0 >> 8);
+	dest[2] = (ubyte) (fit.c1 & 0xFF);
+	dest[3] = (ubyte) (fit.c1 >> 8);
+	for (int y = 0; y < 4; y++){
+		uint bits = 0;
+		for (int x = 0; x < 4; x++){
+			int i = 4 * y + x;
+			uint index = (block.weight[i] == 0)? 3 : fit.indices[i];
+			bits |= index << (2 * x);
+		}
+		dest[4 + y] = (ubyte) bits;
+	}
+}
+
+struct AlphaFit {
+	int a0, a1;
+	ubyte indices[16];
+	int error;
+};
+
+// The values the decoder produces for the endpoints, with a0 > a1 selecting the eight value mode
+static void getAlphaPalette(int palette[8], const int a0, const int a1){
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1){
+		for (int k = 2; k < 8; k++){
+			palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		}
+	} else {
+		for (int k = 2; k < 6; k++){
+			palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// Picks the closest palette entry for each value and returns the squared error
+static int selectAlphaIndices(ubyte *indices, const ubyte *values, const int palette[8]){
+#ifdef USE_SSE2
+	// All 16 values fit one register
+	__m128i v = _mm_loadu_si128((const __m128i *) values);
+	__m128i best = _mm_set1_epi8((char) 0xFF);
+	__m128i bestIndex = _mm_setzero_si128();
+	for (int k = 0; k < 8; k++){
+		__m128i p = _mm_set1_epi8((char) palette[k]);
+		__m128i d = _mm_or_si128(_mm_subs_epu8(v, p), _mm_subs_epu8(p, v));
+
+		// Strictly closer, so the lowest index wins ties like in the scalar path
+		__m128i notCloser = _mm_cmpeq_epi8(_mm_max_epu8(d, best), d);
+		bestIndex = _mm_or_si128(_mm_andnot_si128(notCloser, _mm_set1_epi8((char) k)), _mm_and_si128(notCloser, bestIndex));
+		best = _mm_min_epu8(d, best);
+	}
+	_mm_storeu_si128((__m128i *) indices, bestIndex);
+
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_unpacklo_epi8(best, zero);
+	__m128i hi = _mm_unpackhi_epi8(best, zero);
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	return _mm_cvtsi128_si32(sum);
+#else
+	int error = 0;
+	for (int i = 0; i < 16; i++){
+		int best = 256;
+		int bestIndex = 0;
+		for (int k = 0; k < 8; k++){
+			int d = abs(values[i] - palette[k]);
+			if (d < best){
+				best = d;
+				bestIndex = k;
+			}
+		}
+		indices[i] = (ubyte) bestIndex;
+		error += best * best;
+	}
+	return error;
+#endif
+}
+
+static int clampAlpha(const float a){
+	int i = (int) (a + 0.5f);
+	return (i < 0)? 0 : (i > 255)? 255 : i;
+}
+
+// In the eight value mode a0 must be the larger endpoint, in the six value mode the smaller one
+static void evaluateAlpha(AlphaFit &fit, const ubyte *values, const int e0, const int e1, const bool eightValues){
+	bool larger = (e0 > e1);
+	fit.a0 = (larger == eightValues)? e0 : e1;
+	fit.a1 = (larger == eightValues)? e1 : e0;
+
+	int palette[8];
+	getAlphaPalette(palette, fit.a0, fit.a1);
+	fit.error = selectAlphaIndices(fit.indices, values, palette);
+}
+
+static void refineAlpha(AlphaFit &fit, const ubyte *values, const bool eightValues, const int nIterations){
+	const float *weights = eightValues? eightAlphaWeights : sixAlphaWeights;
+
+	for (int i = 0; i < nIterations && fit.error > 0; i++){
+		float aa = 0, bb = 0, ab = 0, ax = 0, bx = 0;
+		for (int j = 0; j < 16; j++){
+			float a = weights[fit.indices[j]];
+			if (a < 0) continue;
+
+			float b = 1.0f - a;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			ax += a * values[j];
+			bx += b * values[j];
+		}
+
+		float det = aa * bb - ab * ab;
+		if (det < 1e-4f) break;
+
+		float invDet = 1.0f / det;
+		AlphaFit newFit;
+		evaluateAlpha(newFit, values, clampAlpha((ax * bb - bx * ab) * invDet), clampAlpha((bx * aa - ax * ab) * invDet), eightValues);
+		if (newFit.error >= fit.error) break;
+
+		fit = newFit;
+	}
+}
+
+void compressAlphaBlock(ubyte *dest, const ubyte *values, const int quality){
+	int minValue = 255, maxValue = 0;
+	for (int i = 0; i < 16; i++){
+		if (values[i] < minValue) minValue = values[i];
+		if (values[i] > maxValue) maxValue = values[i];
+	}
+
+	int nIterations = (quality == COMPRESS_FAST)? 0 : (quality == COMPRESS_NORMAL)? 1 : 8;
+
+	AlphaFit fit;
+	evaluateAlpha(fit, values, maxValue, minValue, true);
+	refineAlpha(fit, values, true, nIterations);
+
+	// The six value mode has exact 0 and 255, which leaves more precision for the rest if the block has both extremes and values in between
+	if (quality == COMPRESS_HIGH && fit.error > 0 && (minValue == 0 || maxValue == 255)){
+		int minInner = 255, maxInner = 0;
+		for (int i = 0; i < 16; i++){
+			if (values[i] == 0 || values[i] == 255) continue;
+			if (values[i] < minInner) minInner = values[i];
+			if (values[i] > maxInner) maxInner = values[i];
+		}
+		if (minInner <= maxInner){
+			AlphaFit sixFit;
+			evaluateAlpha(sixFit, values, minInner, maxInner, false);
+			refineAlpha(sixFit, values, false, nIterations);
+			if (sixFit.error < fit.error) fit = sixFit;
+		}
+	}
+
+	dest[0] = (ubyte) fit.a0;
+	dest[1] = (ubyte) fit.a1;
+
+	uint64 bits = 0;
+	for (int i = 0; i < 16; i++){
+		bits |= uint64(fit.indices[i]) << (3 * i);
+	}
+	for (int i = 0; i < 6; i++){
+		dest[2 + i] = (ubyte) (bits >> (8 * i));
+	}
+}
+
+void compressExplicitAlphaBlock(ubyte *dest, const ubyte *rgba){
+	for (int y = 0; y < 4; y++){
+		uint bits = 0;
+		for (int x = 0; x < 4; x++){
+			uint a = rgba[4 * (4 * y + x) + 3];
+			bits |= ((a * 15 + 127) / 255) << (4 * x);
+		}
+		dest[2 * y]     = (ubyte) (bits & 0xFF);
+		dest[2 * y + 1] = (ubyte) (bits >> 8);
+	}
+}
+
+// Reads a block as RGBA8, repeating the last row and column past the edges. With gray set, one and two channel
+// sources are treated as intensity and intensity-alpha, otherwise the channels are kept in place.
+static void fetchBlock(ubyte *rgba, const ubyte *src, const int x, const int y, const int width, const int height, const int nChannels, const bool gray){
+	for (int j = 0; j < 4; j++){
+		int sy = (y + j < height)? y + j : height - 1;
+		for (int i = 0; i < 4; i++){
+			int sx = (x + i < width)? x + i : width - 1;
+			const ubyte *s = src + (sy * width + sx) * nChannels;
+			ubyte *d = rgba + 4 * (4 * j + i);
+
+			switch (nChannels){
+			case 1:
+				d[0] = d[1] = d[2] = s[0];
+				d[3] = 255;
+				break;
+			case 2:
+				d[0] = s[0];
+				d[1] = gray? s[0] : s[1];
+				d[2] = s[0];
+				d[3] = gray? s[1] : 255;
+				break;
+			case 3:
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d[3] = 255;
+				break;
+			default:
+				d[0] = s[0];
+				d[1] = s[1];
+				d[2] = s[2];
+				d[3] = s[3];
+			}
+		}
+	}
+}
+
+static void getChannel(ubyte *values, const ubyte *rgba, const int channel){
+	for (int i = 0; i < 16; i++){
+		values[i] = rgba[4 * i + channel];
+	}
+}
+
+struct CompressJob {
+	ubyte *dest;
+	const ubyte *src;
+	int width, height;
+	int nChannels;
+	FORMAT format;
+	int quality;
+};
+
+static void compressRows(void *data, const uint start, const uint end){
+	CompressJob *job = (CompressJob *) data;
+
+	int blockSize = getBytesPerBlock(job->format);
+	int nBlocksX = (job->width + 3) >> 2;
+	bool gray = (job->format <= FORMAT_DXT5);
+	bool hasAlpha = (job->nChannels == 2 || job->nChannels == 4);
+
+	alignment(16) ubyte rgba[64];
+	alignment(16) ubyte values[16];
+	for (uint by = start; by < end; by++){
+		ubyte *dest = job->dest + by * nBlocksX * blockSize;
+		for (int bx = 0; bx < nBlocksX; bx++){
+			fetchBlock(rgba, job->src, 4 * bx, 4 * by, job->width, job->height, job->nChannels, gray);
+
+			switch (job->format){
+			case FORMAT_DXT1:
+				compressColorBlock(dest, rgba, job->quality, true, hasAlpha);
+				break;
+			case FORMAT_DXT3:
+				compressExplicitAlphaBlock(dest, rgba);
+				compressColorBlock(dest + 8, rgba, job->quality, false, false);
+				break;
+			case FORMAT_DXT5:
+				getChannel(values, rgba, 3);
+				compressAlphaBlock(dest, values, job->quality);
+				compressColorBlock(dest + 8, rgba, job->quality, false, false);
+				break;
+			case FORMAT_ATI1N:
+				getChannel(values, rgba, 0);
+				compressAlphaBlock(dest, values, job->quality);
+				break;
+			case FORMAT_ATI2N:
+				// Same layout as decodeCompressedImage() expects, second channel first
+				getChannel(values, rgba, 1);
+				compressAlphaBlock(dest, values, job->quality);
+				getChannel(values, rgba, 0);
+				compressAlphaBlock(dest + 8, values, job->quality);
+				break;
+			default:
+				break;
+			}
+			dest += blockSize;
+		}
+	}
+}
+
+void compressSurface(ubyte *dest, const ubyte *src, const int width, const int height, const int nChannels, const FORMAT format, const int quality){
+	CompressJob job;
+	job.dest = dest;
+	job.src = src;
+	job.width = width;
+	job.height = height;
+	job.nChannels = nChannels;
+	job.format = format;
+	job.quality = quality;
+
+	// A row of blocks is cheap, so several rows go into each job
+	parallelFor(compressRows, &job, (height + 3) >> 2, 4);
+}
@@ -0,0 +1,50 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _BLOCKCOMPRESS_H_
+#define _BLOCKCOMPRESS_H_
+
+#include "Image.h"
+
+/*
+	Encoders for the DXT1/3/5 and ATI1N/2N (BC1-5) block formats. Blocks are 4x4 pixels given as 16 RGBA8
+	pixels or 16 single channel values in row order. Endpoints are fit for hardware decoding, which expands
+	565 colors with bit replication.
+
+	COMPRESS_FAST fits the bounding box of the block, COMPRESS_NORMAL fits the principal axis and refines the
+	endpoints once by least squares, COMPRESS_HIGH refines until the error stops improving and also tries the
+	alternative block modes.
+*/
+
+// Encodes the color part of a block. With threeColor set the block may use the three color mode, which DXT1
+// supports but DXT3/5 don't. With punchThrough set, pixels with alpha below 128 are stored as transparent.
+void compressColorBlock(ubyte *dest, const ubyte *rgba, const int quality, const bool threeColor, const bool punchThrough);
+
+// Encodes 16 values as a DXT5 alpha / ATI1N block
+void compressAlphaBlock(ubyte *dest, const ubyte *values, const int quality);
+
+// Encodes the alpha of 16 RGBA8 pixels as a DXT3 alpha block
+void compressExplicitAlphaBlock(ubyte *dest, const ubyte *rgba);
+
+// Compresses one width x height surface with nChannels 8-bit channels per pixel. Blocks are spread across the job system.
+void compressSurface(ubyte *dest, const ubyte *src, const int width, const int height, const int nChannels, const FORMAT format, const int quality);
+
+#endif // _BLOCKCOMPRESS_H_
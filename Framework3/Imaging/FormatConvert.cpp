@@ -0,0 +1,334 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "FormatConvert.h"
+#include "../Math/Vector.h"
+#include "../Util/JobSystem.h"
+
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+enum ValueType {
+	VALUE_UBYTE,
+	VALUE_USHORT,
+	VALUE_HALF,
+	VALUE_FLOAT,
+};
+
+static const int valueSizes[] = { 1, 2, 2, 4 };
+
+// Pixels per batch, which with four floats per pixel keeps the batches in the L1 cache
+#define BATCH_SIZE 512
+
+static int getValueType(const FORMAT format){
+	if (format >= FORMAT_R8    && format <= FORMAT_RGBA8)   return VALUE_UBYTE;
+	if (format >= FORMAT_R16   && format <= FORMAT_RGBA16)  return VALUE_USHORT;
+	if (format >= FORMAT_R16F  && format <= FORMAT_RGBA16F) return VALUE_HALF;
+	if (format >= FORMAT_R32F  && format <= FORMAT_RGBA32F) return VALUE_FLOAT;
+	return -1;
+}
+
+#ifdef USE_SSE2
+// Clamps to [0, 1] and scales, the conversion truncates like the cast in the scalar code
+static inline __m128i quantize(const __m128 v, const __m128 scale){
+	__m128 s = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(s, scale), _mm_set1_ps(0.5f)));
+}
+
+// Packs eight values in [0, 65535] to shorts, which SSE2 only does with signed saturation
+static inline __m128i packUShorts(const __m128i a, const __m128i b){
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias)), _mm_set1_epi16((short) 0x8000));
+}
+#endif
+
+/* ---------------------------------------------- */
+
+template <int TYPE>
+static void decodeValues(float *dest, const void *src, const uint n);
+
+template <>
+void decodeValues <VALUE_UBYTE> (float *dest, const void *src, const uint n){
+	const ubyte *s = (const ubyte *) src;
+	uint i = 0;
+#ifdef USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (; i + 16 <= n; i += 16){
+		__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_ps(dest + i,      _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dest + i + 4,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dest + i + 8,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dest + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+#endif
+	for (; i < n; i++) dest[i] = s[i] * (1.0f / 255.0f);
+}
+
+template <>
+void decodeValues <VALUE_USHORT> (float *dest, const void *src, const uint n){
+	const ushort *s = (const ushort *) src;
+	uint i = 0;
+#ifdef USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+	for (; i + 8 <= n; i += 8){
+		__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+		_mm_storeu_ps(dest + i,     _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+		_mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+	}
+#endif
+	for (; i < n; i++) dest[i] = s[i] * (1.0f / 65535.0f);
+}
+
+template <>
+void decodeValues <VALUE_HALF> (float *dest, const void *src, const uint n){
+	const half *s = (const half *) src;
+	uint i = 0;
+#ifdef USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i expMask = _mm_set1_epi32(0x7C00);
+	for (; i + 4 <= n; i += 4){
+		__m128i h = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) (s + i)), zero);
+		__m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+		__m128i abs = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+		__m128i exp = _mm_and_si128(abs, expMask);
+
+		// Rebias the exponent of normal values, infinity and NaN get the top exponent and denormals are exact in float
+		__m128i normal = _mm_add_epi32(_mm_slli_epi32(abs, 13), _mm_set1_epi32(112 << 23));
+		__m128i special = _mm_or_si128(_mm_slli_epi32(abs, 13), _mm_set1_epi32(0x7F800000));
+		__m128i denormal = _mm_castps_si128(_mm_mul_ps(_mm_cvtepi32_ps(abs), _mm_set1_ps(1.0f / 16777216.0f)));
+
+		__m128i isSpecial = _mm_cmpeq_epi32(exp, expMask);
+		__m128i isDenormal = _mm_cmpeq_epi32(exp, zero);
+		__m128i f = _mm_or_si128(_mm_and_si128(isSpecial, special), _mm_andnot_si128(isSpecial, normal));
+		f = _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, f));
+
+		_mm_storeu_ps(dest + i, _mm_castsi128_ps(_mm_or_si128(f, sign)));
+	}
+#endif
+	for (; i < n; i++) dest[i] = s[i];
+}
+
+template <>
+void decodeValues <VALUE_FLOAT> (float *dest, const void *src, const uint n){
+	memcpy(dest, src, n * sizeof(float));
+}
+
+/* ---------------------------------------------- */
+
+template <int TYPE>
+static void encodeValues(void *dest, const float *src, const uint n);
+
+template <>
+void encodeValues <VALUE_UBYTE> (void *dest, const float *src, const uint n){
+	ubyte *d = (ubyte *) dest;
+	uint i = 0;
+#ifdef USE_SSE2
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= n; i += 16){
+		__m128i a = quantize(_mm_loadu_ps(src + i),      scale);
+		__m128i b = quantize(_mm_loadu_ps(src + i + 4),  scale);
+		__m128i c = quantize(_mm_loadu_ps(src + i + 8),  scale);
+		__m128i e = quantize(_mm_loadu_ps(src + i + 12), scale);
+		_mm_storeu_si128((__m128i *) (d + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, e)));
+	}
+#endif
+	for (; i < n; i++) d[i] = (ubyte) (255 * saturate(src[i]) + 0.5f);
+}
+
+template <>
+void encodeValues <VALUE_USHORT> (void *dest, const float *src, const uint n){
+	ushort *d = (ushort *) dest;
+	uint i = 0;
+#ifdef USE_SSE2
+	const __m128 scale = _mm_set1_ps(65535.0f);
+	for (; i + 8 <= n; i += 8){
+		__m128i a = quantize(_mm_loadu_ps(src + i),     scale);
+		__m128i b = quantize(_mm_loadu_ps(src + i + 4), scale);
+		_mm_storeu_si128((__m128i *) (d + i), packUShorts(a, b));
+	}
+#endif
+	for (; i < n; i++) d[i] = (ushort) (65535 * saturate(src[i]) + 0.5f);
+}
+
+template <>
+void encodeValues <VALUE_HALF> (void *dest, const float *src, const uint n){
+	half *d = (half *) dest;
+	uint i = 0;
+#ifdef USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i maxHalf = _mm_set1_epi32(0x7C00);
+	for (; i + 4 <= n; i += 4){
+		__m128i x = _mm_castps_si128(_mm_loadu_ps(src + i));
+		__m128i abs = _mm_and_si128(x, _mm_set1_epi32(0x7FFFFFFF));
+		__m128i exp = _mm_srli_epi32(abs, 23);
+
+		// Values that are normal as halves or overflow, and zeros. Denormals and NaNs take the scalar path.
+		__m128i isNormal = _mm_and_si128(_mm_cmpgt_epi32(exp, _mm_set1_epi32(112)), _mm_cmplt_epi32(exp, _mm_set1_epi32(255)));
+		__m128i isZero = _mm_cmpeq_epi32(abs, zero);
+		if (_mm_movemask_epi8(_mm_or_si128(isNormal, isZero)) != 0xFFFF){
+			for (int k = 0; k < 4; k++) d[i + k] = src[i + k];
+			continue;
+		}
+
+		// Rounds the mantissa with any carry going into the exponent, overflow saturates to infinity
+		__m128i h = _mm_srli_epi32(_mm_add_epi32(_mm_sub_epi32(abs, _mm_set1_epi32(112 << 23)), _mm_set1_epi32(0x1000)), 13);
+		__m128i overflow = _mm_cmpgt_epi32(h, maxHalf);
+		h = _mm_or_si128(_mm_and_si128(overflow, maxHalf), _mm_andnot_si128(overflow, h));
+		h = _mm_andnot_si128(isZero, h);
+		h = _mm_or_si128(h, _mm_srli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x80000000)), 16));
+
+		_mm_storel_epi64((__m128i *) (d + i), packUShorts(h, zero));
+	}
+#endif
+	for (; i < n; i++) d[i] = src[i];
+}
+
+template <>
+void encodeValues <VALUE_FLOAT> (void *dest, const float *src, const uint n){
+	memcpy(dest, src, n * sizeof(float));
+}
+
+/* ---------------------------------------------- */
+
+// Fills in missing channels the way Image::convert() always has, single channels are intensity and missing alpha is one.
+// A single channel destination gets the luminance.
+template <int SRC_CHANNELS, int DST_CHANNELS>
+static void remapChannels(float *dest, const float *src, const uint n){
+	for (uint i = 0; i < n; i++){
+		float rgba[4];
+		rgba[0] = src[0];
+		rgba[1] = (SRC_CHANNELS > 1)? src[1] : src[0];
+		rgba[2] = (SRC_CHANNELS > 2)? src[2] : (SRC_CHANNELS == 1)? src[0] : 0.0f;
+		rgba[3] = (SRC_CHANNELS > 3)? src[3] : 1.0f;
+
+		if (DST_CHANNELS == 1){
+			dest[0] = 0.30f * rgba[0] + 0.59f * rgba[1] + 0.11f * rgba[2];
+		} else {
+			for (int c = 0; c < DST_CHANNELS; c++) dest[c] = rgba[c];
+		}
+
+		src  += SRC_CHANNELS;
+		dest += DST_CHANNELS;
+	}
+}
+
+// Same remapping without going through floats, for types that convert to themselves exactly
+template <typename DATA_TYPE, int SRC_CHANNELS, int DST_CHANNELS>
+static void remapValues(DATA_TYPE *dest, const DATA_TYPE *src, const uint n, const DATA_TYPE one){
+	for (uint i = 0; i < n; i++){
+		dest[0] = src[0];
+		if (DST_CHANNELS > 1) dest[1] = (SRC_CHANNELS > 1)? src[1] : src[0];
+		if (DST_CHANNELS > 2) dest[2] = (SRC_CHANNELS > 2)? src[2] : (SRC_CHANNELS == 1)? src[0] : DATA_TYPE(0);
+		if (DST_CHANNELS > 3) dest[3] = (SRC_CHANNELS > 3)? src[3] : one;
+
+		src  += SRC_CHANNELS;
+		dest += DST_CHANNELS;
+	}
+}
+
+typedef void (*ConvertKernel)(void *dest, const void *src, const uint nPixels);
+
+template <int SRC_TYPE, int SRC_CHANNELS, int DST_TYPE, int DST_CHANNELS>
+static void convertKernel(void *dest, const void *src, const uint nPixels){
+	if (SRC_TYPE == DST_TYPE && DST_CHANNELS > 1){
+		if (SRC_TYPE == VALUE_UBYTE){
+			remapValues <ubyte,  SRC_CHANNELS, DST_CHANNELS> ((ubyte *) dest, (const ubyte *) src, nPixels, 255);
+		} else if (SRC_TYPE == VALUE_FLOAT){
+			remapValues <float,  SRC_CHANNELS, DST_CHANNELS> ((float *) dest, (const float *) src, nPixels, 1.0f);
+		} else {
+			// The half for one is 0x3C00
+			remapValues <ushort, SRC_CHANNELS, DST_CHANNELS> ((ushort *) dest, (const ushort *) src, nPixels, (SRC_TYPE == VALUE_HALF)? 0x3C00 : 0xFFFF);
+		}
+		return;
+	}
+
+	float values[BATCH_SIZE * 4];
+	float remapped[BATCH_SIZE * 4];
+
+	const ubyte *s = (const ubyte *) src;
+	ubyte *d = (ubyte *) dest;
+
+	for (uint i = 0; i < nPixels; i += BATCH_SIZE){
+		uint n = (nPixels - i < BATCH_SIZE)? nPixels - i : BATCH_SIZE;
+
+		decodeValues <SRC_TYPE> (values, s, n * SRC_CHANNELS);
+
+		const float *result = values;
+		if (SRC_CHANNELS != DST_CHANNELS || DST_CHANNELS == 1){
+			remapChannels <SRC_CHANNELS, DST_CHANNELS> (remapped, values, n);
+			result = remapped;
+		}
+
+		encodeValues <DST_TYPE> (d, result, n * DST_CHANNELS);
+
+		s += n * SRC_CHANNELS * valueSizes[SRC_TYPE];
+		d += n * DST_CHANNELS * valueSizes[DST_TYPE];
+	}
+}
+
+// The kernels indexed by source type and channels, then destination type and channels
+#define KERNELS_DST(s, sc, d) { convertKernel <s, sc, d, 1>, convertKernel <s, sc, d, 2>, convertKernel <s, sc, d, 3>, convertKernel <s, sc, d, 4> }
+#define KERNELS_SRC_CHANNELS(s, sc) { KERNELS_DST(s, sc, VALUE_UBYTE), KERNELS_DST(s, sc, VALUE_USHORT), KERNELS_DST(s, sc, VALUE_HALF), KERNELS_DST(s, sc, VALUE_FLOAT) }
+#define KERNELS_SRC(s) { KERNELS_SRC_CHANNELS(s, 1), KERNELS_SRC_CHANNELS(s, 2), KERNELS_SRC_CHANNELS(s, 3), KERNELS_SRC_CHANNELS(s, 4) }
+
+static const ConvertKernel kernels[4][4][4][4] = {
+	KERNELS_SRC(VALUE_UBYTE),
+	KERNELS_SRC(VALUE_USHORT),
+	KERNELS_SRC(VALUE_HALF),
+	KERNELS_SRC(VALUE_FLOAT),
+};
+
+bool canConvertPixels(const FORMAT srcFormat, const FORMAT destFormat){
+	return (getValueType(srcFormat) >= 0 && getValueType(destFormat) >= 0);
+}
+
+struct ConvertJob {
+	ConvertKernel kernel;
+	ubyte *dest;
+	const ubyte *src;
+	int destPixelSize;
+	int srcPixelSize;
+};
+
+static void convertRange(void *data, const uint start, const uint end){
+	const ConvertJob *job = (const ConvertJob *) data;
+	job->kernel(job->dest + start * job->destPixelSize, job->src + start * job->srcPixelSize, end - start);
+}
+
+void convertPixels(void *dest, const FORMAT destFormat, const void *src, const FORMAT srcFormat, const uint nPixels){
+	ConvertJob job;
+	job.kernel = kernels[getValueType(srcFormat)][getChannelCount(srcFormat) - 1][getValueType(destFormat)][getChannelCount(destFormat) - 1];
+	job.dest = (ubyte *) dest;
+	job.src = (const ubyte *) src;
+	job.destPixelSize = getBytesPerPixel(destFormat);
+	job.srcPixelSize = getBytesPerPixel(srcFormat);
+
+	// Small images aren't worth splitting
+	parallelFor(convertRange, &job, nPixels, 64 * 1024);
+}
@@ -0,0 +1,40 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _FORMATCONVERT_H_
+#define _FORMATCONVERT_H_
+
+#include "Image.h"
+
+/*
+	Conversion kernels between the 8 and 16-bit unsigned, half and float formats with one to four channels. A kernel
+	is generated for each pair of formats from a decoder for the source type, a channel remap and an encoder for the
+	destination type, and works through the pixels in batches of floats. Pairs of the same type remap the values
+	directly. The results are the same as the per pixel conversion in Image::convert().
+*/
+
+// Returns whether convertPixels() has a kernel for the pair of formats
+bool canConvertPixels(const FORMAT srcFormat, const FORMAT destFormat);
+
+// Converts nPixels pixels. Large conversions are spread across the job system.
+void convertPixels(void *dest, const FORMAT destFormat, const void *src, const FORMAT srcFormat, const uint nPixels);
+
+#endif // _FORMATCONVERT_H_
@@ -20,12 +20,25 @@
 \* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "Image.h"
+#include "BlockCompress.h"
+#include "FormatConvert.h"
+#include "MipFilter.h"
+#include "Morphology.h"
+#include "NormalMap.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "../Math/Vector.h"
+#include "../Util/Array.h"
+#include "../Util/JobSystem.h"
+#include "../Util/MappedFile.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
 
 #ifndef NO_JPEG
 extern "C" {
@@ -277,6 +290,8 @@ Image::Image(){
 
 	nExtraData = 0;
 	extraData = NULL;
+
+	mappedFile = NULL;
 }
 
 Image::Image(const Image &img){
@@ -294,10 +309,12 @@ Image::Image(const Image &img){
 	nExtraData = img.nExtraData;
 	extraData = new unsigned char[nExtraData];
 	memcpy(extraData, img.extraData, nExtraData);
+
+	mappedFile = NULL;
 }
 
 Image::~Image(){
-	delete [] pixels;
+	replacePixels(NULL);
 	delete [] extraData;
 }
 
@@ -309,12 +326,44 @@ unsigned char *Image::create(const FORMAT fmt, const int w, const int h, const i
 	nMipMaps = mipMapCount;
 	arraySize = arraysize;
 
-	return (pixels = new unsigned char[getMipMappedSize(0, nMipMaps) * arraySize]);
+	replacePixels(new unsigned char[getMipMappedSize(0, nMipMaps) * arraySize]);
+
+	return pixels;
+}
+
+void Image::replacePixels(unsigned char *newPixels){
+	if (mappedFile){
+		delete mappedFile;
+		mappedFile = NULL;
+	} else {
+		delete [] pixels;
+	}
+	pixels = newPixels;
+}
+
+bool Image::mapPixels(const char *fileName, const uint64 offset, const FORMAT fmt, const int w, const int h, const int d, const int mipMapCount, const int arraysize){
+	format = fmt;
+	width  = w;
+	height = h;
+	depth  = d;
+	nMipMaps = mipMapCount;
+	arraySize = arraysize;
+
+	replacePixels(NULL);
+
+	MappedFile *map = new MappedFile();
+	if (map->open(fileName, true) && map->getSize() >= offset + uint64(getMipMappedSize(0, nMipMaps)) * arraySize){
+		pixels = map->getData() + offset;
+		mappedFile = map;
+		return true;
+	}
+	delete map;
+
+	return false;
 }
 
 void Image::free(){
-	delete [] pixels;
-	pixels = NULL;
+	replacePixels(NULL);
 
 	delete [] extraData;
 	extraData = NULL;
@@ -566,23 +615,9 @@ bool Image::loadHTEX(const char *fileName){
 	return true;
 }
 
-bool Image::loadDDS(const char *fileName, uint flags){
-	DDSHeader header;
-
-	FILE *file;
-	if ((file = fopen(fileName, "rb")) == NULL) return false;
-
-	fread(&header, sizeof(header), 1, file);
-	if (header.dwMagic != MCHAR4('D','D','S',' ')){
-		fclose(file);
-		return false;
-	}
-
-	width  = header.dwWidth;
-	height = header.dwHeight;
-	depth  = (header.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP)? 0 : (header.dwDepth == 0)? 1 : header.dwDepth;
-	nMipMaps = ((flags & DONT_LOAD_MIPMAPS) || (header.dwMipMapCount == 0))? 1 : header.dwMipMapCount;
-	arraySize = 1;
+// Reads the header and works out the format and whether the pixels are stored BGR, leaving the file at the start of the pixels
+static bool readDDSHeader(FILE *file, DDSHeader &header, FORMAT &format, bool &swapRB){
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.dwMagic != MCHAR4('D','D','S',' ')) return false;
 
 	if (header.ddpfPixelFormat.dwFourCC == MCHAR4('D','X','1','0')){
 		DDSHeaderDX10 dx10Header;
@@ -616,7 +651,6 @@ bool Image::loadDDS(const char *fileName, uint flags){
 			case 80: format = FORMAT_ATI1N; break;
 			case 83: format = FORMAT_ATI2N; break;
 			default:
-				fclose(file);
 				return false;
 		}
 
@@ -649,14 +683,44 @@ bool Image::loadDDS(const char *fileName, uint flags){
 						format = (header.ddpfPixelFormat.dwRBitMask == 0x3FF00000)? FORMAT_RGB10A2 : FORMAT_RGBA8;
 						break;
 					default:
-						fclose(file);
 						return false;
 				}
 		}
 	}
+	swapRB = ((format == FORMAT_RGB8 || format == FORMAT_RGBA8) && header.ddpfPixelFormat.dwBBitMask == 0xFF);
+
+	return true;
+}
+
+bool Image::loadDDS(const char *fileName, uint flags){
+	FILE *file;
+	if ((file = fopen(fileName, "rb")) == NULL) return false;
+
+	DDSHeader header;
+	bool swapRB;
+	if (!readDDSHeader(file, header, format, swapRB)){
+		fclose(file);
+		return false;
+	}
+
+	width  = header.dwWidth;
+	height = header.dwHeight;
+	depth  = (header.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP)? 0 : (header.dwDepth == 0)? 1 : header.dwDepth;
+	nMipMaps = ((flags & DONT_LOAD_MIPMAPS) || (header.dwMipMapCount == 0))? 1 : header.dwMipMapCount;
+	arraySize = 1;
 
 	int size = getMipMappedSize(0, nMipMaps);
-	pixels = new unsigned char[size];
+
+	// Only data that is already in our layout, needs no swizzling and is 16 byte aligned in the file can be mapped
+	long offset = ftell(file);
+	if ((flags & MAP_PIXELS) && !swapRB && (offset & 15) == 0 && (!isCube() || header.dwMipMapCount <= 1)){
+		if (mapPixels(fileName, offset, format, width, height, depth, nMipMaps)){
+			fclose(file);
+			return true;
+		}
+	}
+
+	replacePixels(new unsigned char[size]);
 	if (isCube()){
 		for (int face = 0; face < 6; face++){
 			for (int mipMapLevel = 0; mipMapLevel < nMipMaps; mipMapLevel++){
@@ -673,7 +737,7 @@ bool Image::loadDDS(const char *fileName, uint flags){
 		fread(pixels, 1, size, file);
 	}
 
-	if ((format == FORMAT_RGB8 || format == FORMAT_RGBA8) && header.ddpfPixelFormat.dwBBitMask == 0xFF){
+	if (swapRB){
 		int nChannels = getChannelCount(format);
 		swapChannels(pixels, size / nChannels, nChannels, 0, 2);
 	}
@@ -917,8 +981,7 @@ bool Image::loadPNG(const char *fileName){
 		}
 		format = FORMAT_RGB8;
 
-		delete [] pixels;
-		pixels = newPixels;
+		replacePixels(newPixels);
 	}
 
 	if (bitDepth == 16){
@@ -1316,35 +1379,186 @@ bool Image::loadImage(const char *fileName, uint flags){
 	return true;
 }
 
+bool Image::loadImageInfo(const char *fileName, uint flags){
+	const char *extension = strrchr(fileName, '.');
+
+	clear();
+
+	if (extension == NULL) return false;
+
+	FILE *file = fopen(fileName, "rb");
+	if (file == NULL) return false;
+
+	bool result = false;
+	if (stricmp(extension, ".dds") == 0){
+		DDSHeader header;
+		bool swapRB;
+		if (readDDSHeader(file, header, format, swapRB)){
+			width  = header.dwWidth;
+			height = header.dwHeight;
+			depth  = (header.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP)? 0 : (header.dwDepth == 0)? 1 : header.dwDepth;
+			nMipMaps = ((flags & DONT_LOAD_MIPMAPS) || (header.dwMipMapCount == 0))? 1 : header.dwMipMapCount;
+			arraySize = 1;
+			result = true;
+		}
+	}
+#ifndef NO_TGA
+	else if (stricmp(extension, ".tga") == 0){
+		TGAHeader header;
+		if (fread(&header, sizeof(header), 1, file) == 1){
+			width  = header.width;
+			height = header.height;
+			depth  = 1;
+			nMipMaps = 1;
+			arraySize = 1;
+
+			// What loadTGA() expands the pixels to
+			switch (header.bpp){
+				case 8:  format = (header.descriptionlen + header.cmapentries * header.cmapbits / 8 > 0)? FORMAT_RGB8 : FORMAT_I8; break;
+				case 16: format = FORMAT_RGBA8; break;
+				case 24: format = FORMAT_RGB8;  break;
+				case 32: format = FORMAT_RGBA8; break;
+			}
+			result = (format != FORMAT_NONE);
+		}
+	}
+#endif // NO_TGA
+
+	fclose(file);
+
+	return result;
+}
+
+static bool isMatchingSlice(const Image &image, const Image &first){
+	return (image.getFormat() == first.getFormat() && image.getWidth() == first.getWidth() && image.getHeight() == first.getHeight() &&
+			image.getDepth() == 1 && image.getMipMapCount() == first.getMipMapCount());
+}
+
+struct SliceJob {
+	Image *dest;
+	const Image *first;
+	const char **fileNames;
+	uint flags;
+	int maxImage;
+	std::atomic <bool> failed;
+};
+
+void Image::loadSlices(void *data, const uint start, const uint end){
+	SliceJob *job = (SliceJob *) data;
+
+	for (uint i = start; i < end && !job->failed; i++){
+		if (!job->dest->loadSlice(job->fileNames[i], job->flags, *job->first, i / job->maxImage, i % job->maxImage)) job->failed = true;
+	}
+}
+
+bool Image::loadSlice(const char *fileName, const uint flags, const Image &first, const int arraySlice, const int image){
+	int maxImage = depth? depth : 6;
+	ubyte *dest = pixels + arraySlice * maxImage * first.getMipMappedSize(0, nMipMaps);
+
+	// The pixels of an array slice are ordered by level first, then image, as in assembleSlices()
+	const char *extension = strrchr(fileName, '.');
+	if (extension != NULL && stricmp(extension, ".dds") == 0){
+		FILE *file = fopen(fileName, "rb");
+		if (file == NULL) return false;
+
+		DDSHeader header;
+		FORMAT fileFormat;
+		bool swapRB;
+		bool result = readDDSHeader(file, header, fileFormat, swapRB);
+
+		int nChannels = getChannelCount(format);
+		for (int level = 0; level < nMipMaps && result; level++){
+			int size = first.getMipMappedSize(level, 1);
+			ubyte *levelDest = dest + image * size;
+
+			result = (fread(levelDest, 1, size, file) == size_t(size));
+			if (swapRB) swapChannels(levelDest, size / nChannels, nChannels, 0, 2);
+
+			dest += maxImage * size;
+		}
+		fclose(file);
+
+		return result;
+	}
+
+	// Other files are decoded on their own first. The first slice may have been decoded already to find the layout.
+	Image slice;
+	const Image *src = &first;
+	if (arraySlice > 0 || image > 0 || first.pixels == NULL){
+		if (!slice.loadImage(fileName, flags) || !isMatchingSlice(slice, first)) return false;
+		src = &slice;
+	}
+
+	for (int level = 0; level < nMipMaps; level++){
+		int size = first.getMipMappedSize(level, 1);
+		memcpy(dest + image * size, src->getPixels(level), size);
+		dest += maxImage * size;
+	}
+
+	return true;
+}
+
 bool Image::loadSlicedImage(const char **fileNames, const int nImages, const int nArraySlices, uint flags){
 	int maxImage = nImages? nImages : 6;
+	int nSlices = maxImage * nArraySlices;
+
+	// Slices with a header that tells their layout are checked before anything is decoded, the rest once they are.
+	// If the first slice doesn't have such a header it is decoded to find the layout of the array.
+	Image first;
+	if (!first.loadImageInfo(fileNames[0], flags)){
+		if (!first.loadImage(fileNames[0], flags)) return false;
+	}
+	if (first.depth != 1) return false;
 
-	Image *images = new Image[maxImage * nArraySlices];
+	for (int i = 1; i < nSlices; i++){
+		Image info;
+		if (info.loadImageInfo(fileNames[i], flags) && !isMatchingSlice(info, first)) return false;
+	}
 
-	for (int i = 0; i < maxImage * nArraySlices; i++){
-		if (!images[i].loadImage(fileNames[i], flags)){
-			delete [] images;
-			return false;
-		}
+	// Each slice is read or decoded straight into its place in the array
+	create(first.format, first.width, first.height, nImages, first.nMipMaps, nArraySlices);
+
+	SliceJob job;
+	job.dest = this;
+	job.first = &first;
+	job.fileNames = fileNames;
+	job.flags = flags;
+	job.maxImage = maxImage;
+	job.failed = false;
+
+	parallelFor(loadSlices, &job, nSlices, 1);
+
+	if (job.failed){
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool Image::assembleSlices(const Image **images, const int nImages, const int nArraySlices){
+	int maxImage = nImages? nImages : 6;
+
+	const Image *first = images[0];
+	for (int i = 1; i < maxImage * nArraySlices; i++){
+		if (images[i]->format != first->format || images[i]->width != first->width || images[i]->height != first->height || images[i]->nMipMaps != first->nMipMaps) return false;
 	}
 
-	uint nMipMaps = images[0].nMipMaps;
-	ubyte *dest = create(images[0].format, images[0].width, images[0].height, nImages, nMipMaps, nArraySlices);
+	uint nMipMaps = first->nMipMaps;
+	ubyte *dest = create(first->format, first->width, first->height, nImages, nMipMaps, nArraySlices);
 
 	for (int arraySlice = 0; arraySlice < nArraySlices; arraySlice++){
 		int base = arraySlice * maxImage;
 
 		for (uint level = 0; level < nMipMaps; level++){
-			int size = images[0].getMipMappedSize(level, 1);
+			int size = first->getMipMappedSize(level, 1);
 			for (int i = 0; i < maxImage; i++){
-				memcpy(dest, images[base + i].getPixels(level), size);
+				memcpy(dest, images[base + i]->getPixels(level), size);
 				dest += size;
 			}
 		}
 	}
 
-	delete [] images;
-
 	return true;
 }
 
@@ -1468,11 +1682,9 @@ bool Image::saveHTEX(const char *fileName){
 	return true;
 }
 
-bool Image::saveDDS(const char *fileName){
-	// Set up the header
-	DDSHeader header;
+// Sets up the header saveDDS() writes, returning false for formats DDS files can't hold
+static bool setupDDSHeader(DDSHeader &header, DDSHeaderDX10 &headerDX10, const FORMAT format, const int width, const int height, const int depth, const int nMipMaps){
 	memset(&header, 0, sizeof(header));
-	DDSHeaderDX10 headerDX10;
 	memset(&headerDX10, 0, sizeof(headerDX10));
 
 	header.dwMagic = MCHAR4('D', 'D', 'S', ' ');
@@ -1526,7 +1738,7 @@ bool Image::saveDDS(const char *fileName){
 				header.ddpfPixelFormat.dwFourCC = MCHAR4('D','X','1','0');
 				headerDX10.arraySize = 1;
 				headerDX10.miscFlag = (depth == 0)? D3D10_RESOURCE_MISC_TEXTURECUBE : 0;
-				headerDX10.resourceDimension = is1D()? D3D10_RESOURCE_DIMENSION_TEXTURE1D : is3D()? D3D10_RESOURCE_DIMENSION_TEXTURE3D : D3D10_RESOURCE_DIMENSION_TEXTURE2D;
+				headerDX10.resourceDimension = (depth == 1 && height == 1)? D3D10_RESOURCE_DIMENSION_TEXTURE1D : (depth > 1)? D3D10_RESOURCE_DIMENSION_TEXTURE3D : D3D10_RESOURCE_DIMENSION_TEXTURE2D;
 				switch (format){
 					//case FORMAT_RGBA8:    headerDX10.dxgiFormat = 28; break;
 					case FORMAT_RGB32F:   headerDX10.dxgiFormat = 6; break;
@@ -1544,6 +1756,14 @@ bool Image::saveDDS(const char *fileName){
 	header.ddsCaps.Reserved[1] = 0;
 	header.dwReserved2 = 0;
 
+	return true;
+}
+
+bool Image::saveDDS(const char *fileName){
+	DDSHeader header;
+	DDSHeaderDX10 headerDX10;
+	if (!setupDDSHeader(header, headerDX10, format, width, height, depth, nMipMaps)) return false;
+
 	FILE *file;
 	if ((file = fopen(fileName, "wb")) == NULL) return false;
 
@@ -1551,6 +1771,7 @@ bool Image::saveDDS(const char *fileName){
 	if (headerDX10.dxgiFormat) fwrite(&headerDX10, sizeof(headerDX10), 1, file);
 
 
+	int nChannels = getChannelCount(format);
 	int size = getMipMappedSize(0, nMipMaps);
 
 	// RGB to BGR
@@ -1734,14 +1955,8 @@ bool Image::savePNG(const char *fileName){
 
 
 #ifndef NO_TGA
-bool Image::saveTGA(const char *fileName){
-	if (format != FORMAT_I8 && format != FORMAT_RGB8 && format != FORMAT_RGBA8) return false;
-
-	FILE *file;
-	if ((file = fopen(fileName, "wb")) == NULL) return false;
-
-	int nChannels = getChannelCount(format);
-
+// Writes the header saveTGA() uses for the format, and the gray ramp palette of I8 images
+static void writeTGAHeader(FILE *file, const FORMAT format, const int width, const int height){
 	TGAHeader header = {
 		0x00,
 		(format == FORMAT_I8)? 1 : 0,
@@ -1753,14 +1968,12 @@ bool Image::saveTGA(const char *fileName){
 		0x0000,
 		width,
 		height,
-		nChannels * 8,
+		getChannelCount(format) * 8,
 		0x00
 	};
 
 	fwrite(&header, sizeof(header), 1, file);
 
-	ubyte *dest, *src, *buffer;
-
 	if (format == FORMAT_I8){
 		ubyte pal[768];
 		int p = 0;
@@ -1770,7 +1983,22 @@ bool Image::saveTGA(const char *fileName){
 			pal[p++] = i;
 		}
 		fwrite(pal, sizeof(pal), 1, file);
+	}
+}
 
+bool Image::saveTGA(const char *fileName){
+	if (format != FORMAT_I8 && format != FORMAT_RGB8 && format != FORMAT_RGBA8) return false;
+
+	FILE *file;
+	if ((file = fopen(fileName, "wb")) == NULL) return false;
+
+	int nChannels = getChannelCount(format);
+
+	writeTGAHeader(file, format, width, height);
+
+	ubyte *dest, *src, *buffer;
+
+	if (format == FORMAT_I8){
 		src = pixels + width * height;
 		for (int y = 0; y < height; y++){
 			src -= width;
@@ -2049,38 +2277,63 @@ void buildMipMap(DATA_TYPE *dst, const DATA_TYPE *src, const uint w, const uint
 	}
 }
 
-bool Image::createMipMaps(const int mipMaps){
+bool Image::createMipMaps(const int mipMaps, const int filter, const uint flags, MipMapStats *stats){
 	if (isCompressedFormat(format)) return false;
-	if (!isPowerOf2(width) || !isPowerOf2(height) || !isPowerOf2(depth)) return false;
+
+	// Integer formats are averaged in place and need power of two sizes
+	bool filterable = canFilterMipMaps(format);
+	if (!filterable && (!isPowerOf2(width) || !isPowerOf2(height) || !isPowerOf2(depth))) return false;
 
 	int actualMipMaps = min(mipMaps, getMipMapCountFromDimesions());
 
 	if (nMipMaps != actualMipMaps){
 		int size = getMipMappedSize(0, actualMipMaps);
-		if (arraySize > 1){
-			ubyte *newPixels = new ubyte[size * arraySize];
-
-			// Copy top mipmap of all array slices to new location
-			int firstMipSize = getMipMappedSize(0, 1);
-			int oldSize = getMipMappedSize(0, nMipMaps);
+		ubyte *newPixels = new ubyte[size * arraySize];
 
-			for (int i = 0; i < arraySize; i++){
-				memcpy(newPixels + i * size, pixels + i * oldSize, firstMipSize);
-			}
+		// Copy top mipmap of all array slices to new location
+		int firstMipSize = getMipMappedSize(0, 1);
+		int oldSize = getMipMappedSize(0, nMipMaps);
 
-			delete [] pixels;
-			pixels = newPixels;
-		} else {
-			pixels = (ubyte *) realloc(pixels, size);
+		for (int i = 0; i < arraySize; i++){
+			memcpy(newPixels + i * size, pixels + i * oldSize, firstMipSize);
 		}
+
+		replacePixels(newPixels);
 		nMipMaps = actualMipMaps;
 	}
 
 	int nChannels = getChannelCount(format);
 
-
 	int n = isCube()? 6 : 1;
 
+	if (stats) memset(stats, 0, nMipMaps * sizeof(MipMapStats));
+
+	if (filterable){
+		ubyte *levels[32];
+		MipMapStats surfaceStats[32];
+
+		for (int arraySlice = 0; arraySlice < arraySize; arraySlice++){
+			for (int i = 0; i < n; i++){
+				for (int level = 0; level < nMipMaps; level++){
+					levels[level] = getPixels(level, arraySlice) + i * (getMipMappedSize(level, 1) / n);
+				}
+
+				buildMipChain(levels, format, width, height, getDepth(0), nMipMaps, filter, flags, stats? surfaceStats : NULL);
+
+				if (stats){
+					for (int level = 1; level < nMipMaps; level++){
+						stats[level].time += surfaceStats[level].time;
+						if (surfaceStats[level].drift > stats[level].drift) stats[level].drift = surfaceStats[level].drift;
+						stats[level].clipped += surfaceStats[level].clipped / (n * arraySize);
+						stats[level].normalLength += surfaceStats[level].normalLength / (n * arraySize);
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
 	for (int arraySlice = 0; arraySlice < arraySize; arraySlice++){
 		ubyte *src = getPixels(0, arraySlice);
 		ubyte *dst = getPixels(1, arraySlice);
@@ -2095,9 +2348,7 @@ bool Image::createMipMaps(const int mipMaps){
 
 			for (int i = 0; i < n; i++){
 				if (isPlainFormat(format)){
-					if (isFloatFormat(format)){
-						buildMipMap((float *) dst, (float *) src, w, h, d, nChannels);
-					} else if (format >= FORMAT_I16){
+					if (format >= FORMAT_I16){
 						buildMipMap((ushort *) dst, (ushort *) src, w, h, d, nChannels);
 					} else {
 						buildMipMap(dst, src, w, h, d, nChannels);
@@ -2123,8 +2374,7 @@ bool Image::removeMipMaps(const int firstMipMap, int mipMapsToSave){
 
 	memcpy(newPixels, getPixels(firstMipMap), size);
 
-	delete [] pixels;
-	pixels = newPixels;
+	replacePixels(newPixels);
 	width = getWidth(firstMipMap);
 	height = getHeight(firstMipMap);
 	depth = depth? getDepth(firstMipMap) : 0;
@@ -2215,39 +2465,223 @@ void decodeDXT5AlphaBlock(unsigned char *dest, int w, int h, int xOff, int yOff,
 	}
 }
 
-void decodeCompressedImage(unsigned char *dest, unsigned char *src, const int width, const int height, const FORMAT format){
-	int sx = (width  < 4)? width  : 4;
-	int sy = (height < 4)? height : 4;
+#ifdef USE_SSE2
+// Vector versions of the decoders above for whole 4x4 blocks. They produce the same values, but work on all texels of a block at once.
+
+static inline __m128i selectBits(const __m128i mask, const __m128i a, const __m128i b){
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Returns the rows of a color block as RGB8 texels with zero alpha
+static inline void decodeColorBlockSSE2(__m128i rows[4], const FORMAT format, const unsigned char *src){
+	int colors[4][3];
+
+	uint16 c0 = *(uint16 *) src;
+	uint16 c1 = *(uint16 *) (src + 2);
+
+	colors[0][0] = ((c0 >> 11) & 0x1F) << 3;
+	colors[0][1] = ((c0 >>  5) & 0x3F) << 2;
+	colors[0][2] =  (c0        & 0x1F) << 3;
+
+	colors[1][0] = ((c1 >> 11) & 0x1F) << 3;
+	colors[1][1] = ((c1 >>  5) & 0x3F) << 2;
+	colors[1][2] =  (c1        & 0x1F) << 3;
+
+	if (c0 > c1 || format == FORMAT_DXT5){
+		for (int i = 0; i < 3; i++){
+			colors[2][i] = (2 * colors[0][i] +     colors[1][i] + 1) / 3;
+			colors[3][i] = (    colors[0][i] + 2 * colors[1][i] + 1) / 3;
+		}
+	} else {
+		for (int i = 0; i < 3; i++){
+			colors[2][i] = (colors[0][i] + colors[1][i] + 1) >> 1;
+			colors[3][i] = 0;
+		}
+	}
+
+	__m128i palette[4];
+	for (int k = 0; k < 4; k++){
+		palette[k] = _mm_set1_epi32(colors[k][0] | (colors[k][1] << 8) | (colors[k][2] << 16));
+	}
+
+	// Each lane tests the two index bits of its texel
+	const __m128i bit0 = _mm_set_epi32(0x40, 0x10, 0x04, 0x01);
+	const __m128i bit1 = _mm_set_epi32(0x80, 0x20, 0x08, 0x02);
+	for (int y = 0; y < 4; y++){
+		__m128i indexes = _mm_set1_epi32(src[4 + y]);
+		__m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(indexes, bit0), bit0);
+		__m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(indexes, bit1), bit1);
+		rows[y] = selectBits(m1, selectBits(m0, palette[3], palette[2]), selectBits(m0, palette[1], palette[0]));
+	}
+}
+
+// Returns the 16 alpha values of a block in texel order
+static inline __m128i decodeDXT3AlphaBlockSSE2(const unsigned char *src){
+	const __m128i mask = _mm_set1_epi8(0xF);
+
+	__m128i alpha = _mm_loadl_epi64((const __m128i *) src);
+	__m128i lo = _mm_and_si128(alpha, mask);
+	__m128i hi = _mm_and_si128(_mm_srli_epi16(alpha, 4), mask);
+	alpha = _mm_unpacklo_epi8(lo, hi);
+
+	// Times 17, which can't carry into the next byte for 4-bit values
+	return _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+}
+
+static inline __m128i decodeDXT5AlphaBlockSSE2(const unsigned char *src){
+	int a0 = src[0];
+	int a1 = src[1];
+
+	int palette[8];
+	palette[0] = a0;
+	palette[1] = a1;
+	for (int k = 2; k < 8; k++){
+		if (a0 > a1){
+			palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		} else if (k >= 6){
+			palette[k] = (k == 6)? 0 : 255;
+		} else {
+			palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+		}
+	}
 
+	alignment(16) unsigned char indexes[16];
+	uint64 alpha = (*(uint64 *) src) >> 16;
+	for (int i = 0; i < 16; i++){
+		indexes[i] = ((unsigned int) alpha) & 0x7;
+		alpha >>= 3;
+	}
+
+	__m128i index = _mm_load_si128((const __m128i *) indexes);
+	__m128i values = _mm_setzero_si128();
+	for (int k = 0; k < 8; k++){
+		__m128i match = _mm_cmpeq_epi8(index, _mm_set1_epi8(k));
+		values = _mm_or_si128(values, _mm_and_si128(match, _mm_set1_epi8(palette[k])));
+	}
+
+	return values;
+}
+
+static void decodeBlockSSE2(unsigned char *dest, const int yOff, const FORMAT format, const unsigned char *src){
+	if (format <= FORMAT_DXT5){
+		__m128i rows[4];
+		decodeColorBlockSSE2(rows, format, (format == FORMAT_DXT1)? src : src + 8);
+
+		if (format == FORMAT_DXT1){
+			// Pack each row to RGB8 by shifting the texels down over the empty alpha bytes
+			const __m128i lane0 = _mm_set_epi32(0, 0, 0, 0xFFFFFF);
+			const __m128i lane1 = _mm_set_epi32(0, 0, 0xFFFFFF, 0);
+			const __m128i lane2 = _mm_set_epi32(0, 0xFFFFFF, 0, 0);
+			for (int y = 0; y < 4; y++){
+				__m128i row = rows[y];
+				__m128i rgb = _mm_and_si128(row, lane0);
+				rgb = _mm_or_si128(rgb, _mm_srli_si128(_mm_and_si128(row, lane1), 1));
+				rgb = _mm_or_si128(rgb, _mm_srli_si128(_mm_and_si128(row, lane2), 2));
+				rgb = _mm_or_si128(rgb, _mm_srli_si128(_mm_andnot_si128(_mm_or_si128(lane0, _mm_or_si128(lane1, lane2)), row), 3));
+
+				unsigned char *dst = dest + y * yOff;
+				_mm_storel_epi64((__m128i *) dst, rgb);
+				int last = _mm_cvtsi128_si32(_mm_srli_si128(rgb, 8));
+				memcpy(dst + 8, &last, 4);
+			}
+		} else {
+			__m128i alpha = (format == FORMAT_DXT3)? decodeDXT3AlphaBlockSSE2(src) : decodeDXT5AlphaBlockSSE2(src);
+
+			// Move each alpha value to the top byte of its texel
+			__m128i zero = _mm_setzero_si128();
+			__m128i lo = _mm_unpacklo_epi8(zero, alpha);
+			__m128i hi = _mm_unpackhi_epi8(zero, alpha);
+			_mm_storeu_si128((__m128i *) (dest),            _mm_or_si128(rows[0], _mm_unpacklo_epi16(zero, lo)));
+			_mm_storeu_si128((__m128i *) (dest + yOff),     _mm_or_si128(rows[1], _mm_unpackhi_epi16(zero, lo)));
+			_mm_storeu_si128((__m128i *) (dest + 2 * yOff), _mm_or_si128(rows[2], _mm_unpacklo_epi16(zero, hi)));
+			_mm_storeu_si128((__m128i *) (dest + 3 * yOff), _mm_or_si128(rows[3], _mm_unpackhi_epi16(zero, hi)));
+		}
+	} else if (format == FORMAT_ATI1N){
+		alignment(16) unsigned char values[16];
+		_mm_store_si128((__m128i *) values, decodeDXT5AlphaBlockSSE2(src));
+		for (int y = 0; y < 4; y++){
+			memcpy(dest + y * yOff, values + 4 * y, 4);
+		}
+	} else {
+		// The second block holds the first channel
+		__m128i x = decodeDXT5AlphaBlockSSE2(src + 8);
+		__m128i y = decodeDXT5AlphaBlockSSE2(src);
+		__m128i lo = _mm_unpacklo_epi8(x, y);
+		__m128i hi = _mm_unpackhi_epi8(x, y);
+		_mm_storel_epi64((__m128i *) (dest),            lo);
+		_mm_storel_epi64((__m128i *) (dest + yOff),     _mm_srli_si128(lo, 8));
+		_mm_storel_epi64((__m128i *) (dest + 2 * yOff), hi);
+		_mm_storel_epi64((__m128i *) (dest + 3 * yOff), _mm_srli_si128(hi, 8));
+	}
+}
+#endif // USE_SSE2
+
+// Decodes the block rows [firstRow, lastRow) of a surface
+static void decodeBlockRows(unsigned char *dest, const unsigned char *src, const int width, const int height, const FORMAT format, const int firstRow, const int lastRow){
 	int nChannels = getChannelCount(format);
+	int blockSize = getBytesPerBlock(format);
+	int nBlocksX = (width + 3) >> 2;
+	int yOff = width * nChannels;
+
+	for (int by = firstRow; by < lastRow; by++){
+		int y = 4 * by;
+		int sy = (height - y < 4)? height - y : 4;
 
-	for (int y = 0; y < height; y += 4){
+		unsigned char *block = (unsigned char *) src + by * nBlocksX * blockSize;
 		for (int x = 0; x < width; x += 4){
+			int sx = (width - x < 4)? width - x : 4;
+
 			unsigned char *dst = dest + (y * width + x) * nChannels;
+#ifdef USE_SSE2
+			if (sx == 4 && sy == 4){
+				decodeBlockSSE2(dst, yOff, format, block);
+				block += blockSize;
+				continue;
+			}
+#endif
 			if (format == FORMAT_DXT3){
-				decodeDXT3AlphaBlock(dst + 3, sx, sy, nChannels, width * nChannels, src);
-				src += 8;
+				decodeDXT3AlphaBlock(dst + 3, sx, sy, nChannels, yOff, block);
 			} else if (format == FORMAT_DXT5){
-				decodeDXT5AlphaBlock(dst + 3, sx, sy, nChannels, width * nChannels, src);
-				src += 8;
+				decodeDXT5AlphaBlock(dst + 3, sx, sy, nChannels, yOff, block);
 			}
 			if (format <= FORMAT_DXT5){
-				decodeColorBlock(dst, sx, sy, nChannels, width * nChannels, format, 0, 2, src);
-				src += 8;
+				decodeColorBlock(dst, sx, sy, nChannels, yOff, format, 0, 2, (format == FORMAT_DXT1)? block : block + 8);
+			} else if (format == FORMAT_ATI1N){
+				decodeDXT5AlphaBlock(dst, sx, sy, 1, yOff, block);
 			} else {
-				if (format == FORMAT_ATI1N){
-					decodeDXT5AlphaBlock(dst, sx, sy, 1, width, src);
-					src += 8;
-				} else {
-					decodeDXT5AlphaBlock(dst,     sx, sy, 2, width * 2, src + 8);
-					decodeDXT5AlphaBlock(dst + 1, sx, sy, 2, width * 2, src);
-					src += 16;
-				}
+				decodeDXT5AlphaBlock(dst,     sx, sy, 2, yOff, block + 8);
+				decodeDXT5AlphaBlock(dst + 1, sx, sy, 2, yOff, block);
 			}
+			block += blockSize;
 		}
 	}
 }
 
+void decodeCompressedImage(unsigned char *dest, unsigned char *src, const int width, const int height, const FORMAT format){
+	decodeBlockRows(dest, src, width, height, format, 0, (height + 3) >> 2);
+}
+
+// A band of block rows in one surface of an image
+struct DecodeBand {
+	unsigned char *dest;
+	const unsigned char *src;
+	int width, height;
+	int firstRow, lastRow;
+};
+
+struct DecodeJob {
+	Array <DecodeBand> bands;
+	FORMAT format;
+};
+
+static void decodeBands(void *data, const uint start, const uint end){
+	DecodeJob *job = (DecodeJob *) data;
+	for (uint i = start; i < end; i++){
+		const DecodeBand &band = job->bands[i];
+		decodeBlockRows(band.dest, band.src, band.width, band.height, job->format, band.firstRow, band.lastRow);
+	}
+}
+
 bool Image::uncompressImage(){
 	if (isCompressedFormat(format)){
 		FORMAT destFormat;
@@ -2257,33 +2691,88 @@ bool Image::uncompressImage(){
 			destFormat = (format == FORMAT_DXT1)? FORMAT_RGB8 : FORMAT_RGBA8;
 		}
 
-		ubyte *newPixels = new ubyte[getMipMappedSize(0, nMipMaps, destFormat)];
+		ubyte *newPixels = new ubyte[getMipMappedSize(0, nMipMaps, destFormat) * arraySize];
+
+		// Every mipmap, face and slice is split into bands of block rows so that large levels spread across the workers
+		const int bandRows = 16;
 
-		int level = 0;
-		ubyte *src, *dst = newPixels;
-		while ((src = getPixels(level)) != NULL){
+		DecodeJob job;
+		job.format = format;
+
+		ubyte *dst = newPixels;
+		for (int arraySlice = 0; arraySlice < arraySize; arraySlice++){
+			for (int level = 0; level < nMipMaps; level++){
+				ubyte *src = getPixels(level, arraySlice);
+				int w = getWidth(level);
+				int h = getHeight(level);
+				int d = (depth == 0)? 6 : getDepth(level);
+
+				int dstSliceSize = getSliceSize(level, destFormat);
+				int srcSliceSize = getSliceSize(level, format);
+				int nBlockRows = (h + 3) >> 2;
+
+				for (int slice = 0; slice < d; slice++){
+					for (int row = 0; row < nBlockRows; row += bandRows){
+						DecodeBand band;
+						band.dest = dst;
+						band.src = src;
+						band.width = w;
+						band.height = h;
+						band.firstRow = row;
+						band.lastRow = (row + bandRows < nBlockRows)? row + bandRows : nBlockRows;
+						job.bands.add(band);
+					}
+
+					dst += dstSliceSize;
+					src += srcSliceSize;
+				}
+			}
+		}
+
+		parallelFor(decodeBands, &job, job.bands.getCount(), 1);
+
+		format = destFormat;
+		
+		free();
+		pixels = newPixels;
+	}
+
+	return true;
+}
+
+bool Image::compress(const FORMAT destFormat, const int quality){
+	if (!isCompressedFormat(destFormat)) return false;
+	if (format < FORMAT_R8 || format > FORMAT_RGBA8) return false;
+
+	int nChannels = getChannelCount(format);
+	if (destFormat == FORMAT_ATI2N && nChannels < 2) return false;
+
+	ubyte *newPixels = new ubyte[getMipMappedSize(0, nMipMaps, destFormat) * arraySize];
+
+	ubyte *dst = newPixels;
+	for (int arraySlice = 0; arraySlice < arraySize; arraySlice++){
+		for (int level = 0; level < nMipMaps; level++){
+			ubyte *src = getPixels(level, arraySlice);
 			int w = getWidth(level);
 			int h = getHeight(level);
 			int d = (depth == 0)? 6 : getDepth(level);
 
 			int dstSliceSize = getSliceSize(level, destFormat);
-			int srcSliceSize = getSliceSize(level, format);
+			int srcSliceSize = getSliceSize(level);
 
 			for (int slice = 0; slice < d; slice++){
-				decodeCompressedImage(dst, src, w, h, format);
+				compressSurface(dst, src, w, h, nChannels, destFormat, quality);
 
 				dst += dstSliceSize;
 				src += srcSliceSize;
 			}
-			level++;
 		}
-
-		format = destFormat;
-		
-		free();
-		pixels = newPixels;
 	}
 
+	format = destFormat;
+
+	replacePixels(newPixels);
+
 	return true;
 }
 
@@ -2334,8 +2823,7 @@ bool Image::unpackImage(){
 		return false;
 	}
 
-	delete [] pixels;
-	pixels = newPixels;
+	replacePixels(newPixels);
 
 	return true;
 }
@@ -2368,16 +2856,8 @@ bool Image::convert(const FORMAT newFormat){
 		ubyte *src = pixels;
 		ubyte *dest = newPixels = new ubyte[getMipMappedSize(0, nMipMaps, newFormat) * arraySize];
 
-		if (format == FORMAT_RGB8 && newFormat == FORMAT_RGBA8){
-			// Fast path for RGB->RGBA8
-			do {
-				dest[0] = src[0];
-				dest[1] = src[1];
-				dest[2] = src[2];
-				dest[3] = 255;
-				dest += 4;
-				src += 3;
-			} while (--nPixels);
+		if (canConvertPixels(format, newFormat)){
+			convertPixels(dest, newFormat, src, format, nPixels);
 
 		} else {
 			int srcSize = getBytesPerPixel(format);
@@ -2436,8 +2916,7 @@ bool Image::convert(const FORMAT newFormat){
 			} while (--nPixels);
 		}
 	}
-	delete [] pixels;
-	pixels = newPixels;
+	replacePixels(newPixels);
 	format = newFormat;
 
 	return true;
@@ -2491,98 +2970,56 @@ bool Image::flipY(){
 	}
 
 
-	delete [] pixels;
-	pixels = newPixels;
+	replacePixels(newPixels);
 
 	return true;
 }
 
-bool Image::dilate(){
-	if (format != FORMAT_R8)
-		return false;
+// Every 2D surface of the image, each face and depth slice on its own
+static void getMorphSurfaces(Array <MorphSurface> &surfaces, const Image &image){
+	for (int arraySlice = 0; arraySlice < image.getArraySize(); arraySlice++){
+		for (int level = 0; level < image.getMipMapCount(); level++){
+			MorphSurface surface;
+			surface.width  = image.getWidth(level);
+			surface.height = image.getHeight(level);
 
-	ubyte *newPixels = new ubyte[getMipMappedSize(0, nMipMaps)];
-	ubyte *dst = newPixels;
-
-	//int ch = getChannelCount(format);
+			ubyte *src = image.getPixels(level, arraySlice);
 
-	for (int i = 0; i < nMipMaps; i++){
-		int w = getWidth(i);
-		int h = getHeight(i);
-
-		ubyte *src = getPixels(i);
-
-		for (int y = 0; y < h; y++){
-			for (int x = 0; x < w; x++){
-				int startX = max(x - 1, 0);
-				int endX = min(x + 2, w);
-				int startY = max(y - 1, 0);
-				int endY = min(y + 2, h);
-
-				ubyte max = 0;
-				for (int iy = startY; iy < endY; iy++)
-				{
-					for (int ix = startX; ix < endX; ix++)
-					{
-						ubyte c = src[iy * w + ix];
-						if (c > max)
-							max = c;
-					}
-				}
-
-				*dst++ = max;
+			int n = image.isCube()? 6 : image.getDepth(level);
+			for (int i = 0; i < n; i++){
+				surface.pixels = src + i * image.getSliceSize(level);
+				surfaces.add(surface);
 			}
 		}
 	}
+}
 
+bool Image::dilate(const int iterations){
+	if (!canMorphFormat(format)) return false;
 
-	delete [] pixels;
-	pixels = newPixels;
+	Array <MorphSurface> surfaces;
+	getMorphSurfaces(surfaces, *this);
+	morphSurfaces(surfaces.getArray(), surfaces.getCount(), format, iterations, true);
 
 	return true;
 }
 
-bool Image::erode(){
-	if (format != FORMAT_R8)
-		return false;
-
-	ubyte *newPixels = new ubyte[getMipMappedSize(0, nMipMaps)];
-	ubyte *dst = newPixels;
-
-	//int ch = getChannelCount(format);
-
-	for (int i = 0; i < nMipMaps; i++){
-		int w = getWidth(i);
-		int h = getHeight(i);
+bool Image::erode(const int iterations){
+	if (!canMorphFormat(format)) return false;
 
-		ubyte *src = getPixels(i);
+	Array <MorphSurface> surfaces;
+	getMorphSurfaces(surfaces, *this);
+	morphSurfaces(surfaces.getArray(), surfaces.getCount(), format, iterations, false);
 
-		for (int y = 0; y < h; y++){
-			for (int x = 0; x < w; x++){
-				int startX = max(x - 1, 0);
-				int endX = min(x + 2, w);
-				int startY = max(y - 1, 0);
-				int endY = min(y + 2, h);
-
-				ubyte min = 0xFF;
-				for (int iy = startY; iy < endY; iy++)
-				{
-					for (int ix = startX; ix < endX; ix++)
-					{
-						ubyte c = src[iy * w + ix];
-						if (c < min)
-							min = c;
-					}
-				}
+	return true;
+}
 
-				*dst++ = min;
-			}
-		}
-	}
+bool Image::dilateCoverage(const int iterations, const ubyte minAlpha){
+	if (format != FORMAT_RGBA8) return false;
 
-
-	delete [] pixels;
-	pixels = newPixels;
+	Array <MorphSurface> surfaces;
+	getMorphSurfaces(surfaces, *this);
+	::dilateCoverage(surfaces.getArray(), surfaces.getCount(), iterations, minAlpha);
 
 	return true;
 }
@@ -2604,8 +3041,7 @@ bool Image::toRGBD16(){
 		newPixels[4 * i + 3] = (ushort) (65535 * (1.0f / maxChannel));
 	}
 
-	delete [] pixels;
-	pixels = (ubyte *) newPixels;
+	replacePixels((ubyte *) newPixels);
 	format = FORMAT_RGBA16;
 
 	return true;
@@ -2651,8 +3087,7 @@ bool Image::toRGBE16(float &scale, float &bias){
 	}
 
 
-	delete [] pixels;
-	pixels = (ubyte *) newPixels;
+	replacePixels((ubyte *) newPixels);
 	format = FORMAT_RGBA16;
 
 	return true;
@@ -2707,8 +3142,7 @@ bool Image::toE16(float *scale, float *bias, const bool useAllSameRange, const f
 		}
 	}
 
-	delete [] pixels;
-	pixels = (ubyte *) newPixels;
+	replacePixels((ubyte *) newPixels);
 	format = (FORMAT) ((FORMAT_I16 - 1) + nChannels);
 
 	return true;
@@ -2784,152 +3218,50 @@ bool Image::toFixedPointHDR(float *maxValue, const int finalRgbBits, const int f
 
 	format = FORMAT_RGBA16;
 
-	delete [] pixels;
-	pixels = (ubyte *) newPixels;
+	replacePixels((ubyte *) newPixels);
 
 	*maxValue = maxVal;
 	return true;
 }
 
 bool Image::toNormalMap(FORMAT destFormat, float sZ, float mipMapScaleZ){
-	if (arraySize > 1) return false; // TODO: Implement ...
-	if (format == FORMAT_RGB8 || format == FORMAT_RGBA8) toGrayScale();
-	if (format != FORMAT_I8) return false;
-	
-	uint xMask = 0, yMask = 0, zMask = 0, hMask = 0;
-	uint xShift = 0, yShift = 0, zShift = 0, hShift = 0, hFactor = 1;
-
-	switch (destFormat){
-		case FORMAT_RG8:
-		case FORMAT_RG8S:
-			xMask = yMask = 0xFF;
-			xShift = 8;
-			break;
-		case FORMAT_RGB565:
-			xMask = zMask = 0x1F;
-			yMask = 0x3F;
-			xShift = 11;
-			yShift = 5;
-			break;
-		case FORMAT_RGBA4:
-			xMask = yMask = zMask = hMask = 0xF;
-			yShift = 4;
-			zShift = 8;
-			hShift = 12;
-			break;
-		case FORMAT_RGBA8:
-		case FORMAT_RGBA8S:
-			xMask = yMask = zMask = hMask = 0xFF;
-			yShift = 8;
-			zShift = 16;
-			hShift = 24;
-			break;
-		case FORMAT_RGB10A2:
-			xMask = yMask = zMask = 0x3FF;
-			hMask = 0x03;
-			yShift = 10;
-			zShift = 20;
-			hShift = 30;
-			break;
-		case FORMAT_RGBA16:
-		case FORMAT_RGBA16S:
-			xMask = yMask = zMask = hMask = 0xFFFF;
-			yShift = 16;
-			zShift = 32;
-			hShift = 48;
-			hFactor = 257;
-			break;
-		default:
-			return false;
-	}
-
-	const float sobelX[5][5] = {
-		{ 1,  2,  0,  -2, -1 },
-		{ 4,  8,  0,  -8, -4 },
-		{ 6, 12,  0, -12, -6 },
-		{ 4,  8,  0,  -8, -4 },
-		{ 1,  2,  0,  -2, -1 },
-	};
-	const float sobelY[5][5] = {
-		{  1,  4,   6,  4,  1 },
-		{  2,  8,  12,  8,  2 },
-		{  0,  0,   0,  0,  0 },
-		{ -2, -8, -12, -8, -2 },
-		{ -1, -4,  -6, -4, -1 },
-	};
-
-	int bpp = getBytesPerPixel(destFormat);
-	bool use16 = (bpp == 2);
-	bool use32 = (bpp == 4);
-
-	float xFactor = 0.5f * xMask;
-	float yFactor = 0.5f * yMask;
-	float zFactor = 0.5f * zMask;
-	float bias = isSignedFormat(destFormat)? 0.0f : 1.0f;
-
+	if (!canBuildNormalMap(format, destFormat)) return false;
 
 	// Size of the z component
 	sZ *= 128.0f / max(width, height);
 
-	ubyte *newPixels = new ubyte[getMipMappedSize(0, nMipMaps, destFormat)];
+	int srcSize  = getMipMappedSize(0, nMipMaps);
+	int destSize = getMipMappedSize(0, nMipMaps, destFormat);
+	ubyte *newPixels = new ubyte[destSize * arraySize];
 
-	union {
-		ushort *dest16;
-		uint32 *dest32;
-		uint64 *dest64;
-	};
-	dest32 = (uint32 *) newPixels;
+	// Each face and depth slice is filtered on its own
+	Array <NormalMapSurface> surfaces;
+	for (int arraySlice = 0; arraySlice < arraySize; arraySlice++){
+		NormalMapSurface surface;
+		surface.sZ = sZ;
 
-	for (int mipMap = 0; mipMap < nMipMaps; mipMap++){
-		ubyte *src = getPixels(mipMap);
+		for (int level = 0; level < nMipMaps; level++){
+			surface.width  = getWidth(level);
+			surface.height = getHeight(level);
 
-		int w = getWidth(mipMap);
-		int h = getHeight(mipMap);
+			ubyte *src  = pixels + arraySlice * srcSize + getMipMappedSize(0, level);
+			ubyte *dest = newPixels + arraySlice * destSize + getMipMappedSize(0, level, destFormat);
 
-		for (int y = 0; y < h; y++){
-			for (int x = 0; x < w; x++){
-				// Apply a 5x5 Sobel filter
-				float sX = 0;
-				float sY = 0;
-				for (int dy = 0; dy < 5; dy++){
-					int fy = (y + dy - 2 + h) % h;
-					for (int dx = 0; dx < 5; dx++){
-						int fx = (x + dx - 2 + w) % w;
-						sX += sobelX[dy][dx] * src[fy * w + fx];
-						sY += sobelY[dy][dx] * src[fy * w + fx];
-					}
-				}
-				// Construct the components
-				sX *= 1.0f / (48 * 255);
-				sY *= 1.0f / (48 * 255);
-
-				// Normalize and store
-				float invLen = 1.0f / sqrtf(sX * sX + sY * sY + sZ * sZ);
-				float rX = xFactor * (sX * invLen + bias);
-				float rY = yFactor * (sY * invLen + bias);
-				float rZ = zFactor * (sZ * invLen + bias);
-
-				uint64 result = 0;
-				result |= uint64(int(rX) & xMask) << xShift;
-				result |= uint64(int(rY) & yMask) << yShift;
-				result |= uint64(int(rZ) & zMask) << zShift;
-				result |= uint64((src[y * w + x] * hFactor) & hMask) << hShift;
-
-				if (use32){
-                    *dest32++ = (uint32) result;
-				} else if (use16){
-                    *dest16++ = (uint16) result;
-				} else {
-					*dest64++ = result;
-				}
+			int n = isCube()? 6 : getDepth(level);
+			for (int i = 0; i < n; i++){
+				surface.src  = src  + i * getSliceSize(level);
+				surface.dest = dest + i * getSliceSize(level, destFormat);
+				surfaces.add(surface);
 			}
+
+			surface.sZ *= mipMapScaleZ;
 		}
-		sZ *= mipMapScaleZ;
 	}
 
+	buildNormalMaps(surfaces.getArray(), surfaces.getCount(), format, destFormat);
+
 	format = destFormat;
-	delete [] pixels;
-	pixels = newPixels;
+	replacePixels(newPixels);
 
 	return true;
 }
@@ -2961,7 +3293,9 @@ bool Image::toGrayScale(){
 		size *= 2;
 	}
 
-	pixels = (ubyte *) realloc(pixels, size);
+	ubyte *newPixels = new ubyte[size];
+	memcpy(newPixels, pixels, size);
+	replacePixels(newPixels);
 
 	return true;
 }
@@ -3070,8 +3404,237 @@ bool Image::removeChannels(bool keepCh0, bool keepCh1, bool keepCh2, bool keepCh
 		} while (--nPixels);
 	}
 
-	delete [] pixels;
-	pixels = newPixels;
+	replacePixels(newPixels);
 
 	return true;
 }
+
+static bool seekFile(FILE *file, const uint64 offset){
+#ifdef _WIN32
+	return (_fseeki64(file, offset, SEEK_SET) == 0);
+#else
+	return (fseeko(file, offset, SEEK_SET) == 0);
+#endif
+}
+
+ImageRowFile::ImageRowFile(){
+	file = NULL;
+	format = FORMAT_NONE;
+	width  = 0;
+	height = 0;
+	palette = NULL;
+	rowBuffer = NULL;
+	failed = false;
+}
+
+ImageRowFile::~ImageRowFile(){
+	close();
+}
+
+bool ImageRowFile::openRead(const char *fileName){
+	close();
+
+	const char *extension = strrchr(fileName, '.');
+	if (extension == NULL) return false;
+
+	if ((file = fopen(fileName, "rb")) == NULL) return false;
+
+	bool result = false;
+	if (stricmp(extension, ".dds") == 0){
+		DDSHeader header;
+		if (readDDSHeader(file, header, format, swapRB) && !isCompressedFormat(format) &&
+			(header.ddsCaps.dwCaps2 & DDSCAPS2_CUBEMAP) == 0 && header.dwDepth <= 1){
+
+			width  = header.dwWidth;
+			height = header.dwHeight;
+			dataOffset = ftell(file);
+			fileBpp = getBytesPerPixel(format);
+			bottomUp = false;
+			result = true;
+		}
+	}
+#ifndef NO_TGA
+	else if (stricmp(extension, ".tga") == 0){
+		TGAHeader header;
+		// Only uncompressed files, as the rows of RLE files can't be found without decoding all before them
+		if (fread(&header, sizeof(header), 1, file) == 1 && (header.imagetype & 0x08) == 0){
+			int palLength = header.descriptionlen + header.cmapentries * header.cmapbits / 8;
+
+			width  = header.width;
+			height = header.height;
+			dataOffset = sizeof(header) + palLength;
+			fileBpp = header.bpp / 8;
+			bottomUp = true;
+			swapRB = (header.bpp >= 24);
+
+			switch (header.bpp){
+				case 8:
+					if (palLength > 0){
+						palette = new ubyte[768];
+						fread(palette, 768, 1, file);
+						format = FORMAT_RGB8;
+					} else {
+						format = FORMAT_I8;
+					}
+					break;
+				case 16: format = FORMAT_RGBA8; break;
+				case 24: format = FORMAT_RGB8;  break;
+				case 32: format = FORMAT_RGBA8; break;
+			}
+			result = (format != FORMAT_NONE);
+		}
+	}
+#endif // NO_TGA
+
+	if (!result){
+		close();
+		return false;
+	}
+
+	fileRowSize = width * fileBpp;
+	rowBuffer = new ubyte[fileRowSize];
+
+	return true;
+}
+
+bool ImageRowFile::openWrite(const char *fileName, const FORMAT fmt, const int w, const int h){
+	close();
+
+	const char *extension = strrchr(fileName, '.');
+	if (extension == NULL || w <= 0 || h <= 0) return false;
+
+	format = fmt;
+	width  = w;
+	height = h;
+
+	if (stricmp(extension, ".dds") == 0){
+		DDSHeader header;
+		DDSHeaderDX10 headerDX10;
+		if (isCompressedFormat(format) || !setupDDSHeader(header, headerDX10, format, width, height, 1, 1)) return false;
+		if ((file = fopen(fileName, "wb")) == NULL) return false;
+
+		fwrite(&header, sizeof(header), 1, file);
+		if (headerDX10.dxgiFormat) fwrite(&headerDX10, sizeof(headerDX10), 1, file);
+
+		dataOffset = ftell(file);
+		bottomUp = false;
+	}
+#ifndef NO_TGA
+	else if (stricmp(extension, ".tga") == 0){
+		if (format != FORMAT_I8 && format != FORMAT_RGB8 && format != FORMAT_RGBA8) return false;
+		if ((file = fopen(fileName, "wb")) == NULL) return false;
+
+		writeTGAHeader(file, format, width, height);
+
+		dataOffset = ftell(file);
+		bottomUp = true;
+	}
+#endif // NO_TGA
+	else {
+		return false;
+	}
+
+	swapRB = (format == FORMAT_RGB8 || format == FORMAT_RGBA8);
+	fileBpp = getBytesPerPixel(format);
+	fileRowSize = width * fileBpp;
+	rowBuffer = new ubyte[fileRowSize];
+
+	return true;
+}
+
+bool ImageRowFile::close(){
+	bool result = !failed;
+	if (file){
+		if (fclose(file) != 0) result = false;
+		file = NULL;
+	}
+
+	delete [] palette;
+	delete [] rowBuffer;
+	palette = NULL;
+	rowBuffer = NULL;
+
+	format = FORMAT_NONE;
+	width  = 0;
+	height = 0;
+	failed = false;
+
+	return result;
+}
+
+bool ImageRowFile::seekRow(const int fileRow){
+	return seekFile(file, dataOffset + uint64(fileRow) * fileRowSize);
+}
+
+bool ImageRowFile::readRows(ubyte *dest, const int firstRow, const int nRows){
+	if (file == NULL || firstRow < 0 || nRows <= 0 || firstRow + nRows > height) return false;
+
+	int nChannels = getChannelCount(format);
+	int rowSize = getRowSize();
+
+	if (!bottomUp){
+		if (!seekRow(firstRow) || fread(dest, rowSize, nRows, file) != size_t(nRows)) return false;
+		if (swapRB) swapChannels(dest, width * nRows, nChannels, 0, 2);
+
+		return true;
+	}
+
+	// The band is read in file order, which starts from its last row
+	if (!seekRow(height - firstRow - nRows)) return false;
+
+	for (int i = nRows - 1; i >= 0; i--){
+		ubyte *dst = dest + size_t(i) * rowSize;
+
+		if (fileBpp == nChannels){
+			if (fread(dst, rowSize, 1, file) != 1) return false;
+			if (swapRB) swapChannels(dst, width, nChannels, 0, 2);
+		} else {
+			if (fread(rowBuffer, fileRowSize, 1, file) != 1) return false;
+
+			if (palette){
+				for (int x = 0; x < width; x++){
+					const ubyte *entry = palette + 3 * rowBuffer[x];
+					dst[3 * x + 0] = entry[2];
+					dst[3 * x + 1] = entry[1];
+					dst[3 * x + 2] = entry[0];
+				}
+			} else {
+				for (int x = 0; x < width; x++){
+					uint pixel = ((ushort *) rowBuffer)[x];
+					dst[4 * x + 0] = ((pixel >> 10) & 0x1F) << 3;
+					dst[4 * x + 1] = ((pixel >>  5) & 0x1F) << 3;
+					dst[4 * x + 2] = ((pixel      ) & 0x1F) << 3;
+					dst[4 * x + 3] = (pixel >> 15)? 0xFF : 0;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ImageRowFile::writeRows(const ubyte *src, const int firstRow, const int nRows){
+	if (file == NULL || firstRow < 0 || nRows <= 0 || firstRow + nRows > height) return false;
+
+	int nChannels = getChannelCount(format);
+	int rowSize = getRowSize();
+
+	bool result = seekRow(bottomUp? height - firstRow - nRows : firstRow);
+	if (result && !bottomUp && !swapRB){
+		result = (fwrite(src, rowSize, nRows, file) == size_t(nRows));
+	} else {
+		for (int i = 0; i < nRows && result; i++){
+			const ubyte *row = src + size_t(bottomUp? nRows - 1 - i : i) * rowSize;
+			if (swapRB){
+				memcpy(rowBuffer, row, rowSize);
+				swapChannels(rowBuffer, width, nChannels, 0, 2);
+				row = rowBuffer;
+			}
+			result = (fwrite(row, rowSize, 1, file) == 1);
+		}
+	}
+
+	if (!result) failed = true;
+
+	return result;
+}
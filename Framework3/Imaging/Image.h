@@ -28,6 +28,22 @@
 
 // Image loading flags
 #define DONT_LOAD_MIPMAPS 0x1
+// DDS pixels are referenced in a copy-on-write view of the file instead of being read into memory, where the layout allows
+#define MAP_PIXELS        0x2
+
+// Block compression quality
+#define COMPRESS_FAST   0
+#define COMPRESS_NORMAL 1
+#define COMPRESS_HIGH   2
+
+// Mipmap filter kernels
+#define MIPMAP_BOX     0
+#define MIPMAP_KAISER  1
+#define MIPMAP_LANCZOS 2
+
+// Mipmap generation flags
+#define MIPMAP_SRGB      0x1
+#define MIPMAP_NORMALMAP 0x2
 
 enum FORMAT {
 	FORMAT_NONE     = 0,
@@ -221,6 +237,16 @@ inline int getBytesPerBlock(const FORMAT format){
 const char *getFormatString(const FORMAT format);
 FORMAT getFormatFromString(char *string);
 
+class MappedFile;
+
+// Per level results of Image::createMipMaps()
+struct MipMapStats {
+	float time;         // Seconds spent on the level, summed over faces and slices
+	float drift;        // Largest change of a channel's average from the top level, in the space the filtering was done in
+	float clipped;      // Fraction of values outside the format's range that were clamped, mostly ringing of the sharper kernels
+	float normalLength; // Average length of the filtered normals before renormalization, with MIPMAP_NORMALMAP
+};
+
 class Image {
 public:
 	Image();
@@ -228,6 +254,9 @@ public:
 	~Image();
 
 	unsigned char *create(const FORMAT fmt, const int w, const int h, const int d, const int mipMapCount, const int arraysize = 1);
+	// Like create(), but the pixels are the data at offset in a copy-on-write view of the file. On failure the image
+	// keeps the new format and dimensions but has no pixels.
+	bool mapPixels(const char *fileName, const uint64 offset, const FORMAT fmt, const int w, const int h, const int d, const int mipMapCount, const int arraysize = 1);
 	void free();
 	void clear();
 
@@ -253,6 +282,7 @@ public:
 	bool is3D()    const { return (depth >  1); }
 	bool isCube()  const { return (depth == 0); }
 	bool isArray() const { return (arraySize > 1); }
+	bool isMapped() const { return (mappedFile != NULL); }
 
 	FORMAT getFormat() const { return format; }
 	void setFormat(const FORMAT form){ format = form; }
@@ -307,28 +337,44 @@ public:
 #endif // NO_PCX
 
 	bool loadImage(const char *fileName, uint flags = 0);
+	// Reads only the format and dimensions that loadImage() would give, without any pixels. Only DDS and TGA
+	// files are understood, as their headers tell without decoding anything.
+	bool loadImageInfo(const char *fileName, uint flags = 0);
+	// Loads the images as cubemap faces (nImages == 0) or array slices, decoding them in parallel into the final image
 	bool loadSlicedImage(const char **fileNames, const int nImages, const int nArraySlices = 1, uint flags = 0);
+	// Stacks loaded images of matching format, size and mipmap count into cubemap faces (nImages == 0) or array slices
+	bool assembleSlices(const Image **images, const int nImages, const int nArraySlices = 1);
 	bool saveImage(const char *fileName);
 
 	void loadFromMemory(void *mem, const FORMAT frmt, const int w, const int h, const int d, const int mipMapCount, bool ownsMemory);
 
-	bool createMipMaps(const int mipMaps = ALL_MIPMAPS);
+	// Filters the mipmaps from the top level. With MIPMAP_SRGB, color channels of unsigned formats are filtered in linear space.
+	// With MIPMAP_NORMALMAP, the first three channels are normals that get renormalized. If stats is given, it receives one entry per level.
+	bool createMipMaps(const int mipMaps = ALL_MIPMAPS, const int filter = MIPMAP_BOX, const uint flags = 0, MipMapStats *stats = NULL);
 	bool removeMipMaps(const int firstMipMap, const int mipMapsToSave = ALL_MIPMAPS);
 
 	bool uncompressImage();
+	// Compresses 8-bit unsigned images to DXT1/3/5 or ATI1N/2N. For DXT, one and two channel images are intensity and intensity-alpha,
+	// and DXT1 keeps alpha as a 1-bit cutoff.
+	bool compress(const FORMAT destFormat, const int quality = COMPRESS_NORMAL);
 	bool unpackImage();
 
 	bool convert(const FORMAT newFormat);
 	bool swap(const int ch0, const int ch1);
 	bool flipX();
 	bool flipY();
-	bool dilate();
-	bool erode();
+	// Replace each texel with the max or min of the 3x3 texels around it, iterations times, in each channel of 8-bit unsigned formats
+	bool dilate(const int iterations = 1);
+	bool erode(const int iterations = 1);
+	// Pads the colors of RGBA8 texels with alpha of at least minAlpha over the texels around them by one texel per iteration,
+	// so that mipmapping doesn't bleed the uncovered texels into them. Alpha is left as it is.
+	bool dilateCoverage(const int iterations, const ubyte minAlpha = 1);
 
 	bool toRGBD16();
 	bool toRGBE16(float &scale, float &bias);
 	bool toE16(float *scale, float *bias, const bool useAllSameRange = false, const float minValue = FLT_MIN, const float maxValue = FLT_MAX);
 	bool toFixedPointHDR(float *maxValue, const int finalRgbBits, const int finalRangeBits);
+	// Converts I8, RGB8 or RGBA8 heights to normals in RG8(S), RGB565, RGBA4, RGBA8(S), RGB10A2, RGBA16(S) or ATI2N
 	bool toNormalMap(FORMAT destFormat, float sZ = 1.0f, float mipMapScaleZ = 2.0f);
 	bool toGrayScale();
 	bool getRange(float &min, float &max);
@@ -338,6 +384,13 @@ public:
 	bool removeChannels(bool keepCh0, bool keepCh1 = true, bool keepCh2 = true, bool keepCh3 = true);
 
 protected:
+	// Frees the current pixels, or releases the view they are mapped from, and takes over newPixels
+	void replacePixels(unsigned char *newPixels);
+
+	// Reads or decodes one file of loadSlicedImage() into its place, with first telling the layout of each file
+	bool loadSlice(const char *fileName, const uint flags, const Image &first, const int arraySlice, const int image);
+	static void loadSlices(void *data, const uint start, const uint end);
+
 	unsigned char *pixels;
 	int width, height, depth;
 	int nMipMaps;
@@ -346,6 +399,49 @@ protected:
 
 	int nExtraData;
 	unsigned char *extraData;
+
+	// The file the pixels point into with MAP_PIXELS, otherwise NULL
+	MappedFile *mappedFile;
+};
+
+// Reads or writes the top level of a 2D image file a band of rows at a time, for images too large to be held whole.
+// Uncompressed DDS and TGA files can be read, giving the pixels loadImage() would. Files are written as saveDDS() and
+// saveTGA() write them, in the formats those take. Rows are top to bottom and can be accessed in any order.
+class ImageRowFile {
+public:
+	ImageRowFile();
+	~ImageRowFile();
+
+	bool openRead(const char *fileName);
+	bool openWrite(const char *fileName, const FORMAT fmt, const int w, const int h);
+	// Returns false if anything failed to be written
+	bool close();
+
+	bool readRows(ubyte *dest, const int firstRow, const int nRows);
+	bool writeRows(const ubyte *src, const int firstRow, const int nRows);
+
+	FORMAT getFormat() const { return format; }
+	int getWidth () const { return width;  }
+	int getHeight() const { return height; }
+	// Bytes of one row as read or written, not as stored in the file
+	int getRowSize() const { return width * getBytesPerPixel(format); }
+
+protected:
+	bool seekRow(const int fileRow);
+
+	FILE *file;
+	FORMAT format;
+	int width, height;
+
+	uint64 dataOffset;
+	int fileRowSize;
+	// TGA rows are stored bottom up and BGR, and 8-bit palettized or 16-bit pixels are expanded to RGB8 or RGBA8
+	bool bottomUp;
+	bool swapRB;
+	int fileBpp;
+	ubyte *palette;
+	ubyte *rowBuffer;
+	bool failed;
 };
 
 #endif // _IMAGE_H_
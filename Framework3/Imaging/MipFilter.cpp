@@ -0,0 +1,697 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "MipFilter.h"
+#include "../Math/Vector.h"
+#include "../Util/JobSystem.h"
+
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define KAISER_ALPHA 4.0f
+#define SINC_RADIUS  3.0f
+
+static float sinc(float x){
+	if (fabsf(x) < 1e-5f) return 1.0f;
+	x *= PI;
+	return sinf(x) / x;
+}
+
+// Zeroth order modified Bessel function of the first kind
+static float besselI0(const float x){
+	float sum = 1.0f;
+	float term = 1.0f;
+	float x2 = 0.25f * x * x;
+	for (int k = 1; k < 32; k++){
+		term *= x2 / float(k * k);
+		sum += term;
+		if (term < 1e-7f * sum) break;
+	}
+	return sum;
+}
+
+static float evalKernel(const int filter, const float t){
+	if (fabsf(t) >= SINC_RADIUS) return 0.0f;
+
+	if (filter == MIPMAP_LANCZOS){
+		return sinc(t) * sinc(t / SINC_RADIUS);
+	} else {
+		float r = t / SINC_RADIUS;
+		return sinc(t) * besselI0(KAISER_ALPHA * sqrtf(1.0f - r * r)) / besselI0(KAISER_ALPHA);
+	}
+}
+
+// Filter weights from one axis of a level to the same axis of the next. Each destination texel reads count[i]
+// consecutive source texels starting at first[i], with edge taps folded into the first and last texel.
+struct FilterTaps {
+	FilterTaps(const int srcSize, const int dstSize, const int filter);
+	~FilterTaps(){
+		delete [] first;
+		delete [] count;
+		delete [] weights;
+	}
+
+	int *first;
+	int *count;
+	float *weights;
+	int maxTaps;
+};
+
+FilterTaps::FilterTaps(const int srcSize, const int dstSize, const int filter){
+	float scale = float(srcSize) / float(dstSize);
+	float support = ((filter == MIPMAP_BOX)? 0.5f : SINC_RADIUS) * scale;
+
+	maxTaps = int(2.0f * support) + 3;
+	first = new int[dstSize];
+	count = new int[dstSize];
+	weights = new float[dstSize * maxTaps];
+
+	for (int i = 0; i < dstSize; i++){
+		float center = (i + 0.5f) * scale;
+		int s0 = int(floorf(center - support));
+		int s1 = int(ceilf(center + support));
+
+		int lo = (s0 < 0)? 0 : s0;
+		int hi = (s1 > srcSize - 1)? srcSize - 1 : s1;
+
+		float *w = weights + i * maxTaps;
+		memset(w, 0, maxTaps * sizeof(float));
+
+		for (int s = s0; s <= s1; s++){
+			float weight;
+			if (filter == MIPMAP_BOX){
+				// Area of the source texel inside the destination texel's footprint
+				float a = (s > center - support)? float(s) : center - support;
+				float b = (s + 1 < center + support)? float(s + 1) : center + support;
+				weight = (b > a)? b - a : 0.0f;
+			} else {
+				weight = evalKernel(filter, (s + 0.5f - center) / scale);
+			}
+
+			int index = (s < lo)? lo : (s > hi)? hi : s;
+			w[index - lo] += weight;
+		}
+
+		// Trim zero weights at the ends and normalize
+		int n = hi - lo + 1;
+		int start = 0;
+		while (start < n - 1 && w[start] == 0.0f) start++;
+		while (n > start + 1 && w[n - 1] == 0.0f) n--;
+
+		float sum = 0.0f;
+		for (int k = start; k < n; k++) sum += w[k];
+		for (int k = start; k < n; k++) w[k - start] = w[k] / sum;
+
+		first[i] = lo + start;
+		count[i] = n - start;
+	}
+}
+
+static float srgbToLinear(const float c){
+	return (c <= 0.04045f)? c * (1.0f / 12.92f) : powf((c + 0.055f) * (1.0f / 1.055f), 2.4f);
+}
+
+static float linearToSrgb(const float c){
+	return (c <= 0.0031308f)? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+// Lookup tables for 8-bit sRGB. A linear value encodes to the number of rounding thresholds below it, which is found
+// by stepping up from a table indexed by the value.
+struct SRGBTables {
+	SRGBTables(){
+		for (int i = 0; i < 256; i++){
+			toLinear[i] = srgbToLinear(i * (1.0f / 255.0f));
+		}
+		for (int i = 0; i < 255; i++){
+			thresholds[i] = srgbToLinear((i + 0.5f) * (1.0f / 255.0f));
+		}
+		thresholds[255] = FLT_MAX;
+
+		// Starting points for the search, at most a couple of steps below the result
+		int b = 0;
+		for (int i = 0; i < 4096; i++){
+			while (thresholds[b] < i * (1.0f / 4095.0f)) b++;
+			start[i] = (ubyte) b;
+		}
+	}
+
+	// The input must be in [0, 1]
+	ubyte encode(const float linear) const {
+		int b = start[int(linear * 4095.0f)];
+		while (thresholds[b] < linear) b++;
+		return (ubyte) b;
+	}
+
+	float toLinear[256];
+	float thresholds[256];
+	ubyte start[4096];
+};
+
+static const SRGBTables &getSRGBTables(){
+	static const SRGBTables tables;
+	return tables;
+}
+
+// State shared by the passes over one level
+struct MipLevelJob {
+	const float *src;
+	float *dest;
+
+	// The top level while building level 1, and the texels of the level being written
+	const ubyte *srcTexels;
+	ubyte *dstTexels;
+
+	FORMAT format;
+	int nChannels;
+	bool srgb[4];
+	bool normalMap;
+	const float *byteToFloat[4];
+
+	int srcWidth, srcHeight, srcDepth;
+	int dstWidth, dstHeight;
+	const FilterTaps *taps;
+
+	// Sums over each row, for the statistics
+	double *rowSums;
+	int *rowClipped;
+	double *rowLengths;
+};
+
+// Rows per job for ranges of about 16K floats
+static inline uint getMinRows(const int width){
+	int rows = 4096 / width;
+	return (rows > 1)? rows : 1;
+}
+
+template <typename DATA_TYPE>
+static void decodeTexels(float *dest, const DATA_TYPE *src, const int width, const int nChannels, const float scale){
+	for (int x = 0; x < width; x++){
+		for (int c = 0; c < nChannels; c++){
+			float v = src[x * nChannels + c] * scale;
+			dest[4 * x + c] = (v < -1.0f)? -1.0f : v;
+		}
+	}
+}
+
+// Converts a row of texels to RGBA floats, unused channels are zero
+static void decodeRow(const MipLevelJob *job, float *dest, const ubyte *texels, const int width, double *sums){
+	FORMAT format = job->format;
+	int nChannels = job->nChannels;
+
+	if (nChannels < 4) memset(dest, 0, width * 4 * sizeof(float));
+
+	if (format <= FORMAT_RGBA8){
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++){
+				dest[4 * x + c] = job->byteToFloat[c][texels[x * nChannels + c]];
+			}
+		}
+	} else if (format <= FORMAT_RGBA16){
+		decodeTexels(dest, (const ushort *) texels, width, nChannels, 1.0f / 65535.0f);
+		for (int c = 0; c < nChannels; c++){
+			if (job->srgb[c]){
+				for (int x = 0; x < width; x++) dest[4 * x + c] = srgbToLinear(dest[4 * x + c]);
+			}
+		}
+	} else if (format <= FORMAT_RGBA8S){
+		decodeTexels(dest, (const signed char *) texels, width, nChannels, 1.0f / 127.0f);
+	} else if (format <= FORMAT_RGBA16S){
+		decodeTexels(dest, (const short *) texels, width, nChannels, 1.0f / 32767.0f);
+	} else if (format <= FORMAT_RGBA16F){
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++) dest[4 * x + c] = ((const half *) texels)[x * nChannels + c];
+		}
+	} else {
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++) dest[4 * x + c] = ((const float *) texels)[x * nChannels + c];
+		}
+	}
+
+	for (int c = 0; c < 4; c++){
+		float sum = 0.0f;
+		for (int x = 0; x < width; x++) sum += dest[4 * x + c];
+		sums[c] = sum;
+	}
+}
+
+template <typename DATA_TYPE>
+static void encodeTexels(DATA_TYPE *dest, const float *src, const int width, const int nChannels, const float scale, double *sums){
+	for (int c = 0; c < nChannels; c++){
+		double sum = 0;
+		for (int x = 0; x < width; x++){
+			float v = src[4 * x + c] * scale;
+			DATA_TYPE t = (DATA_TYPE) (v + ((v < 0)? -0.5f : 0.5f));
+			dest[x * nChannels + c] = t;
+			sum += t;
+		}
+		sums[c] = sum / scale;
+	}
+}
+
+// Renormalizes, clamps and converts a row of filtered floats in place and stores it in the format
+static void encodeRow(const MipLevelJob *job, float *row, ubyte *texels, const int width, double *sums, int &clipped, double &lengths){
+	FORMAT format = job->format;
+	int nChannels = job->nChannels;
+	bool isUnsigned = (format <= FORMAT_RGBA16);
+
+	clipped = 0;
+	lengths = 0;
+	sums[0] = sums[1] = sums[2] = sums[3] = 0;
+
+	if (job->normalMap){
+		for (int x = 0; x < width; x++){
+			float *v = row + 4 * x;
+			if (isUnsigned){
+				for (int c = 0; c < 3; c++) v[c] = 2.0f * v[c] - 1.0f;
+			}
+			float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			lengths += length;
+			if (length > 0){
+				float s = 1.0f / length;
+				for (int c = 0; c < 3; c++) v[c] *= s;
+			}
+			if (isUnsigned){
+				for (int c = 0; c < 3; c++) v[c] = 0.5f * v[c] + 0.5f;
+			}
+		}
+	}
+
+	if (format <= FORMAT_RGBA16S){
+		// Ringing past the last representable step counts as clipped
+		float lo = isUnsigned? 0.0f : -1.0f;
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++){
+				float v = row[4 * x + c];
+				if (v < lo || v > 1.0f){
+					if (v < lo - 0.002f || v > 1.002f) clipped++;
+					row[4 * x + c] = (v < lo)? lo : 1.0f;
+				}
+			}
+		}
+	}
+
+	if (format <= FORMAT_RGBA8){
+		const SRGBTables &tables = getSRGBTables();
+		for (int c = 0; c < nChannels; c++){
+			const float *toFloat = job->byteToFloat[c];
+			float sum = 0.0f;
+			for (int x = 0; x < width; x++){
+				float v = row[4 * x + c];
+				ubyte b = job->srgb[c]? tables.encode(v) : (ubyte) (v * 255.0f + 0.5f);
+				texels[x * nChannels + c] = b;
+				sum += toFloat[b];
+			}
+			sums[c] = sum;
+		}
+	} else if (format <= FORMAT_RGBA16){
+		for (int c = 0; c < nChannels; c++){
+			if (job->srgb[c]){
+				for (int x = 0; x < width; x++) row[4 * x + c] = linearToSrgb(row[4 * x + c]);
+			}
+		}
+		encodeTexels((ushort *) texels, row, width, nChannels, 65535.0f, sums);
+	} else if (format <= FORMAT_RGBA8S){
+		encodeTexels((signed char *) texels, row, width, nChannels, 127.0f, sums);
+	} else if (format <= FORMAT_RGBA16S){
+		encodeTexels((short *) texels, row, width, nChannels, 32767.0f, sums);
+	} else if (format <= FORMAT_RGBA16F){
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++){
+				half h = row[4 * x + c];
+				((half *) texels)[x * nChannels + c] = h;
+				sums[c] += float(h);
+			}
+		}
+	} else {
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++){
+				((float *) texels)[x * nChannels + c] = row[4 * x + c];
+				sums[c] += row[4 * x + c];
+			}
+		}
+	}
+
+	// The statistics compare linear values for sRGB
+	if (format > FORMAT_RGBA8 && format <= FORMAT_RGBA16){
+		for (int c = 0; c < nChannels; c++){
+			if (job->srgb[c]) sums[c] = 0;
+		}
+		for (int x = 0; x < width; x++){
+			for (int c = 0; c < nChannels; c++){
+				if (job->srgb[c]) sums[c] += srgbToLinear(((ushort *) texels)[x * nChannels + c] * (1.0f / 65535.0f));
+			}
+		}
+	}
+}
+
+static void horizontalPass(void *data, const uint start, const uint end){
+	const MipLevelJob *job = (const MipLevelJob *) data;
+	const FilterTaps &taps = *job->taps;
+
+	// The first level reads the texels of the top level
+	float *decoded = NULL;
+	if (job->srcTexels) decoded = new float[job->srcWidth * 4];
+	int texelRowSize = job->srcWidth * getBytesPerPixel(job->format);
+
+	for (uint row = start; row < end; row++){
+		const float *src;
+		if (decoded){
+			decodeRow(job, decoded, job->srcTexels + row * texelRowSize, job->srcWidth, job->rowSums + 4 * row);
+			src = decoded;
+		} else {
+			src = job->src + row * job->srcWidth * 4;
+		}
+		float *dest = job->dest + row * job->dstWidth * 4;
+
+		for (int x = 0; x < job->dstWidth; x++){
+			const float *s = src + taps.first[x] * 4;
+			const float *w = taps.weights + x * taps.maxTaps;
+			int n = taps.count[x];
+#ifdef USE_SSE2
+			__m128 sum = _mm_mul_ps(_mm_loadu_ps(s), _mm_set1_ps(w[0]));
+			for (int k = 1; k < n; k++){
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(s + 4 * k), _mm_set1_ps(w[k])));
+			}
+			_mm_storeu_ps(dest + 4 * x, sum);
+#else
+			for (int c = 0; c < 4; c++){
+				float sum = s[c] * w[0];
+				for (int k = 1; k < n; k++){
+					sum += s[4 * k + c] * w[k];
+				}
+				dest[4 * x + c] = sum;
+			}
+#endif
+		}
+	}
+
+	delete [] decoded;
+}
+
+// Weighted sum of count lines nFloats long and lineStride apart
+static void accumulateLines(float *dest, const float *src, const int lineStride, const float *weights, const int count, const int nFloats){
+#ifdef USE_SSE2
+	for (int i = 0; i < nFloats; i += 4){
+		__m128 sum = _mm_mul_ps(_mm_loadu_ps(src + i), _mm_set1_ps(weights[0]));
+		for (int k = 1; k < count; k++){
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + k * lineStride + i), _mm_set1_ps(weights[k])));
+		}
+		_mm_storeu_ps(dest + i, sum);
+	}
+#else
+	for (int i = 0; i < nFloats; i++){
+		float sum = src[i] * weights[0];
+		for (int k = 1; k < count; k++){
+			sum += src[k * lineStride + i] * weights[k];
+		}
+		dest[i] = sum;
+	}
+#endif
+}
+
+// Rows are numbered over all slices of the destination, which has the depth of the source
+static void verticalPass(void *data, const uint start, const uint end){
+	const MipLevelJob *job = (const MipLevelJob *) data;
+	const FilterTaps &taps = *job->taps;
+	int lineFloats = job->dstWidth * 4;
+
+	for (uint row = start; row < end; row++){
+		int z = row / job->dstHeight;
+		int y = row % job->dstHeight;
+
+		const float *src = job->src + (z * job->srcHeight + taps.first[y]) * lineFloats;
+		accumulateLines(job->dest + row * lineFloats, src, lineFloats, taps.weights + y * taps.maxTaps, taps.count[y], lineFloats);
+	}
+}
+
+static void depthPass(void *data, const uint start, const uint end){
+	const MipLevelJob *job = (const MipLevelJob *) data;
+	const FilterTaps &taps = *job->taps;
+	int lineFloats = job->dstWidth * 4;
+	int sliceFloats = job->dstHeight * lineFloats;
+
+	for (uint row = start; row < end; row++){
+		int z = row / job->dstHeight;
+		int y = row % job->dstHeight;
+
+		const float *src = job->src + taps.first[z] * sliceFloats + y * lineFloats;
+		accumulateLines(job->dest + row * lineFloats, src, sliceFloats, taps.weights + z * taps.maxTaps, taps.count[z], lineFloats);
+	}
+}
+
+// Stores rows of the filtered level, which stay as they are for filtering the next one
+static void writePass(void *data, const uint start, const uint end){
+	const MipLevelJob *job = (const MipLevelJob *) data;
+	int width = job->dstWidth;
+	int texelRowSize = width * getBytesPerPixel(job->format);
+
+	float *row = new float[width * 4];
+	for (uint r = start; r < end; r++){
+		memcpy(row, job->src + r * width * 4, width * 4 * sizeof(float));
+		encodeRow(job, row, job->dstTexels + r * texelRowSize, width, job->rowSums + 4 * r, job->rowClipped[r], job->rowLengths[r]);
+	}
+	delete [] row;
+}
+
+// Box filtering of 8-bit power of two levels, which averages the stored bytes without going through floats
+static void byteBoxPass(void *data, const uint start, const uint end){
+	const MipLevelJob *job = (const MipLevelJob *) data;
+	int nChannels = job->nChannels;
+	int w = job->srcWidth;
+	int h = job->srcHeight;
+	int d = job->srcDepth;
+	int dw = job->dstWidth;
+	int dh = job->dstHeight;
+
+	int xOff = (w < 2)? 0 : nChannels;
+	int yOff = (h < 2)? 0 : nChannels * w;
+	int zOff = (d < 2)? 0 : nChannels * w * h;
+
+	for (uint row = start; row < end; row++){
+		int z = row / dh;
+		int y = row % dh;
+
+		const ubyte *src = job->srcTexels + (((z << 1) * h + (y << 1)) * w) * nChannels;
+		ubyte *dest = job->dstTexels + row * dw * nChannels;
+		int x = 0;
+
+#ifdef USE_SSE2
+		if (nChannels == 4 && xOff && yOff && !zOff){
+			// Four pixels from each of two rows to two output pixels
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i one = _mm_set1_epi16(1);
+			for (; x + 4 <= dw; x += 4){
+				__m128i r0 = _mm_loadu_si128((const __m128i *) (src + 8 * x));
+				__m128i r1 = _mm_loadu_si128((const __m128i *) (src + 8 * x + yOff));
+				__m128i r2 = _mm_loadu_si128((const __m128i *) (src + 8 * x + 16));
+				__m128i r3 = _mm_loadu_si128((const __m128i *) (src + 8 * x + yOff + 16));
+
+				__m128i a = _mm_add_epi16(_mm_unpacklo_epi8(r0, zero), _mm_unpacklo_epi8(r1, zero));
+				__m128i b = _mm_add_epi16(_mm_unpackhi_epi8(r0, zero), _mm_unpackhi_epi8(r1, zero));
+				__m128i c = _mm_add_epi16(_mm_unpacklo_epi8(r2, zero), _mm_unpacklo_epi8(r3, zero));
+				__m128i e = _mm_add_epi16(_mm_unpackhi_epi8(r2, zero), _mm_unpackhi_epi8(r3, zero));
+
+				// Sum neighboring pixels, which sit in the two halves of each register
+				__m128i p01 = _mm_unpacklo_epi64(_mm_add_epi16(a, _mm_srli_si128(a, 8)), _mm_add_epi16(b, _mm_srli_si128(b, 8)));
+				__m128i p23 = _mm_unpacklo_epi64(_mm_add_epi16(c, _mm_srli_si128(c, 8)), _mm_add_epi16(e, _mm_srli_si128(e, 8)));
+
+				// Ties round to even so that the levels don't drift
+				p01 = _mm_add_epi16(p01, _mm_add_epi16(one, _mm_and_si128(_mm_srli_epi16(p01, 2), one)));
+				p23 = _mm_add_epi16(p23, _mm_add_epi16(one, _mm_and_si128(_mm_srli_epi16(p23, 2), one)));
+				p01 = _mm_srli_epi16(p01, 2);
+				p23 = _mm_srli_epi16(p23, 2);
+				_mm_storeu_si128((__m128i *) (dest + 4 * x), _mm_packus_epi16(p01, p23));
+			}
+		}
+#endif
+		src += x * 2 * nChannels;
+		for (; x < dw; x++){
+			for (int c = 0; c < nChannels; c++){
+				int sum = src[0] + src[xOff] + src[yOff] + src[yOff + xOff] + src[zOff] + src[zOff + xOff] + src[zOff + yOff] + src[zOff + yOff + xOff];
+				dest[x * nChannels + c] = (ubyte) ((sum + 3 + ((sum >> 3) & 1)) >> 3);
+				src++;
+			}
+			src += xOff;
+		}
+
+		double *sums = job->rowSums + 4 * row;
+		for (int c = 0; c < 4; c++){
+			int sum = 0;
+			if (c < nChannels){
+				for (int i = 0; i < dw; i++) sum += dest[i * nChannels + c];
+			}
+			sums[c] = sum * (1.0 / 255.0);
+		}
+		job->rowClipped[row] = 0;
+		job->rowLengths[row] = 0;
+	}
+}
+
+void buildMipChain(ubyte **levels, const FORMAT format, const int width, const int height, const int depth, const int nMipMaps, const int filter, const uint flags, MipMapStats *stats){
+	int nChannels = getChannelCount(format);
+
+	MipLevelJob job;
+	job.format = format;
+	job.nChannels = nChannels;
+	job.normalMap = (flags & MIPMAP_NORMALMAP) && nChannels >= 3;
+
+	// Normal maps and signed or float data are linear already. Alpha and the second channel of two channel formats are never sRGB.
+	bool srgb = (flags & MIPMAP_SRGB) && !(flags & MIPMAP_NORMALMAP) && format <= FORMAT_RGBA16;
+
+	float linearBytes[256];
+	for (int i = 0; i < 256; i++) linearBytes[i] = i * (1.0f / 255.0f);
+
+	for (int c = 0; c < 4; c++){
+		job.srgb[c] = srgb && c < ((nChannels == 2)? 1 : 3);
+		job.byteToFloat[c] = job.srgb[c]? getSRGBTables().toLinear : linearBytes;
+	}
+
+	// Plain box filtering of 8-bit power of two surfaces stays in bytes
+	bool byteBox = (filter == MIPMAP_BOX && !srgb && !job.normalMap && format <= FORMAT_RGBA8 && isPowerOf2(width) && isPowerOf2(height) && isPowerOf2(depth));
+
+	int maxRows = height * depth;
+	job.rowSums = new double[4 * maxRows];
+	job.rowClipped = new int[maxRows];
+	job.rowLengths = new double[maxRows];
+
+	// Level 1 is the largest output of each pass. The next levels read the last filtered floats, which each pass is done with before they get overwritten.
+	int w1 = (width  > 1)? width  >> 1 : 1;
+	int h1 = (height > 1)? height >> 1 : 1;
+	int d1 = (depth  > 1)? depth  >> 1 : 1;
+	float *horizontal = NULL, *vertical = NULL, *deep = NULL;
+	if (!byteBox){
+		horizontal = new float[w1 * height * depth * 4];
+		vertical = new float[w1 * h1 * depth * 4];
+		if (depth > 1) deep = new float[w1 * h1 * d1 * 4];
+	}
+	const float *current = NULL;
+
+	double topMean[4] = { 0, 0, 0, 0 };
+	if (stats){
+		memset(stats, 0, nMipMaps * sizeof(MipMapStats));
+
+		// The float passes get the top level's sums from decoding it
+		if (byteBox){
+			int nTexels = width * height * depth;
+			for (int c = 0; c < nChannels; c++){
+				uint64 sum = 0;
+				for (int i = 0; i < nTexels; i++) sum += levels[0][i * nChannels + c];
+				topMean[c] = sum / (255.0 * nTexels);
+			}
+		}
+	}
+
+	timestamp startTime = getCurrentTime();
+
+	int w = width, h = height, d = depth;
+	for (int level = 1; level < nMipMaps; level++){
+		int dw = (w > 1)? w >> 1 : 1;
+		int dh = (h > 1)? h >> 1 : 1;
+		int dd = (d > 1)? d >> 1 : 1;
+
+		job.srcWidth  = w;
+		job.srcHeight = h;
+		job.srcDepth  = d;
+		job.dstWidth  = dw;
+		job.dstHeight = dh;
+
+		if (byteBox){
+			job.srcTexels = levels[level - 1];
+			job.dstTexels = levels[level];
+			parallelFor(byteBoxPass, &job, dh * dd, getMinRows(dw));
+		} else {
+			// Width, then height, then depth, each pass shrinking the data for the next
+			FilterTaps xTaps(w, dw, filter);
+			job.srcTexels = (level == 1)? levels[0] : NULL;
+			job.src = current;
+			job.dest = horizontal;
+			job.taps = &xTaps;
+			parallelFor(horizontalPass, &job, h * d, getMinRows(w));
+
+			if (level == 1){
+				for (int row = 0; row < h * d; row++){
+					for (int c = 0; c < 4; c++) topMean[c] += job.rowSums[4 * row + c];
+				}
+				for (int c = 0; c < 4; c++) topMean[c] /= double(w) * h * d;
+			}
+
+			FilterTaps yTaps(h, dh, filter);
+			job.src = horizontal;
+			job.dest = vertical;
+			job.taps = &yTaps;
+			parallelFor(verticalPass, &job, dh * d, getMinRows(dw));
+			current = vertical;
+
+			if (d > 1){
+				FilterTaps zTaps(d, dd, filter);
+				job.src = vertical;
+				job.dest = deep;
+				job.taps = &zTaps;
+				parallelFor(depthPass, &job, dh * dd, getMinRows(dw));
+				current = deep;
+			}
+
+			job.src = current;
+			job.dstTexels = levels[level];
+			parallelFor(writePass, &job, dh * dd, getMinRows(dw));
+		}
+
+		w = dw;
+		h = dh;
+		d = dd;
+
+		if (!stats) continue;
+
+		int rows = dh * dd;
+		double mean[4] = { 0, 0, 0, 0 };
+		double clipped = 0, lengths = 0;
+		for (int row = 0; row < rows; row++){
+			for (int c = 0; c < 4; c++) mean[c] += job.rowSums[4 * row + c];
+			clipped += job.rowClipped[row];
+			lengths += job.rowLengths[row];
+		}
+
+		double nTexels = double(dw) * dh * dd;
+		float drift = 0;
+		for (int c = 0; c < nChannels; c++){
+			float diff = (float) fabs(mean[c] / nTexels - topMean[c]);
+			if (diff > drift) drift = diff;
+		}
+
+		timestamp endTime = getCurrentTime();
+		stats[level].time = getTimeDifference(startTime, endTime);
+		stats[level].drift = drift;
+		stats[level].clipped = float(clipped / (nTexels * nChannels));
+		stats[level].normalLength = job.normalMap? float(lengths / nTexels) : 0.0f;
+		startTime = endTime;
+	}
+
+	delete [] horizontal;
+	delete [] vertical;
+	delete [] deep;
+	delete [] job.rowSums;
+	delete [] job.rowClipped;
+	delete [] job.rowLengths;
+}
@@ -0,0 +1,48 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _MIPFILTER_H_
+#define _MIPFILTER_H_
+
+#include "Image.h"
+
+/*
+	Mipmap filtering for the plain unsigned, signed and float formats. The top level is converted to RGBA floats
+	once and each level is filtered from the unrounded floats of the one above it, so rounding doesn't accumulate
+	down the chain. Levels are max(size >> 1, 1) in each dimension, also for sizes that aren't powers of two, and
+	the kernels are scaled to the actual ratio between the levels. Edges are clamped.
+
+	MIPMAP_BOX averages the area each texel covers. For 8-bit power of two surfaces without flags it instead averages
+	the stored bytes of the level above with rounding, which is much faster and differs by at most a step.
+	MIPMAP_KAISER and MIPMAP_LANCZOS are windowed sinc kernels three texels wide that keep more detail but can ring,
+	which is clamped to the format's range.
+*/
+
+// Returns whether buildMipChain() handles the format
+inline bool canFilterMipMaps(const FORMAT format){
+	return (format >= FORMAT_R8 && format <= FORMAT_RGBA32F);
+}
+
+// Fills levels 1 to nMipMaps - 1 of one surface from level 0. Each entry in levels points to that level's texels.
+// If stats isn't NULL, it receives one entry per level. Rows are spread across the job system.
+void buildMipChain(ubyte **levels, const FORMAT format, const int width, const int height, const int depth, const int nMipMaps, const int filter, const uint flags, MipMapStats *stats);
+
+#endif // _MIPFILTER_H_
@@ -0,0 +1,360 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Morphology.h"
+#include "../Util/Array.h"
+#include "../Util/JobSystem.h"
+
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+struct MorphBand {
+	int surface;
+	int firstRow, lastRow;
+};
+
+// Bands of rows, large enough that handing them out is negligible
+static void getMorphBands(Array <MorphBand> &bands, const MorphSurface *surfaces, const int nSurfaces, const int bpp){
+	for (int i = 0; i < nSurfaces; i++){
+		int h = surfaces[i].height;
+
+		int rowsPerBand = 64 * 1024 / (surfaces[i].width * bpp);
+		if (rowsPerBand < 16) rowsPerBand = 16;
+
+		MorphBand band;
+		band.surface = i;
+		for (int y = 0; y < h; y += rowsPerBand){
+			band.firstRow = y;
+			band.lastRow = (y + rowsPerBand < h)? y + rowsPerBand : h;
+			bands.add(band);
+		}
+	}
+}
+
+template <bool DILATE>
+static inline ubyte morph(const ubyte a, const ubyte b){
+	return DILATE? ((a > b)? a : b) : ((a < b)? a : b);
+}
+
+#ifdef USE_SSE2
+template <bool DILATE>
+static inline __m128i morph(const __m128i a, const __m128i b){
+	return DILATE? _mm_max_epu8(a, b) : _mm_min_epu8(a, b);
+}
+#endif
+
+// One three texel step along a row of size bytes
+template <bool DILATE>
+static void morphRow(ubyte *dest, const ubyte *src, const int size, const int nChannels){
+	if (size == nChannels){
+		memcpy(dest, src, size);
+		return;
+	}
+
+	// The texels at the ends have a neighbour on one side only
+	int last = size - nChannels;
+	for (int c = 0; c < nChannels; c++){
+		dest[c] = morph <DILATE> (src[c], src[c + nChannels]);
+		dest[last + c] = morph <DILATE> (src[last + c], src[last - nChannels + c]);
+	}
+
+	int i = nChannels;
+#ifdef USE_SSE2
+	for (; i + 16 <= last; i += 16){
+		__m128i l = _mm_loadu_si128((const __m128i *) (src + i - nChannels));
+		__m128i m = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i r = _mm_loadu_si128((const __m128i *) (src + i + nChannels));
+		_mm_storeu_si128((__m128i *) (dest + i), morph <DILATE> (morph <DILATE> (l, m), r));
+	}
+#endif
+	for (; i < last; i++){
+		dest[i] = morph <DILATE> (morph <DILATE> (src[i - nChannels], src[i]), src[i + nChannels]);
+	}
+}
+
+// Merges a row into the destination row
+template <bool DILATE>
+static void morphRows(ubyte *dest, const ubyte *src, const int size){
+	int i = 0;
+#ifdef USE_SSE2
+	for (; i + 16 <= size; i += 16){
+		__m128i d = _mm_loadu_si128((const __m128i *) (dest + i));
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + i));
+		_mm_storeu_si128((__m128i *) (dest + i), morph <DILATE> (d, s));
+	}
+#endif
+	for (; i < size; i++){
+		dest[i] = morph <DILATE> (dest[i], src[i]);
+	}
+}
+
+struct MorphJob {
+	const MorphSurface *surfaces;
+	const MorphBand *bands;
+	// Where the horizontal pass leaves each surface
+	ubyte **temps;
+	int nChannels;
+	int maxRowSize;
+	int iterations;
+};
+
+template <bool DILATE>
+static void morphBandsX(void *data, const uint start, const uint end){
+	MorphJob *job = (MorphJob *) data;
+
+	// The steps go back and forth between two rows, with the last one written to the destination
+	ubyte *rows = (job->iterations > 1)? new ubyte[2 * job->maxRowSize] : NULL;
+
+	for (uint b = start; b < end; b++){
+		const MorphBand &band = job->bands[b];
+		const MorphSurface &surface = job->surfaces[band.surface];
+		int rowSize = surface.width * job->nChannels;
+
+		for (int y = band.firstRow; y < band.lastRow; y++){
+			const ubyte *src = surface.pixels + y * rowSize;
+			ubyte *dest = job->temps[band.surface] + y * rowSize;
+
+			for (int i = 0; i < job->iterations; i++){
+				ubyte *to = (i == job->iterations - 1)? dest : rows + (i & 1) * job->maxRowSize;
+				morphRow <DILATE> (to, src, rowSize, job->nChannels);
+				src = to;
+			}
+		}
+	}
+
+	delete [] rows;
+}
+
+template <bool DILATE>
+static void morphBandsY(void *data, const uint start, const uint end){
+	MorphJob *job = (MorphJob *) data;
+
+	for (uint b = start; b < end; b++){
+		const MorphBand &band = job->bands[b];
+		const MorphSurface &surface = job->surfaces[band.surface];
+		int rowSize = surface.width * job->nChannels;
+		const ubyte *temp = job->temps[band.surface];
+
+		for (int y = band.firstRow; y < band.lastRow; y++){
+			int first = (y - job->iterations > 0)? y - job->iterations : 0;
+			int last  = (y + job->iterations < surface.height)? y + job->iterations : surface.height - 1;
+
+			ubyte *dest = surface.pixels + y * rowSize;
+			memcpy(dest, temp + first * rowSize, rowSize);
+			for (int r = first + 1; r <= last; r++){
+				morphRows <DILATE> (dest, temp + r * rowSize, rowSize);
+			}
+		}
+	}
+}
+
+void morphSurfaces(const MorphSurface *surfaces, const int nSurfaces, const FORMAT format, const int iterations, const bool dilate){
+	if (iterations <= 0 || nSurfaces <= 0) return;
+
+	MorphJob job;
+	job.surfaces = surfaces;
+	job.nChannels = getChannelCount(format);
+	job.maxRowSize = 0;
+	job.iterations = iterations;
+
+	int size = 0;
+	for (int i = 0; i < nSurfaces; i++){
+		int rowSize = surfaces[i].width * job.nChannels;
+		if (rowSize > job.maxRowSize) job.maxRowSize = rowSize;
+		size += rowSize * surfaces[i].height;
+	}
+
+	ubyte *temp = new ubyte[size];
+	job.temps = new ubyte *[nSurfaces];
+	for (int i = 0, offset = 0; i < nSurfaces; i++){
+		job.temps[i] = temp + offset;
+		offset += surfaces[i].width * job.nChannels * surfaces[i].height;
+	}
+
+	Array <MorphBand> bands;
+	getMorphBands(bands, surfaces, nSurfaces, job.nChannels);
+	job.bands = bands.getArray();
+
+	// The vertical pass needs the rows around each band, so all of the horizontal pass has to be done first
+	parallelFor(dilate? morphBandsX <true> : morphBandsX <false>, &job, bands.getCount(), 1);
+	parallelFor(dilate? morphBandsY <true> : morphBandsY <false>, &job, bands.getCount(), 1);
+
+	delete [] temp;
+	delete [] job.temps;
+}
+
+struct CoverageJob {
+	const MorphSurface *surfaces;
+	const MorphBand *bands;
+	// One byte per texel, 0xFF where covered
+	ubyte **cover;
+	ubyte **newCover;
+	ubyte minAlpha;
+	std::atomic <bool> filled;
+};
+
+static void initCoverage(void *data, const uint start, const uint end){
+	CoverageJob *job = (CoverageJob *) data;
+
+	for (uint b = start; b < end; b++){
+		const MorphBand &band = job->bands[b];
+		const MorphSurface &surface = job->surfaces[band.surface];
+
+		int first = band.firstRow * surface.width;
+		int last  = band.lastRow  * surface.width;
+
+		const ubyte *src = surface.pixels;
+		ubyte *cover = job->cover[band.surface];
+		for (int i = first; i < last; i++){
+			cover[i] = (src[4 * i + 3] >= job->minAlpha)? 0xFF : 0;
+		}
+	}
+}
+
+static void padBands(void *data, const uint start, const uint end){
+	CoverageJob *job = (CoverageJob *) data;
+
+	bool filled = false;
+	for (uint b = start; b < end; b++){
+		const MorphBand &band = job->bands[b];
+		const MorphSurface &surface = job->surfaces[band.surface];
+		int w = surface.width;
+		int h = surface.height;
+		const ubyte *cover = job->cover[band.surface];
+
+		for (int y = band.firstRow; y < band.lastRow; y++){
+			int firstRow = (y > 0)? y - 1 : 0;
+			int lastRow  = (y < h - 1)? y + 1 : h - 1;
+
+			const ubyte *coverRow = cover + y * w;
+			ubyte *newCoverRow = job->newCover[band.surface] + y * w;
+			ubyte *dest = surface.pixels + 4 * y * w;
+
+			int x = 0;
+			while (x < w){
+#ifdef USE_SSE2
+				// Runs of 16 texels that are all covered, or that have nothing covered around them, stay as they are
+				if (x > 0 && x + 17 <= w){
+					__m128i zero = _mm_setzero_si128();
+					__m128i c = _mm_loadu_si128((const __m128i *) (coverRow + x));
+					if (_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)) == 0){
+						_mm_storeu_si128((__m128i *) (newCoverRow + x), c);
+						x += 16;
+						continue;
+					}
+
+					__m128i around = zero;
+					for (int r = firstRow; r <= lastRow; r++){
+						const ubyte *row = cover + r * w + x;
+						around = _mm_or_si128(around, _mm_loadu_si128((const __m128i *) (row - 1)));
+						around = _mm_or_si128(around, _mm_loadu_si128((const __m128i *) (row)));
+						around = _mm_or_si128(around, _mm_loadu_si128((const __m128i *) (row + 1)));
+					}
+					if (_mm_movemask_epi8(_mm_cmpeq_epi8(around, zero)) == 0xFFFF){
+						_mm_storeu_si128((__m128i *) (newCoverRow + x), zero);
+						x += 16;
+						continue;
+					}
+				}
+#endif
+				if (coverRow[x]){
+					newCoverRow[x] = 0xFF;
+				} else {
+					int firstX = (x > 0)? x - 1 : 0;
+					int lastX  = (x < w - 1)? x + 1 : w - 1;
+
+					// Only covered texels are read and only uncovered ones are written, so the bands don't disturb each other
+					uint r = 0, g = 0, b = 0, count = 0;
+					for (int iy = firstRow; iy <= lastRow; iy++){
+						for (int ix = firstX; ix <= lastX; ix++){
+							if (cover[iy * w + ix]){
+								const ubyte *src = surface.pixels + 4 * (iy * w + ix);
+								r += src[0];
+								g += src[1];
+								b += src[2];
+								count++;
+							}
+						}
+					}
+
+					if (count){
+						dest[4 * x + 0] = (r + count / 2) / count;
+						dest[4 * x + 1] = (g + count / 2) / count;
+						dest[4 * x + 2] = (b + count / 2) / count;
+						newCoverRow[x] = 0xFF;
+						filled = true;
+					} else {
+						newCoverRow[x] = 0;
+					}
+				}
+				x++;
+			}
+		}
+	}
+
+	if (filled) job->filled = true;
+}
+
+void dilateCoverage(const MorphSurface *surfaces, const int nSurfaces, const int iterations, const ubyte minAlpha){
+	if (iterations <= 0) return;
+
+	CoverageJob job;
+	job.surfaces = surfaces;
+	job.minAlpha = minAlpha;
+
+	int size = 0;
+	for (int i = 0; i < nSurfaces; i++){
+		size += surfaces[i].width * surfaces[i].height;
+	}
+
+	ubyte *masks = new ubyte[2 * size];
+	job.cover = new ubyte *[nSurfaces];
+	job.newCover = new ubyte *[nSurfaces];
+	for (int i = 0, offset = 0; i < nSurfaces; i++){
+		job.cover[i] = masks + offset;
+		job.newCover[i] = masks + size + offset;
+		offset += surfaces[i].width * surfaces[i].height;
+	}
+
+	Array <MorphBand> bands;
+	getMorphBands(bands, surfaces, nSurfaces, 4);
+	job.bands = bands.getArray();
+
+	parallelFor(initCoverage, &job, bands.getCount(), 1);
+
+	for (int i = 0; i < iterations; i++){
+		job.filled = false;
+		parallelFor(padBands, &job, bands.getCount(), 1);
+		if (!job.filled) break;
+
+		ubyte **cover = job.cover;
+		job.cover = job.newCover;
+		job.newCover = cover;
+	}
+
+	delete [] masks;
+	delete [] job.cover;
+	delete [] job.newCover;
+}
@@ -0,0 +1,54 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _MORPHOLOGY_H_
+#define _MORPHOLOGY_H_
+
+#include "Image.h"
+
+/*
+	Dilation and erosion of 8-bit unsigned images, per channel. An iteration replaces each texel with the max or min
+	of the 3x3 texels around it, clamped at the edges of the surface. The max or min over a square is the max or min
+	along the columns of the max or min along the rows, so n iterations run as n three texel steps within each row
+	followed by a single pass over the 2n + 1 rows around each row, 16 bytes at a time.
+
+	Coverage dilation pads the charts of RGBA8 atlases so that mipmapping doesn't bleed the empty space around them
+	into their edges. Each iteration gives every uncovered texel, one with alpha below minAlpha, the average color of
+	the covered texels among the 3x3 around it, after which it counts as covered. Alpha is left as it is.
+*/
+
+// Returns whether morphSurfaces() handles the format
+inline bool canMorphFormat(const FORMAT format){
+	return (format >= FORMAT_R8 && format <= FORMAT_RGBA8);
+}
+
+struct MorphSurface {
+	ubyte *pixels;
+	int width, height;
+};
+
+// Dilates or erodes each surface in place. All rows of all surfaces are spread across the job system together.
+void morphSurfaces(const MorphSurface *surfaces, const int nSurfaces, const FORMAT format, const int iterations, const bool dilate);
+
+// Pads the covered texels of each RGBA8 surface in place by one texel per iteration
+void dilateCoverage(const MorphSurface *surfaces, const int nSurfaces, const int iterations, const ubyte minAlpha);
+
+#endif // _MORPHOLOGY_H_
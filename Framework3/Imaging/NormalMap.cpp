@@ -0,0 +1,428 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "NormalMap.h"
+#include "BlockCompress.h"
+#include "../Util/Array.h"
+#include "../Util/JobSystem.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Where the x, y, z and height values go in a destination pixel
+struct NormalLayout {
+	uint mask[4];
+	uint shift[4];
+	uint hFactor;
+	int bpp;
+	float bias;
+};
+
+static bool getNormalLayout(NormalLayout &layout, const FORMAT destFormat){
+	memset(&layout, 0, sizeof(layout));
+	layout.hFactor = 1;
+
+	switch (destFormat){
+		case FORMAT_RG8:
+		case FORMAT_RG8S:
+		case FORMAT_ATI2N:
+			layout.mask[0] = layout.mask[1] = 0xFF;
+			layout.shift[0] = 8;
+			break;
+		case FORMAT_RGB565:
+			layout.mask[0] = layout.mask[2] = 0x1F;
+			layout.mask[1] = 0x3F;
+			layout.shift[0] = 11;
+			layout.shift[1] = 5;
+			break;
+		case FORMAT_RGBA4:
+			layout.mask[0] = layout.mask[1] = layout.mask[2] = layout.mask[3] = 0xF;
+			layout.shift[1] = 4;
+			layout.shift[2] = 8;
+			layout.shift[3] = 12;
+			break;
+		case FORMAT_RGBA8:
+		case FORMAT_RGBA8S:
+			layout.mask[0] = layout.mask[1] = layout.mask[2] = layout.mask[3] = 0xFF;
+			layout.shift[1] = 8;
+			layout.shift[2] = 16;
+			layout.shift[3] = 24;
+			break;
+		case FORMAT_RGB10A2:
+			layout.mask[0] = layout.mask[1] = layout.mask[2] = 0x3FF;
+			layout.mask[3] = 0x03;
+			layout.shift[1] = 10;
+			layout.shift[2] = 20;
+			layout.shift[3] = 30;
+			break;
+		case FORMAT_RGBA16:
+		case FORMAT_RGBA16S:
+			layout.mask[0] = layout.mask[1] = layout.mask[2] = layout.mask[3] = 0xFFFF;
+			layout.shift[1] = 16;
+			layout.shift[2] = 32;
+			layout.shift[3] = 48;
+			layout.hFactor = 257;
+			break;
+		default:
+			return false;
+	}
+
+	// ATI2N is built as RG8 and compressed afterwards
+	layout.bpp = (destFormat == FORMAT_ATI2N)? 2 : getBytesPerPixel(destFormat);
+	layout.bias = isSignedFormat(destFormat)? 0.0f : 1.0f;
+
+	return true;
+}
+
+bool canBuildNormalMap(const FORMAT srcFormat, const FORMAT destFormat){
+	if (srcFormat != FORMAT_I8 && srcFormat != FORMAT_R8 && srcFormat != FORMAT_RGB8 && srcFormat != FORMAT_RGBA8) return false;
+
+	NormalLayout layout;
+	return getNormalLayout(layout, destFormat);
+}
+
+struct NormalBand {
+	int surface;
+	int firstRow, lastRow;
+};
+
+struct NormalMapJob {
+	const NormalMapSurface *surfaces;
+	const NormalBand *bands;
+	int nChannels;
+	int maxWidth;
+	NormalLayout layout;
+};
+
+static inline int wrap(const int i, const int n){
+	int r = i % n;
+	return (r < 0)? r + n : r;
+}
+
+// Fills row with the heights of columns -2 to width + 1, wrapped around
+static void fetchHeights(short *row, const ubyte *src, const int width, const int nChannels){
+	short *dest = row + 2;
+	if (nChannels == 1){
+		int x = 0;
+#ifdef USE_SSE2
+		__m128i zero = _mm_setzero_si128();
+		for (; x + 8 <= width; x += 8){
+			__m128i h = _mm_loadl_epi64((const __m128i *) (src + x));
+			_mm_storeu_si128((__m128i *) (dest + x), _mm_unpacklo_epi8(h, zero));
+		}
+#endif
+		for (; x < width; x++){
+			dest[x] = src[x];
+		}
+	} else {
+		// Same luminance as Image::toGrayScale()
+		for (int x = 0; x < width; x++){
+			dest[x] = (77 * src[0] + 151 * src[1] + 28 * src[2] + 128) >> 8;
+			src += nChannels;
+		}
+	}
+
+	row[0] = dest[wrap(-2, width)];
+	row[1] = dest[wrap(-1, width)];
+	row[width + 2] = dest[wrap(width,     width)];
+	row[width + 3] = dest[wrap(width + 1, width)];
+}
+
+static inline uint64 packNormal(const NormalLayout &layout, const int iX, const int iY, const int h, const float sZ){
+	float sX = iX * (1.0f / (48 * 255));
+	float sY = iY * (1.0f / (48 * 255));
+
+	// Normalize and scale into the range of the format
+	float invLen = 1.0f / sqrtf(sX * sX + sY * sY + sZ * sZ);
+	float rX = (0.5f * layout.mask[0]) * (sX * invLen + layout.bias);
+	float rY = (0.5f * layout.mask[1]) * (sY * invLen + layout.bias);
+	float rZ = (0.5f * layout.mask[2]) * (sZ * invLen + layout.bias);
+
+	uint64 result = 0;
+	result |= uint64(int(rX) & layout.mask[0]) << layout.shift[0];
+	result |= uint64(int(rY) & layout.mask[1]) << layout.shift[1];
+	result |= uint64(int(rZ) & layout.mask[2]) << layout.shift[2];
+	result |= uint64((h * layout.hFactor) & layout.mask[3]) << layout.shift[3];
+
+	return result;
+}
+
+static inline void storePixel(ubyte *dest, const int bpp, const uint64 pixel){
+	if (bpp == 2){
+		*(ushort *) dest = (ushort) pixel;
+	} else if (bpp == 4){
+		*(uint32 *) dest = (uint32) pixel;
+	} else {
+		*(uint64 *) dest = pixel;
+	}
+}
+
+#ifdef USE_SSE2
+
+// Packs four normals from the filtered slopes and heights, same math as packNormal()
+struct NormalPacker {
+	__m128 invScale, sZ, sZ2, factor[3], bias;
+	__m128i mask[4], shift[4], hFactor;
+	bool high[4];
+
+	NormalPacker(const NormalLayout &layout, const float z){
+		invScale = _mm_set1_ps(1.0f / (48 * 255));
+		sZ  = _mm_set1_ps(z);
+		sZ2 = _mm_set1_ps(z * z);
+		for (int i = 0; i < 3; i++){
+			factor[i] = _mm_set1_ps(0.5f * layout.mask[i]);
+		}
+		bias = _mm_set1_ps(layout.bias);
+		for (int i = 0; i < 4; i++){
+			mask[i] = _mm_set1_epi32(layout.mask[i]);
+			high[i] = (layout.shift[i] >= 32);
+			shift[i] = _mm_cvtsi32_si128(layout.shift[i] & 31);
+		}
+		hFactor = _mm_set1_epi16((short) layout.hFactor);
+	}
+
+	// Returns the low and high 32 bits of each pixel
+	void pack(__m128i &lo, __m128i &hi, const __m128i iX, const __m128i iY, const __m128i h) const {
+		__m128 sX = _mm_mul_ps(_mm_cvtepi32_ps(iX), invScale);
+		__m128 sY = _mm_mul_ps(_mm_cvtepi32_ps(iY), invScale);
+
+		__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, sX), _mm_mul_ps(sY, sY)), sZ2);
+		__m128 invLen = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lenSq));
+
+		__m128i c[4];
+		c[0] = _mm_cvttps_epi32(_mm_mul_ps(factor[0], _mm_add_ps(_mm_mul_ps(sX, invLen), bias)));
+		c[1] = _mm_cvttps_epi32(_mm_mul_ps(factor[1], _mm_add_ps(_mm_mul_ps(sY, invLen), bias)));
+		c[2] = _mm_cvttps_epi32(_mm_mul_ps(factor[2], _mm_add_ps(_mm_mul_ps(sZ, invLen), bias)));
+		c[3] = h;
+
+		lo = _mm_setzero_si128();
+		hi = _mm_setzero_si128();
+		for (int i = 0; i < 4; i++){
+			__m128i v = _mm_sll_epi32(_mm_and_si128(c[i], mask[i]), shift[i]);
+			if (high[i]){
+				hi = _mm_or_si128(hi, v);
+			} else {
+				lo = _mm_or_si128(lo, v);
+			}
+		}
+	}
+};
+
+static inline void storePixels(ubyte *dest, const int bpp, const __m128i lo, const __m128i hi){
+	if (bpp == 2){
+		// Sign extend so the saturating pack keeps all 16 bits
+		__m128i v = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+		_mm_storel_epi64((__m128i *) dest, _mm_packs_epi32(v, v));
+	} else if (bpp == 4){
+		_mm_storeu_si128((__m128i *) dest, lo);
+	} else {
+		_mm_storeu_si128((__m128i *) dest,        _mm_unpacklo_epi32(lo, hi));
+		_mm_storeu_si128((__m128i *) (dest + 16), _mm_unpackhi_epi32(lo, hi));
+	}
+}
+
+#endif // USE_SSE2
+
+static void normalMapBands(void *data, const uint start, const uint end){
+	NormalMapJob *job = (NormalMapJob *) data;
+	const NormalLayout &layout = job->layout;
+
+	// Five height rows, the vertically filtered rows and the slopes, with room for whole vectors past the end
+	int rowSize = ((job->maxWidth + 7) & ~7) + 8;
+	short *buffer = new short[9 * rowSize];
+	memset(buffer, 0, 9 * rowSize * sizeof(short));
+
+	short *smoothed = buffer + 5 * rowSize;
+	short *derived  = buffer + 6 * rowSize;
+	short *slopesX  = buffer + 7 * rowSize;
+	short *slopesY  = buffer + 8 * rowSize;
+
+	for (uint b = start; b < end; b++){
+		const NormalBand &band = job->bands[b];
+		const NormalMapSurface &surface = job->surfaces[band.surface];
+
+		int w = surface.width;
+		int h = surface.height;
+		int srcPitch = w * job->nChannels;
+		int destPitch = w * layout.bpp;
+		int nFiltered = (w + 7) & ~7;
+
+		short *rows[5];
+		for (int i = 0; i < 5; i++){
+			rows[i] = buffer + i * rowSize;
+			fetchHeights(rows[i], surface.src + wrap(band.firstRow + i - 2, h) * srcPitch, w, job->nChannels);
+		}
+
+#ifdef USE_SSE2
+		NormalPacker packer(layout, surface.sZ);
+#endif
+
+		for (int y = band.firstRow; y < band.lastRow; y++){
+			if (y > band.firstRow){
+				short *first = rows[0];
+				for (int i = 0; i < 4; i++) rows[i] = rows[i + 1];
+				rows[4] = first;
+				fetchHeights(rows[4], surface.src + wrap(y + 2, h) * srcPitch, w, job->nChannels);
+			}
+
+			// Vertical pass, [1 4 6 4 1] for the x slopes and [1 2 0 -2 -1] for the y slopes. Sums fit in 16 bits.
+			int x = 0;
+#ifdef USE_SSE2
+			for (; x < nFiltered + 4; x += 8){
+				__m128i r0 = _mm_loadu_si128((const __m128i *) (rows[0] + x));
+				__m128i r1 = _mm_loadu_si128((const __m128i *) (rows[1] + x));
+				__m128i r2 = _mm_loadu_si128((const __m128i *) (rows[2] + x));
+				__m128i r3 = _mm_loadu_si128((const __m128i *) (rows[3] + x));
+				__m128i r4 = _mm_loadu_si128((const __m128i *) (rows[4] + x));
+
+				__m128i s = _mm_add_epi16(_mm_add_epi16(r0, r4), _mm_slli_epi16(_mm_add_epi16(r1, r3), 2));
+				s = _mm_add_epi16(s, _mm_add_epi16(_mm_slli_epi16(r2, 2), _mm_slli_epi16(r2, 1)));
+				__m128i d = _mm_add_epi16(_mm_sub_epi16(r0, r4), _mm_slli_epi16(_mm_sub_epi16(r1, r3), 1));
+
+				_mm_storeu_si128((__m128i *) (smoothed + x), s);
+				_mm_storeu_si128((__m128i *) (derived  + x), d);
+			}
+#else
+			for (; x < w + 4; x++){
+				smoothed[x] = rows[0][x] + 4 * rows[1][x] + 6 * rows[2][x] + 4 * rows[3][x] + rows[4][x];
+				derived[x]  = rows[0][x] + 2 * rows[1][x] - 2 * rows[3][x] - rows[4][x];
+			}
+#endif
+
+			// Horizontal pass, the other way around
+			x = 0;
+#ifdef USE_SSE2
+			for (; x < nFiltered; x += 8){
+				__m128i s0 = _mm_loadu_si128((const __m128i *) (smoothed + x));
+				__m128i s1 = _mm_loadu_si128((const __m128i *) (smoothed + x + 1));
+				__m128i s3 = _mm_loadu_si128((const __m128i *) (smoothed + x + 3));
+				__m128i s4 = _mm_loadu_si128((const __m128i *) (smoothed + x + 4));
+				__m128i d0 = _mm_loadu_si128((const __m128i *) (derived + x));
+				__m128i d1 = _mm_loadu_si128((const __m128i *) (derived + x + 1));
+				__m128i d2 = _mm_loadu_si128((const __m128i *) (derived + x + 2));
+				__m128i d3 = _mm_loadu_si128((const __m128i *) (derived + x + 3));
+				__m128i d4 = _mm_loadu_si128((const __m128i *) (derived + x + 4));
+
+				__m128i sX = _mm_add_epi16(_mm_sub_epi16(s0, s4), _mm_slli_epi16(_mm_sub_epi16(s1, s3), 1));
+				__m128i sY = _mm_add_epi16(_mm_add_epi16(d0, d4), _mm_slli_epi16(_mm_add_epi16(d1, d3), 2));
+				sY = _mm_add_epi16(sY, _mm_add_epi16(_mm_slli_epi16(d2, 2), _mm_slli_epi16(d2, 1)));
+
+				_mm_storeu_si128((__m128i *) (slopesX + x), sX);
+				_mm_storeu_si128((__m128i *) (slopesY + x), sY);
+			}
+#else
+			for (; x < w; x++){
+				slopesX[x] = smoothed[x] + 2 * smoothed[x + 1] - 2 * smoothed[x + 3] - smoothed[x + 4];
+				slopesY[x] = derived[x] + 4 * derived[x + 1] + 6 * derived[x + 2] + 4 * derived[x + 3] + derived[x + 4];
+			}
+#endif
+
+			// Normalize and pack
+			const short *heights = rows[2] + 2;
+			ubyte *dest = surface.dest + y * destPitch;
+			x = 0;
+#ifdef USE_SSE2
+			__m128i zero = _mm_setzero_si128();
+			for (; x + 8 <= w; x += 8){
+				__m128i sX = _mm_loadu_si128((const __m128i *) (slopesX + x));
+				__m128i sY = _mm_loadu_si128((const __m128i *) (slopesY + x));
+				__m128i hv = _mm_mullo_epi16(_mm_loadu_si128((const __m128i *) (heights + x)), packer.hFactor);
+
+				__m128i lo, hi;
+				packer.pack(lo, hi, _mm_srai_epi32(_mm_unpacklo_epi16(sX, sX), 16), _mm_srai_epi32(_mm_unpacklo_epi16(sY, sY), 16), _mm_unpacklo_epi16(hv, zero));
+				storePixels(dest + x * layout.bpp, layout.bpp, lo, hi);
+				packer.pack(lo, hi, _mm_srai_epi32(_mm_unpackhi_epi16(sX, sX), 16), _mm_srai_epi32(_mm_unpackhi_epi16(sY, sY), 16), _mm_unpackhi_epi16(hv, zero));
+				storePixels(dest + (x + 4) * layout.bpp, layout.bpp, lo, hi);
+			}
+#endif
+			for (; x < w; x++){
+				storePixel(dest + x * layout.bpp, layout.bpp, packNormal(layout, slopesX[x], slopesY[x], heights[x], surface.sZ));
+			}
+		}
+	}
+
+	delete [] buffer;
+}
+
+void buildNormalMaps(const NormalMapSurface *surfaces, const int nSurfaces, const FORMAT srcFormat, const FORMAT destFormat){
+	NormalMapJob job;
+	getNormalLayout(job.layout, destFormat);
+	job.nChannels = getChannelCount(srcFormat);
+	job.maxWidth = 0;
+
+	// ATI2N surfaces are first built as RG8 into a temporary buffer
+	NormalMapSurface *targets = NULL;
+	ubyte *temp = NULL;
+	if (destFormat == FORMAT_ATI2N){
+		targets = new NormalMapSurface[nSurfaces];
+
+		int size = 0;
+		for (int i = 0; i < nSurfaces; i++){
+			size += surfaces[i].width * surfaces[i].height * 2;
+		}
+		temp = new ubyte[size];
+
+		ubyte *dest = temp;
+		for (int i = 0; i < nSurfaces; i++){
+			targets[i] = surfaces[i];
+			targets[i].dest = dest;
+			dest += surfaces[i].width * surfaces[i].height * 2;
+		}
+		job.surfaces = targets;
+	} else {
+		job.surfaces = surfaces;
+	}
+
+	// Bands of rows, large enough that refilling the five height rows at the start is negligible
+	Array <NormalBand> bands;
+	for (int i = 0; i < nSurfaces; i++){
+		int w = surfaces[i].width;
+		int h = surfaces[i].height;
+		if (w > job.maxWidth) job.maxWidth = w;
+
+		int rowsPerBand = 64 * 1024 / w;
+		if (rowsPerBand < 16) rowsPerBand = 16;
+
+		NormalBand band;
+		band.surface = i;
+		for (int y = 0; y < h; y += rowsPerBand){
+			band.firstRow = y;
+			band.lastRow = (y + rowsPerBand < h)? y + rowsPerBand : h;
+			bands.add(band);
+		}
+	}
+	job.bands = bands.getArray();
+
+	parallelFor(normalMapBands, &job, bands.getCount(), 1);
+
+	if (destFormat == FORMAT_ATI2N){
+		for (int i = 0; i < nSurfaces; i++){
+			compressSurface(surfaces[i].dest, targets[i].dest, surfaces[i].width, surfaces[i].height, 2, FORMAT_ATI2N, COMPRESS_NORMAL);
+		}
+		delete [] targets;
+		delete [] temp;
+	}
+}
@@ -0,0 +1,49 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _NORMALMAP_H_
+#define _NORMALMAP_H_
+
+#include "Image.h"
+
+/*
+	Height map to normal map conversion. The slopes come from a 5x5 Sobel filter that wraps around the edges of
+	each surface, which is separable into a [1 4 6 4 1] smoothing and a [1 2 0 -2 -1] derivative, so it runs as
+	two passes over 16-bit integers. The result is packed straight into the destination format, with the height
+	in the alpha channel where there is one. RGB8 and RGBA8 heights are taken from the luminance.
+
+	FORMAT_ATI2N stores x and y in the same channel order as FORMAT_RG8, so shaders can use either.
+*/
+
+// Returns whether buildNormalMaps() handles the pair of formats
+bool canBuildNormalMap(const FORMAT srcFormat, const FORMAT destFormat);
+
+struct NormalMapSurface {
+	const ubyte *src;
+	ubyte *dest;
+	int width, height;
+	float sZ;
+};
+
+// Converts each height map surface to normals. All rows of all surfaces are spread across the job system together.
+void buildNormalMaps(const NormalMapSurface *surfaces, const int nSurfaces, const FORMAT srcFormat, const FORMAT destFormat);
+
+#endif // _NORMALMAP_H_
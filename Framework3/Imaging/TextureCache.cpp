@@ -0,0 +1,246 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "TextureCache.h"
+#include "NormalMap.h"
+#include "../Util/MappedFile.h"
+#include "../Util/String.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#pragma pack (push, 1)
+
+struct TextureCacheHeader {
+	uint32 identifier;
+	uint32 version;
+	uint64 key;
+	uint32 format;
+	uint32 width;
+	uint32 height;
+	uint32 depth;
+	uint32 nMipMaps;
+	uint32 arraySize;
+	uint32 reserved[6];
+};
+
+#pragma pack (pop)
+
+// Bump when the processing changes its output, which invalidates all entries
+#define TEXTURE_CACHE_VERSION 2
+
+// The pixels follow the header, which keeps them aligned for SIMD code working on them in place
+#define TEXTURE_CACHE_DATA_OFFSET sizeof(TextureCacheHeader)
+
+static String cacheDirectory("../TextureCache/");
+static std::atomic <uint> tempCounter;
+
+void setTextureCacheDirectory(const char *directory){
+	if (directory){
+		cacheDirectory = directory;
+		if (cacheDirectory.getLength() > 0){
+			char last = ((const char *) cacheDirectory)[cacheDirectory.getLength() - 1];
+			if (last != '/' && last != '\\') cacheDirectory += "/";
+		}
+	} else {
+		cacheDirectory = "";
+	}
+}
+
+const char *getTextureCacheDirectory(){
+	return cacheDirectory.isEmpty()? NULL : (const char *) cacheDirectory;
+}
+
+static String getEntryName(const uint64 key){
+	static const char hexDigits[] = "0123456789abcdef";
+
+	char hex[17];
+	for (int i = 0; i < 16; i++){
+		hex[i] = hexDigits[(key >> (60 - 4 * i)) & 0xF];
+	}
+	hex[16] = '\0';
+
+	return cacheDirectory + hex + ".tcache";
+}
+
+// Whether the file is a DDS that loads as the final texture without any processing
+static bool isReadyDDS(const char *fileName, const MappedFile &file, const TextureProcessing &processing){
+	const char *extension = strrchr(fileName, '.');
+	if (extension == NULL || stricmp(extension, ".dds") != 0) return false;
+	if (processing.normalMapFormat != FORMAT_NONE) return false;
+
+	// dwMipMapCount of the header. Mipmaps that have to be created are worth caching.
+	if (file.getSize() < 32) return false;
+	uint32 mipMapCount = *(const uint32 *) (file.getData() + 28);
+
+	return (!processing.useMipMaps || mipMapCount > 1);
+}
+
+bool getTextureCacheKey(const char **fileNames, const TextureProcessing &processing, uint64 &key){
+	if (cacheDirectory.isEmpty()) return false;
+
+	// Hashed field by field, as the struct has padding
+	uint32 params[] = {
+		TEXTURE_CACHE_VERSION,
+		processing.useMipMaps,
+		uint32(processing.nImages),
+		uint32(processing.nArraySlices),
+		uint32(processing.normalMapFormat),
+	};
+	float scales[] = { processing.sZ, processing.mipMapScaleZ };
+
+	key = hashMemory(params, sizeof(params));
+	key = hashMemory(scales, sizeof(scales), key);
+
+	int nFiles = (processing.nImages? processing.nImages : 6) * processing.nArraySlices;
+	MappedFile *files = new MappedFile[nFiles];
+
+	// Sources that are all ready to use are not hashed at all
+	bool readable = true, ready = true;
+	for (int i = 0; i < nFiles && readable; i++){
+		readable = files[i].open(fileNames[i]);
+		ready &= isReadyDDS(fileNames[i], files[i], processing);
+	}
+
+	if (readable && !ready){
+		for (int i = 0; i < nFiles; i++){
+			uint64 hash = hashMemory(files[i].getData(), files[i].getSize());
+			key = hashMemory(&hash, sizeof(hash), key);
+		}
+	}
+	delete [] files;
+
+	return (readable && !ready);
+}
+
+bool loadCachedTexture(Image &img, const uint64 key){
+	String name = getEntryName(key);
+
+	FILE *file = fopen(name, "rb");
+	if (file == NULL) return false;
+
+	TextureCacheHeader header;
+	bool valid = (fread(&header, sizeof(header), 1, file) == 1 &&
+		header.identifier == MCHAR4('T','C','H','E') && header.version == TEXTURE_CACHE_VERSION && header.key == key);
+	fclose(file);
+
+	// The size is checked when mapping, which catches truncated entries
+	if (valid){
+		valid = img.mapPixels(name, TEXTURE_CACHE_DATA_OFFSET, (FORMAT) header.format, header.width, header.height, header.depth, header.nMipMaps, header.arraySize);
+		if (!valid) img.clear();
+	}
+
+	return valid;
+}
+
+bool saveCachedTexture(const Image &img, const uint64 key){
+	String name = getEntryName(key);
+
+	// Unique across threads and processes, so concurrent writers of the same entry each write a complete file
+	String tempName(name);
+	tempName += ".";
+#ifdef _WIN32
+	tempName.appendInt(_getpid());
+#else
+	tempName.appendInt(getpid());
+#endif
+	tempName += "_";
+	tempName.appendInt(tempCounter++);
+
+	FILE *file = fopen(tempName, "wb");
+	if (file == NULL){
+		// Most likely the directory doesn't exist yet
+#ifdef _WIN32
+		CreateDirectoryA(cacheDirectory, NULL);
+#else
+		mkdir(cacheDirectory, 0777);
+#endif
+		if ((file = fopen(tempName, "wb")) == NULL) return false;
+	}
+
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.identifier = MCHAR4('T','C','H','E');
+	header.version = TEXTURE_CACHE_VERSION;
+	header.key = key;
+	header.format = img.getFormat();
+	header.width  = img.getWidth();
+	header.height = img.getHeight();
+	header.depth  = img.getDepth();
+	header.nMipMaps  = img.getMipMapCount();
+	header.arraySize = img.getArraySize();
+
+	size_t size = size_t(img.getMipMappedSize(0, header.nMipMaps)) * header.arraySize;
+
+	bool written = (fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(img.getPixels(), 1, size, file) == size);
+	written &= (fclose(file) == 0);
+
+	if (written){
+#ifdef _WIN32
+		written = (MoveFileExA(tempName, name, MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+		written = (rename(tempName, name) == 0);
+#endif
+	}
+	if (!written) remove(tempName);
+
+	return written;
+}
+
+bool processTexture(Image &img, const TextureProcessing &processing){
+	if (img.getFormat() == FORMAT_RGBE8) img.unpackImage();
+
+	if (processing.normalMapFormat != FORMAT_NONE){
+		if (!canBuildNormalMap(img.getFormat(), processing.normalMapFormat)) return false;
+
+		if (processing.useMipMaps && img.getMipMapCount() <= 1) img.createMipMaps();
+		return img.toNormalMap(processing.normalMapFormat, processing.sZ, processing.mipMapScaleZ);
+	}
+
+	if (processing.useMipMaps && img.getMipMapCount() <= 1) img.createMipMaps();
+	return true;
+}
+
+bool loadProcessedTexture(Image &img, const char **fileNames, const TextureProcessing &processing){
+	uint64 key;
+	bool cached = getTextureCacheKey(fileNames, processing, key);
+	if (cached && loadCachedTexture(img, key)) return true;
+
+	bool loaded;
+	if (processing.nImages == 1 && processing.nArraySlices == 1){
+		loaded = img.loadImage(fileNames[0], processing.useMipMaps? MAP_PIXELS : MAP_PIXELS | DONT_LOAD_MIPMAPS);
+	} else {
+		loaded = img.loadSlicedImage(fileNames, processing.nImages, processing.nArraySlices, MAP_PIXELS);
+	}
+	if (!loaded || !processTexture(img, processing)) return false;
+
+	if (cached) saveCachedTexture(img, key);
+
+	return true;
+}
@@ -0,0 +1,71 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _TEXTURECACHE_H_
+#define _TEXTURECACHE_H_
+
+#include "Image.h"
+
+/*
+	Content addressed on-disk cache of processed textures. An entry is keyed on a hash of the contents of the source
+	files and of everything done to them after loading, so an edited source or changed parameters simply lead to
+	another entry and stale ones are never used. Entries hold the final image with all mipmaps, faces and array
+	slices at an aligned offset behind a small header, and are mapped rather than read when loaded.
+
+	Entries are written under a temporary name and renamed into place, so any number of processes may fill the
+	cache at once. Nothing is ever removed from it, deleting the directory is always safe.
+*/
+
+// What is done to the source files after loading
+struct TextureProcessing {
+	TextureProcessing(const bool mipMaps = true, const int images = 1, const int arraySlices = 1){
+		useMipMaps = mipMaps;
+		nImages = images;
+		nArraySlices = arraySlices;
+		normalMapFormat = FORMAT_NONE;
+		sZ = 1.0f;
+		mipMapScaleZ = 2.0f;
+	}
+
+	bool useMipMaps;
+	int nImages;            // As in Image::loadSlicedImage(), 1 for 2D textures and arrays and 0 for cubemaps
+	int nArraySlices;
+	FORMAT normalMapFormat; // Converts height maps to normal maps in this format unless FORMAT_NONE
+	float sZ, mipMapScaleZ;
+};
+
+// Defaults to "../TextureCache/", which sits next to the shared Textures directory. NULL disables the cache.
+void setTextureCacheDirectory(const char *directory);
+const char *getTextureCacheDirectory();
+
+// Returns false if the cache is disabled, a source can't be read, or the sources are DDS files that already hold
+// the result, in which case an entry would only be a copy.
+bool getTextureCacheKey(const char **fileNames, const TextureProcessing &processing, uint64 &key);
+bool loadCachedTexture(Image &img, const uint64 key);
+bool saveCachedTexture(const Image &img, const uint64 key);
+
+// Unpacks RGBE, creates missing mipmaps and converts height maps, as requested
+bool processTexture(Image &img, const TextureProcessing &processing);
+
+// Loads the cache entry for the sources, or loads and processes them and adds an entry
+bool loadProcessedTexture(Image &img, const char **fileNames, const TextureProcessing &processing);
+
+#endif // _TEXTURECACHE_H_
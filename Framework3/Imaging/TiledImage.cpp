@@ -0,0 +1,208 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "TiledImage.h"
+#include "../Math/Vector.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void TilePipeline::addDilate(const int iterations){
+	addStage(TILE_DILATE, iterations);
+}
+
+void TilePipeline::addErode(const int iterations){
+	addStage(TILE_ERODE, iterations);
+}
+
+void TilePipeline::addGrayScale(){
+	addStage(TILE_GRAYSCALE);
+}
+
+void TilePipeline::addScaleBias(const float scale, const float bias){
+	addStage(TILE_SCALEBIAS, 1, scale, bias);
+}
+
+void TilePipeline::addNormalize(){
+	addStage(TILE_NORMALIZE);
+}
+
+void TilePipeline::addConvert(const FORMAT format){
+	addStage(TILE_CONVERT, 1, 1.0f, 0.0f, format);
+}
+
+void TilePipeline::addStage(const TileOperation op, const int iterations, const float scale, const float bias, const FORMAT format){
+	TileStage stage;
+	stage.op = op;
+	stage.iterations = iterations;
+	stage.scale = scale;
+	stage.bias = bias;
+	stage.format = format;
+
+	stages.add(stage);
+}
+
+// Rows on each side of a pixel that a stage looks at
+static int getHalo(const TileStage &stage){
+	return (stage.op == TILE_DILATE || stage.op == TILE_ERODE)? stage.iterations : 0;
+}
+
+static bool applyStage(Image &band, const TileStage &stage){
+	switch (stage.op){
+		case TILE_DILATE:    return band.dilate(stage.iterations);
+		case TILE_ERODE:     return band.erode(stage.iterations);
+		case TILE_GRAYSCALE: return band.toGrayScale();
+		case TILE_SCALEBIAS: return band.scaleBias(stage.scale, stage.bias);
+		case TILE_NORMALIZE: return band.normalize();
+		case TILE_CONVERT:   return band.convert(stage.format);
+	}
+	return false;
+}
+
+// Reads the rows from first to last with halo rows around them and runs the stages over them. The rows from first
+// to last come out at rows in the band, the rows around them are only right as far as the halo needed.
+static bool runBand(ImageRowFile &src, Image &band, const TileStage *stages, const int nStages, const int halo, const int first, const int last, ubyte *&rows, TileStats &stats){
+	int start = max(first - halo, 0);
+	int end = min(last + halo, src.getHeight());
+
+	uint64 size = uint64(end - start) * src.getRowSize();
+	ubyte *pixels = new ubyte[size];
+	if (!src.readRows(pixels, start, end - start)){
+		delete [] pixels;
+		return false;
+	}
+	band.loadFromMemory(pixels, src.getFormat(), src.getWidth(), end - start, 1, 1, true);
+	stats.bytesRead += size;
+	stats.nBands++;
+
+	for (int i = 0; i < nStages; i++){
+		if (!applyStage(band, stages[i])) return false;
+
+		// Other than scaleBias() the operations hold the old and new pixels at once
+		uint64 newSize = band.getMipMappedSize(0, 1);
+		uint64 memory = (stages[i].op == TILE_SCALEBIAS)? newSize : size + newSize;
+		if (memory > stats.peakMemory) stats.peakMemory = memory;
+		size = newSize;
+	}
+	if (size > stats.peakMemory) stats.peakMemory = size;
+
+	rows = band.getPixels() + (first - start) * src.getWidth() * getBytesPerPixel(band.getFormat());
+
+	return true;
+}
+
+bool TilePipeline::process(const char *srcFileName, const char *destFileName, const uint64 memoryLimit, TileStats *stats){
+	timestamp startTime = getCurrentTime();
+
+	ImageRowFile src;
+	if (!src.openRead(srcFileName)) return false;
+
+	int width  = src.getWidth();
+	int height = src.getHeight();
+
+	// Normalizing is replaced by the scale and bias that the range of the image calls for once it's known
+	Array <TileStage> run;
+	for (uint i = 0; i < stages.getCount(); i++){
+		run.add(stages[i]);
+	}
+
+	// Running the pipeline over a single pixel tells whether each operation takes the format it gets, and the most
+	// bytes per pixel held at once
+	Image pixel;
+	pixel.loadFromMemory(new ubyte[16](), src.getFormat(), 1, 1, 1, 1, true);
+
+	uint64 pixelSize = getBytesPerPixel(src.getFormat());
+	int halo = 0;
+	for (uint i = 0; i < run.getCount(); i++){
+		int size = getBytesPerPixel(pixel.getFormat());
+		if (!applyStage(pixel, run[i])) return false;
+		int newSize = getBytesPerPixel(pixel.getFormat());
+
+		pixelSize = max(pixelSize, uint64((run[i].op == TILE_SCALEBIAS)? newSize : size + newSize));
+		halo += getHalo(run[i]);
+	}
+	FORMAT destFormat = pixel.getFormat();
+
+	// Bands are held in images, whose sizes are ints
+	uint64 bandSize = min(memoryLimit, uint64(0x7FFFFFFF));
+	int bandRows = int(min(bandSize / (pixelSize * width), uint64(height + 2 * halo))) - 2 * halo;
+	if (bandRows < 1) return false;
+
+	TileStats tileStats;
+	memset(&tileStats, 0, sizeof(tileStats));
+	tileStats.bandRows = bandRows;
+
+	// Passes to find the range of each normalize, through the operations before it
+	int runHalo = 0;
+	for (uint i = 0; i < run.getCount(); i++){
+		if (run[i].op == TILE_NORMALIZE){
+			float minValue =  FLT_MAX;
+			float maxValue = -FLT_MAX;
+
+			for (int first = 0; first < height; first += bandRows){
+				int last = min(first + bandRows, height);
+
+				Image band;
+				ubyte *rows;
+				if (!runBand(src, band, run.getArray(), i, runHalo, first, last, rows, tileStats)) return false;
+
+				const float *values = (const float *) rows;
+				int nValues = (last - first) * width * getChannelCount(band.getFormat());
+				for (int j = 0; j < nValues; j++){
+					if (values[j] < minValue) minValue = values[j];
+					if (values[j] > maxValue) maxValue = values[j];
+				}
+			}
+			tileStats.nPasses++;
+
+			run[i].op = TILE_SCALEBIAS;
+			run[i].scale = 1.0f / (maxValue - minValue);
+			run[i].bias = -minValue * run[i].scale;
+		}
+		runHalo += getHalo(run[i]);
+	}
+
+	ImageRowFile dest;
+	if (!dest.openWrite(destFileName, destFormat, width, height)) return false;
+
+	bool result = true;
+	for (int first = 0; first < height && result; first += bandRows){
+		int last = min(first + bandRows, height);
+
+		Image band;
+		ubyte *rows;
+		result = runBand(src, band, run.getArray(), run.getCount(), halo, first, last, rows, tileStats) && dest.writeRows(rows, first, last - first);
+		tileStats.bytesWritten += uint64(last - first) * dest.getRowSize();
+	}
+	tileStats.nPasses++;
+
+	if (!dest.close() || !result){
+		remove(destFileName);
+		return false;
+	}
+
+	tileStats.time = getTimeDifference(startTime, getCurrentTime());
+	tileStats.pixelsPerSecond = float(width) * float(height) / tileStats.time;
+
+	if (stats) *stats = tileStats;
+
+	return true;
+}
@@ -0,0 +1,86 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _TILEDIMAGE_H_
+#define _TILEDIMAGE_H_
+
+#include "Image.h"
+#include "../Util/Array.h"
+
+/*
+	Processing of images too large to be held in memory. The source file is streamed through a pipeline of operations
+	in bands of full rows and written out band by band, so that only a band and its results are held at once. Bands are
+	as tall as the memory limit allows. Operations that look at neighbouring pixels get the extra rows they need around
+	each band, so the result is the same as running the Image functions of the same names on the whole image.
+
+	Rows rather than square tiles are streamed, as DDS and TGA files store the rows one after another, which makes
+	each band one read and one write. Normalizing needs the range of the whole image, so each normalize adds a pass
+	through the source to find the range before the final one. Only the top level is processed.
+*/
+
+enum TileOperation {
+	TILE_DILATE,
+	TILE_ERODE,
+	TILE_GRAYSCALE,
+	TILE_SCALEBIAS,
+	TILE_NORMALIZE,
+	TILE_CONVERT,
+};
+
+struct TileStage {
+	TileOperation op;
+	int iterations;
+	float scale, bias;
+	FORMAT format;
+};
+
+struct TileStats {
+	uint64 peakMemory;     // Most bytes held in bands at once, including the results of each operation
+	uint64 bytesRead;      // Over all passes, including the rows read again around bands
+	uint64 bytesWritten;
+	int bandRows;          // Rows written per band
+	int nBands;            // Over all passes
+	int nPasses;           // Reads through the source, one more than the number of normalizes
+	float time;            // Seconds for everything
+	float pixelsPerSecond; // Pixels of the image over the time
+};
+
+class TilePipeline {
+public:
+	void addDilate(const int iterations = 1);
+	void addErode(const int iterations = 1);
+	void addGrayScale();
+	void addScaleBias(const float scale, const float bias);
+	void addNormalize();
+	void addConvert(const FORMAT format);
+	void clear(){ stages.clear(); }
+
+	// Streams the source through the operations into the destination, holding at most memoryLimit bytes of pixels.
+	// Fails if the files can't be streamed, an operation doesn't take the format it gets, or a band wouldn't fit.
+	bool process(const char *srcFileName, const char *destFileName, const uint64 memoryLimit, TileStats *stats = NULL);
+
+protected:
+	void addStage(const TileOperation op, const int iterations = 1, const float scale = 1.0f, const float bias = 0.0f, const FORMAT format = FORMAT_NONE);
+
+	Array <TileStage> stages;
+};
+
+#endif // _TILEDIMAGE_H_
@@ -20,6 +20,7 @@
 \* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "../CPU.h"
+#include "../Util/JobSystem.h"
 #include "../BaseApp.h"
 
 #include <sys/resource.h>
@@ -42,6 +43,7 @@ int main(int argc, char *argv[]){
 	gtk_init(NULL, NULL);
 
 	initCPU();
+	initJobSystem();
 
 	// Make sure we're running in the exe's directory
 	char path[PATH_MAX];
@@ -177,6 +179,8 @@ int main(int argc, char *argv[]){
 
 	delete app;
 
+	shutdownJobSystem();
+
 	close(joy);
 
 	return 0;
@@ -20,6 +20,7 @@
 \* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "../CPU.h"
+#include "../Util/JobSystem.h"
 #include "../BaseApp.h"
 
 #include <unistd.h>
@@ -173,6 +174,7 @@ int main(int argc, char *argv[]){
 	}
 */
 	initCPU();
+	initJobSystem();
 
 
 	// Initialize timer
@@ -263,5 +265,7 @@ int main(int argc, char *argv[]){
 
 	delete app;
 
+	shutdownJobSystem();
+
 	return 0;
 }
@@ -22,14 +22,16 @@
 #include "Frustum.h"
 
 void Frustum::loadFrustum(const mat4 &mvp){
-	planes[FRUSTUM_LEFT  ] = Plane(mvp[12] - mvp[0], mvp[13] - mvp[1], mvp[14] - mvp[2],  mvp[15] - mvp[3]);
-	planes[FRUSTUM_RIGHT ] = Plane(mvp[12] + mvp[0], mvp[13] + mvp[1], mvp[14] + mvp[2],  mvp[15] + mvp[3]);
+	mat4 rows = transpose(mvp);
 
-	planes[FRUSTUM_TOP   ] = Plane(mvp[12] - mvp[4], mvp[13] - mvp[5], mvp[14] - mvp[6],  mvp[15] - mvp[7]);
-	planes[FRUSTUM_BOTTOM] = Plane(mvp[12] + mvp[4], mvp[13] + mvp[5], mvp[14] + mvp[6],  mvp[15] + mvp[7]);
+	planes[FRUSTUM_LEFT  ] = Plane(rows[3] + rows[0]);
+	planes[FRUSTUM_RIGHT ] = Plane(rows[3] - rows[0]);
 
-	planes[FRUSTUM_FAR   ] = Plane(mvp[12] - mvp[8], mvp[13] - mvp[9], mvp[14] - mvp[10], mvp[15] - mvp[11]);
-	planes[FRUSTUM_NEAR  ] = Plane(mvp[12] + mvp[8], mvp[13] + mvp[9], mvp[14] + mvp[10], mvp[15] + mvp[11]);
+	planes[FRUSTUM_TOP   ] = Plane(rows[3] - rows[1]);
+	planes[FRUSTUM_BOTTOM] = Plane(rows[3] + rows[1]);
+
+	planes[FRUSTUM_FAR   ] = Plane(rows[3] - rows[2]);
+	planes[FRUSTUM_NEAR  ] = Plane(rows[3] + rows[2]);
 }
 
 bool Frustum::pointInFrustum(const vec3 &pos) const {
@@ -39,6 +39,9 @@ struct Plane {
 		normal *= invLen;
 		offset = o * invLen;
 	}
+	Plane(const vec4 &p){
+		*this = Plane(p.x, p.y, p.z, p.w);
+	}
 
 	float dist(const vec3 &pos) const {
 		return dot(normal, pos) + offset;
@@ -34,11 +34,15 @@ struct Texture {
 		GLuint glDepthID;
 	};
 	GLuint glTarget;
+	GLint glInternalFormat;
 	FORMAT format;
 	uint flags;
 	int width, height;
 	float lod;
 
+	// First level uploaded, larger levels are added by uploadMipMaps()
+	int baseLevel;
+
 	SamplerStateID samplerState;
 };
 
@@ -550,6 +554,10 @@ static const GLenum srcTypes[] = {
 
 
 TextureID OpenGLRenderer::addTexture(Image &img, const SamplerStateID samplerState, uint flags){
+	return addPartialTexture(img, 0, samplerState, flags);
+}
+
+TextureID OpenGLRenderer::addPartialTexture(Image &img, const int firstMipMap, const SamplerStateID samplerState, uint flags){
 	ASSERT(samplerState != SS_NONE);
 
 	Texture tex;
@@ -570,8 +578,6 @@ TextureID OpenGLRenderer::addTexture(Image &img, const SamplerStateID samplerSta
 		format = img.getFormat();
 	}*/
 
-	GLenum srcFormat = srcFormats[getChannelCount(format)];
-    GLenum srcType = srcTypes[format];
 	GLint internalFormat = internalFormats[format];
 	if ((flags & HALF_FLOAT) != 0 && format >= FORMAT_I32F && format <= FORMAT_RGBA32F){
         internalFormat = internalFormats[format - (FORMAT_I32F - FORMAT_I16F)];
@@ -619,10 +625,48 @@ TextureID OpenGLRenderer::addTexture(Image &img, const SamplerStateID samplerSta
 	setupSampler(tex.glTarget, samplerStates[samplerState]);
 	tex.samplerState = samplerState;
 
-	// Upload it all
-	ubyte *src;
-	int mipMapLevel = 0;
-	while ((src = img.getPixels(mipMapLevel)) != NULL){
+	// Upload it all, or the smallest levels from firstMipMap
+	tex.glInternalFormat = internalFormat;
+	tex.baseLevel = firstMipMap;
+	if (firstMipMap > 0){
+		glTexParameteri(tex.glTarget, GL_TEXTURE_BASE_LEVEL, firstMipMap);
+		glTexParameteri(tex.glTarget, GL_TEXTURE_MAX_LEVEL, img.getMipMapCount() - 1);
+	}
+	uploadMipMapLevels(tex, img, firstMipMap, img.getMipMapCount());
+
+	glBindTexture(tex.glTarget, 0);
+
+	return textures.add(tex);
+}
+
+
+bool OpenGLRenderer::uploadMipMaps(const TextureID texture, Image &img, const int firstMipMap){
+	Texture &tex = textures[texture];
+	if (firstMipMap >= tex.baseLevel) return true;
+
+	glBindTexture(tex.glTarget, tex.glTexID);
+	uploadMipMapLevels(tex, img, firstMipMap, tex.baseLevel);
+	glTexParameteri(tex.glTarget, GL_TEXTURE_BASE_LEVEL, firstMipMap);
+	glBindTexture(tex.glTarget, 0);
+
+	tex.baseLevel = firstMipMap;
+
+	// The bound texture changed behind the cached state
+	for (uint i = 0; i < MAX_TEXTUREUNIT; i++){
+		currentTextures[i] = TEXTURE_NONE;
+	}
+
+	return true;
+}
+
+void OpenGLRenderer::uploadMipMapLevels(const Texture &tex, Image &img, const int firstMipMap, const int endMipMap){
+	FORMAT format = tex.format;
+	GLenum srcFormat = srcFormats[getChannelCount(format)];
+	GLenum srcType = srcTypes[format];
+	GLint internalFormat = tex.glInternalFormat;
+
+	for (int mipMapLevel = firstMipMap; mipMapLevel < endMipMap; mipMapLevel++){
+		ubyte *src = img.getPixels(mipMapLevel);
 		if (img.isCube()){
 			int size = img.getMipMappedSize(mipMapLevel, 1) / 6;
 			for (uint i = 0; i < 6; i++){
@@ -671,12 +715,7 @@ TextureID OpenGLRenderer::addTexture(Image &img, const SamplerStateID samplerSta
 		} else {
 			glTexImage1D(tex.glTarget, mipMapLevel, internalFormat, img.getWidth(mipMapLevel), 0, srcFormat, srcType, src);
 		}
-		mipMapLevel++;
 	}
-
-	glBindTexture(tex.glTarget, 0);
-
-	return textures.add(tex);
 }
 
 
@@ -1103,6 +1142,12 @@ IndexBufferID OpenGLRenderer::addIndexBuffer(const uint nIndices, const uint ind
 	return indexBuffers.add(ib);
 }
 
+void OpenGLRenderer::deleteIndexBuffer(IndexBufferID bufferID)
+{
+  glDeleteBuffers(1, &indexBuffers[bufferID].vboIB);
+  indexBuffers[bufferID].vboIB = 0;
+}
+
 bool OpenGLRenderer::updateVertexBuffer(const VertexBufferID vertexBuffer, const intptr offset, const long size, const void *data)
 {
 	if(vertexBuffer == VB_NONE ||
@@ -1489,7 +1534,7 @@ void OpenGLRenderer::changeVertexFormat(const VertexFormatID vertexFormat){
 void OpenGLRenderer::changeVertexBuffer(const int stream, const VertexBufferID vertexBuffer, const intptr offset){
 	const GLsizei glTypes[] = {
 		GL_FLOAT,
-		0, // No half float support
+		GL_HALF_FLOAT,
 		GL_UNSIGNED_BYTE,
 	};
 
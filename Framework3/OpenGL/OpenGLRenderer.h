@@ -43,6 +43,8 @@ public:
 	void reset(const uint flags = RESET_ALL);
 
 	TextureID addTexture(Image &img, const SamplerStateID samplerState = SS_NONE, uint flags = 0);
+	TextureID addPartialTexture(Image &img, const int firstMipMap, const SamplerStateID samplerState = SS_NONE, uint flags = 0);
+	bool uploadMipMaps(const TextureID texture, Image &img, const int firstMipMap);
 	void updateTexture(TextureID texId, uint a_w, uint a_h, FORMAT a_format, const void * a_data);
 
 	TextureID addRenderTarget(const int width, const int height, const int depth, const int mipMapCount, const int arraySize, const FORMAT format, const int msaaSamples = 1, const SamplerStateID samplerState = SS_NONE, uint flags = 0);
@@ -63,6 +65,7 @@ public:
   bool updateVertexBuffer(const VertexBufferID vertexBuffer, const intptr offset, const long size, const void *data);
   
 	IndexBufferID addIndexBuffer(const uint nIndices, const uint indexSize, const BufferAccess bufferAccess, const void *data = NULL);
+  void deleteIndexBuffer(IndexBufferID bufferID);
 
 	SamplerStateID addSamplerState(const Filter filter, const AddressMode s, const AddressMode t, const AddressMode r, const float lod = 0, const uint maxAniso = 16, const int compareFunc = 0, const float *border_color = NULL);
 	BlendStateID addBlendState(const int srcFactorRGB, const int destFactorRGB, const int srcFactorAlpha, const int destFactorAlpha, const int blendModeRGB, const int blendModeAlpha, const int mask = ALL, const bool alphaToCoverage = false);
@@ -130,6 +133,7 @@ protected:
 	void changeFrontFace(const GLenum frontFace);
 //	void setupFilter(const Texture &tex, const Filter filter, const uint flags);
 	void setupSampler(GLenum glTarget, const SamplerState &ss);
+	void uploadMipMapLevels(const Texture &tex, Image &img, const int firstMipMap, const int endMipMap);
 
 #if defined(WIN32)
 	HDC hdc;
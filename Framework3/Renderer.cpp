@@ -21,6 +21,7 @@
 
 #include "Renderer.h"
 #include "Util/String.h"
+#include "Imaging/TextureCache.h"
 
 int constantTypeSizes[CONSTANT_TYPE_COUNT] = {
 	sizeof(float),
@@ -206,13 +207,7 @@ void Renderer::clear(){
 
 TextureID Renderer::addTexture(const char *fileName, const bool useMipMaps, const SamplerStateID samplerState, uint flags){
 	Image img;
-
-	uint loadFlags = 0;
-	if (!useMipMaps) loadFlags |= DONT_LOAD_MIPMAPS;
-
-	if (img.loadImage(fileName, loadFlags)){
-		if (img.getFormat() == FORMAT_RGBE8) img.unpackImage();
-		if (useMipMaps && img.getMipMapCount() <= 1) img.createMipMaps();
+	if (loadProcessedTexture(img, &fileName, TextureProcessing(useMipMaps))){
 		return addTexture(img, samplerState, flags);
 	} else {
 		char str[256];
@@ -226,9 +221,7 @@ TextureID Renderer::addTexture(const char *fileName, const bool useMipMaps, cons
 TextureID Renderer::addTexture(const char **fileNames, const bool useMipMaps, const SamplerStateID samplerState, const int nArraySlices, uint flags)
 {
 	Image img;
-	if (img.loadSlicedImage(fileNames, 1, nArraySlices)){
-		if (img.getFormat() == FORMAT_RGBE8) img.unpackImage();
-		if (useMipMaps && img.getMipMapCount() <= 1) img.createMipMaps();
+	if (loadProcessedTexture(img, fileNames, TextureProcessing(useMipMaps, 1, nArraySlices))){
 		return addTexture(img, samplerState, flags);
 	} else {
 		char str[1024];
@@ -241,9 +234,7 @@ TextureID Renderer::addTexture(const char **fileNames, const bool useMipMaps, co
 
 TextureID Renderer::addCubemap(const char **fileNames, const bool useMipMaps, const SamplerStateID samplerState, const int nArraySlices, uint flags){
 	Image img;
-	if (img.loadSlicedImage(fileNames, 0, nArraySlices)){
-		if (img.getFormat() == FORMAT_RGBE8) img.unpackImage();
-		if (useMipMaps && img.getMipMapCount() <= 1) img.createMipMaps();
+	if (loadProcessedTexture(img, fileNames, TextureProcessing(useMipMaps, 0, nArraySlices))){
 		return addTexture(img, samplerState, flags);
 	} else {
 		char str[1024];
@@ -258,23 +249,21 @@ TextureID Renderer::addCubemap(const char **fileNames, const bool useMipMaps, co
 }
 
 TextureID Renderer::addNormalMap(const char *fileName, const FORMAT destFormat, const bool useMipMaps, const SamplerStateID samplerState, float sZ, float mipMapScaleZ, uint flags){
-	Image img;
-
-	uint loadFlags = 0;
-	if (!useMipMaps) loadFlags |= DONT_LOAD_MIPMAPS;
+	TextureProcessing processing(useMipMaps);
+	processing.normalMapFormat = destFormat;
+	processing.sZ = sZ;
+	processing.mipMapScaleZ = mipMapScaleZ;
 
-	if (img.loadImage(fileName, loadFlags)){
-		if (useMipMaps && img.getMipMapCount() <= 1) img.createMipMaps();
-		if (img.toNormalMap(destFormat, sZ, mipMapScaleZ)){
-			return addTexture(img, samplerState, flags);
-		}
+	Image img;
+	if (loadProcessedTexture(img, &fileName, processing)){
+		return addTexture(img, samplerState, flags);
 	} else {
 		char str[256];
 		sprintf(str, "Couldn't open \"%s\"", fileName);
 
 		ErrorMsg(str);
+		return TEXTURE_NONE;
 	}
-	return TEXTURE_NONE;
 }
 
 ShaderID Renderer::addShader(const char *fileName, const uint flags){
@@ -292,20 +281,6 @@ ShaderID Renderer::addShader(const char *fileName, const char **attributeNames,
 	if (file == NULL){
 		ErrorMsg(String("Couldn't load \"") + fileName + "\"");
 	} else {
-#ifdef DEBUG
-		char str[66];
-		str[0] = '\n';
-		memset(str + 1, '-', sizeof(str) - 2);
-		str[sizeof(str) - 1] = '\0';
-		size_t lfn = strlen(fileName);
-		size_t start = (sizeof(str) - lfn) / 2;
-
-		str[start - 1]   = '[';
-		str[start + lfn] = ']';
-		strncpy(str + start, fileName, lfn);
-		outputDebugString(str);
-#endif
-
 		// Find file size
 		fseek(file, 0, SEEK_END);
 		int length = ftell(file);
@@ -316,55 +291,73 @@ ShaderID Renderer::addShader(const char *fileName, const char **attributeNames,
 		fclose(file);
 		shaderText[length] = '\0';
 
-		char *vs = strstr(shaderText, "[Vertex shader]");
-		char *gs = strstr(shaderText, "[Geometry shader]");
-		char *fs = strstr(shaderText, "[Fragment shader]");
+		res = addShaderSource(shaderText, fileName, attributeNames, nAttributes, extra, flags);
+		delete shaderText;
+	}
+	return res;
+}
 
-		char *header = (shaderText[0] != '[')? shaderText : NULL;
+ShaderID Renderer::addShaderSource(char *shaderText, const char *fileName, const char **attributeNames, const int nAttributes, const char *extra, const uint flags){
+#ifdef DEBUG
+	char str[66];
+	str[0] = '\n';
+	memset(str + 1, '-', sizeof(str) - 2);
+	str[sizeof(str) - 1] = '\0';
+	size_t lfn = strlen(fileName);
+	size_t start = (sizeof(str) - lfn) / 2;
+
+	str[start - 1]   = '[';
+	str[start + lfn] = ']';
+	strncpy(str + start, fileName, lfn);
+	outputDebugString(str);
+#endif
 
-		int vsLine = 0;
-		if (vs != NULL){
-			*vs = '\0';
-			vs += 15;
-			while (*vs == '\r' || *vs == '\n') vs++;
+	char *vs = strstr(shaderText, "[Vertex shader]");
+	char *gs = strstr(shaderText, "[Geometry shader]");
+	char *fs = strstr(shaderText, "[Fragment shader]");
 
-			char *str = shaderText;
-			while (str < vs){
-                if (*str == '\n') vsLine++;
-				str++;
-			}
-		}
+	char *header = (shaderText[0] != '[')? shaderText : NULL;
 
-		int gsLine = 0;
-		if (gs != NULL){
-			*gs = '\0';
-			gs += 17;
-			while (*gs == '\r' || *gs == '\n') gs++;
-
-			char *str = shaderText;
-			while (str < gs){
-                if (*str == '\n') gsLine++;
-				str++;
-			}
+	int vsLine = 0;
+	if (vs != NULL){
+		*vs = '\0';
+		vs += 15;
+		while (*vs == '\r' || *vs == '\n') vs++;
+
+		char *str = shaderText;
+		while (str < vs){
+			if (*str == '\n') vsLine++;
+			str++;
 		}
+	}
+
+	int gsLine = 0;
+	if (gs != NULL){
+		*gs = '\0';
+		gs += 17;
+		while (*gs == '\r' || *gs == '\n') gs++;
 
-		int fsLine = 0;
-		if (fs != NULL){
-			*fs = '\0';
-			fs += 17;
-			while (*fs == '\r' || *fs == '\n') fs++;
-
-			char *str = shaderText;
-			while (str < fs){
-                if (*str == '\n') fsLine++;
-				str++;
-			}
+		char *str = shaderText;
+		while (str < gs){
+			if (*str == '\n') gsLine++;
+			str++;
 		}
+	}
 
-		res = addShader(vs, gs, fs, vsLine, gsLine, fsLine, header, extra, fileName, attributeNames, nAttributes, flags);
-		delete shaderText;
+	int fsLine = 0;
+	if (fs != NULL){
+		*fs = '\0';
+		fs += 17;
+		while (*fs == '\r' || *fs == '\n') fs++;
+
+		char *str = shaderText;
+		while (str < fs){
+			if (*str == '\n') fsLine++;
+			str++;
+		}
 	}
-	return res;
+
+	return addShader(vs, gs, fs, vsLine, gsLine, fsLine, header, extra, fileName, attributeNames, nAttributes, flags);
 }
 
 int Renderer::getFormatSize(const AttributeFormat format) const {
@@ -293,6 +293,11 @@ public:
 	TextureID addTexture(const char *fileName, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, uint flags = 0);
 	TextureID addTexture(const char **fileNames, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, const int nArraySlices = 1, uint flags = 0);
   virtual TextureID addTexture(Image &img, const SamplerStateID samplerState = SS_NONE, uint flags = 0) = 0;
+	// Creates a texture for all levels of img but only uploads the levels from firstMipMap down, and samples only those.
+	// The larger levels can follow with uploadMipMaps(). Renderers without support upload everything right away.
+	virtual TextureID addPartialTexture(Image &img, const int firstMipMap, const SamplerStateID samplerState = SS_NONE, uint flags = 0){ return addTexture(img, samplerState, flags); }
+	// Uploads the levels from firstMipMap to the first level uploaded so far
+	virtual bool uploadMipMaps(const TextureID texture, Image &img, const int firstMipMap){ return true; }
 	TextureID addCubemap(const char **fileNames, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, const int nArraySlices = 1, uint flags = 0);
 	TextureID addNormalMap(const char *fileName, const FORMAT destFormat, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, float sZ = 1.0f, float mipMapScaleZ = 2.0f, uint flags = 0);
 
@@ -314,6 +319,8 @@ public:
 	ShaderID addShader(const char *fileName, const uint flags = 0);
 	ShaderID addShader(const char *fileName, const char *extra, const uint flags = 0);
 	ShaderID addShader(const char *fileName, const char **attributeNames, const int nAttributes, const char *extra = NULL, const uint flags = 0);
+	// Splits a shader file already in memory into its stages. The text is modified in place.
+	ShaderID addShaderSource(char *shaderText, const char *fileName, const char **attributeNames = NULL, const int nAttributes = 0, const char *extra = NULL, const uint flags = 0);
 	virtual ShaderID addShader(const char *vsText, const char *gsText, const char *fsText, const int vsLine, const int gsLine, const int fsLine,
 		const char *header = NULL, const char *extra = NULL, const char *fileName = NULL, const char **attributeNames = NULL, const int nAttributes = 0, const uint flags = 0) = 0;
 
@@ -322,6 +329,7 @@ public:
 	virtual VertexBufferID addVertexBuffer(const long size, const BufferAccess bufferAccess, const void *data = NULL) = 0;
 	virtual void deleteVertexBuffer(VertexBufferID bufferID) = 0;
 	virtual IndexBufferID addIndexBuffer(const uint nIndices, const uint indexSize, const BufferAccess bufferAccess, const void *data = NULL) = 0;
+	virtual void deleteIndexBuffer(IndexBufferID bufferID) = 0;
 
   virtual bool updateVertexBuffer(const VertexBufferID vertexBuffer, const intptr offset, const long size, const void *data) = 0;
 
@@ -507,16 +515,17 @@ public:
 	virtual void finish() = 0;
 
 protected:
-	Array <Texture> textures;
-	Array <Shader> shaders;
-	Array <VertexBuffer> vertexBuffers;
-	Array <IndexBuffer> indexBuffers;
+	// The resource structs are only defined by the API specific renderers
+	PlainArray <Texture> textures;
+	PlainArray <Shader> shaders;
+	PlainArray <VertexBuffer> vertexBuffers;
+	PlainArray <IndexBuffer> indexBuffers;
 	Array <TexFont> fonts;
-	Array <VertexFormat> vertexFormats;
-	Array <SamplerState> samplerStates;
-	Array <BlendState> blendStates;
-	Array <DepthState> depthStates;
-	Array <RasterizerState> rasterizerStates;
+	PlainArray <VertexFormat> vertexFormats;
+	PlainArray <SamplerState> samplerStates;
+	PlainArray <BlendState> blendStates;
+	PlainArray <DepthState> depthStates;
+	PlainArray <RasterizerState> rasterizerStates;
 
 	uint nImageUnits, nMRTs;
 	int maxAnisotropic;
@@ -0,0 +1,220 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Allocator.h"
+
+// Everything is handed out at this alignment, enough for SIMD types
+#define ARENA_ALIGNMENT 16
+
+static size_t alignSize(const size_t size){
+	return (size + ARENA_ALIGNMENT - 1) & ~size_t(ARENA_ALIGNMENT - 1);
+}
+
+struct ArenaBlock {
+	ArenaBlock *prev;
+	size_t size;
+	size_t used;
+	size_t last;
+
+	unsigned char *getData(){ return ((unsigned char *) this) + alignSize(sizeof(ArenaBlock)); }
+};
+
+MemoryArena::MemoryArena(const size_t blockSize){
+	current = NULL;
+	defaultBlockSize = blockSize;
+	totalSize = 0;
+	peakSize = 0;
+	nAllocations = 0;
+	nBlocks = 0;
+}
+
+MemoryArena::~MemoryArena(){
+	ArenaMark mark = { NULL, 0 };
+	rewind(mark);
+}
+
+ArenaBlock *MemoryArena::newBlock(const size_t size){
+	// Oversized allocations get a block of their own
+	size_t blockSize = (size > defaultBlockSize)? size : defaultBlockSize;
+
+	ArenaBlock *block = (ArenaBlock *) malloc(alignSize(sizeof(ArenaBlock)) + blockSize);
+	block->prev = current;
+	block->size = blockSize;
+	block->used = 0;
+	block->last = 0;
+	nBlocks++;
+
+	return block;
+}
+
+void *MemoryArena::allocate(const size_t size){
+	size_t aligned = alignSize(size);
+	if (current == NULL || current->used + aligned > current->size){
+		current = newBlock(aligned);
+	}
+
+	unsigned char *mem = current->getData() + current->used;
+	current->last = current->used;
+	current->used += aligned;
+
+	totalSize += aligned;
+	if (totalSize > peakSize) peakSize = totalSize;
+	nAllocations++;
+
+	return mem;
+}
+
+void *MemoryArena::reallocate(void *mem, const size_t oldSize, const size_t newSize){
+	if (mem == NULL) return allocate(newSize);
+
+	// The latest allocation can grow or shrink in place if the block has room for it
+	if (mem == current->getData() + current->last){
+		size_t aligned = alignSize(newSize);
+		if (current->last + aligned <= current->size){
+			totalSize = totalSize - (current->used - current->last) + aligned;
+			if (totalSize > peakSize) peakSize = totalSize;
+
+			current->used = current->last + aligned;
+			return mem;
+		}
+	}
+
+	void *newMem = allocate(newSize);
+	memcpy(newMem, mem, (oldSize < newSize)? oldSize : newSize);
+	return newMem;
+}
+
+void MemoryArena::release(void *mem, const size_t size){
+	// Only the latest allocation can be given back
+	if (mem != NULL && mem == current->getData() + current->last){
+		totalSize -= current->used - current->last;
+		current->used = current->last;
+	}
+}
+
+ArenaMark MemoryArena::getMark() const {
+	ArenaMark mark;
+	mark.block = current;
+	mark.used = (current != NULL)? current->used : 0;
+
+	return mark;
+}
+
+void MemoryArena::rewind(const ArenaMark &mark){
+	while (current != mark.block){
+		ArenaBlock *prev = current->prev;
+		totalSize -= current->used;
+		free(current);
+		nBlocks--;
+		current = prev;
+	}
+	if (current){
+		totalSize -= current->used - mark.used;
+		current->used = mark.used;
+		// Nothing below the mark may be grown or released anymore
+		current->last = current->size;
+	}
+}
+
+void MemoryArena::reset(){
+	// Keep the first block around for the next round
+	while (current != NULL && current->prev != NULL){
+		ArenaBlock *prev = current->prev;
+		free(current);
+		nBlocks--;
+		current = prev;
+	}
+	if (current){
+		current->used = 0;
+		current->last = current->size;
+	}
+	totalSize = 0;
+}
+
+/***************************************************************************************************/
+
+struct PoolBlock {
+	PoolBlock *next;
+};
+
+MemoryPool::MemoryPool(const size_t elemSize, const unsigned int elemsPerBlock){
+	// Free elements hold the free list link
+	elementSize = alignSize((elemSize > sizeof(void *))? elemSize : sizeof(void *));
+	elementsPerBlock = (elemsPerBlock > 0)? elemsPerBlock : 1;
+	blocks = NULL;
+	freeList = NULL;
+	nElements = 0;
+	nBlocks = 0;
+}
+
+MemoryPool::~MemoryPool(){
+	reset();
+}
+
+void *MemoryPool::allocate(const size_t size){
+	if (size > elementSize) return NULL;
+
+	if (freeList == NULL){
+		PoolBlock *block = (PoolBlock *) malloc(alignSize(sizeof(PoolBlock)) + elementsPerBlock * elementSize);
+		block->next = blocks;
+		blocks = block;
+		nBlocks++;
+
+		// Thread the new elements onto the free list, first element first
+		unsigned char *elements = ((unsigned char *) block) + alignSize(sizeof(PoolBlock));
+		for (unsigned int i = elementsPerBlock; i > 0; i--){
+			void *elem = elements + (i - 1) * elementSize;
+			*(void **) elem = freeList;
+			freeList = elem;
+		}
+	}
+
+	void *mem = freeList;
+	freeList = *(void **) mem;
+	nElements++;
+
+	return mem;
+}
+
+void *MemoryPool::reallocate(void *mem, const size_t oldSize, const size_t newSize){
+	if (mem == NULL) return allocate(newSize);
+
+	return (newSize <= elementSize)? mem : NULL;
+}
+
+void MemoryPool::release(void *mem, const size_t size){
+	if (mem == NULL) return;
+
+	*(void **) mem = freeList;
+	freeList = mem;
+	nElements--;
+}
+
+void MemoryPool::reset(){
+	while (blocks){
+		PoolBlock *next = blocks->next;
+		free(blocks);
+		blocks = next;
+	}
+	freeList = NULL;
+	nElements = 0;
+	nBlocks = 0;
+}
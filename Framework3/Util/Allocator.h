@@ -0,0 +1,123 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+// Raw memory for containers and node types. Nothing is constructed or destroyed, and the size
+// of each block is passed back on release, so allocators need not store it. Not thread safe.
+class Allocator {
+public:
+	virtual ~Allocator(){}
+
+	virtual void *allocate(const size_t size) = 0;
+	virtual void *reallocate(void *mem, const size_t oldSize, const size_t newSize) = 0;
+	virtual void release(void *mem, const size_t size) = 0;
+};
+
+struct ArenaBlock;
+
+struct ArenaMark {
+	ArenaBlock *block;
+	size_t used;
+};
+
+// Monotonic allocator for scratch memory during build phases. Allocations are carved out of large
+// blocks and freed all at once with reset() or back to a mark with rewind(). Only the most recent
+// allocation can grow in place or be released on its own, which suits arrays that are filled one
+// at a time and scratch used in a stack like fashion.
+class MemoryArena : public Allocator {
+public:
+	MemoryArena(const size_t blockSize = 64 * 1024);
+	~MemoryArena();
+
+	void *allocate(const size_t size);
+	void *reallocate(void *mem, const size_t oldSize, const size_t newSize);
+	void release(void *mem, const size_t size);
+
+	ArenaMark getMark() const;
+	void rewind(const ArenaMark &mark);
+	void reset();
+
+	unsigned int getAllocationCount() const { return nAllocations; }
+	unsigned int getBlockCount() const { return nBlocks; }
+	size_t getPeakSize() const { return peakSize; }
+
+protected:
+	ArenaBlock *newBlock(const size_t size);
+
+	ArenaBlock *current;
+	size_t defaultBlockSize;
+	size_t totalSize;
+	size_t peakSize;
+	unsigned int nAllocations;
+	unsigned int nBlocks;
+};
+
+// Fixed size allocator for node types. Released elements go on a free list and are handed out
+// again before new blocks are allocated. All memory is returned with reset() or on destruction.
+class MemoryPool : public Allocator {
+public:
+	MemoryPool(const size_t elemSize, const unsigned int elemsPerBlock = 256);
+	~MemoryPool();
+
+	void *allocate(const size_t size);
+	void *reallocate(void *mem, const size_t oldSize, const size_t newSize);
+	void release(void *mem, const size_t size);
+
+	void reset();
+
+	unsigned int getCount() const { return nElements; }
+	unsigned int getBlockCount() const { return nBlocks; }
+
+protected:
+	struct PoolBlock *blocks;
+	void *freeList;
+	size_t elementSize;
+	unsigned int elementsPerBlock;
+	unsigned int nElements;
+	unsigned int nBlocks;
+};
+
+// Typed pool that also constructs and destroys. Objects still alive when the pool is reset or
+// destroyed are not destroyed, so this is meant for types without destructors, or trees that
+// are torn down as a whole.
+template <class TYPE>
+class Pool : public MemoryPool {
+public:
+	Pool(const unsigned int elemsPerBlock = 256) : MemoryPool(sizeof(TYPE), elemsPerBlock){}
+
+	TYPE *newObject(){
+		return new (allocate(sizeof(TYPE))) TYPE;
+	}
+	void deleteObject(TYPE *object){
+		if (object){
+			object->~TYPE();
+			release(object, sizeof(TYPE));
+		}
+	}
+};
+
+#endif // _ALLOCATOR_H_
@@ -19,112 +19,612 @@
 *                                                                *
 \* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+
 #ifndef _ARRAY_H_
 #define _ARRAY_H_
 
 #include <stdlib.h>
 #include <string.h>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include "Allocator.h"
+#include "JobSystem.h"
 
+// Elements are constructed and destroyed in place, so any copyable or movable type can be stored.
+// Storage comes from malloc unless an allocator is given, in which case it must outlive the array.
+// References to elements stay valid until the array grows.
 template <class TYPE>
 class Array {
 public:
 	Array(){
-		count = capacity = 0;
-		list = NULL;
+		init(NULL, 0, NULL);
 	}
 
-	Array(const unsigned int iCapasity){
-		count = 0;
-		capacity = iCapasity;
-		list = (TYPE *) malloc(capacity * sizeof(TYPE));
+	Array(const unsigned int iCapasity, Allocator *iAllocator = NULL){
+		init(NULL, 0, iAllocator);
+		reserve(iCapasity);
+	}
+
+	Array(const Array &array){
+		init(NULL, 0, array.allocator);
+		copyFrom(array);
+	}
+
+	Array(Array &&array){
+		init(NULL, 0, array.allocator);
+		moveFrom(array);
 	}
 	
 	~Array(){
-		free(list);
+		destroy(0, count);
+		releaseList(list);
+	}
+
+	Array &operator = (const Array &array){
+		if (this != &array){
+			clear();
+			copyFrom(array);
+		}
+		return *this;
+	}
+
+	Array &operator = (Array &&array){
+		if (this != &array){
+			clear();
+			moveFrom(array);
+		}
+		return *this;
 	}
 
 	TYPE *getArray() const { return list; }
+	// The caller takes over the elements, which must then be freed with free() without being destroyed.
+	// Not for arrays with an allocator.
 	TYPE *abandonArray(){
 		TYPE *rList = list;
-		list = NULL;
+		if (list == inlineList){
+			rList = (TYPE *) malloc(count * sizeof(TYPE));
+			relocate(rList, list, count);
+		}
+		list = inlineList;
+		count = 0;
+		capacity = inlineCapacity;
 		return rList;
 	}
 
 	TYPE &operator [] (const unsigned int index) const { return list[index]; }
 	unsigned int getCount() const { return count; }
+	unsigned int getCapacity() const { return capacity; }
 
+	// New elements are default constructed, which leaves plain types uninitialized
 	void setCount(const unsigned int newCount){
-		capacity = count = newCount;
-		list = (TYPE *) realloc(list, capacity * sizeof(TYPE));
+		if (newCount > capacity) resize(newCount);
+
+		if (newCount > count){
+			for (unsigned int i = count; i < newCount; i++){
+				new (list + i) TYPE;
+			}
+		} else {
+			destroy(newCount, count);
+		}
+		count = newCount;
 	}
 
-	unsigned int add(const TYPE object){
+	void reserve(const unsigned int newCapacity){
+		if (newCapacity > capacity) resize(newCapacity);
+	}
+
+	unsigned int add(const TYPE &object){
 		if (count >= capacity){
-			if (capacity) capacity += capacity; else capacity = 8;
-			list = (TYPE *) realloc(list, capacity * sizeof(TYPE));
+			// The object may be an element of this array, so take a copy before the list moves
+			TYPE copy(object);
+			grow();
+			new (list + count) TYPE(std::move(copy));
+		} else {
+			new (list + count) TYPE(object);
+		}
+		return count++;
+	}
+
+	unsigned int add(TYPE &&object){
+		if (count >= capacity){
+			TYPE temp(std::move(object));
+			grow();
+			new (list + count) TYPE(std::move(temp));
+		} else {
+			new (list + count) TYPE(std::move(object));
+		}
+		return count++;
+	}
+
+	// Constructs the new element in place from the arguments
+	template <class... ARGS>
+	unsigned int emplace(ARGS &&... args){
+		if (count >= capacity){
+			TYPE temp(std::forward<ARGS>(args)...);
+			grow();
+			new (list + count) TYPE(std::move(temp));
+		} else {
+			new (list + count) TYPE(std::forward<ARGS>(args)...);
 		}
-		list[count] = object;
 		return count++;
 	}
 
 	void fastRemove(const unsigned int index){
 		if (index < count){
 			count--;
-			list[index] = list[count];
+			if (index != count) list[index] = std::move(list[count]);
+			list[count].~TYPE();
 		}
 	}
 
 	void orderedRemove(const unsigned int index){
 		if (index < count){
 			count--;
-			memmove(list + index, list + index + 1, (count - index) * sizeof(TYPE));
+			for (unsigned int i = index; i < count; i++){
+				list[i] = std::move(list[i + 1]);
+			}
+			list[count].~TYPE();
 		}
 	}
 
 	void clear(){
+		destroy(0, count);
 		count = 0;
 	}
 
 	void reset(){
-		free(list);
-		list = NULL;
-		count = capacity = 0;
+		destroy(0, count);
+		releaseList(list);
+		list = inlineList;
+		count = 0;
+		capacity = inlineCapacity;
+	}
+
+protected:
+	// For arrays with inline storage of bufferCapacity elements
+	Array(TYPE *buffer, const unsigned int bufferCapacity){
+		init(buffer, bufferCapacity, NULL);
 	}
 
 private:
-	int partition(int (*compare)(const TYPE &elem0, const TYPE &elem1), int p, int r){
-		TYPE tmp, pivot = list[p];
-		int left = p;
-
-		for (int i = p + 1; i <= r; i++){
-			if (compare(list[i], pivot) < 0){
-				left++;
-				tmp = list[i];
-				list[i] = list[left];
-				list[left] = tmp;
+	void init(TYPE *buffer, const unsigned int bufferCapacity, Allocator *iAllocator){
+		list = inlineList = buffer;
+		count = 0;
+		capacity = inlineCapacity = bufferCapacity;
+		allocator = iAllocator;
+	}
+
+	void grow(){
+		resize(capacity? capacity + capacity : 8);
+	}
+
+	void resize(const unsigned int newCapacity){
+		if (list != inlineList){
+			resize(newCapacity, std::is_trivially_copyable<TYPE>());
+		} else {
+			resize(newCapacity, std::false_type());
+		}
+	}
+
+	// Plain types can be moved with realloc, which may grow the list in place
+	void resize(const unsigned int newCapacity, std::true_type){
+		if (allocator){
+			list = (TYPE *) allocator->reallocate(list, capacity * sizeof(TYPE), newCapacity * sizeof(TYPE));
+		} else {
+			list = (TYPE *) realloc((void *) list, newCapacity * sizeof(TYPE));
+		}
+		capacity = newCapacity;
+	}
+
+	void resize(const unsigned int newCapacity, std::false_type){
+		TYPE *newList = (newCapacity <= inlineCapacity)? inlineList : (TYPE *) (allocator? allocator->allocate(newCapacity * sizeof(TYPE)) : malloc(newCapacity * sizeof(TYPE)));
+		if (newList != list){
+			relocate(newList, list, count);
+			releaseList(list);
+			list = newList;
+		}
+		capacity = (newList == inlineList)? inlineCapacity : newCapacity;
+	}
+
+	void releaseList(TYPE *oldList){
+		if (oldList == inlineList) return;
+
+		if (allocator){
+			allocator->release(oldList, capacity * sizeof(TYPE));
+		} else {
+			free(oldList);
+		}
+	}
+
+	// Moves n elements into uninitialized memory, leaving the source destroyed
+	static void relocate(TYPE *dest, TYPE *src, const unsigned int n){
+		relocate(dest, src, n, std::is_trivially_copyable<TYPE>());
+	}
+
+	static void relocate(TYPE *dest, TYPE *src, const unsigned int n, std::true_type){
+		if (n) memcpy((void *) dest, (const void *) src, n * sizeof(TYPE));
+	}
+
+	static void relocate(TYPE *dest, TYPE *src, const unsigned int n, std::false_type){
+		for (unsigned int i = 0; i < n; i++){
+			new (dest + i) TYPE(std::move(src[i]));
+			src[i].~TYPE();
+		}
+	}
+
+	void destroy(const unsigned int first, const unsigned int last){
+		if (!std::is_trivially_destructible<TYPE>::value){
+			for (unsigned int i = first; i < last; i++){
+				list[i].~TYPE();
 			}
 		}
-		tmp = list[p];
-		list[p] = list[left];
-		list[left] = tmp;
-		return left;
 	}
 
-	void quickSort(int (*compare)(const TYPE &elem0, const TYPE &elem1), int p, int r){
-		if (p < r){
-			int q = partition(compare, p, r);
-			quickSort(compare, p, q - 1);
-			quickSort(compare, q + 1, r);
+	void copyFrom(const Array &array){
+		reserve(array.count);
+		for (unsigned int i = 0; i < array.count; i++){
+			new (list + i) TYPE(array.list[i]);
+		}
+		count = array.count;
+	}
+
+	// Takes over the list of an empty array, or the elements one by one if they are stored inline
+	void moveFrom(Array &array){
+		if (array.list != array.inlineList){
+			releaseList(list);
+			list = array.list;
+			capacity = array.capacity;
+			allocator = array.allocator;
+			count = array.count;
+		} else {
+			reserve(array.count);
+			relocate(list, array.list, array.count);
+			count = array.count;
 		}
+		array.list = array.inlineList;
+		array.count = 0;
+		array.capacity = array.inlineCapacity;
 	}
+
+	typedef int (*CompareFunc)(const TYPE &elem0, const TYPE &elem1);
+
+	// Ranges up to this size are finished with insertion sort
+	enum { SORT_THRESHOLD = 16, SORT_RUN = 32 };
+
+	static void insertionSort(TYPE *first, TYPE *last, CompareFunc compare){
+		if (last - first < 2) return;
+
+		for (TYPE *i = first + 1; i < last; i++){
+			if (compare(*i, *(i - 1)) < 0){
+				TYPE temp(std::move(*i));
+				TYPE *j = i;
+				do {
+					*j = std::move(*(j - 1));
+					j--;
+				} while (j > first && compare(temp, *(j - 1)) < 0);
+				*j = std::move(temp);
+			}
+		}
+	}
+
+	static void siftDown(TYPE *heap, unsigned int root, const unsigned int n, CompareFunc compare){
+		unsigned int child;
+		while ((child = 2 * root + 1) < n){
+			if (child + 1 < n && compare(heap[child], heap[child + 1]) < 0) child++;
+			if (compare(heap[root], heap[child]) >= 0) break;
+
+			std::swap(heap[root], heap[child]);
+			root = child;
+		}
+	}
+
+	static void heapSort(TYPE *first, TYPE *last, CompareFunc compare){
+		unsigned int n = (unsigned int) (last - first);
+		for (unsigned int i = n / 2; i > 0; i--){
+			siftDown(first, i - 1, n, compare);
+		}
+		for (unsigned int i = n - 1; i > 0; i--){
+			std::swap(first[0], first[i]);
+			siftDown(first, 0, i, compare);
+		}
+	}
+
+	// Moves the median of the first, middle and last elements to the front and partitions the rest around it.
+	// The median guarantees both scans stop inside the range, and stopping on equal elements keeps the split
+	// balanced for inputs with many duplicates.
+	static TYPE *partition(TYPE *first, TYPE *last, CompareFunc compare){
+		TYPE *a = first + 1, *b = first + (last - first) / 2, *c = last - 1;
+		if (compare(*a, *b) < 0){
+			if (compare(*b, *c) < 0) std::swap(*first, *b); else if (compare(*a, *c) < 0) std::swap(*first, *c); else std::swap(*first, *a);
+		} else {
+			if (compare(*a, *c) < 0) std::swap(*first, *a); else if (compare(*b, *c) < 0) std::swap(*first, *c); else std::swap(*first, *b);
+		}
+
+		TYPE *lo = first + 1, *hi = last;
+		while (true){
+			while (compare(*lo, *first) < 0) lo++;
+			hi--;
+			while (compare(*first, *hi) < 0) hi--;
+			if (lo >= hi) return lo;
+
+			std::swap(*lo, *hi);
+			lo++;
+		}
+	}
+
+	static void introSort(TYPE *first, TYPE *last, unsigned int depth, CompareFunc compare){
+		while (last - first > SORT_THRESHOLD){
+			if (depth == 0){
+				heapSort(first, last, compare);
+				return;
+			}
+			depth--;
+
+			// Recurse into the smaller part and loop on the larger one so the stack stays O(log n)
+			TYPE *cut = partition(first, last, compare);
+			if (cut - first < last - cut){
+				introSort(first, cut, depth, compare);
+				first = cut;
+			} else {
+				introSort(cut, last, depth, compare);
+				last = cut;
+			}
+		}
+		insertionSort(first, last, compare);
+	}
+
+	// Number of elements from a among the first k elements of the stable merge of a and b
+	static unsigned int mergeSplit(const TYPE *a, const unsigned int na, const TYPE *b, const unsigned int nb, const unsigned int k, CompareFunc compare){
+		unsigned int lo = (k > nb)? k - nb : 0;
+		unsigned int hi = (k < na)? k : na;
+		while (lo < hi){
+			unsigned int mid = (lo + hi) / 2;
+			if (compare(b[k - mid - 1], a[mid]) < 0){
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		return lo;
+	}
+
+	// Merges [a, aEnd) and [b, bEnd) into uninitialized memory at dest, leaving the sources destroyed.
+	// Ties are taken from a, which keeps the sort stable.
+	static void merge(TYPE *a, TYPE *aEnd, TYPE *b, TYPE *bEnd, TYPE *dest, CompareFunc compare){
+		if (a < aEnd && b < bEnd && compare(*b, *(aEnd - 1)) >= 0){
+			// Already in order, which is common for nearly sorted input
+			relocate(dest, a, (unsigned int) (aEnd - a));
+			relocate(dest + (aEnd - a), b, (unsigned int) (bEnd - b));
+			return;
+		}
+
+		while (a < aEnd && b < bEnd){
+			TYPE *src = (compare(*b, *a) < 0)? b++ : a++;
+			new (dest++) TYPE(std::move(*src));
+			src->~TYPE();
+		}
+		relocate(dest, a, (unsigned int) (aEnd - a));
+		relocate(dest + (aEnd - a), b, (unsigned int) (bEnd - b));
+	}
+
+	struct MergePass {
+		TYPE *src, *dest;
+		unsigned int count, width, splits;
+		unsigned int *splitPoints;
+		CompareFunc compare;
+	};
+
+	static void sortRuns(void *data, const unsigned int start, const unsigned int end){
+		MergePass *pass = (MergePass *) data;
+		for (unsigned int i = start; i < end; i++){
+			unsigned int first = i * SORT_RUN;
+			unsigned int last = (first + SORT_RUN < pass->count)? first + SORT_RUN : pass->count;
+			insertionSort(pass->src + first, pass->src + last, pass->compare);
+		}
+	}
+
+	// Each task merges a part of a pair of runs, so a pass can be spread over more threads than there are pairs.
+	// Task t covers output [k0, k1) of its pair and starts at splitPoints[t] in the first run.
+	static void mergeRuns(void *data, const unsigned int start, const unsigned int end){
+		MergePass *pass = (MergePass *) data;
+		for (unsigned int t = start; t < end; t++){
+			unsigned int pair = t / pass->splits, piece = t % pass->splits;
+			unsigned int first = pair * 2 * pass->width;
+			unsigned int mid  = (first + pass->width < pass->count)? first + pass->width : pass->count;
+			unsigned int last = (mid + pass->width < pass->count)? mid + pass->width : pass->count;
+
+			TYPE *a = pass->src + first, *b = pass->src + mid;
+			unsigned int na = mid - first, nb = last - mid;
+
+			unsigned int k0 = (unsigned int) (uint64(na + nb) * piece / pass->splits);
+			unsigned int k1 = (unsigned int) (uint64(na + nb) * (piece + 1) / pass->splits);
+			unsigned int i0 = (piece == 0)? 0 : pass->splitPoints[t];
+			unsigned int i1 = (piece == pass->splits - 1)? na : pass->splitPoints[t + 1];
+
+			merge(a + i0, a + i1, b + (k0 - i0), b + (k1 - i1), pass->dest + first + k0, pass->compare);
+		}
+	}
+
+	// Split points have to be found before any task starts moving elements out of the runs
+	static void findSplitPoints(MergePass *pass, const unsigned int nTasks){
+		for (unsigned int t = 0; t < nTasks; t++){
+			unsigned int pair = t / pass->splits, piece = t % pass->splits;
+			if (piece == 0) continue;
+
+			unsigned int first = pair * 2 * pass->width;
+			unsigned int mid  = (first + pass->width < pass->count)? first + pass->width : pass->count;
+			unsigned int last = (mid + pass->width < pass->count)? mid + pass->width : pass->count;
+			unsigned int na = mid - first, nb = last - mid;
+
+			unsigned int k = (unsigned int) (uint64(na + nb) * piece / pass->splits);
+			pass->splitPoints[t] = mergeSplit(pass->src + first, na, pass->src + mid, nb, k, pass->compare);
+		}
+	}
+
+	// Bottom-up merge sort that ping-pongs between the list and a scratch buffer. With threads > 1 the
+	// passes are spread over parallelFor, each task covering at least about minRange elements.
+	void mergeSort(CompareFunc compare, const unsigned int threads, const unsigned int minRange){
+		if (count < 2) return;
+
+		TYPE *temp = (TYPE *) malloc(count * sizeof(TYPE));
+
+		MergePass pass;
+		pass.src = list;
+		pass.dest = temp;
+		pass.count = count;
+		pass.splitPoints = NULL;
+		pass.compare = compare;
+
+		unsigned int nRuns = (count + SORT_RUN - 1) / SORT_RUN;
+		if (threads > 1){
+			parallelFor(sortRuns, &pass, nRuns, minRange / SORT_RUN + 1);
+		} else {
+			sortRuns(&pass, 0, nRuns);
+		}
+
+		for (pass.width = SORT_RUN; pass.width < count; pass.width *= 2){
+			unsigned int nPairs = (unsigned int) ((uint64(count) + 2 * pass.width - 1) / (2 * pass.width));
+
+			// Split the merges when there are fewer pairs than threads, but not below minRange elements per task
+			pass.splits = 1;
+			if (threads > nPairs){
+				unsigned int maxSplits = (unsigned int) (uint64(2 * pass.width) / (minRange + 1)) + 1;
+				pass.splits = threads / nPairs;
+				if (pass.splits > maxSplits) pass.splits = maxSplits;
+			}
+
+			unsigned int nTasks = nPairs * pass.splits;
+			if (pass.splits > 1){
+				pass.splitPoints = (unsigned int *) realloc(pass.splitPoints, nTasks * sizeof(unsigned int));
+				findSplitPoints(&pass, nTasks);
+			}
+			if (threads > 1){
+				parallelFor(mergeRuns, &pass, nTasks, minRange / (2 * pass.width) + 1);
+			} else {
+				mergeRuns(&pass, 0, nTasks);
+			}
+			std::swap(pass.src, pass.dest);
+		}
+
+		if (pass.src != list) relocate(list, pass.src, count);
+		free(pass.splitPoints);
+		free(temp);
+	}
+
 public:
-	void sort(int (*compare)(const TYPE &elem0, const TYPE &elem1)){
-		quickSort(compare, 0, count - 1);
+	// Introsort: quicksort with median of three pivots, falling back to heap sort if the recursion goes
+	// too deep. O(n log n) worst case, but the order of equal elements is not preserved.
+	void sort(CompareFunc compare){
+		unsigned int depth = 0;
+		for (unsigned int n = count; n > 1; n >>= 1) depth += 2;
+
+		introSort(list, list + count, depth, compare);
+	}
+
+	// Merge sort, keeps equal elements in their original order. Needs a scratch buffer the size of the array.
+	void stableSort(CompareFunc compare){
+		mergeSort(compare, 1, 0);
+	}
+
+	// Stable merge sort spread over all cores, falling back to stableSort() for small arrays.
+	// The compare function is called from several threads at once.
+	void parallelSort(CompareFunc compare, const unsigned int minRange = 16384){
+		unsigned int threads = (count < 2 * minRange)? 1 : getWorkerCount();
+
+		mergeSort(compare, threads, minRange);
 	}
+
 protected:
 	unsigned int capacity;
 	unsigned int count;
 	TYPE *list;
+	Allocator *allocator;
+
+	TYPE *inlineList;
+	unsigned int inlineCapacity;
+};
+
+// Array with room for N elements inside the object itself, for short lived lists that usually stay
+// small. It only goes to the heap once it outgrows that, and can be passed wherever an Array is taken.
+template <class TYPE, unsigned int N>
+class SmallArray : public Array <TYPE> {
+public:
+	SmallArray() : Array <TYPE>((TYPE *) buffer, N){}
+
+	SmallArray(const Array <TYPE> &array) : Array <TYPE>((TYPE *) buffer, N){
+		Array <TYPE>::operator = (array);
+	}
+	SmallArray(const SmallArray &array) : Array <TYPE>((TYPE *) buffer, N){
+		Array <TYPE>::operator = (array);
+	}
+	SmallArray(Array <TYPE> &&array) : Array <TYPE>((TYPE *) buffer, N){
+		Array <TYPE>::operator = (std::move(array));
+	}
+	SmallArray(SmallArray &&array) : Array <TYPE>((TYPE *) buffer, N){
+		Array <TYPE>::operator = (std::move(array));
+	}
+
+	SmallArray &operator = (const Array <TYPE> &array){
+		Array <TYPE>::operator = (array);
+		return *this;
+	}
+	SmallArray &operator = (const SmallArray &array){
+		Array <TYPE>::operator = (array);
+		return *this;
+	}
+	SmallArray &operator = (Array <TYPE> &&array){
+		Array <TYPE>::operator = (std::move(array));
+		return *this;
+	}
+	SmallArray &operator = (SmallArray &&array){
+		Array <TYPE>::operator = (std::move(array));
+		return *this;
+	}
+
+private:
+	alignas(TYPE) unsigned char buffer[N * sizeof(TYPE)];
+};
+
+// Growable list of plain data that only ever allocates and frees, without knowing its element type otherwise. Unlike
+// Array, it can be declared and destroyed where TYPE is only forward declared, as the renderer does with the resources
+// that each API defines for itself. Only the code adding elements needs the complete type.
+template <class TYPE>
+class PlainArray {
+public:
+	PlainArray(){
+		count = capacity = 0;
+		list = NULL;
+	}
+
+	~PlainArray(){
+		free(list);
+	}
+
+	TYPE *getArray() const { return list; }
+	TYPE &operator [] (const unsigned int index) const { return list[index]; }
+	unsigned int getCount() const { return count; }
+
+	unsigned int add(const TYPE &object){
+		if (count >= capacity){
+			capacity = capacity? capacity + capacity : 8;
+			list = (TYPE *) realloc((void *) list, capacity * sizeof(TYPE));
+		}
+		memcpy((void *) (list + count), (const void *) &object, sizeof(TYPE));
+		return count++;
+	}
+
+	void clear(){
+		count = 0;
+	}
+
+private:
+	PlainArray(const PlainArray &);
+	PlainArray &operator = (const PlainArray &);
+
+	unsigned int capacity;
+	unsigned int count;
+	TYPE *list;
 };
 
 #endif // _ARRAY_H_
@@ -196,11 +196,6 @@ bool BTri::isAbove3DNow(v2sf v0XY, v2sf v0Z1) const {
 }
 #endif
 
-BNode::~BNode(){
-    delete back;
-	delete front;
-}
-
 no_alias bool BNode::intersects(const vec3 &v0, const vec3 &v1, const vec3 &dir, vec3 *point, const BTri **triangle) const {
 #if 0
 	float d0 = planeDistance(tri.plane, v0);
@@ -476,19 +471,19 @@ no_alias void BNode::getDistance(const vec3 &pos, float &minDist) const {
 	}
 }
 
-void BNode::read(FILE *file){
+void BNode::read(FILE *file, Pool <BNode> &nodes){
 	fread(&tri.v, sizeof(tri.v), 1, file);
 	tri.finalize();
 
 	int flags = 0;
 	fread(&flags, sizeof(int), 1, file);
 	if (flags & 1){
-		back = new BNode;
-		back->read(file);
+		back = nodes.newObject();
+		back->read(file, nodes);
 	} else back = NULL;
 	if (flags & 2){
-		front = new BNode;
-		front->read(file);
+		front = nodes.newObject();
+		front->read(file, nodes);
 	} else front = NULL;
 }
 
@@ -554,7 +549,7 @@ void BNode::build(Array <BTri> &tris){
 }
 */
 
-void BNode::build(Array <BTri> &tris, const int splitCost, const int balCost, const float epsilon){
+void BNode::build(Array <BTri> &tris, const int splitCost, const int balCost, const float epsilon, MemoryArena &arena, Pool <BNode> &nodes){
 	uint index = 0;
 	int minScore = 0x7FFFFFFF;
 
@@ -584,46 +579,69 @@ void BNode::build(Array <BTri> &tris, const int splitCost, const int balCost, co
 	tri = tris[index];
 	tris.fastRemove(index);
 
-	Array <BTri> backTris;
-	Array <BTri> frontTris;
+	// Count first so that both sides can be allocated up front, a split adding at most two triangles to each
+	uint nBack = 0, nFront = 0;
 	for (uint i = 0; i < tris.getCount(); i++){
-
 		uint neg = 0, pos = 0;
 		for (uint j = 0; j < 3; j++){
 			float dist = planeDistance(tri.plane, tris[i].v[j]);
-            if (dist < -epsilon) neg++; else
+			if (dist < -epsilon) neg++; else
 			if (dist >  epsilon) pos++;
 		}
 
 		if (neg){
-			if (pos){
-				BTri newTris[3];
-				int nPos, nNeg;
-				tris[i].split(newTris, nPos, nNeg, tri.plane, epsilon);
-				for (int i = 0; i < nPos; i++){
-					frontTris.add(newTris[i]);
-				}
-				for (int i = 0; i < nNeg; i++){
-					backTris.add(newTris[nPos + i]);
+			nBack  += pos? 2 : 1;
+			nFront += pos? 2 : 0;
+		} else {
+			nFront++;
+		}
+	}
+
+	// Both sides are scratch for the subtrees only, which leave the arena as they found it
+	ArenaMark mark = arena.getMark();
+	{
+		Array <BTri> backTris(nBack, &arena);
+		Array <BTri> frontTris(nFront, &arena);
+		for (uint i = 0; i < tris.getCount(); i++){
+
+			uint neg = 0, pos = 0;
+			for (uint j = 0; j < 3; j++){
+				float dist = planeDistance(tri.plane, tris[i].v[j]);
+				if (dist < -epsilon) neg++; else
+				if (dist >  epsilon) pos++;
+			}
+
+			if (neg){
+				if (pos){
+					BTri newTris[3];
+					int nPos, nNeg;
+					tris[i].split(newTris, nPos, nNeg, tri.plane, epsilon);
+					for (int i = 0; i < nPos; i++){
+						frontTris.add(newTris[i]);
+					}
+					for (int i = 0; i < nNeg; i++){
+						backTris.add(newTris[nPos + i]);
+					}
+				} else {
+					backTris.add(tris[i]);
 				}
 			} else {
-				backTris.add(tris[i]);
+				frontTris.add(tris[i]);
 			}
-		} else {
-			frontTris.add(tris[i]);
 		}
-	}
-	tris.reset();
+		tris.reset();
 
-	if (backTris.getCount() > 0){
-		back = new BNode;
-		back->build(backTris, splitCost, balCost, epsilon);
-	} else back = NULL;
+		if (backTris.getCount() > 0){
+			back = nodes.newObject();
+			back->build(backTris, splitCost, balCost, epsilon, arena, nodes);
+		} else back = NULL;
 
-	if (frontTris.getCount() > 0){
-		front = new BNode;
-		front->build(frontTris, splitCost, balCost, epsilon);
-	} else front = NULL;
+		if (frontTris.getCount() > 0){
+			front = nodes.newObject();
+			front->build(frontTris, splitCost, balCost, epsilon, arena, nodes);
+		} else front = NULL;
+	}
+	arena.rewind(mark);
 }
 
 #ifdef USE_SIMD
@@ -659,9 +677,15 @@ void BSP::addTriangle(const vec3 &v0, const vec3 &v1, const vec3 &v2, void *data
 void BSP::build(const int splitCost, const int balCost, const float epsilon){
 //	int nTris = tris.getCount();
 
-	top = new BNode;
+	nodes.reset();
+	top = NULL;
+	if (tris.getCount() == 0) return;
+
+	MemoryArena arena(256 * 1024);
+
+	top = nodes.newObject();
 //	top->build(tris);
-	top->build(tris, splitCost, balCost, epsilon);
+	top->build(tris, splitCost, balCost, epsilon, arena, nodes);
 /*
 	SSENode *mem = new SSENode[nTris * 4];
 
@@ -818,13 +842,10 @@ bool BSP::loadFile(const char *fileName){
 	FILE *file = fopen(fileName, "rb");
 	if (file == NULL) return false;
 
-	delete top;
-
-	top = new BNode;
-	top->read(file);
+	bool result = read(file);
 	fclose(file);
 
-	return true;
+	return result;
 }
 
 bool BSP::saveFile(const char *fileName) const {
@@ -833,10 +854,27 @@ bool BSP::saveFile(const char *fileName) const {
 	FILE *file = fopen(fileName, "wb");
 	if (file == NULL) return false;
 
-	top->write(file);
+	bool result = write(file);
 	fclose(file);
 
-	return true;
+	return result;
+}
+
+bool BSP::read(FILE *file){
+	nodes.reset();
+
+	top = nodes.newObject();
+	top->read(file, nodes);
+
+	return (ferror(file) == 0 && !feof(file));
+}
+
+bool BSP::write(FILE *file) const {
+	if (top == NULL) return false;
+
+	top->write(file);
+
+	return (ferror(file) == 0);
 }
 
 #ifdef _WIN32
@@ -29,6 +29,7 @@
 #include "../Platform.h"
 #include "../Math/Vector.h"
 #include "Array.h"
+#include "Allocator.h"
 #include <stdio.h>
 
 
@@ -57,9 +58,8 @@ struct BTri {
 	void *data;
 };
 
+// Nodes live in the pool of the owning BSP and are freed all at once along with it
 struct BNode {
-	~BNode();
-
 	bool intersects(const vec3 &v0, const vec3 &v1, const vec3 &dir, vec3 *point, const BTri **triangle) const;
 	BTri *intersectsCached(const vec3 &v0, const vec3 &v1, const vec3 &dir) const;
 #ifdef USE_SIMD
@@ -69,10 +69,10 @@ struct BNode {
 	bool pushSphere(vec3 &pos, const float radius) const;
 	void getDistance(const vec3 &pos, float &minDist) const;
 
-	void build(Array <BTri> &tris, const int splitCost, const int balCost, const float epsilon);
+	void build(Array <BTri> &tris, const int splitCost, const int balCost, const float epsilon, MemoryArena &arena, Pool <BNode> &nodes);
 	//void build(Array <BTri> &tris);
 
-	void read(FILE *file);
+	void read(FILE *file, Pool <BNode> &nodes);
 	void write(FILE *file) const;
 
 	
@@ -112,7 +112,6 @@ public:
 #ifdef USE_SIMD
 		delete sseDest;
 #endif
-		delete top;
 	}
 
 	void addTriangle(const vec3 &v0, const vec3 &v1, const vec3 &v2, void *data = NULL);
@@ -135,9 +134,13 @@ public:
 
 	bool loadFile(const char *fileName);
 	bool saveFile(const char *fileName) const;
+	// Reads or writes the tree at the current position, so it can be embedded in other files
+	bool read(FILE *file);
+	bool write(FILE *file) const;
 
 protected:
 	Array <BTri> tris;
+	Pool <BNode> nodes;
 	BNode *top;
 	BTri *cache;
 #ifdef USE_SIMD
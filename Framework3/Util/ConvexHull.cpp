@@ -45,7 +45,7 @@ void ConvexHull::Clear()
 		{
 			next = node->Next;
 
-			delete node;
+			m_NodePool.deleteObject(node);
 			node = next;
 		} while (node != m_Root);
 
@@ -59,7 +59,7 @@ bool ConvexHull::InsertPoint(const float2 &point)
 {
 	if (m_Count < 2)
 	{
-		CHNode *node = new CHNode;
+		CHNode *node = m_NodePool.newObject();
 		node->Point = point;
 
 		if (m_Root == NULL)
@@ -144,12 +144,12 @@ bool ConvexHull::InsertPoint(const float2 &point)
 
 		CHNode *del = node;
 		node = node->Next;
-		delete del;
+		m_NodePool.deleteObject(del);
 		--m_Count;
 
 	} while (true);
 
-	CHNode *new_node = new CHNode;
+	CHNode *new_node = m_NodePool.newObject();
 	new_node->Point = point;
 	++m_Count;
 
@@ -268,7 +268,7 @@ bool ConvexHull::RemoveLeastRelevantEdge()
 		if (del == m_Root)
 			m_Root = min_node;
 
-		delete del;
+		m_NodePool.deleteObject(del);
 
 		--m_Count;
 
@@ -24,6 +24,7 @@
 
 #include "../Platform.h"
 #include "../Math/Vector.h"
+#include "Allocator.h"
 
 struct CHNode
 {
@@ -58,6 +59,9 @@ protected:
 	CHNode *m_Curr;
 	uint m_Count;
 
+	// Nodes are recycled through the pool as points come and go
+	Pool<CHNode> m_NodePool;
+
 };
 
 #endif // _CONVEXHULL_H_
@@ -26,6 +26,14 @@
 #define NULL 0
 #endif
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define HASH_SSE2
+#include <emmintrin.h>
+#endif
+
 struct HashEntry {
 	unsigned int *value;
 	HashEntry *next;
@@ -35,8 +43,12 @@ struct HashEntry {
 
 class Hash {
 public:
+	// The capasity is a hint; values inserted past it go into further blocks of the same size
 	Hash(const unsigned int dim, const unsigned int entryCount, const unsigned int capasity){
-		curr = mem = (unsigned char *) malloc(entryCount * sizeof(HashEntry *) + capasity * (sizeof(HashEntry) + sizeof(unsigned int) * dim));
+		blockSize = capasity * (sizeof(HashEntry) + sizeof(unsigned int) * dim);
+		curr = mem = (unsigned char *) malloc(entryCount * sizeof(HashEntry *) + blockSize);
+		end = curr + entryCount * sizeof(HashEntry *) + blockSize;
+		extraBlocks = NULL;
 
 
 		nDim = dim;
@@ -49,6 +61,11 @@ public:
 	}
 
 	~Hash(){
+		while (extraBlocks){
+			unsigned char *next = *(unsigned char **) extraBlocks;
+			free(extraBlocks);
+			extraBlocks = next;
+		}
 		free(mem);
 /*
 		for (unsigned int i = 0; i < nEntries; i++){
@@ -116,12 +133,168 @@ protected:
 
 
 	void *newMem(const unsigned int size){
+		if (curr + size > end){
+			// Out of room, so chain on another block with a link to the previous one first
+			size_t newSize = sizeof(unsigned char *) + ((size > blockSize)? size : blockSize);
+			unsigned char *block = (unsigned char *) malloc(newSize);
+			*(unsigned char **) block = extraBlocks;
+			extraBlocks = block;
+
+			curr = block + sizeof(unsigned char *);
+			end = block + newSize;
+		}
+
 		unsigned char *rmem = curr;
 		curr += size;
 		return rmem;
 	}
 
-	unsigned char *mem, *curr;
+	unsigned char *mem, *curr, *end;
+	unsigned char *extraBlocks;
+	size_t blockSize;
+};
+
+
+/*
+	Open addressing hash of fixed size keys of DIM unsigned ints. Like Hash, each unique key
+	is numbered in the order it was first inserted. Key storage is sized from the expected
+	number of keys and doubles if more come in, and the table is kept at most half full.
+	Keys of a multiple of four ints are compared with SSE2 where available.
+*/
+inline unsigned int rotateLeft(const unsigned int x, const int r){
+	return (x << r) | (x >> (32 - r));
+}
+
+struct IndexHashSlot {
+	unsigned int hash;
+	unsigned int index;
+};
+
+template <unsigned int DIM>
+class IndexHash {
+public:
+	IndexHash(const unsigned int capasity){
+		// Meshes typically share each vertex between several indices, so start at a fraction
+		// of the capasity and grow as needed. Growing is cheap since the hashes are stored.
+		tableSize = 16;
+		while (tableSize < capasity / 8) tableSize <<= 1;
+
+		table = new IndexHashSlot[tableSize];
+		memset(table, 0xFF, tableSize * sizeof(IndexHashSlot));
+
+		keyCapasity = (capasity > 16)? capasity : 16;
+		keys = new unsigned int[keyCapasity * DIM];
+		count = 0;
+	}
+
+	~IndexHash(){
+		delete [] table;
+		delete [] keys;
+	}
+
+	bool insert(const unsigned int *value, unsigned int *index){
+		unsigned int hash = hashKey(value);
+
+		unsigned int mask = tableSize - 1;
+		unsigned int slot = hash & mask;
+		while (true){
+			unsigned int entry = table[slot].index;
+			if (entry == 0xFFFFFFFF) break;
+
+			// The stored hash rejects nearly all mismatches without touching the key
+			if (table[slot].hash == hash && isEqual(keys + entry * DIM, value)){
+				*index = entry;
+				return true;
+			}
+			slot = (slot + 1) & mask;
+		}
+
+		if (count == keyCapasity) growKeys();
+
+		memcpy(keys + count * DIM, value, DIM * sizeof(unsigned int));
+		table[slot].hash = hash;
+		table[slot].index = count;
+
+		*index = count++;
+		if (2 * count > tableSize) grow();
+
+		return false;
+	}
+
+	unsigned int getCount() const { return count; }
+
+protected:
+	void growKeys(){
+		unsigned int *oldKeys = keys;
+
+		keyCapasity *= 2;
+		keys = new unsigned int[keyCapasity * DIM];
+		memcpy(keys, oldKeys, count * DIM * sizeof(unsigned int));
+
+		delete [] oldKeys;
+	}
+
+	void grow(){
+		IndexHashSlot *oldTable = table;
+		unsigned int oldSize = tableSize;
+
+		tableSize *= 2;
+		table = new IndexHashSlot[tableSize];
+		memset(table, 0xFF, tableSize * sizeof(IndexHashSlot));
+
+		unsigned int mask = tableSize - 1;
+		for (unsigned int i = 0; i < oldSize; i++){
+			if (oldTable[i].index != 0xFFFFFFFF){
+				unsigned int slot = oldTable[i].hash & mask;
+				while (table[slot].index != 0xFFFFFFFF) slot = (slot + 1) & mask;
+				table[slot] = oldTable[i];
+			}
+		}
+		delete [] oldTable;
+	}
+
+	// MurmurHash3 style mixing
+	static unsigned int hashKey(const unsigned int *value){
+		unsigned int hash = 0x9747B28C;
+		for (unsigned int i = 0; i < DIM; i++){
+			unsigned int k = value[i] * 0xCC9E2D51;
+			k = rotateLeft(k, 15) * 0x1B873593;
+
+			hash ^= k;
+			hash = rotateLeft(hash, 13) * 5 + 0xE6546B64;
+		}
+
+		hash ^= hash >> 16;
+		hash *= 0x85EBCA6B;
+		hash ^= hash >> 13;
+		hash *= 0xC2B2AE35;
+		hash ^= hash >> 16;
+
+		return hash;
+	}
+
+	static bool isEqual(const unsigned int *a, const unsigned int *b){
+#ifdef HASH_SSE2
+		if ((DIM & 3) == 0){
+			for (unsigned int i = 0; i < DIM; i += 4){
+				__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *) (a + i)), _mm_loadu_si128((const __m128i *) (b + i)));
+				if (_mm_movemask_epi8(eq) != 0xFFFF) return false;
+			}
+			return true;
+		}
+#endif
+		for (unsigned int i = 0; i < DIM; i++){
+			if (a[i] != b[i]) return false;
+		}
+		return true;
+	}
+
+	IndexHashSlot *table;
+	unsigned int tableSize;
+
+	unsigned int *keys;
+	unsigned int keyCapasity;
+	unsigned int count;
 };
 
 #endif // _HASH_H_
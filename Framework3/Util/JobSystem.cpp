@@ -0,0 +1,492 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "JobSystem.h"
+#include "Thread.h"
+#include "Array.h"
+#include "../CPU.h"
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+// Must be a power of two. A worker that fills its deque runs further jobs directly.
+#define DEQUE_SIZE 4096
+#define JOB_BLOCK_SIZE 256
+#define MAX_WORKERS 64
+// Rounds of looking for work before an idle worker goes to sleep
+#define IDLE_SPINS 64
+
+struct Job {
+	JobProc proc;
+	void *data;
+	Job *parent;
+	JobCounter *counter;
+
+	// The job itself plus its unfinished children
+	std::atomic <int> unfinished;
+
+	// Worker whose pool the job came from, or -1 if it was allocated on the heap
+	int owner;
+	Job *next;
+};
+
+/*
+	Chase-Lev deque with a fixed size ring, with the memory ordering from
+	"Correct and Efficient Work-Stealing for Weak Memory Models" by Le, Pop, Cohen and Zappa Nardelli.
+	Only the owning worker may push and pop, any thread may steal.
+*/
+struct JobDeque {
+	bool push(Job *job){
+		int64 b = bottom.load(std::memory_order_relaxed);
+		int64 t = top.load(std::memory_order_acquire);
+		if (b - t >= DEQUE_SIZE) return false;
+
+		jobs[b & (DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	Job *pop(){
+		int64 b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 t = top.load(std::memory_order_relaxed);
+
+		if (t > b){
+			// Empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return NULL;
+		}
+
+		Job *job = jobs[b & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (t == b){
+			// Last job, race any thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = NULL;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	Job *steal(){
+		int64 t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64 b = bottom.load(std::memory_order_acquire);
+		if (t >= b) return NULL;
+
+		Job *job = jobs[t & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return NULL;
+
+		return job;
+	}
+
+	// Keep the ends on separate cache lines, thieves only touch top
+	std::atomic <int64> top;
+	char pad0[64];
+	std::atomic <int64> bottom;
+	char pad1[64];
+	std::atomic <Job *> jobs[DEQUE_SIZE];
+};
+
+struct Worker {
+	JobDeque deque;
+
+	// Only touched by the owning thread
+	Job *freeJobs;
+	Array <Job *> jobBlocks;
+	char pad[64];
+
+	// Jobs from this pool that finished on other threads
+	std::atomic <Job *> returnedJobs;
+
+	ThreadHandle thread;
+	uint index;
+};
+
+static Worker **workers = NULL;
+static uint nWorkers = 0;
+// 1 if worker 0 is the thread that called initJobSystem(), 0 if it has a thread of its own
+static uint firstThread = 0;
+static std::atomic <bool> started(false);
+static std::atomic <bool> quit(false);
+static std::atomic_flag initLock = ATOMIC_FLAG_INIT;
+
+// Jobs from threads that aren't workers
+static Mutex sharedMutex;
+static Job *sharedFirst = NULL, *sharedLast = NULL;
+static std::atomic <int> sharedCount(0);
+
+// Idle workers sleep on the condition while no jobs are queued
+static Mutex sleepMutex;
+static Condition wakeCondition;
+static std::atomic <int> sleepers(0);
+static std::atomic <int> queuedJobs(0);
+// Sleepers that are waiting on a counter rather than for jobs
+static std::atomic <int> waiters(0);
+
+static thread_local Worker *currentWorker = NULL;
+static thread_local uint randomState = 0;
+
+static void yieldThread(){
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+static uint nextRandom(){
+	// Xorshift, seeded from the address of the state so that threads pick different victims
+	if (randomState == 0) randomState = uint((size_t) &randomState) | 1;
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+static Job *allocateJob(){
+	Worker *worker = currentWorker;
+	if (worker == NULL){
+		Job *job = new Job;
+		job->owner = -1;
+		return job;
+	}
+
+	if (worker->freeJobs == NULL){
+		worker->freeJobs = worker->returnedJobs.exchange(NULL, std::memory_order_acquire);
+		if (worker->freeJobs == NULL){
+			Job *block = new Job[JOB_BLOCK_SIZE];
+			for (uint i = 0; i < JOB_BLOCK_SIZE; i++){
+				block[i].owner = worker->index;
+				block[i].next = block + i + 1;
+			}
+			block[JOB_BLOCK_SIZE - 1].next = NULL;
+
+			worker->jobBlocks.add(block);
+			worker->freeJobs = block;
+		}
+	}
+
+	Job *job = worker->freeJobs;
+	worker->freeJobs = job->next;
+	return job;
+}
+
+static void releaseJob(Job *job){
+	if (job->owner < 0){
+		delete job;
+		return;
+	}
+
+	Worker *owner = workers[job->owner];
+	if (owner == currentWorker){
+		job->next = owner->freeJobs;
+		owner->freeJobs = job;
+	} else {
+		// Only the owner takes jobs off this list, and it takes all of them at once, so there's no ABA problem
+		Job *head = owner->returnedJobs.load(std::memory_order_relaxed);
+		do {
+			job->next = head;
+		} while (!owner->returnedJobs.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+	}
+}
+
+static void finishJob(Job *job){
+	while (job != NULL && job->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1){
+		Job *parent = job->parent;
+		JobCounter *counter = job->counter;
+		releaseJob(job);
+
+		// The waiting thread may free the counter as soon as it reaches zero, so it's not touched after that.
+		// Waiters register before checking the counter, so either they see zero or we see them.
+		if (counter && counter->count.fetch_sub(1) == 1 && waiters.load() > 0){
+			lockMutex(sleepMutex);
+			broadcastCondition(wakeCondition);
+			unlockMutex(sleepMutex);
+		}
+		job = parent;
+	}
+}
+
+static void executeJob(Job *job){
+	if (job->proc) job->proc(job, job->data);
+	finishJob(job);
+}
+
+static Job *findJob(Worker *worker){
+	Job *job = NULL;
+	if (worker) job = worker->deque.pop();
+
+	if (job == NULL && sharedCount.load(std::memory_order_relaxed) > 0){
+		lockMutex(sharedMutex);
+		if (sharedFirst){
+			job = sharedFirst;
+			sharedFirst = job->next;
+			if (sharedFirst == NULL) sharedLast = NULL;
+			sharedCount--;
+		}
+		unlockMutex(sharedMutex);
+	}
+
+	if (job == NULL){
+		// Start at a random victim so that thieves spread out
+		uint first = nextRandom() % nWorkers;
+		for (uint i = 0; i < nWorkers && job == NULL; i++){
+			Worker *victim = workers[(first + i) % nWorkers];
+			if (victim != worker) job = victim->deque.steal();
+		}
+	}
+
+	if (job) queuedJobs.fetch_sub(1);
+	return job;
+}
+
+static void workerMain(void *param){
+	Worker *worker = (Worker *) param;
+	currentWorker = worker;
+
+	uint idle = 0;
+	while (!quit.load(std::memory_order_acquire)){
+		Job *job = findJob(worker);
+		if (job){
+			executeJob(job);
+			idle = 0;
+		} else if (++idle < IDLE_SPINS){
+			yieldThread();
+		} else {
+			// runJob() bumps queuedJobs before checking for sleepers, and we register as a sleeper before
+			// checking queuedJobs, so either we see the job or it sees us and signals under the mutex
+			lockMutex(sleepMutex);
+			sleepers++;
+			while (queuedJobs.load() <= 0 && !quit.load()){
+				waitCondition(wakeCondition, sleepMutex);
+			}
+			sleepers--;
+			unlockMutex(sleepMutex);
+			idle = 0;
+		}
+	}
+
+	currentWorker = NULL;
+}
+
+static void startJobSystem(const uint nWorkerThreads, const bool callerIsWorker){
+	while (initLock.test_and_set(std::memory_order_acquire)) yieldThread();
+
+	if (!started.load(std::memory_order_relaxed)){
+		nWorkers = nWorkerThreads;
+		if (nWorkers == 0) nWorkers = (cpuCount > 1)? cpuCount : 1;
+		if (nWorkers > MAX_WORKERS) nWorkers = MAX_WORKERS;
+
+		createMutex(sharedMutex);
+		createMutex(sleepMutex);
+		createCondition(wakeCondition);
+		quit = false;
+
+		workers = new Worker *[nWorkers];
+		for (uint i = 0; i < nWorkers; i++){
+			Worker *worker = new Worker;
+			worker->deque.top = 0;
+			worker->deque.bottom = 0;
+			worker->freeJobs = NULL;
+			worker->returnedJobs = NULL;
+			worker->index = i;
+			workers[i] = worker;
+		}
+
+		// Worker 0 is the thread calling initJobSystem(), if any, and only runs jobs while it waits for them
+		firstThread = callerIsWorker? 1 : 0;
+		if (callerIsWorker) currentWorker = workers[0];
+		for (uint i = firstThread; i < nWorkers; i++){
+			workers[i]->thread = createThread(workerMain, workers[i]);
+		}
+
+		started.store(true, std::memory_order_release);
+	}
+
+	initLock.clear(std::memory_order_release);
+}
+
+void initJobSystem(const uint nWorkerThreads){
+	startJobSystem(nWorkerThreads, true);
+}
+
+// All jobs must have finished before this is called
+void shutdownJobSystem(){
+	if (!started.load(std::memory_order_acquire)) return;
+
+	lockMutex(sleepMutex);
+	quit = true;
+	broadcastCondition(wakeCondition);
+	unlockMutex(sleepMutex);
+
+	for (uint i = firstThread; i < nWorkers; i++){
+		waitOnThread(workers[i]->thread);
+		deleteThread(workers[i]->thread);
+	}
+
+	for (uint i = 0; i < nWorkers; i++){
+		for (uint j = 0; j < workers[i]->jobBlocks.getCount(); j++){
+			delete [] workers[i]->jobBlocks[j];
+		}
+		delete workers[i];
+	}
+	delete [] workers;
+	workers = NULL;
+	nWorkers = 0;
+	currentWorker = NULL;
+
+	deleteCondition(wakeCondition);
+	deleteMutex(sleepMutex);
+	deleteMutex(sharedMutex);
+
+	started = false;
+}
+
+uint getWorkerCount(){
+	if (started.load(std::memory_order_acquire)) return nWorkers;
+
+	return (cpuCount > 1)? cpuCount : 1;
+}
+
+Job *createJob(JobProc proc, void *data, JobCounter *counter, Job *parent){
+	// Whichever thread happens to create the first job must not become worker 0, as it may not stay around
+	if (!started.load(std::memory_order_acquire)) startJobSystem(0, false);
+
+	Job *job = allocateJob();
+	job->proc = proc;
+	job->data = data;
+	job->parent = parent;
+	job->counter = counter;
+	job->unfinished.store(1, std::memory_order_relaxed);
+
+	if (parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+	if (counter) counter->count.fetch_add(1, std::memory_order_relaxed);
+
+	return job;
+}
+
+void runJob(Job *job){
+	Worker *worker = currentWorker;
+	if (worker){
+		if (!worker->deque.push(job)){
+			executeJob(job);
+			return;
+		}
+	} else {
+		job->next = NULL;
+
+		lockMutex(sharedMutex);
+		if (sharedLast){
+			sharedLast->next = job;
+		} else {
+			sharedFirst = job;
+		}
+		sharedLast = job;
+		sharedCount++;
+		unlockMutex(sharedMutex);
+	}
+
+	queuedJobs++;
+	if (sleepers.load() > 0){
+		lockMutex(sleepMutex);
+		// A waiter woken instead of a worker may find its counter done and leave the job be, so wake everyone then
+		if (waiters.load() > 0){
+			broadcastCondition(wakeCondition);
+		} else {
+			signalCondition(wakeCondition);
+		}
+		unlockMutex(sleepMutex);
+	}
+}
+
+void waitForCounter(JobCounter *counter){
+	Worker *worker = currentWorker;
+	uint idle = 0;
+	while (counter->count.load(std::memory_order_acquire) > 0){
+		Job *job = findJob(worker);
+		if (job){
+			executeJob(job);
+			idle = 0;
+		} else if (++idle < IDLE_SPINS){
+			yieldThread();
+		} else {
+			// Sleeps like an idle worker, but also wakes up when finishJob() brings the counter to zero
+			lockMutex(sleepMutex);
+			sleepers++;
+			waiters++;
+			while (counter->count.load() > 0 && queuedJobs.load() <= 0){
+				waitCondition(wakeCondition, sleepMutex);
+			}
+			waiters--;
+			sleepers--;
+			unlockMutex(sleepMutex);
+			idle = 0;
+		}
+	}
+}
+
+
+struct RangeJob {
+	RangeProc proc;
+	void *data;
+	uint start, end;
+};
+
+static void rangeJob(Job *job, void *data){
+	RangeJob *range = (RangeJob *) data;
+	range->proc(range->data, range->start, range->end);
+}
+
+void parallelFor(RangeProc proc, void *data, const uint count, const uint minRange){
+	uint range = (minRange > 0)? minRange : 1;
+	uint maxRanges = uint((uint64(count) + range - 1) / range);
+
+	// A few ranges per worker lets stealing even out ranges that take longer than others
+	uint nRanges = 4 * getWorkerCount();
+	if (nRanges > maxRanges) nRanges = maxRanges;
+
+	if (nRanges <= 1 || getWorkerCount() <= 1){
+		if (count) proc(data, 0, count);
+		return;
+	}
+
+	RangeJob stackRanges[64];
+	RangeJob *ranges = (nRanges <= 64)? stackRanges : new RangeJob[nRanges];
+
+	JobCounter counter;
+	for (uint i = 0; i < nRanges; i++){
+		ranges[i].proc = proc;
+		ranges[i].data = data;
+		ranges[i].start = uint(uint64(count) * i / nRanges);
+		ranges[i].end   = uint(uint64(count) * (i + 1) / nRanges);
+	}
+
+	// The calling thread takes the first range itself
+	for (uint i = 1; i < nRanges; i++){
+		runJob(createJob(rangeJob, ranges + i, &counter));
+	}
+	proc(data, ranges[0].start, ranges[0].end);
+	waitForCounter(&counter);
+
+	if (ranges != stackRanges) delete [] ranges;
+}
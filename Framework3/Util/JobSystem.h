@@ -0,0 +1,75 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _JOBSYSTEM_H_
+#define _JOBSYSTEM_H_
+
+#include "../Platform.h"
+#include <atomic>
+
+/*
+	Work stealing job scheduler. Every worker thread owns a Chase-Lev deque that it pushes to and
+	pops from at the bottom without locking, while idle workers steal from the top of the others.
+	The thread that calls initJobSystem() becomes worker 0 and runs jobs while it waits, so
+	cpuCount workers use cpuCount - 1 extra threads. Other threads may create and wait on jobs too,
+	their jobs go through a shared queue.
+
+	Jobs are pooled and released automatically once they and all their children have finished.
+	To wait for jobs, pass a JobCounter when creating them. It counts the unfinished jobs and must
+	outlive them, which a counter on the waiting thread's stack naturally does.
+*/
+
+struct Job;
+typedef void (*JobProc)(Job *job, void *data);
+
+struct JobCounter {
+	JobCounter(){
+		count = 0;
+	}
+
+	bool isDone() const { return count.load() == 0; }
+
+	std::atomic <int> count;
+};
+
+// Starts the workers, with cpuCount workers if nWorkers is zero. Jobs created before this is
+// called start the system with the default worker count, all of them on threads of their own, in
+// which case the thread calling this later doesn't become a worker but goes through the shared queue.
+void initJobSystem(const uint nWorkers = 0);
+void shutdownJobSystem();
+uint getWorkerCount();
+
+// Every created job must be passed to runJob(). A job created with a parent doesn't let the parent
+// finish until it has finished itself, so a running job can split its work into children without
+// waiting for them. The parent must not have finished when the child is created, which holds if
+// the child is created by the parent's job function.
+Job *createJob(JobProc proc, void *data = NULL, JobCounter *counter = NULL, Job *parent = NULL);
+void runJob(Job *job);
+
+// Runs jobs until every job counted by the counter has finished, sleeping while there are none
+void waitForCounter(JobCounter *counter);
+
+// Splits [0, count) into contiguous ranges of at least minRange elements and runs them as jobs,
+// with the calling thread taking part. Returns when all ranges are done.
+typedef void (*RangeProc)(void *data, const uint start, const uint end);
+void parallelFor(RangeProc proc, void *data, const uint count, const uint minRange = 1024);
+
+#endif // _JOBSYSTEM_H_
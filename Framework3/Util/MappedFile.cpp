@@ -0,0 +1,157 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "MappedFile.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(){
+	data = NULL;
+	size = 0;
+
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+#else
+	file = -1;
+#endif
+}
+
+MappedFile::~MappedFile(){
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *fileName, const bool copyOnWrite){
+	close();
+
+	file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+		close();
+		return false;
+	}
+
+	if ((mapping = CreateFileMappingA(file, NULL, copyOnWrite? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL)) == NULL){
+		close();
+		return false;
+	}
+
+	if ((data = (ubyte *) MapViewOfFile(mapping, copyOnWrite? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0)) == NULL){
+		close();
+		return false;
+	}
+	size = fileSize.QuadPart;
+
+	return true;
+}
+
+void MappedFile::close(){
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	data = NULL;
+	size = 0;
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+}
+
+#else
+
+bool MappedFile::open(const char *fileName, const bool copyOnWrite){
+	close();
+
+	if ((file = ::open(fileName, O_RDONLY)) < 0) return false;
+
+	struct stat st;
+	if (fstat(file, &st) != 0 || st.st_size == 0){
+		close();
+		return false;
+	}
+
+	void *mem = mmap(NULL, st.st_size, copyOnWrite? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, file, 0);
+	if (mem == MAP_FAILED){
+		close();
+		return false;
+	}
+	data = (ubyte *) mem;
+	size = st.st_size;
+
+	return true;
+}
+
+void MappedFile::close(){
+	if (data) munmap(data, size);
+	if (file >= 0) ::close(file);
+
+	data = NULL;
+	size = 0;
+	file = -1;
+}
+
+#endif
+
+// MurmurHash3's 64-bit finalizer, which spreads every bit of the word over all of the result
+static inline uint64 mixWord(uint64 word){
+	word ^= word >> 33;
+	word *= 0xFF51AFD7ED558CCDULL;
+	word ^= word >> 33;
+	word *= 0xC4CEB9FE1A85EC53ULL;
+	word ^= word >> 33;
+	return word;
+}
+
+uint64 hashMemory(const void *mem, const uint64 size, uint64 hash){
+	const ubyte *src = (const ubyte *) mem;
+
+	// Whole words first, which is what makes hashing large files cheap next to reading them. A bare
+	// multiply only carries bits upward, so each word is mixed before it's folded in like an FNV byte.
+	uint64 nWords = size >> 3;
+	for (uint64 i = 0; i < nWords; i++){
+		uint64 word;
+		memcpy(&word, src + 8 * i, sizeof(word));
+		hash ^= mixWord(word);
+		hash *= 0x100000001B3ULL;
+	}
+	for (uint64 i = nWords << 3; i < size; i++){
+		hash ^= src[i];
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+bool hashFile(const char *fileName, uint64 &hash){
+	MappedFile file;
+	if (!file.open(fileName)) return false;
+
+	hash = hashMemory(file.getData(), file.getSize());
+	return true;
+}
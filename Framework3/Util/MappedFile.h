@@ -0,0 +1,59 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include "../Platform.h"
+
+// View of a whole file, backed by the OS page cache
+class MappedFile {
+public:
+	MappedFile();
+	~MappedFile();
+
+	// With copyOnWrite the view may be written to. Written pages become private copies and never reach the file.
+	bool open(const char *fileName, const bool copyOnWrite = false);
+	void close();
+
+	bool isOpen() const { return data != NULL; }
+	const ubyte *getData() const { return data; }
+	ubyte *getData(){ return data; }
+	uint64 getSize() const { return size; }
+
+protected:
+	ubyte *data;
+	uint64 size;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+};
+
+// 64-bit FNV-1a style hash chained through the hash parameter. Whole words go through a bit mixer
+// before they're folded in, the tail is plain bytewise FNV-1a.
+uint64 hashMemory(const void *mem, const uint64 size, uint64 hash = 0xCBF29CE484222325ULL);
+bool hashFile(const char *fileName, uint64 &hash);
+
+#endif // _MAPPEDFILE_H_
@@ -0,0 +1,352 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "MeshOptimizer.h"
+#include "../Math/Vector.h"
+
+void optimizeVertexCache(uint *indices, const uint nIndices, const uint nVertices, const uint cacheSize, Array <uint> *clusters){
+	uint nTriangles = nIndices / 3;
+
+	if (clusters) clusters->clear();
+	if (nTriangles == 0){
+		if (clusters) clusters->add(0);
+		return;
+	}
+
+	// Triangles around each vertex
+	uint *adjacencyStart = new uint[nVertices + 1];
+	uint *adjacency = new uint[nIndices];
+	uint *liveCount = new uint[nVertices];
+
+	memset(liveCount, 0, nVertices * sizeof(uint));
+	for (uint i = 0; i < nIndices; i++){
+		liveCount[indices[i]]++;
+	}
+
+	uint maxValence = 0;
+	adjacencyStart[0] = 0;
+	for (uint v = 0; v < nVertices; v++){
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveCount[v];
+		if (liveCount[v] > maxValence) maxValence = liveCount[v];
+	}
+
+	uint *fill = new uint[nVertices];
+	memcpy(fill, adjacencyStart, nVertices * sizeof(uint));
+	for (uint i = 0; i < nIndices; i++){
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+	delete [] fill;
+
+	// A vertex is in the cache if it was last missed less than cacheSize misses ago
+	int *cacheTime = new int[nVertices];
+	memset(cacheTime, 0, nVertices * sizeof(int));
+	int time = cacheSize + 1;
+
+	bool *emitted = new bool[nTriangles];
+	memset(emitted, 0, nTriangles * sizeof(bool));
+
+	uint *deadEnd = new uint[nIndices];
+	uint deadEndSize = 0;
+
+	uint *candidates = new uint[3 * maxValence];
+	uint *output = new uint[nIndices];
+	uint nOutput = 0;
+
+	bool coldCache = true;
+	uint cursor = 0;
+	int fanning = indices[0];
+
+	while (fanning >= 0){
+		// Emit all the remaining triangles around the fanning vertex
+		uint nCandidates = 0;
+		for (uint a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++){
+			uint t = adjacency[a];
+			if (emitted[t]) continue;
+
+			if (coldCache){
+				if (clusters) clusters->add(nOutput / 3);
+				coldCache = false;
+			}
+
+			for (uint k = 0; k < 3; k++){
+				uint v = indices[3 * t + k];
+				output[nOutput++] = v;
+				deadEnd[deadEndSize++] = v;
+				candidates[nCandidates++] = v;
+				liveCount[v]--;
+
+				if (time - cacheTime[v] > (int) cacheSize){
+					cacheTime[v] = time++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		// Continue from the vertex that will still be in the cache after its fan, and has been there the longest
+		int next = -1;
+		int bestPriority = -1;
+		for (uint c = 0; c < nCandidates; c++){
+			uint v = candidates[c];
+			if (liveCount[v] == 0) continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * (int) liveCount[v] <= (int) cacheSize){
+				priority = time - cacheTime[v];
+			}
+			if (priority > bestPriority){
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0){
+			// Dead end, so back up to a recently used vertex, or failing that any vertex with triangles left
+			coldCache = true;
+
+			while (deadEndSize > 0){
+				uint v = deadEnd[--deadEndSize];
+				if (liveCount[v] > 0){
+					next = v;
+					break;
+				}
+			}
+			while (next < 0 && cursor < nVertices){
+				if (liveCount[cursor] > 0){
+					next = cursor;
+				} else {
+					cursor++;
+				}
+			}
+		}
+
+		fanning = next;
+	}
+
+	if (clusters) clusters->add(nTriangles);
+
+	memcpy(indices, output, nIndices * sizeof(uint));
+
+	delete [] adjacencyStart;
+	delete [] adjacency;
+	delete [] liveCount;
+	delete [] cacheTime;
+	delete [] emitted;
+	delete [] deadEnd;
+	delete [] candidates;
+	delete [] output;
+}
+
+struct OverdrawCluster {
+	uint start, end;
+	float sortKey;
+};
+
+static int compareClusters(const void *elem0, const void *elem1){
+	const OverdrawCluster *c0 = (const OverdrawCluster *) elem0;
+	const OverdrawCluster *c1 = (const OverdrawCluster *) elem1;
+
+	if (c0->sortKey > c1->sortKey) return -1;
+	if (c0->sortKey < c1->sortKey) return  1;
+
+	return int(c0->start) - int(c1->start);
+}
+
+static uint countCacheMisses(const uint *triangle, int *cacheTime, int &time, const uint cacheSize){
+	uint misses = 0;
+	for (uint k = 0; k < 3; k++){
+		if (time - cacheTime[triangle[k]] > (int) cacheSize){
+			cacheTime[triangle[k]] = time++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+void optimizeOverdraw(uint *indices, const uint nIndices, const float *positions, const uint stride, const uint nVertices,
+                      const Array <uint> &clusters, const uint cacheSize, const float threshold){
+	if (nIndices == 0 || clusters.getCount() < 2) return;
+
+	int *cacheTime = new int[nVertices];
+	memset(cacheTime, 0, nVertices * sizeof(int));
+	int time = cacheSize + 1;
+
+	// Soft boundaries inside each cluster wherever breaking off costs little in cache efficiency
+	Array <OverdrawCluster> soft;
+	for (uint c = 0; c + 1 < clusters.getCount(); c++){
+		uint start = clusters[c];
+		uint end = clusters[c + 1];
+		if (start >= end) continue;
+
+		time += cacheSize + 1;
+		uint clusterMisses = 0;
+		for (uint t = start; t < end; t++){
+			clusterMisses += countCacheMisses(indices + 3 * t, cacheTime, time, cacheSize);
+		}
+		float acmr = float(clusterMisses) / float(end - start);
+
+		time += cacheSize + 1;
+		uint misses = 0;
+		OverdrawCluster cluster;
+		cluster.start = start;
+		for (uint t = start; t < end; t++){
+			misses += countCacheMisses(indices + 3 * t, cacheTime, time, cacheSize);
+
+			if (t + 1 < end && float(misses) <= threshold * acmr * float(t + 1 - cluster.start)){
+				cluster.end = t + 1;
+				soft.add(cluster);
+
+				cluster.start = t + 1;
+				misses = 0;
+				time += cacheSize + 1;
+			}
+		}
+		cluster.end = end;
+		soft.add(cluster);
+	}
+	delete [] cacheTime;
+
+	// Area weighted centroid and average normal of each cluster
+	vec3 *centroids = new vec3[soft.getCount()];
+	vec3 *normals = new vec3[soft.getCount()];
+	vec3 meshCentroid(0, 0, 0);
+	float meshArea = 0;
+
+	for (uint c = 0; c < soft.getCount(); c++){
+		vec3 centroid(0, 0, 0), normal(0, 0, 0);
+		float area = 0;
+
+		for (uint t = soft[c].start; t < soft[c].end; t++){
+			const vec3 &v0 = *(const vec3 *) (positions + indices[3 * t    ] * stride);
+			const vec3 &v1 = *(const vec3 *) (positions + indices[3 * t + 1] * stride);
+			const vec3 &v2 = *(const vec3 *) (positions + indices[3 * t + 2] * stride);
+
+			vec3 n = cross(v1 - v0, v2 - v0);
+			float a = length(n);
+
+			centroid += (v0 + v1 + v2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		centroids[c] = (area > 0)? centroid / area : centroid;
+		normals[c] = normal;
+	}
+	if (meshArea > 0) meshCentroid /= meshArea;
+
+	// Clusters facing away from the center are least likely to be occluded by the rest of the mesh
+	for (uint c = 0; c < soft.getCount(); c++){
+		float len = length(normals[c]);
+		soft[c].sortKey = (len > 0)? dot(centroids[c] - meshCentroid, normals[c] / len) : 0.0f;
+	}
+	delete [] centroids;
+	delete [] normals;
+
+	qsort(soft.getArray(), soft.getCount(), sizeof(OverdrawCluster), compareClusters);
+
+	uint *output = new uint[nIndices];
+	uint *dest = output;
+	for (uint c = 0; c < soft.getCount(); c++){
+		uint n = 3 * (soft[c].end - soft[c].start);
+		memcpy(dest, indices + 3 * soft[c].start, n * sizeof(uint));
+		dest += n;
+	}
+	memcpy(indices, output, nIndices * sizeof(uint));
+	delete [] output;
+}
+
+uint optimizeVertexFetch(float *vertices, const uint vertexSize, uint *indices, const uint nIndices, const uint nVertices){
+	uint *remap = new uint[nVertices];
+	memset(remap, 0xFF, nVertices * sizeof(uint));
+
+	float *newVertices = new float[nVertices * vertexSize];
+
+	uint count = 0;
+	for (uint i = 0; i < nIndices; i++){
+		uint v = indices[i];
+		if (remap[v] == 0xFFFFFFFF){
+			memcpy(newVertices + count * vertexSize, vertices + v * vertexSize, vertexSize * sizeof(float));
+			remap[v] = count++;
+		}
+		indices[i] = remap[v];
+	}
+
+	memcpy(vertices, newVertices, count * vertexSize * sizeof(float));
+
+	delete [] newVertices;
+	delete [] remap;
+
+	return count;
+}
+
+void simulateVertexCache(const uint *indices, const uint nIndices, const uint nVertices, const uint cacheSize, const bool lru, float *acmr, float *atvr){
+	uint misses = 0;
+
+	if (lru){
+		// Most recently used first
+		uint *cache = new uint[cacheSize];
+		uint cacheCount = 0;
+
+		for (uint i = 0; i < nIndices; i++){
+			uint v = indices[i];
+
+			uint pos = 0;
+			while (pos < cacheCount && cache[pos] != v) pos++;
+
+			if (pos == cacheCount){
+				misses++;
+				if (cacheCount < cacheSize) cacheCount++;
+				pos = cacheCount - 1;
+			}
+			memmove(cache + 1, cache, pos * sizeof(uint));
+			cache[0] = v;
+		}
+		delete [] cache;
+	} else {
+		int *cacheTime = new int[nVertices];
+		memset(cacheTime, 0, nVertices * sizeof(int));
+		int time = cacheSize + 1;
+
+		for (uint i = 0; i < nIndices; i++){
+			if (time - cacheTime[indices[i]] > (int) cacheSize){
+				cacheTime[indices[i]] = time++;
+				misses++;
+			}
+		}
+		delete [] cacheTime;
+	}
+
+	bool *used = new bool[nVertices];
+	memset(used, 0, nVertices * sizeof(bool));
+	uint nUsed = 0;
+	for (uint i = 0; i < nIndices; i++){
+		if (!used[indices[i]]){
+			used[indices[i]] = true;
+			nUsed++;
+		}
+	}
+	delete [] used;
+
+	if (acmr) *acmr = (nIndices > 0)? float(misses) / float(nIndices / 3) : 0.0f;
+	if (atvr) *atvr = (nUsed > 0)? float(misses) / float(nUsed) : 0.0f;
+}
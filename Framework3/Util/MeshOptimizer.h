@@ -0,0 +1,52 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+#include "../Platform.h"
+#include "Array.h"
+
+/*
+	Index and vertex reordering for triangle lists. None of these change the winding or the
+	order of the vertices within a triangle, so the provoking vertex of each triangle is kept.
+*/
+
+// Reorders triangles for a post-transform vertex cache of cacheSize entries, using Tipsify from
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" by Sander et al.
+// If clusters isn't NULL it receives the first triangle of each run that started with a cold
+// cache, followed by the triangle count.
+void optimizeVertexCache(uint *indices, const uint nIndices, const uint nVertices, const uint cacheSize, Array <uint> *clusters = NULL);
+
+// Splits the clusters from optimizeVertexCache further wherever the cache efficiency so far is
+// within threshold of the cluster as a whole, then draws the outward facing clusters first.
+void optimizeOverdraw(uint *indices, const uint nIndices, const float *positions, const uint stride, const uint nVertices,
+                      const Array <uint> &clusters, const uint cacheSize, const float threshold = 1.05f);
+
+// Renumbers vertices in the order the indices first use them and moves the vertex data
+// to match. Unreferenced vertices are dropped. Returns the new vertex count.
+uint optimizeVertexFetch(float *vertices, const uint vertexSize, uint *indices, const uint nIndices, const uint nVertices);
+
+// Runs the indices through a FIFO or LRU cache of cacheSize entries. ACMR is the number of
+// cache misses per triangle and ATVR the number per referenced vertex, where 1.0 is ideal.
+void simulateVertexCache(const uint *indices, const uint nIndices, const uint nVertices, const uint cacheSize, const bool lru, float *acmr, float *atvr);
+
+#endif // _MESHOPTIMIZER_H_
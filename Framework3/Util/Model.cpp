@@ -22,18 +22,40 @@
 #include "Model.h"
 #include "Tokenizer.h"
 
+#include "../Math/Frustum.h"
 #include "Hash.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "Simplify.h"
+#include "Weld.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define USE_SSE
+#include <xmmintrin.h>
+#endif
 
 Model::Model(){
 	vertexFormat = VF_NONE;
 	vertexBuffer = VB_NONE;
 	indexBuffer  = IB_NONE;
+	lodIndexBuffer = IB_NONE;
 	nIndices = 0;
 
 	lastVertexCount = 0;
 	lastVertices = NULL;
 	lastIndices = NULL;
 	lastFormat = NULL;
+	mappedFile = NULL;
+	compiledData = NULL;
+
+	lodIndices = NULL;
+	nLodIndices = 0;
+
+	optimizeDrawOrder = false;
+	optimizeVertexOrder = true;
+	vertexCacheSize = 16;
+	memset(&drawOrderStats, 0, sizeof(drawOrderStats));
 }
 
 Model::~Model(){
@@ -283,6 +305,303 @@ bool Model::save(const char *fileName){
 	return true;
 }
 
+static const uint formatSize[] = { sizeof(float), sizeof(half), sizeof(ubyte) };
+
+// Packed streams are padded to keep each attribute four byte aligned
+static uint getPackedComponents(const uint nComponents, const AttributeFormat format){
+	if (format == FORMAT_HALF)  return (nComponents + 1) & ~1;
+	if (format == FORMAT_UBYTE) return 4;
+	return nComponents;
+}
+
+#define COMPILED_MODEL_MAGIC   MCHAR4('C', 'M', 'D', 'L')
+#define COMPILED_MODEL_VERSION 1
+
+struct CompiledModelHeader {
+	uint32 magic;
+	uint32 version;
+	uint64 sourceHash;
+
+	uint32 nStreams;
+	uint32 nBatches;
+	uint32 nVertices;
+	uint32 nIndices;
+	uint32 vertexSize;
+	uint32 indexSize;
+
+	uint64 vertexOffset;
+	uint64 indexOffset;
+};
+
+struct CompiledStream {
+	uint32 type;
+	uint32 format;
+	uint32 nComponents;
+	uint32 reserved;
+};
+
+static uint64 alignOffset(const uint64 offset, const uint64 alignment){
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Fills in the header and lays out the image, returning its total size
+static uint64 setupCompiledHeader(CompiledModelHeader &header, const uint nStreams, const uint nBatches, const uint nVertices, const uint nIndices, const uint vertexSize, const uint64 sourceHash){
+	header.magic = COMPILED_MODEL_MAGIC;
+	header.version = COMPILED_MODEL_VERSION;
+	header.sourceHash = sourceHash;
+	header.nStreams = nStreams;
+	header.nBatches = nBatches;
+	header.nVertices = nVertices;
+	header.nIndices = nIndices;
+	header.vertexSize = vertexSize;
+	header.indexSize = (nVertices > 65535)? 4 : 2;
+
+	uint64 tableEnd = sizeof(header) + nStreams * sizeof(CompiledStream) + nBatches * sizeof(Batch);
+	header.vertexOffset = alignOffset(tableEnd, 16);
+	header.indexOffset  = alignOffset(header.vertexOffset + uint64(nVertices) * vertexSize, 16);
+
+	return header.indexOffset + uint64(nIndices) * header.indexSize;
+}
+
+bool Model::loadCompiled(const char *fileName, const uint64 sourceHash){
+	clear();
+
+	MappedFile *file = new MappedFile();
+	if (!file->open(fileName) || !setCompiledData(file->getData(), file->getSize(), sourceHash)){
+		delete file;
+		return false;
+	}
+	mappedFile = file;
+
+	return true;
+}
+
+bool Model::loadCompiled(ubyte *data, const uint64 size, const uint64 sourceHash){
+	clear();
+
+	if (!setCompiledData(data, size, sourceHash)){
+		delete [] data;
+		return false;
+	}
+	compiledData = data;
+
+	return true;
+}
+
+bool Model::setCompiledData(const ubyte *data, const uint64 size, const uint64 sourceHash){
+	if (size < sizeof(CompiledModelHeader)) return false;
+
+	const CompiledModelHeader *header = (const CompiledModelHeader *) data;
+
+	// Validate everything up front so that a stale or truncated file is simply rejected
+	bool valid = (header->magic == COMPILED_MODEL_MAGIC && header->version == COMPILED_MODEL_VERSION);
+	if (valid && sourceHash != 0 && header->sourceHash != sourceHash) valid = false;
+	if (valid){
+		uint64 tableEnd = sizeof(CompiledModelHeader) + uint64(header->nStreams) * sizeof(CompiledStream) + uint64(header->nBatches) * sizeof(Batch);
+
+		valid =
+			header->nStreams > 0 && header->nVertices > 0 && header->nIndices % 3 == 0 &&
+			header->indexSize == ((header->nVertices > 65535)? 4 : 2) &&
+			header->vertexOffset >= tableEnd && (header->vertexOffset & 3) == 0 &&
+			header->indexOffset >= header->vertexOffset + uint64(header->nVertices) * header->vertexSize && (header->indexOffset & 3) == 0 &&
+			header->indexOffset + uint64(header->nIndices) * header->indexSize <= size;
+	}
+	if (valid){
+		const CompiledStream *cStreams = (const CompiledStream *) (header + 1);
+
+		uint vertexSize = 0;
+		for (uint i = 0; i < header->nStreams; i++){
+			if (cStreams[i].type > TYPE_BINORMAL || cStreams[i].format > FORMAT_UBYTE || cStreams[i].nComponents == 0 || cStreams[i].nComponents > 4 ||
+				getPackedComponents(cStreams[i].nComponents, (AttributeFormat) cStreams[i].format) != cStreams[i].nComponents){
+				valid = false;
+				break;
+			}
+			vertexSize += cStreams[i].nComponents * formatSize[cStreams[i].format];
+		}
+		if (vertexSize != header->vertexSize) valid = false;
+	}
+	if (valid){
+		const Batch *cBatches = (const Batch *) (data + sizeof(CompiledModelHeader) + header->nStreams * sizeof(CompiledStream));
+		for (uint i = 0; i < header->nBatches; i++){
+			if (uint64(cBatches[i].startIndex) + cBatches[i].nIndices > header->nIndices ||
+				uint64(cBatches[i].startVertex) + cBatches[i].nVertices > header->nVertices){
+				valid = false;
+				break;
+			}
+		}
+	}
+	if (valid){
+		const void *indices = data + header->indexOffset;
+		for (uint i = 0; i < header->nIndices; i++){
+			uint index = (header->indexSize == 4)? ((const uint *) indices)[i] : ((const ushort *) indices)[i];
+			if (index >= header->nVertices){
+				valid = false;
+				break;
+			}
+		}
+	}
+
+	if (!valid) return false;
+
+	const CompiledStream *cStreams = (const CompiledStream *) (header + 1);
+	const Batch *cBatches = (const Batch *) (cStreams + header->nStreams);
+
+	lastFormat = new FormatDesc[header->nStreams];
+	for (uint i = 0; i < header->nStreams; i++){
+		// No per-stream data is kept, only the layout
+		Stream stream;
+		stream.vertices = NULL;
+		stream.indices = NULL;
+		stream.nVertices = 0;
+		stream.nComponents = cStreams[i].nComponents;
+		stream.type = (AttributeType) cStreams[i].type;
+		stream.optimized = true;
+		stream.format = (AttributeFormat) cStreams[i].format;
+		stream.packingError = 0;
+		streams.add(stream);
+
+		lastFormat[i].stream = 0;
+		lastFormat[i].type   = (AttributeType) cStreams[i].type;
+		lastFormat[i].format = (AttributeFormat) cStreams[i].format;
+		lastFormat[i].size   = cStreams[i].nComponents;
+	}
+	for (uint i = 0; i < header->nBatches; i++){
+		batches.add(cBatches[i]);
+	}
+
+	nIndices = header->nIndices;
+	lastVertexCount = header->nVertices;
+	lastVertices = (ubyte *) (data + header->vertexOffset);
+	lastIndices = (uint *) (data + header->indexOffset);
+
+	return true;
+}
+
+bool Model::saveCompiled(const char *fileName, const uint64 sourceHash){
+	if (!isCompiled() && compile() == 0) return false;
+
+	FILE *file = fopen(fileName, "wb");
+	if (file == NULL) return false;
+
+	bool result = saveCompiled(file, sourceHash);
+	fclose(file);
+
+	return result;
+}
+
+bool Model::saveCompiled(FILE *file, const uint64 sourceHash){
+	if (!isCompiled() && compile() == 0) return false;
+
+	uint vertexSize = getVertexSize();
+	uint indexSize = (lastVertexCount > 65535)? 4 : 2;
+
+	CompiledModelHeader header;
+	setupCompiledHeader(header, streams.getCount(), batches.getCount(), lastVertexCount, nIndices, vertexSize, sourceHash);
+	uint64 tableEnd = sizeof(header) + header.nStreams * sizeof(CompiledStream) + header.nBatches * sizeof(Batch);
+
+	fwrite(&header, sizeof(header), 1, file);
+	for (uint i = 0; i < streams.getCount(); i++){
+		CompiledStream stream;
+		stream.type = lastFormat[i].type;
+		stream.format = lastFormat[i].format;
+		stream.nComponents = lastFormat[i].size;
+		stream.reserved = 0;
+		fwrite(&stream, sizeof(stream), 1, file);
+	}
+	for (uint i = 0; i < batches.getCount(); i++){
+		fwrite(&batches[i], sizeof(Batch), 1, file);
+	}
+
+	static const ubyte padding[16] = { 0 };
+	fwrite(padding, 1, size_t(header.vertexOffset - tableEnd), file);
+	fwrite(lastVertices, vertexSize, lastVertexCount, file);
+
+	fwrite(padding, 1, size_t(header.indexOffset - (header.vertexOffset + uint64(lastVertexCount) * vertexSize)), file);
+	fwrite(lastIndices, indexSize, nIndices, file);
+
+	return (ferror(file) == 0);
+}
+
+bool Model::extract(Model *dest, const uint *triangles, const uint nTriangles, Array <uint> *vertexMap) const {
+	if (lastVertices == NULL || nTriangles == 0) return false;
+
+	const uint nSrcTriangles = nIndices / 3;
+	for (uint t = 0; t < nTriangles; t++){
+		if (triangles[t] >= nSrcTriangles || (t > 0 && triangles[t] <= triangles[t - 1])) return false;
+	}
+
+	// Renumber the vertices in order of first use
+	uint *remap = new uint[lastVertexCount];
+	memset(remap, 0xFF, lastVertexCount * sizeof(uint));
+
+	uint *indices = new uint[3 * nTriangles];
+	uint nVertices = 0;
+	if (vertexMap) vertexMap->reset();
+	for (uint i = 0; i < 3 * nTriangles; i++){
+		uint index = getCompiledIndex(3 * triangles[i / 3] + i % 3);
+		if (remap[index] == 0xFFFFFFFF){
+			remap[index] = nVertices++;
+			if (vertexMap) vertexMap->add(index);
+		}
+		indices[i] = remap[index];
+	}
+
+	const uint vertexSize = getVertexSize();
+	const uint nStreams = streams.getCount();
+	const uint nBatches = batches.getCount();
+
+	CompiledModelHeader header;
+	uint64 size = setupCompiledHeader(header, nStreams, nBatches, nVertices, 3 * nTriangles, vertexSize, 0);
+
+	ubyte *data = new ubyte[size];
+	memset(data, 0, size_t(header.vertexOffset));
+	memcpy(data, &header, sizeof(header));
+
+	CompiledStream *cStreams = (CompiledStream *) (data + sizeof(header));
+	for (uint i = 0; i < nStreams; i++){
+		cStreams[i].type = lastFormat[i].type;
+		cStreams[i].format = lastFormat[i].format;
+		cStreams[i].nComponents = lastFormat[i].size;
+	}
+
+	// The triangles are in increasing order, so each batch takes a run of them
+	Batch *cBatches = (Batch *) (cStreams + nStreams);
+	uint t = 0;
+	for (uint b = 0; b < nBatches; b++){
+		uint end = (batches[b].startIndex + batches[b].nIndices) / 3;
+
+		uint minIndex = 0xFFFFFFFF, maxIndex = 0;
+		cBatches[b].startIndex = 3 * t;
+		for (; t < nTriangles && triangles[t] < end; t++){
+			for (uint k = 0; k < 3; k++){
+				minIndex = min(minIndex, indices[3 * t + k]);
+				maxIndex = max(maxIndex, indices[3 * t + k]);
+			}
+		}
+		cBatches[b].nIndices = 3 * t - cBatches[b].startIndex;
+		cBatches[b].startVertex = (cBatches[b].nIndices > 0)? minIndex : 0;
+		cBatches[b].nVertices = (cBatches[b].nIndices > 0)? maxIndex - minIndex + 1 : 0;
+	}
+
+	ubyte *vertices = data + header.vertexOffset;
+	for (uint i = 0; i < lastVertexCount; i++){
+		if (remap[i] != 0xFFFFFFFF) memcpy(vertices + remap[i] * vertexSize, lastVertices + i * vertexSize, vertexSize);
+	}
+	memset(vertices + nVertices * vertexSize, 0, size_t(header.indexOffset - header.vertexOffset - nVertices * vertexSize));
+
+	if (header.indexSize == 4){
+		memcpy(data + header.indexOffset, indices, 3 * nTriangles * sizeof(uint));
+	} else {
+		ushort *dest16 = (ushort *) (data + header.indexOffset);
+		for (uint i = 0; i < 3 * nTriangles; i++) dest16[i] = (ushort) indices[i];
+	}
+
+	delete [] remap;
+	delete [] indices;
+
+	return dest->loadCompiled(data, size);
+}
+
 bool Model::loadObj(const char *fileName){
 	Tokenizer tok, lineTok;
 	if (!tok.setFile(fileName)){
@@ -726,7 +1045,40 @@ bool Model::loadT3d(const char *fileName, const bool removePortals, const bool r
 }
 
 uint Model::getVertexSize() const {
-	return getComponentCount() * sizeof(float);
+	return getStreamOffset(streams.getCount());
+}
+
+uint Model::getStreamOffset(const StreamID stream) const {
+	uint offset = 0;
+	for (StreamID i = 0; i < stream; i++){
+		offset += getPackedComponents(streams[i].nComponents, streams[i].format) * formatSize[streams[i].format];
+	}
+	return offset;
+}
+
+bool Model::setStreamFormat(const StreamID stream, const AttributeFormat format){
+	if (streams[stream].type == TYPE_VERTEX && format != FORMAT_FLOAT) return false;
+	if (format == FORMAT_UBYTE && streams[stream].nComponents > 4) return false;
+
+	streams[stream].format = format;
+	return true;
+}
+
+void Model::setVertexCompression(const bool halfTexCoords, const bool packedFrames){
+	for (uint i = 0; i < streams.getCount(); i++){
+		switch (streams[i].type){
+		case TYPE_TEXCOORD:
+			setStreamFormat(i, halfTexCoords? FORMAT_HALF : FORMAT_FLOAT);
+			break;
+		case TYPE_NORMAL:
+		case TYPE_TANGENT:
+		case TYPE_BINORMAL:
+			setStreamFormat(i, packedFrames? FORMAT_UBYTE : FORMAT_FLOAT);
+			break;
+		default:
+			break;
+		}
+	}
 }
 
 uint Model::getComponentCount() const {
@@ -755,6 +1107,8 @@ StreamID Model::addStream(const AttributeType type, const int nComponents, const
 	stream.type      = type;
 	stream.nComponents = nComponents;
 	stream.optimized = optimized;
+	stream.format    = FORMAT_FLOAT;
+	stream.packingError = 0;
 
 	return streams.add(stream);
 }
@@ -895,6 +1249,122 @@ void tangentVectors(const vec3 &v0, const vec3 &v1, const vec3 &v2, const vec2 &
 	normal = normalize(cross(dv0, dv1));
 }
 
+struct TangentSpaceData {
+	const vec3 *vertices;
+	const vec2 *texCoords;
+	const uint *indices;
+
+	// One normalized basis per triangle
+	vec3 *tangents;
+	vec3 *binormals;
+	vec3 *normals;
+
+	// Triangles around each vertex, for accumulating smooth bases
+	const uint *vertexStart;
+	const uint *vertexFaces;
+	vec3 *vtxTangents;
+	vec3 *vtxBinormals;
+	vec3 *vtxNormals;
+};
+
+static void computeFaceTangents(void *param, const uint start, const uint end){
+	TangentSpaceData *data = (TangentSpaceData *) param;
+	const vec3 *vertices = data->vertices;
+	const vec2 *texCoords = data->texCoords;
+	const uint *indices = data->indices;
+
+	uint i = start;
+
+#ifdef USE_SSE
+	// Four triangles at a time with the components laid out in separate registers
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (; i + 4 <= end; i += 4){
+		alignment(16) float v[3][3][4], t[3][2][4];
+		for (uint k = 0; k < 4; k++){
+			for (uint c = 0; c < 3; c++){
+				const vec3 &vtx = vertices [indices[3 * (i + k) + c]];
+				const vec2 &tex = texCoords[indices[3 * (i + k) + c]];
+				v[c][0][k] = vtx.x;
+				v[c][1][k] = vtx.y;
+				v[c][2][k] = vtx.z;
+				t[c][0][k] = tex.x;
+				t[c][1][k] = tex.y;
+			}
+		}
+
+		__m128 dv0x = _mm_sub_ps(_mm_load_ps(v[1][0]), _mm_load_ps(v[0][0]));
+		__m128 dv0y = _mm_sub_ps(_mm_load_ps(v[1][1]), _mm_load_ps(v[0][1]));
+		__m128 dv0z = _mm_sub_ps(_mm_load_ps(v[1][2]), _mm_load_ps(v[0][2]));
+		__m128 dv1x = _mm_sub_ps(_mm_load_ps(v[2][0]), _mm_load_ps(v[0][0]));
+		__m128 dv1y = _mm_sub_ps(_mm_load_ps(v[2][1]), _mm_load_ps(v[0][1]));
+		__m128 dv1z = _mm_sub_ps(_mm_load_ps(v[2][2]), _mm_load_ps(v[0][2]));
+
+		__m128 dt0x = _mm_sub_ps(_mm_load_ps(t[1][0]), _mm_load_ps(t[0][0]));
+		__m128 dt0y = _mm_sub_ps(_mm_load_ps(t[1][1]), _mm_load_ps(t[0][1]));
+		__m128 dt1x = _mm_sub_ps(_mm_load_ps(t[2][0]), _mm_load_ps(t[0][0]));
+		__m128 dt1y = _mm_sub_ps(_mm_load_ps(t[2][1]), _mm_load_ps(t[0][1]));
+
+		__m128 r = _mm_div_ps(one, _mm_sub_ps(_mm_mul_ps(dt0x, dt1y), _mm_mul_ps(dt1x, dt0y)));
+
+		__m128 b[3][3];
+		b[0][0] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dt1y, dv0x), _mm_mul_ps(dt0y, dv1x)), r);
+		b[0][1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dt1y, dv0y), _mm_mul_ps(dt0y, dv1y)), r);
+		b[0][2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dt1y, dv0z), _mm_mul_ps(dt0y, dv1z)), r);
+
+		b[1][0] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dt0x, dv1x), _mm_mul_ps(dt1x, dv0x)), r);
+		b[1][1] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dt0x, dv1y), _mm_mul_ps(dt1x, dv0y)), r);
+		b[1][2] = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(dt0x, dv1z), _mm_mul_ps(dt1x, dv0z)), r);
+
+		b[2][0] = _mm_sub_ps(_mm_mul_ps(dv0y, dv1z), _mm_mul_ps(dv0z, dv1y));
+		b[2][1] = _mm_sub_ps(_mm_mul_ps(dv0z, dv1x), _mm_mul_ps(dv0x, dv1z));
+		b[2][2] = _mm_sub_ps(_mm_mul_ps(dv0x, dv1y), _mm_mul_ps(dv0y, dv1x));
+
+		vec3 *dest[3] = { data->tangents + i, data->binormals + i, data->normals + i };
+		for (uint n = 0; n < 3; n++){
+			__m128 lenSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b[n][0], b[n][0]), _mm_mul_ps(b[n][1], b[n][1])), _mm_mul_ps(b[n][2], b[n][2]));
+			__m128 invLen = _mm_div_ps(one, _mm_sqrt_ps(lenSq));
+
+			alignment(16) float x[4], y[4], z[4];
+			_mm_store_ps(x, _mm_mul_ps(b[n][0], invLen));
+			_mm_store_ps(y, _mm_mul_ps(b[n][1], invLen));
+			_mm_store_ps(z, _mm_mul_ps(b[n][2], invLen));
+			for (uint k = 0; k < 4; k++){
+				dest[n][k] = vec3(x[k], y[k], z[k]);
+			}
+		}
+	}
+#endif
+
+	for (; i < end; i++){
+		vec3 sdir, tdir, normal;
+		tangentVectors(vertices [indices[3 * i]], vertices [indices[3 * i + 1]], vertices [indices[3 * i + 2]],
+		               texCoords[indices[3 * i]], texCoords[indices[3 * i + 1]], texCoords[indices[3 * i + 2]], sdir, tdir, normal);
+
+		data->tangents [i] = normalize(sdir);
+		data->binormals[i] = normalize(tdir);
+		data->normals  [i] = normal;
+	}
+}
+
+static void computeVertexTangents(void *param, const uint start, const uint end){
+	TangentSpaceData *data = (TangentSpaceData *) param;
+
+	for (uint v = start; v < end; v++){
+		// Faces are listed in increasing order, so this sums in the same order as a serial scatter would
+		vec3 tangent(0, 0, 0), binormal(0, 0, 0), normal(0, 0, 0);
+		for (uint f = data->vertexStart[v]; f < data->vertexStart[v + 1]; f++){
+			uint face = data->vertexFaces[f];
+			tangent  += data->tangents [face];
+			binormal += data->binormals[face];
+			normal   += data->normals  [face];
+		}
+
+		data->vtxTangents [v] = normalize(tangent);
+		data->vtxBinormals[v] = normalize(binormal);
+		data->vtxNormals  [v] = normalize(normal);
+	}
+}
+
 bool Model::computeTangentSpace(const bool flat){
 	StreamID streams[2] = { findStream(TYPE_VERTEX), findStream(TYPE_TEXCOORD) };
 
@@ -904,106 +1374,82 @@ bool Model::computeTangentSpace(const bool flat){
 	uint *indices;
 
 	uint nVertices = assemble(streams, 2, vertexArrays, &indices, true);
+	uint nFaces = nIndices / 3;
 
-	vec3 *vertices  = (vec3 *) vertexArrays[0];
-	vec2 *texCoords = (vec2 *) vertexArrays[1];
+	TangentSpaceData data;
+	data.vertices  = (vec3 *) vertexArrays[0];
+	data.texCoords = (vec2 *) vertexArrays[1];
+	data.indices   = indices;
 
-	if (flat){
-		uint nFaces = nIndices / 3;
+	data.tangents  = new vec3[nFaces];
+	data.binormals = new vec3[nFaces];
+	data.normals   = new vec3[nFaces];
 
-		vec3 *tangents  = new vec3[nFaces];
-		vec3 *binormals = new vec3[nFaces];
-		vec3 *normals   = new vec3[nFaces];
+	parallelFor(computeFaceTangents, &data, nFaces, 4096);
 
+	if (flat){
 		uint *indicesS = new uint[nIndices];
 		uint *indicesT = new uint[nIndices];
 		uint *indicesN = new uint[nIndices];
 
 		for (uint i = 0; i < nFaces; i++){
-			vec3 v0 = vertices[indices[3 * i    ]];
-			vec3 v1 = vertices[indices[3 * i + 1]];
-			vec3 v2 = vertices[indices[3 * i + 2]];
-
-			vec2 t0 = texCoords[indices[3 * i    ]];
-			vec2 t1 = texCoords[indices[3 * i + 1]];
-			vec2 t2 = texCoords[indices[3 * i + 2]];
-
-			vec3 sdir, tdir, normal;
-			tangentVectors(v0, v1, v2, t0, t1, t2, sdir, tdir, normal);
-
-			sdir = normalize(sdir);
-			tdir = normalize(tdir);
-
-			tangents [i] = normalize(sdir);
-			binormals[i] = normalize(tdir);
-			normals  [i] = normal;
-
 			indicesS[3 * i] = indicesS[3 * i + 1] = indicesS[3 * i + 2] = i;
 			indicesT[3 * i] = indicesT[3 * i + 1] = indicesT[3 * i + 2] = i;
 			indicesN[3 * i] = indicesN[3 * i + 1] = indicesN[3 * i + 2] = i;
 		}
 
-		addStream(TYPE_TANGENT,  3, nFaces, (float *) tangents,  indicesS, false);
-		addStream(TYPE_BINORMAL, 3, nFaces, (float *) binormals, indicesT, false);
-		addStream(TYPE_NORMAL,   3, nFaces, (float *) normals,   indicesN, false);
+		addStream(TYPE_TANGENT,  3, nFaces, (float *) data.tangents,  indicesS, false);
+		addStream(TYPE_BINORMAL, 3, nFaces, (float *) data.binormals, indicesT, false);
+		addStream(TYPE_NORMAL,   3, nFaces, (float *) data.normals,   indicesN, false);
 
 		delete [] indices;
 
 	} else {
-		vec3 *tangents  = new vec3[nVertices];
-		vec3 *binormals = new vec3[nVertices];
-		vec3 *normals   = new vec3[nVertices];
-
-		memset(tangents,  0, nVertices * sizeof(vec3));
-		memset(binormals, 0, nVertices * sizeof(vec3));
-		memset(normals,   0, nVertices * sizeof(vec3));
-
-		for (uint i = 0; i < nIndices; i += 3){
-			vec3 v0 = vertices[indices[i    ]];
-			vec3 v1 = vertices[indices[i + 1]];
-			vec3 v2 = vertices[indices[i + 2]];
-
-			vec2 t0 = texCoords[indices[i    ]];
-			vec2 t1 = texCoords[indices[i + 1]];
-			vec2 t2 = texCoords[indices[i + 2]];
-
-			vec3 sdir, tdir, normal;
-			tangentVectors(v0, v1, v2, t0, t1, t2, sdir, tdir, normal);
-
-			sdir = normalize(sdir);
-			tdir = normalize(tdir);
+		// Bucket the triangles by vertex so that each vertex can be summed independently
+		uint *vertexStart = new uint[nVertices + 1];
+		uint *vertexFaces = new uint[nIndices];
 
-			tangents[indices[i    ]] += sdir;
-			tangents[indices[i + 1]] += sdir;
-			tangents[indices[i + 2]] += sdir;
-
-			binormals[indices[i    ]] += tdir;
-			binormals[indices[i + 1]] += tdir;
-			binormals[indices[i + 2]] += tdir;
-
-			normals[indices[i    ]] += normal;
-			normals[indices[i + 1]] += normal;
-			normals[indices[i + 2]] += normal;
+		memset(vertexStart, 0, (nVertices + 1) * sizeof(uint));
+		for (uint i = 0; i < nIndices; i++){
+			vertexStart[indices[i] + 1]++;
 		}
-		
 		for (uint j = 0; j < nVertices; j++){
-			tangents [j] = normalize(tangents [j]);
-			binormals[j] = normalize(binormals[j]);
-			normals  [j] = normalize(normals  [j]);
+			vertexStart[j + 1] += vertexStart[j];
+		}
+		for (uint i = 0; i < nIndices; i++){
+			vertexFaces[vertexStart[indices[i]]++] = i / 3;
 		}
+		for (uint j = nVertices; j > 0; j--){
+			vertexStart[j] = vertexStart[j - 1];
+		}
+		vertexStart[0] = 0;
+
+		data.vertexStart  = vertexStart;
+		data.vertexFaces  = vertexFaces;
+		data.vtxTangents  = new vec3[nVertices];
+		data.vtxBinormals = new vec3[nVertices];
+		data.vtxNormals   = new vec3[nVertices];
+
+		parallelFor(computeVertexTangents, &data, nVertices, 4096);
+
+		delete [] vertexStart;
+		delete [] vertexFaces;
+		delete [] data.tangents;
+		delete [] data.binormals;
+		delete [] data.normals;
 
 		uint *indicesS = new uint[nIndices];
 		uint *indicesT = new uint[nIndices];
 		memcpy(indicesS, indices, nIndices * sizeof(uint));
 		memcpy(indicesT, indices, nIndices * sizeof(uint));
 
-		addStream(TYPE_TANGENT,  3, nVertices, (float *) tangents,  indicesS, false);
-		addStream(TYPE_BINORMAL, 3, nVertices, (float *) binormals, indicesT, false);
-		addStream(TYPE_NORMAL,   3, nVertices, (float *) normals,   indices,  false);
+		addStream(TYPE_TANGENT,  3, nVertices, (float *) data.vtxTangents,  indicesS, false);
+		addStream(TYPE_BINORMAL, 3, nVertices, (float *) data.vtxBinormals, indicesT, false);
+		addStream(TYPE_NORMAL,   3, nVertices, (float *) data.vtxNormals,   indices,  false);
 	}
 
-	delete [] vertices;
-	delete [] texCoords;
+	delete [] vertexArrays[0];
+	delete [] vertexArrays[1];
 
 	return true;
 }
@@ -1027,7 +1473,7 @@ bool Model::addStencilVolume(){
 	optimizeStream(vertexStream);
 
 
-	Hash hash(2, nIndices >> 3, nIndices);
+	IndexHash <2> hash(nIndices);
 	Array <uint> list;
 	Array <vec3> normList;
 
@@ -1092,7 +1538,7 @@ bool Model::addStencilVolume(){
 
 struct Triangle {
 	vec3 pos[3];
-	float *attributes[3];
+	uint attributes[3];
 	int batch;
 };
 
@@ -1100,6 +1546,165 @@ int compareTriangles(const Triangle &elem0, const Triangle &elem1){
 	return elem0.batch - elem1.batch;
 }
 
+// Flat storage for the per-corner attributes of the triangles in cleanUp()
+struct AttributeArena {
+	AttributeArena(const uint size, const uint capacity){
+		nAttrib = size;
+		count = 0;
+		maxCount = max(capacity, 16U);
+		mem = (float *) malloc(maxCount * nAttrib * sizeof(float));
+	}
+
+	~AttributeArena(){
+		free(mem);
+	}
+
+	float *operator [] (const uint index) const { return mem + index * nAttrib; }
+
+	uint add(){
+		if (count >= maxCount){
+			maxCount += maxCount;
+			mem = (float *) realloc(mem, maxCount * nAttrib * sizeof(float));
+		}
+		return count++;
+	}
+
+	uint add(const uint index){
+		uint newIndex = add();
+		memcpy((*this)[newIndex], (*this)[index], nAttrib * sizeof(float));
+		return newIndex;
+	}
+
+	float *mem;
+	uint nAttrib;
+	uint count;
+	uint maxCount;
+};
+
+// Uniform grid over a set of points, hashed into a fixed number of buckets.
+// Each bucket lists its points in increasing index order.
+struct PointGrid {
+	PointGrid(const vec3 *points, const uint nPoints, const float size){
+		cellSize = size;
+		invCellSize = 1.0f / size;
+
+		minPos = maxPos = points[0];
+		for (uint i = 1; i < nPoints; i++){
+			minPos = min(minPos, points[i]);
+			maxPos = max(maxPos, points[i]);
+		}
+
+		nBuckets = 64;
+		while (nBuckets < 2 * nPoints) nBuckets += nBuckets;
+
+		bucketStart = new uint[nBuckets + 1];
+		bucketPoints = new uint[nPoints];
+		uint *pointBucket = new uint[nPoints];
+
+		memset(bucketStart, 0, (nBuckets + 1) * sizeof(uint));
+		for (uint i = 0; i < nPoints; i++){
+			pointBucket[i] = getBucket(getCell(points[i].x, minPos.x), getCell(points[i].y, minPos.y), getCell(points[i].z, minPos.z));
+			bucketStart[pointBucket[i] + 1]++;
+		}
+		for (uint i = 0; i < nBuckets; i++){
+			bucketStart[i + 1] += bucketStart[i];
+		}
+		for (uint i = 0; i < nPoints; i++){
+			bucketPoints[bucketStart[pointBucket[i]]++] = i;
+		}
+		// Filling shifted every start down by one bucket
+		for (uint i = nBuckets; i > 0; i--){
+			bucketStart[i] = bucketStart[i - 1];
+		}
+		bucketStart[0] = 0;
+
+		delete [] pointBucket;
+	}
+
+	~PointGrid(){
+		delete [] bucketStart;
+		delete [] bucketPoints;
+	}
+
+	int getCell(const float x, const float base) const {
+		return int(floorf((x - base) * invCellSize));
+	}
+
+	uint getBucket(const int x, const int y, const int z) const {
+		return (uint(x) * 73856093U ^ uint(y) * 19349663U ^ uint(z) * 83492791U) & (nBuckets - 1);
+	}
+
+	vec3 minPos, maxPos;
+	float cellSize, invCellSize;
+
+	uint nBuckets;
+	uint *bucketStart;
+	uint *bucketPoints;
+};
+
+// Returns true if the vertex splits the edge v0-v1, also returning the interpolation factor
+static inline bool splitsEdge(const vec3 &v0, const vec3 &vVec, const vec3 &vertex, float &c){
+	vec3 lVec = vertex - v0;
+
+	c = dot(lVec, vVec) / dot(vVec, vVec);
+	if (c > 0.00001f && c < 0.99999f){
+		vec3 pl = c * vVec - lVec;
+		return (dot(pl, pl) < 0.0001f);
+	}
+	return false;
+}
+
+// Finds the lowest indexed vertex that splits the edge, or returns false if there's none
+static bool findSplitVertex(const PointGrid &grid, const vec3 *vertices, const uint nVertices, const vec3 &v0, const vec3 &v1, uint &splitVertex, float &splitC){
+	vec3 vVec = v1 - v0;
+	float c;
+
+	// Anything closer than 0.01 to the edge is inside its slightly padded bounding box
+	const float pad = 0.02f;
+	vec3 lo = max(min(v0, v1) - pad, grid.minPos);
+	vec3 hi = min(max(v0, v1) + pad, grid.maxPos);
+
+	int x0 = grid.getCell(lo.x, grid.minPos.x), x1 = grid.getCell(hi.x, grid.minPos.x);
+	int y0 = grid.getCell(lo.y, grid.minPos.y), y1 = grid.getCell(hi.y, grid.minPos.y);
+	int z0 = grid.getCell(lo.z, grid.minPos.z), z1 = grid.getCell(hi.z, grid.minPos.z);
+
+	uint best = 0xFFFFFFFF;
+	if (x1 < x0 || y1 < y0 || z1 < z0){
+		// Edge is entirely outside of the vertex bounds (or degenerate)
+	} else if (float(x1 - x0 + 1) * float(y1 - y0 + 1) * float(z1 - z0 + 1) >= float(grid.nBuckets)){
+		// Large edges would visit more buckets than there are, so just scan all vertices
+		for (uint k = 0; k < nVertices; k++){
+			if (splitsEdge(v0, vVec, vertices[k], c)){
+				best = k;
+				splitC = c;
+				break;
+			}
+		}
+	} else {
+		for (int z = z0; z <= z1; z++){
+			for (int y = y0; y <= y1; y++){
+				for (int x = x0; x <= x1; x++){
+					uint bucket = grid.getBucket(x, y, z);
+					for (uint b = grid.bucketStart[bucket]; b < grid.bucketStart[bucket + 1]; b++){
+						uint k = grid.bucketPoints[b];
+						// Points are sorted within the bucket, so nothing further can beat the current best
+						if (k >= best) break;
+
+						if (splitsEdge(v0, vVec, vertices[k], c)){
+							best = k;
+							splitC = c;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	splitVertex = best;
+	return (best != 0xFFFFFFFF);
+}
+
 void Model::cleanUp(){
 	StreamID vertexStream = findStream(TYPE_VERTEX);
 	if (vertexStream < 0) return;
@@ -1110,10 +1715,14 @@ void Model::cleanUp(){
 	uint *indices   = streams[vertexStream].indices;
 	uint nVertices  = streams[vertexStream].nVertices;
 
-	Array <Triangle> triangles;
+	if (nIndices == 0 || nVertices == 0) return;
 
 	uint nAttrib = getComponentCount();
 
+	Array <Triangle> triangles(nIndices / 3);
+	AttributeArena attributes(nAttrib, nIndices);
+
+	float edgeLength = 0;
 	for (uint n = 0; n < batches.getCount(); n++){
 		uint endIndex = batches[n].startIndex + batches[n].nIndices;
 		for (uint i = batches[n].startIndex; i < endIndex; i += 3){
@@ -1122,9 +1731,9 @@ void Model::cleanUp(){
 
 			for (uint j = 0; j < 3; j++){
 				tri.pos[j] = vertices[indices[i + j]];
-				tri.attributes[j] = new float[nAttrib];
+				tri.attributes[j] = attributes.add();
 
-				float *dest = tri.attributes[j];
+				float *dest = attributes[tri.attributes[j]];
 				for (uint k = 0; k < streams.getCount(); k++){
 					if (signed(k) != vertexStream){
 						int nComp = streams[k].nComponents;
@@ -1133,63 +1742,59 @@ void Model::cleanUp(){
 					}
 				}
 			}
+			edgeLength += length(tri.pos[1] - tri.pos[0]) + length(tri.pos[2] - tri.pos[1]) + length(tri.pos[0] - tri.pos[2]);
 
 			triangles.add(tri);
 		}
 	}
 
+	// Size grid cells to about the average edge length so that most edge queries only touch a handful of cells
+	float cellSize = max(edgeLength / float(3 * max(triangles.getCount(), 1U)), 0.1f);
+	PointGrid grid(vertices, nVertices, cellSize);
+
 	for (uint i = 0; i < triangles.getCount(); i++){
 
 restart:
 
 		uint prev = 2;
 		for (uint j = 0; j < 3; j++){
-			vec3 v0 = triangles[i].pos[prev];
-			vec3 v1 = triangles[i].pos[j];
-
-			for (uint k = 0; k < nVertices; k++){
-				vec3 vVec = v1 - v0;
-				vec3 lVec = vertices[k] - v0;
-
-				float c = dot(lVec, vVec) / dot(vVec, vVec);
-				if (c > 0.00001f && c < 0.99999f){
-					vec3 pl = c * vVec - lVec;
-					if (dot(pl, pl) < 0.0001f){
-
-						// Copy current triangle
-						Triangle tri;
-						tri.batch = triangles[i].batch;
-						for (uint x = 0; x < 3; x++){
-							tri.pos[x] = triangles[i].pos[x];
-							tri.attributes[x] = new float[nAttrib];
-							memcpy(tri.attributes[x], triangles[i].attributes[x], nAttrib * sizeof(float));
-						}
-
-						// Assign new position for the splitted edge
-						triangles[i].pos[j] = vertices[k];
-						tri.pos[prev] = vertices[k];
+			uint k;
+			float c;
+			if (findSplitVertex(grid, vertices, nVertices, triangles[i].pos[prev], triangles[i].pos[j], k, c)){
+				// Copy current triangle
+				Triangle tri;
+				tri.batch = triangles[i].batch;
+				for (uint x = 0; x < 3; x++){
+					tri.pos[x] = triangles[i].pos[x];
+					tri.attributes[x] = attributes.add(triangles[i].attributes[x]);
+				}
 
-						// Interpolate the other attributes
-						for (uint x = 0; x < nAttrib; x++){
-							float ip = lerp(tri.attributes[prev][x], tri.attributes[j][x], c);
+				// Assign new position for the splitted edge
+				triangles[i].pos[j] = vertices[k];
+				tri.pos[prev] = vertices[k];
 
-							triangles[i].attributes[j][x] = ip;
-							tri.attributes[prev][x] = ip;
-						}
+				// Interpolate the other attributes
+				float *splitAttribs = attributes[triangles[i].attributes[j]];
+				float *prevAttribs  = attributes[tri.attributes[prev]];
+				float *srcAttribs   = attributes[tri.attributes[j]];
+				for (uint x = 0; x < nAttrib; x++){
+					float ip = lerp(prevAttribs[x], srcAttribs[x], c);
 
-						triangles.add(tri);
+					splitAttribs[x] = ip;
+					prevAttribs[x] = ip;
+				}
 
+				triangles.add(tri);
 
-						goto restart;
-					}
-				}
+				goto restart;
 			}
 
 			prev = j;
 		}
 	}
 
-	triangles.sort(compareTriangles);
+	// Triangles come in batch order apart from the ones split off above, and a stable sort keeps the original order within each batch
+	triangles.parallelSort(compareTriangles);
 
 	nIndices = 3 * triangles.getCount();
 
@@ -1214,7 +1819,7 @@ restart:
 			float *dest = streams[i].vertices;
 			for (uint j = 0; j < triangles.getCount(); j++){
 				for (uint k = 0; k < 3; k++){
-					memcpy(dest, triangles[j].attributes[k] + currComp, nComp * sizeof(float));
+					memcpy(dest, attributes[triangles[j].attributes[k]] + currComp, nComp * sizeof(float));
 					dest += nComp;
 				}
 			}
@@ -1238,9 +1843,6 @@ restart:
 	uint startIndex = 0;
 	while (i < triangles.getCount()){
 		while (i < triangles.getCount() && triangles[i].batch == currBatch){
-			for (int j = 0; j < 3; j++){
-				delete triangles[i].attributes[j];
-			}
 			i++;
 		}
 
@@ -1454,7 +2056,8 @@ void Model::copy(const Model *model){
 		memcpy(vertices, stream.vertices, stream.nComponents * stream.nVertices * sizeof(float));
 		uint *indices = new uint[nIndices];
 		memcpy(indices, stream.indices, nIndices * sizeof(uint));
-		addStream(stream.type, stream.nComponents, stream.nVertices, vertices, indices, stream.optimized);
+		StreamID id = addStream(stream.type, stream.nComponents, stream.nVertices, vertices, indices, stream.optimized);
+		streams[id].format = stream.format;
 	}
 
 	for (uint i = 0; i < model->batches.getCount(); i++){
@@ -1470,9 +2073,20 @@ void Model::clear(){
 	}
 	streams.clear();
 	batches.clear();
-
-	delete lastVertices;
-	delete lastIndices;
+	clusters.clear();
+	batchClusters.clear();
+	clearLods();
+
+	if (mappedFile || compiledData){
+		// Vertex and index data point straight into the mapped file or image
+		delete mappedFile;
+		delete [] compiledData;
+		mappedFile = NULL;
+		compiledData = NULL;
+	} else {
+		delete lastVertices;
+		delete lastIndices;
+	}
 	delete lastFormat;
 
 	lastVertexCount = 0;
@@ -1487,22 +2101,19 @@ void Model::optimize(){
 	}
 }
 
-void Model::optimizeStream(const StreamID streamID){
+void Model::optimizeStream(const StreamID streamID, const float epsilon){
 	if (streams[streamID].optimized) return;
 
 	uint nComp = streams[streamID].nComponents;
 	uint nVert = streams[streamID].nVertices;
 
-	KdTree <float> kdTree(nComp, nVert);
-
 	uint *indexRemap = new uint[nVert];
 	float *vertices = streams[streamID].vertices;
-	for (uint i = 0; i < nVert; i++){
-		float *vertex = vertices + i * nComp;
-		uint index = kdTree.addUnique(vertex);
+	uint nUnique = weldVertices(vertices, nVert, nComp, indexRemap, epsilon);
 
-		indexRemap[i] = index;
-		memcpy(vertices + index * nComp, vertex, nComp * sizeof(float));
+	// Welded indices never exceed the original ones, so vertices can be compacted in place
+	for (uint i = 0; i < nVert; i++){
+		memmove(vertices + indexRemap[i] * nComp, vertices + i * nComp, nComp * sizeof(float));
 	}
 
 	uint *indices = streams[streamID].indices;
@@ -1510,64 +2121,90 @@ void Model::optimizeStream(const StreamID streamID){
 		indices[j] = indexRemap[indices[j]];
 	}
 
-	delete indexRemap;
-	streams[streamID].nVertices = kdTree.getCount();
-	streams[streamID].vertices = (float *) realloc(vertices, kdTree.getCount() * nComp * sizeof(float));
+	delete [] indexRemap;
+	streams[streamID].nVertices = nUnique;
+	streams[streamID].vertices = (float *) realloc(vertices, nUnique * nComp * sizeof(float));
 	streams[streamID].optimized = true;
 }
 
+// Numbers the unique combinations of indices across the source streams. Keys are zero padded
+// up to keySize. sources receives the first index position where each combination appears.
+template <class HASH>
+static uint indexVertices(HASH &hash, const uint keySize, uint **srcIndices, const uint nStreams, const uint nIndices, uint *destIndices, uint *sources){
+	uint *key = new uint[keySize];
+	memset(key, 0, keySize * sizeof(uint));
+
+	for (uint j = 0; j < nIndices; j++){
+		for (uint i = 0; i < nStreams; i++){
+			key[i] = srcIndices[i][j];
+		}
+
+		uint index;
+		if (!hash.insert(key, &index)){
+			sources[index] = j;
+		}
+		destIndices[j] = index;
+	}
+	delete [] key;
+
+	return hash.getCount();
+}
+
 uint Model::assemble(const StreamID *aStreams, const uint nStreams, float **destVertices, uint **destIndices, bool separateArrays){
 	uint i, j, nComp = getComponentCount(aStreams, nStreams);
 	for (i = 0; i < nStreams; i++){
 		optimizeStream(aStreams[i]);
 	}
 
-	if (separateArrays){
-		for (i = 0; i < nStreams; i++){
-			destVertices[i] = new float[streams[aStreams[i]].nComponents * nIndices];
-		}
-	} else {
-		*destVertices = new float[nComp * nIndices];
+	uint **srcIndices = new uint *[nStreams];
+	for (i = 0; i < nStreams; i++){
+		srcIndices[i] = streams[aStreams[i]].indices;
 	}
-	uint *iDest = *destIndices = new uint[nIndices];
 
-	uint *iIndex = new uint[nStreams];
-	Hash hash(nStreams, nIndices >> 3, nIndices);
-	for (j = 0; j < nIndices; j++){
-		for (i = 0; i < nStreams; i++){
-			iIndex[i] = streams[aStreams[i]].indices[j];
-		}
-
-		uint index;
-		if (!hash.insert(iIndex, &index)){
-			if (separateArrays){
-				for (i = 0; i < nStreams; i++){
-					uint nc = streams[aStreams[i]].nComponents;
-					float *dest = destVertices[i] + index * nc;
-					memcpy(dest, streams[aStreams[i]].vertices + streams[aStreams[i]].indices[j] * nc, nc * sizeof(float));
-				}
-			} else {
-				float *dest = *destVertices + index * nComp;
-				for (i = 0; i < nStreams; i++){
-					uint nc = streams[aStreams[i]].nComponents;
-					memcpy(dest, streams[aStreams[i]].vertices + streams[aStreams[i]].indices[j] * nc, nc * sizeof(float));
-					dest += nc;
-				}
-			}
-		}
-
-		*iDest++ = index;
+	uint *iDest = *destIndices = new uint[nIndices];
+	uint *sources = new uint[nIndices];
+
+	uint nVertices;
+	if (nStreams <= 2){
+		IndexHash <2> hash(nIndices);
+		nVertices = indexVertices(hash, 2, srcIndices, nStreams, nIndices, iDest, sources);
+	} else if (nStreams <= 4){
+		IndexHash <4> hash(nIndices);
+		nVertices = indexVertices(hash, 4, srcIndices, nStreams, nIndices, iDest, sources);
+	} else if (nStreams <= 8){
+		IndexHash <8> hash(nIndices);
+		nVertices = indexVertices(hash, 8, srcIndices, nStreams, nIndices, iDest, sources);
+	} else {
+		Hash hash(nStreams, nIndices >> 3, nIndices);
+		nVertices = indexVertices(hash, nStreams, srcIndices, nStreams, nIndices, iDest, sources);
 	}
-	delete iIndex;
+	delete [] srcIndices;
 
 	if (separateArrays){
 		for (i = 0; i < nStreams; i++){
-			destVertices[i] = (float *) realloc(destVertices[i], hash.getCount() * streams[aStreams[i]].nComponents * sizeof(float));
+			uint nc = streams[aStreams[i]].nComponents;
+			const float *src = streams[aStreams[i]].vertices;
+			const uint *indices = streams[aStreams[i]].indices;
+
+			float *dest = destVertices[i] = new float[nc * nVertices];
+			for (j = 0; j < nVertices; j++){
+				memcpy(dest, src + indices[sources[j]] * nc, nc * sizeof(float));
+				dest += nc;
+			}
 		}
 	} else {
-		*destVertices = (float *) realloc(*destVertices, hash.getCount() * nComp * sizeof(float));
+		float *dest = *destVertices = new float[nComp * nVertices];
+		for (j = 0; j < nVertices; j++){
+			for (i = 0; i < nStreams; i++){
+				uint nc = streams[aStreams[i]].nComponents;
+				memcpy(dest, streams[aStreams[i]].vertices + streams[aStreams[i]].indices[sources[j]] * nc, nc * sizeof(float));
+				dest += nc;
+			}
+		}
 	}
-	return hash.getCount();
+	delete [] sources;
+
+	return nVertices;
 }
 
 void convertToShorts(const uint *src, int nIndices, const uint nVertices){
@@ -1590,99 +2227,535 @@ void convertToShorts(const uint *src, int nIndices, const uint nVertices){
 	}
 }
 
-uint Model::makeDrawable(Renderer *renderer, const bool useCache, const ShaderID shader){
-	if (streams.getCount() == 0) return 0;
+void Model::getDrawFormat(FormatDesc *format) const {
+	for (uint i = 0; i < streams.getCount(); i++){
+		format[i].stream = 0;
+		format[i].type   = streams[i].type;
+		format[i].format = streams[i].format;
+		format[i].size   = getPackedComponents(streams[i].nComponents, streams[i].format);
+	}
+}
 
-	int vertexSize = getVertexSize();
+// Converts the assembled float vertices to the stream formats and measures the largest error per stream
+static void packVertex(ubyte *dest, const float *src, const uint nComponents, const AttributeFormat format, float &maxError){
+	if (format == FORMAT_HALF){
+		half *hDest = (half *) dest;
+		for (uint k = 0; k < nComponents; k++){
+			hDest[k] = half(src[k]);
+			maxError = max(maxError, fabsf(float(hDest[k]) - src[k]));
+		}
+		if (nComponents & 1) hDest[nComponents] = half(0.0f);
+	} else if (format == FORMAT_UBYTE){
+		for (uint k = 0; k < 4; k++){
+			float f = (k < nComponents)? clamp(src[k], -1.0f, 1.0f) : 0.0f;
+			dest[k] = (ubyte) (f * 127.5f + 127.5f + 0.5f);
+			if (k < nComponents) maxError = max(maxError, fabsf(dest[k] * (2.0f / 255.0f) - 1.0f - src[k]));
+		}
+	} else {
+		memcpy(dest, src, nComponents * sizeof(float));
+	}
+}
 
-	if (useCache && lastVertices){
-		if ((vertexFormat = renderer->addVertexFormat(lastFormat, streams.getCount(), shader)) == VF_NONE) return 0;
-		if ((vertexBuffer = renderer->addVertexBuffer(lastVertexCount * vertexSize, STATIC, lastVertices)) == VB_NONE) return 0;
+uint Model::assembleDrawable(ubyte **vertices, uint **indices, FormatDesc **format){
+	StreamID *aStreams = new StreamID[streams.getCount()];
 
-		if (lastVertexCount > 65535){
-			if ((indexBuffer = renderer->addIndexBuffer(nIndices, 4, STATIC, lastIndices)) == IB_NONE) return 0;
-		} else {
-			if ((indexBuffer = renderer->addIndexBuffer(nIndices, 2, STATIC, lastIndices)) == IB_NONE) return 0;
-		}
+	for (uint i = 0; i < streams.getCount(); i++){
+		aStreams[i] = i;
+	}
 
-		return lastVertexCount;
+	float *floatVertices;
+	uint nVertices = assemble(aStreams, streams.getCount(), &floatVertices, indices, false);
+	delete aStreams;
+
+	if (optimizeDrawOrder){
+		nVertices = reorderForDrawing(floatVertices, nVertices, *indices);
+	}
+
+	uint vertexSize = getVertexSize();
+	uint nComp = getComponentCount();
+	if (vertexSize == nComp * sizeof(float)){
+		// All float, so the assembled vertices are already in the final layout
+		*vertices = (ubyte *) floatVertices;
 	} else {
-		StreamID *aStreams = new StreamID[streams.getCount()];
+		*vertices = new ubyte[nVertices * vertexSize];
 
 		for (uint i = 0; i < streams.getCount(); i++){
-			aStreams[i] = i;
+			streams[i].packingError = 0;
 		}
-		float *vertices;
-		uint *indices;
 
-		uint nVertices = assemble(aStreams, streams.getCount(), &vertices, &indices, false);
+		const float *src = floatVertices;
+		ubyte *dest = *vertices;
+		for (uint j = 0; j < nVertices; j++){
+			for (uint i = 0; i < streams.getCount(); i++){
+				packVertex(dest, src, streams[i].nComponents, streams[i].format, streams[i].packingError);
+				src  += streams[i].nComponents;
+				dest += getPackedComponents(streams[i].nComponents, streams[i].format) * formatSize[streams[i].format];
+			}
+		}
+		delete [] floatVertices;
+	}
 
-		// Compute ranges for batches
-		for (uint j = 0; j < batches.getCount(); j++){
-			uint minVertex = 0xFFFFFFFF;
-			uint maxVertex = 0;
+	// Compute ranges for batches
+	for (uint j = 0; j < batches.getCount(); j++){
+		uint minVertex = 0xFFFFFFFF;
+		uint maxVertex = 0;
 
-			uint first = batches[j].startIndex;
-			uint last  = first + batches[j].nIndices;
-			if (first < last){
-				for (uint i = first; i < last; i++){
-					if (indices[i] < minVertex) minVertex = indices[i];
-					if (indices[i] > maxVertex) maxVertex = indices[i];
-				}
+		uint first = batches[j].startIndex;
+		uint last  = first + batches[j].nIndices;
+		if (first < last){
+			for (uint i = first; i < last; i++){
+				if ((*indices)[i] < minVertex) minVertex = (*indices)[i];
+				if ((*indices)[i] > maxVertex) maxVertex = (*indices)[i];
+			}
 
-				batches[j].startVertex = minVertex;
-				batches[j].nVertices = maxVertex - minVertex + 1;
-			} else {
-				// Empty batch
-				batches[j].startVertex = 0;
-				batches[j].nVertices = 0;
+			batches[j].startVertex = minVertex;
+			batches[j].nVertices = maxVertex - minVertex + 1;
+		} else {
+			// Empty batch
+			batches[j].startVertex = 0;
+			batches[j].nVertices = 0;
+		}
+	}
+
+	*format = new FormatDesc[streams.getCount()];
+	getDrawFormat(*format);
+
+	if (nVertices <= 65535){
+		convertToShorts(*indices, nIndices, nVertices);
+	}
+
+	return nVertices;
+}
+
+uint Model::reorderForDrawing(float *vertices, const uint nVertices, uint *indices){
+	uint vertexSize = getComponentCount();
+
+	StreamID vertexStream = findStream(TYPE_VERTEX);
+	uint posOffset = 0;
+	for (StreamID i = 0; i < vertexStream; i++){
+		posOffset += streams[i].nComponents;
+	}
+
+	simulateVertexCache(indices, nIndices, nVertices, vertexCacheSize, false, &drawOrderStats.acmrBefore, &drawOrderStats.atvrBefore);
+
+	// Batches are optimized one by one, with their vertices numbered locally
+	uint *localIndex = new uint[nVertices];
+	uint *globalIndex = new uint[nVertices];
+	vec3 *positions = new vec3[nVertices];
+	uint *batchIndices = new uint[nIndices];
+	memset(localIndex, 0xFF, nVertices * sizeof(uint));
+
+	Array <uint> clusters;
+	uint nBatches = max(batches.getCount(), 1U);
+	for (uint b = 0; b < nBatches; b++){
+		uint first = (batches.getCount() > 0)? batches[b].startIndex : 0;
+		uint count = (batches.getCount() > 0)? batches[b].nIndices : nIndices;
+
+		uint nLocal = 0;
+		for (uint i = 0; i < count; i++){
+			uint v = indices[first + i];
+			if (localIndex[v] == 0xFFFFFFFF){
+				localIndex[v] = nLocal;
+				globalIndex[nLocal++] = v;
 			}
+			batchIndices[i] = localIndex[v];
 		}
 
-		FormatDesc *format = new FormatDesc[streams.getCount()];
-		for (uint i = 0; i < streams.getCount(); i++){
-			format[i].stream = 0;
-			format[i].type   = streams[i].type;
-			format[i].format = FORMAT_FLOAT;
-			format[i].size   = streams[i].nComponents;
+		optimizeVertexCache(batchIndices, count, nLocal, vertexCacheSize, &clusters);
+		if (vertexStream >= 0 && streams[vertexStream].nComponents >= 3){
+			for (uint j = 0; j < nLocal; j++){
+				positions[j] = *(vec3 *) (vertices + globalIndex[j] * vertexSize + posOffset);
+			}
+			optimizeOverdraw(batchIndices, count, (float *) positions, 3, nLocal, clusters, vertexCacheSize);
 		}
 
-		if ((vertexFormat = renderer->addVertexFormat(format, streams.getCount(), shader)) == VF_NONE) return 0;
-		if ((vertexBuffer = renderer->addVertexBuffer(nVertices * vertexSize, STATIC, vertices)) == VB_NONE) return 0;
+		for (uint i = 0; i < count; i++){
+			indices[first + i] = globalIndex[batchIndices[i]];
+		}
+		for (uint j = 0; j < nLocal; j++){
+			localIndex[globalIndex[j]] = 0xFFFFFFFF;
+		}
+	}
 
-		if (nVertices > 65535){
-			if ((indexBuffer = renderer->addIndexBuffer(nIndices, 4, STATIC, indices)) == IB_NONE) return 0;
-		} else {
-			convertToShorts(indices, nIndices, nVertices);
+	delete [] localIndex;
+	delete [] globalIndex;
+	delete [] positions;
+	delete [] batchIndices;
+
+	uint count = nVertices;
+	if (optimizeVertexOrder){
+		count = optimizeVertexFetch(vertices, vertexSize, indices, nIndices, nVertices);
+	}
+
+	simulateVertexCache(indices, nIndices, count, vertexCacheSize, false, &drawOrderStats.acmrAfter, &drawOrderStats.atvrAfter);
+
+	return count;
+}
+
+uint Model::compile(){
+	if (streams.getCount() == 0) return 0;
+
+	// Nothing to assemble from for models loaded with loadCompiled()
+	if (mappedFile || compiledData) return lastVertexCount;
+
+	ubyte *vertices;
+	uint *indices;
+	FormatDesc *format;
+
+	uint nVertices = assembleDrawable(&vertices, &indices, &format);
+
+	delete lastFormat;
+	delete lastVertices;
+	delete lastIndices;
+	clusters.clear();
+	batchClusters.clear();
+	clearLods();
+
+	lastFormat = format;
+	lastVertexCount = nVertices;
+	lastVertices = vertices;
+	lastIndices = indices;
+
+	return nVertices;
+}
+
+uint Model::buildClusters(const uint clusterSize){
+	clusters.clear();
+	batchClusters.clear();
+
+	StreamID vertexStream = findStream(TYPE_VERTEX);
+	if (lastVertices == NULL || vertexStream < 0 || streams[vertexStream].nComponents < 3 || clusterSize == 0) return 0;
+
+	const uint stride = getVertexSize();
+	const ubyte *positions = lastVertices + getStreamOffset(vertexStream);
+
+	vec3 *corners = new vec3[3 * clusterSize];
+	vec3 *normals = new vec3[clusterSize];
+
+	for (uint b = 0; b < batches.getCount(); b++){
+		batchClusters.add(clusters.getCount());
+
+		for (uint first = 0; first < batches[b].nIndices; first += 3 * clusterSize){
+			Cluster cluster;
+			cluster.first = first;
+			cluster.nIndices = min(3 * clusterSize, batches[b].nIndices - first);
+
+			vec3 minPos = vec3(FLT_MAX), maxPos = vec3(-FLT_MAX);
+			for (uint i = 0; i < cluster.nIndices; i++){
+				corners[i] = *(const vec3 *) (positions + stride * getCompiledIndex(batches[b].startIndex + first + i));
+				minPos = min(minPos, corners[i]);
+				maxPos = max(maxPos, corners[i]);
+			}
+
+			// Sphere around the bounding box center
+			cluster.center = 0.5f * (minPos + maxPos);
+			float radiusSq = 0;
+			for (uint i = 0; i < cluster.nIndices; i++){
+				vec3 d = corners[i] - cluster.center;
+				radiusSq = max(radiusSq, dot(d, d));
+			}
+			cluster.radius = sqrtf(radiusSq);
+
+			// Cone around the mean face normal, ignoring degenerate triangles
+			uint nTriangles = cluster.nIndices / 3;
+			vec3 axis = vec3(0.0f);
+			for (uint t = 0; t < nTriangles; t++){
+				vec3 normal = cross(corners[3 * t + 1] - corners[3 * t], corners[3 * t + 2] - corners[3 * t]);
+				float len = length(normal);
+				normals[t] = (len > 0)? normal / len : vec3(0.0f);
+				axis += normals[t];
+			}
 
-			if ((indexBuffer = renderer->addIndexBuffer(nIndices, 2, STATIC, indices)) == IB_NONE) return 0;
+			float minDot = -1.0f;
+			float axisLen = length(axis);
+			if (axisLen > 0){
+				axis /= axisLen;
+				minDot = 1.0f;
+				for (uint t = 0; t < nTriangles; t++){
+					if (normals[t] != vec3(0.0f)) minDot = min(minDot, dot(normals[t], axis));
+				}
+			}
+			cluster.coneAxis = axis;
+			// A cutoff above one never culls, used where the normals span a half space or more
+			cluster.coneCutoff = (minDot > 0)? sqrtf(1.0f - minDot * minDot) : 2.0f;
+
+			clusters.add(cluster);
 		}
+	}
+	batchClusters.add(clusters.getCount());
 
-		delete aStreams;
+	delete [] corners;
+	delete [] normals;
+
+	return clusters.getCount();
+}
+
+uint Model::cullBatch(const uint batch, const Frustum &frustum, const vec3 *viewPos, Array <DrawRange> &ranges) const {
+	// Without clusters the batch is drawn whole
+	if (batch + 1 >= batchClusters.getCount()){
+		DrawRange range = { 0, batches[batch].nIndices };
+		ranges.add(range);
+		return range.count;
+	}
 
-		if (useCache){
-			delete lastFormat;
-			delete lastVertices;
-			delete lastIndices;
+	const uint firstRange = ranges.getCount();
+	uint nVisible = 0;
 
-			lastFormat = format;
-			lastVertexCount = nVertices;
-			lastVertices = vertices;
-			lastIndices = indices;
+	for (uint c = batchClusters[batch]; c < batchClusters[batch + 1]; c++){
+		const Cluster &cluster = clusters[c];
+
+		if (!frustum.sphereInFrustum(cluster.center, cluster.radius)) continue;
+		if (viewPos){
+			// Every point of the bounding sphere sees the back of all triangles
+			vec3 dir = cluster.center - *viewPos;
+			if (dot(dir, cluster.coneAxis) >= cluster.coneCutoff * length(dir) + cluster.radius) continue;
+		}
+
+		uint last = ranges.getCount() - 1;
+		if (ranges.getCount() > firstRange && ranges[last].first + ranges[last].count == cluster.first){
+			ranges[last].count += cluster.nIndices;
 		} else {
-			delete format;
-			delete vertices;
-			delete indices;
+			DrawRange range = { cluster.first, cluster.nIndices };
+			ranges.add(range);
 		}
+		nVisible += cluster.nIndices;
+	}
+
+	return nVisible;
+}
+
+uint Model::buildLods(const uint nLods, const float reduction, const float maxError, const uint *vertexRegions){
+	clearLods();
 
-		return nVertices;
+	if (lastVertices == NULL && compile() == 0) return 0;
+
+	StreamID vertexStream = findStream(TYPE_VERTEX);
+	if (vertexStream < 0 || streams[vertexStream].nComponents < 3 || nIndices == 0) return 0;
+
+	const uint vertexSize = getVertexSize();
+	const uint stride = vertexSize / sizeof(float);
+	const float *positions = (const float *) (lastVertices + getStreamOffset(vertexStream));
+
+	// Identical vertices in the same region are simplified as one, using the first of them
+	const uint nComponents = stride + (vertexRegions? 1 : 0);
+	float *keys = new float[lastVertexCount * nComponents];
+	for (uint v = 0; v < lastVertexCount; v++){
+		memcpy(keys + v * nComponents, lastVertices + v * vertexSize, vertexSize);
+		if (vertexRegions) memcpy(keys + v * nComponents + stride, vertexRegions + v, sizeof(uint));
+	}
+
+	uint *remap = new uint[lastVertexCount];
+	uint nUnique = weldVertices(keys, lastVertexCount, nComponents, remap);
+
+	uint *first = new uint[nUnique];
+	for (uint v = lastVertexCount; v > 0; v--){
+		first[remap[v - 1]] = v - 1;
+	}
+	for (uint v = 0; v < lastVertexCount; v++){
+		remap[v] = first[remap[v]];
+	}
+	delete [] first;
+
+	// Different vertices at the same position lie on a seam
+	for (uint v = 0; v < lastVertexCount; v++){
+		memcpy(keys + 3 * v, positions + v * stride, 3 * sizeof(float));
+	}
+	uint *position = new uint[lastVertexCount];
+	uint nPositions = weldVertices(keys, lastVertexCount, 3, position);
+	delete [] keys;
+
+	uint *positionOwner = new uint[nPositions];
+	memset(positionOwner, 0xFF, nPositions * sizeof(uint));
+
+	ubyte *locked = new ubyte[lastVertexCount];
+	memset(locked, 0, lastVertexCount);
+	for (uint v = 0; v < lastVertexCount; v++){
+		if (remap[v] != v) continue;
+
+		uint &owner = positionOwner[position[v]];
+		if (owner == 0xFFFFFFFF){
+			owner = v;
+		} else {
+			locked[owner] = 1;
+			locked[v] = 1;
+		}
+	}
+	delete [] positionOwner;
+	delete [] position;
+
+	uint *indices = new uint[nIndices];
+	for (uint i = 0; i < nIndices; i++){
+		indices[i] = remap[getCompiledIndex(i)];
+	}
+	delete [] remap;
+
+	// Keep the borders between regions
+	if (vertexRegions){
+		for (uint i = 0; i < nIndices; i += 3){
+			for (uint k = 0; k < 3; k++){
+				uint a = indices[i + k];
+				uint b = indices[i + (k + 1) % 3];
+				if (vertexRegions[a] != vertexRegions[b]){
+					locked[a] = 1;
+					locked[b] = 1;
+				}
+			}
+		}
+	}
+
+	vec3 minPos = vec3(FLT_MAX), maxPos = vec3(-FLT_MAX);
+	for (uint v = 0; v < lastVertexCount; v++){
+		minPos = min(minPos, *(const vec3 *) (positions + v * stride));
+		maxPos = max(maxPos, *(const vec3 *) (positions + v * stride));
+	}
+	float radius = 0.5f * length(maxPos - minPos);
+	if (radius <= 0) radius = 1.0f;
+
+	lodIndices = new uint[nIndices * max(nLods, 2U)];
+	lodErrors.add(0.0f);
+
+	uint nBatches = max(batches.getCount(), 1U);
+	uint lastCount = nIndices;
+	float target = 1.0f;
+	for (uint lod = 1; lod < nLods; lod++){
+		target *= reduction;
+
+		uint lodStart = nLodIndices;
+		float lodError = 0;
+		for (uint b = 0; b < nBatches; b++){
+			uint first = (batches.getCount() > 0)? batches[b].startIndex : 0;
+			uint count = (batches.getCount() > 0)? batches[b].nIndices : nIndices;
+
+			float error;
+			uint *dest = lodIndices + nLodIndices;
+			uint n = simplifyTriangles(dest, indices + first, count, positions, stride, lastVertexCount, locked, 3 * uint(target * (count / 3)), maxError * radius, &error);
+			if (optimizeDrawOrder){
+				optimizeVertexCache(dest, n, lastVertexCount, vertexCacheSize);
+			}
+
+			Batch batch;
+			batch.startIndex = nLodIndices;
+			batch.nIndices = n;
+			batch.startVertex = 0;
+			batch.nVertices = 0;
+			if (n > 0){
+				uint minVertex = 0xFFFFFFFF;
+				uint maxVertex = 0;
+				for (uint i = 0; i < n; i++){
+					if (dest[i] < minVertex) minVertex = dest[i];
+					if (dest[i] > maxVertex) maxVertex = dest[i];
+				}
+				batch.startVertex = minVertex;
+				batch.nVertices = maxVertex - minVertex + 1;
+			}
+			lodBatches.add(batch);
+
+			nLodIndices += n;
+			lodError = max(lodError, error / radius);
+		}
+
+		// Stop once the error limit keeps a level from getting any smaller
+		if (nLodIndices - lodStart == lastCount){
+			lodBatches.setCount(lodBatches.getCount() - nBatches);
+			nLodIndices = lodStart;
+			break;
+		}
+		lastCount = nLodIndices - lodStart;
+		lodErrors.add(lodError);
+	}
+
+	delete [] indices;
+	delete [] locked;
+
+	if (lastVertexCount <= 65535){
+		convertToShorts(lodIndices, nLodIndices, lastVertexCount);
+	}
+
+	return getLodCount();
+}
+
+uint Model::getLodIndexCount(const uint lod) const {
+	if (lod == 0 || lod >= getLodCount()) return nIndices;
+
+	uint nBatches = lodBatches.getCount() / (getLodCount() - 1);
+	const Batch &first = lodBatches[(lod - 1) * nBatches];
+	const Batch &last  = lodBatches[lod * nBatches - 1];
+
+	return last.startIndex + last.nIndices - first.startIndex;
+}
+
+uint Model::selectLod(const float screenRadius, const float pixelError) const {
+	for (uint lod = getLodCount() - 1; lod > 0; lod--){
+		if (lodErrors[lod] * screenRadius <= pixelError) return lod;
+	}
+	return 0;
+}
+
+void Model::clearLods(){
+	delete [] lodIndices;
+	lodIndices = NULL;
+	nLodIndices = 0;
+
+	lodBatches.clear();
+	lodErrors.clear();
+}
+
+bool Model::uploadDrawable(Renderer *renderer, const ShaderID shader, const FormatDesc *format, const uint nVertices, const ubyte *vertices, const uint *indices){
+	int vertexSize = getVertexSize();
+
+	if ((vertexFormat = renderer->addVertexFormat(format, streams.getCount(), shader)) == VF_NONE) return false;
+	if ((vertexBuffer = renderer->addVertexBuffer(nVertices * vertexSize, STATIC, vertices)) == VB_NONE) return false;
+
+	if (nVertices > 65535){
+		if ((indexBuffer = renderer->addIndexBuffer(nIndices, 4, STATIC, indices)) == IB_NONE) return false;
+	} else {
+		if ((indexBuffer = renderer->addIndexBuffer(nIndices, 2, STATIC, indices)) == IB_NONE) return false;
+	}
+
+	return true;
+}
+
+bool Model::uploadLods(Renderer *renderer){
+	if (nLodIndices == 0) return true;
+
+	uint indexSize = (lastVertexCount > 65535)? 4 : 2;
+	return ((lodIndexBuffer = renderer->addIndexBuffer(nLodIndices, indexSize, STATIC, lodIndices)) != IB_NONE);
+}
+
+uint Model::makeDrawable(Renderer *renderer, const bool useCache, const ShaderID shader){
+	if (streams.getCount() == 0) return 0;
+
+	if (useCache || mappedFile || compiledData){
+		if (lastVertices == NULL && compile() == 0) return 0;
+		if (!uploadDrawable(renderer, shader, lastFormat, lastVertexCount, lastVertices, lastIndices)) return 0;
+		if (!uploadLods(renderer)) return 0;
+
+		return lastVertexCount;
+	} else {
+		ubyte *vertices;
+		uint *indices;
+		FormatDesc *format;
+
+		uint nVertices = assembleDrawable(&vertices, &indices, &format);
+		bool result = uploadDrawable(renderer, shader, format, nVertices, vertices, indices) && uploadLods(renderer);
+
+		delete format;
+		delete vertices;
+		delete indices;
+
+		return result? nVertices : 0;
 	}
 }
 
 void Model::unmakeDrawable(Renderer *renderer){
-//	renderer->removeVertexFormat(indexBuffer);
-//	renderer->removeVertexBuffer(vertexBuffer);
-//	renderer->removeIndexBuffer(indexBuffer);
+	// There is no removing vertex formats, they are small and live as long as the renderer
+	if (vertexBuffer != VB_NONE) renderer->deleteVertexBuffer(vertexBuffer);
+	if (indexBuffer != IB_NONE) renderer->deleteIndexBuffer(indexBuffer);
+	if (lodIndexBuffer != IB_NONE) renderer->deleteIndexBuffer(lodIndexBuffer);
+
+	vertexBuffer = VB_NONE;
+	indexBuffer  = IB_NONE;
+	lodIndexBuffer = IB_NONE;
 }
 
 void Model::setBuffers(Renderer *renderer){
@@ -1727,6 +2800,40 @@ void Model::drawSubBatch(Renderer *renderer, const uint batch, const uint first,
 	renderer->drawElements(PRIM_TRIANGLES, startIndex, indexCount, batches[batch].startVertex, batches[batch].nVertices);
 }
 
+void Model::drawLod(Renderer *renderer, const uint lod){
+	if (lod == 0 || lod >= getLodCount()){
+		draw(renderer);
+		return;
+	}
+
+	ASSERT(vertexBuffer   != VB_NONE);
+	ASSERT(lodIndexBuffer != IB_NONE);
+
+	renderer->changeVertexFormat(vertexFormat);
+	renderer->changeVertexBuffer(0, vertexBuffer);
+	renderer->changeIndexBuffer(lodIndexBuffer);
+
+	uint nBatches = lodBatches.getCount() / (getLodCount() - 1);
+	renderer->drawElements(PRIM_TRIANGLES, lodBatches[(lod - 1) * nBatches].startIndex, getLodIndexCount(lod), 0, lastVertexCount);
+}
+
+void Model::drawBatchLod(Renderer *renderer, const uint batch, const uint lod){
+	if (lod == 0 || lod >= getLodCount()){
+		drawBatch(renderer, batch);
+		return;
+	}
+
+	ASSERT(vertexBuffer   != VB_NONE);
+	ASSERT(lodIndexBuffer != IB_NONE);
+
+	renderer->changeVertexFormat(vertexFormat);
+	renderer->changeVertexBuffer(0, vertexBuffer);
+	renderer->changeIndexBuffer(lodIndexBuffer);
+
+	const Batch &lodBatch = lodBatches[(lod - 1) * batches.getCount() + batch];
+	renderer->drawElements(PRIM_TRIANGLES, lodBatch.startIndex, lodBatch.nIndices, lodBatch.startVertex, lodBatch.nVertices);
+}
+
 uint *Model::getArrayIndices(const uint nVertices){
 	uint *indices = new uint[nVertices];
 	for (uint i = 0; i < nVertices; i++){
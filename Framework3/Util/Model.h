@@ -23,9 +23,11 @@
 #define _MODEL_H_
 
 #include "../Platform.h"
-#include "KdTree.h"
 #include "../Renderer.h"
 
+class MappedFile;
+class Frustum;
+
 typedef int StreamID;
 typedef int BatchID;
 
@@ -38,6 +40,10 @@ struct Stream {
 	AttributeType type;
 
 	bool optimized;
+
+	// Format when compiled for drawing, and the largest error converting to it last time
+	AttributeFormat format;
+	float packingError;
 };
 
 struct Batch {
@@ -47,10 +53,35 @@ struct Batch {
 	uint nVertices;
 };
 
+// A run of consecutive triangles within a batch, bounded for culling as a whole. The face normals
+// all lie within coneCutoff of coneAxis, stored as the sine of the cone's half angle.
+struct Cluster {
+	vec3 center;
+	float radius;
+	vec3 coneAxis;
+	float coneCutoff;
+
+	uint first;
+	uint nIndices;
+};
+
+// Post-transform vertex cache efficiency of the draw order before and after the last reordering.
+// ACMR is the average cache misses per triangle and ATVR the transforms per vertex.
+struct DrawOrderStats {
+	float acmrBefore, acmrAfter;
+	float atvrBefore, atvrAfter;
+};
+
+// Indices to draw with drawSubBatch()
+struct DrawRange {
+	uint first;
+	uint count;
+};
+
 class Model {
 public:
 	Model();
-	~Model();
+	virtual ~Model();
 
 	// Utility functions
 	void createSphere(const int subDivLevel);
@@ -62,6 +93,14 @@ public:
 	void changeAllGeneric(const bool excludeVertex = false);
 	void changeStreamType(const StreamID stream, const AttributeType type){ streams[stream].type = type; }
 
+	// Streams are assembled as floats and converted when compiled for drawing. FORMAT_HALF suits
+	// texture coordinates. FORMAT_UBYTE holds values in [-1, 1], like normals and tangents, as
+	// x * 0.5 + 0.5 in four bytes, so shaders need to expand them with x * 2.0 - 1.0.
+	// The vertex position stays FORMAT_FLOAT.
+	bool setStreamFormat(const StreamID stream, const AttributeFormat format);
+	void setVertexCompression(const bool halfTexCoords, const bool packedFrames);
+	float getPackingError(const StreamID stream) const { return streams[stream].packingError; }
+
 	BatchID addBatch(const uint startIndex, const uint nIndices);
 	const Batch &getBatch(const BatchID batch) const { return batches[batch]; }
 	uint getBatchCount() const { return batches.getCount(); }
@@ -76,7 +115,17 @@ public:
 	bool saveObj(const char *fileName);
 	bool loadT3d(const char *fileName, const bool removePortals = true, const bool removeInvisible = true, const bool removeTwoSided = false, const float texSize = 256.0f);
 
+	// Compiled models hold the final interleaved vertex and index buffers only, ready to be uploaded.
+	// A sourceHash of zero accepts any cached file.
+	bool loadCompiled(const char *fileName, const uint64 sourceHash = 0);
+	bool saveCompiled(const char *fileName, const uint64 sourceHash = 0);
+	// Same as above for a compiled image in memory or embedded in another file. The model takes
+	// ownership of data, which must be allocated with new [], and deletes it also on failure.
+	bool loadCompiled(ubyte *data, const uint64 size, const uint64 sourceHash = 0);
+	bool saveCompiled(FILE *file, const uint64 sourceHash = 0);
+
 	uint getVertexSize() const;
+	uint getStreamOffset(const StreamID stream) const;
 	uint getComponentCount() const;
 	uint getComponentCount(const StreamID *cStreams, const uint nStreams) const;
 
@@ -107,8 +156,58 @@ public:
 	void copy(const Model *model);
 
 	void optimize();
-	void optimizeStream(const StreamID streamID);
+	// Welds duplicate vertices. With epsilon > 0, vertices with all values within epsilon are merged.
+	void optimizeStream(const StreamID streamID, const float epsilon = 0.0f);
 	virtual uint assemble(const StreamID *aStreams, const uint nStreams, float **destVertices, uint **destIndices, bool separateArrays);
+	uint compile();
+
+	bool isCompiled() const { return lastVertices != NULL; }
+	uint getCompiledVertexCount() const { return lastVertexCount; }
+	const ubyte *getCompiledVertices() const { return lastVertices; }
+	uint getCompiledIndex(const uint index) const { return (lastVertexCount > 65535)? lastIndices[index] : ((const ushort *) lastIndices)[index]; }
+
+	// Builds a compiled model in dest from the given triangles of this compiled model, in increasing
+	// order. Batches are kept, though some may end up empty. Vertices are renumbered in order of first
+	// use; vertexMap receives the source vertex of each new one if given.
+	bool extract(Model *dest, const uint *triangles, const uint nTriangles, Array <uint> *vertexMap = NULL) const;
+
+	// When enabled, triangles within each batch are reordered for a post-transform vertex cache of
+	// cacheSize entries and for less overdraw whenever the model is assembled for drawing. With
+	// reorderVertices, vertices are also renumbered in order of first use, so leave it off if
+	// anything stored outside the model refers to vertices by index.
+	void setDrawOrderOptimization(const bool enable, const bool reorderVertices = true, const uint cacheSize = 16){
+		optimizeDrawOrder = enable;
+		optimizeVertexOrder = reorderVertices;
+		vertexCacheSize = cacheSize;
+	}
+	const DrawOrderStats &getDrawOrderStats() const { return drawOrderStats; }
+
+	// Splits each batch of the compiled model into clusters of up to clusterSize triangles in draw
+	// order. Compiling again discards the clusters.
+	uint buildClusters(const uint clusterSize = 64);
+	uint getClusterCount() const { return clusters.getCount(); }
+	const Cluster &getCluster(const uint cluster) const { return clusters[cluster]; }
+
+	// Appends the ranges of the batch's clusters that intersect the frustum to ranges, merging
+	// neighbouring ones. Given a viewPos, clusters facing away from it are dropped as well, which
+	// is only right when drawing with back face culling. Returns the number of indices kept.
+	uint cullBatch(const uint batch, const Frustum &frustum, const vec3 *viewPos, Array <DrawRange> &ranges) const;
+
+	// Simplifies each batch of the compiled model into nLods - 1 further levels of detail, each aiming
+	// for reduction times the triangles of the one before, but stopping short of an error of maxError
+	// times the bounding radius. Vertices stay where they are, so the levels share the vertex buffer.
+	// Attribute seams and open edges are kept, as are the borders between vertexRegions if given.
+	// Triangles may share their last vertex in the simplified levels, see simplifyTriangles().
+	// Call before makeDrawable(). Returns the number of levels built, including the full model.
+	uint buildLods(const uint nLods, const float reduction = 0.5f, const float maxError = 0.05f, const uint *vertexRegions = NULL);
+	uint getLodCount() const { return max(lodErrors.getCount(), 1U); }
+	// Error of a level as a fraction of the bounding radius
+	float getLodError(const uint lod) const { return (lod < lodErrors.getCount())? lodErrors[lod] : 0.0f; }
+	uint getLodIndexCount(const uint lod) const;
+
+	// Picks the coarsest level with an error below pixelError for a model whose bounding sphere
+	// projects to a radius of screenRadius pixels
+	uint selectLod(const float screenRadius, const float pixelError = 1.0f) const;
 
 	uint makeDrawable(Renderer *renderer, const bool useCache = true, const ShaderID shader = SHADER_NONE);
 	void unmakeDrawable(Renderer *renderer);
@@ -118,24 +217,53 @@ public:
 	void draw(Renderer *renderer);
 	void drawBatch(Renderer *renderer, const uint batch);
 	void drawSubBatch(Renderer *renderer, const uint batch, const uint first, const uint count);
+	void drawLod(Renderer *renderer, const uint lod);
+	void drawBatchLod(Renderer *renderer, const uint batch, const uint lod);
 
 	static uint *getArrayIndices(const uint nVertices);
 protected:
+	bool setCompiledData(const ubyte *data, const uint64 size, const uint64 sourceHash);
+	void getDrawFormat(FormatDesc *format) const;
+	uint assembleDrawable(ubyte **vertices, uint **indices, FormatDesc **format);
+	uint reorderForDrawing(float *vertices, const uint nVertices, uint *indices);
+	bool uploadDrawable(Renderer *renderer, const ShaderID shader, const FormatDesc *format, const uint nVertices, const ubyte *vertices, const uint *indices);
+	bool uploadLods(Renderer *renderer);
+	void clearLods();
 
 	uint nIndices;
 
 	VertexFormatID vertexFormat;
 	VertexBufferID vertexBuffer;
 	IndexBufferID indexBuffer;
+	IndexBufferID lodIndexBuffer;
 	
 	Array <Stream> streams;
 	Array <Batch> batches;
 
+	// First cluster of each batch, with the cluster count as the last entry
+	Array <Cluster> clusters;
+	Array <uint> batchClusters;
+
+	// Batches of each level of detail past the first, in the index format of lastIndices
+	Array <Batch> lodBatches;
+	Array <float> lodErrors;
+	uint *lodIndices;
+	uint nLodIndices;
+
 	// Cached
 	uint lastVertexCount;
-	float *lastVertices;
+	ubyte *lastVertices;
 	uint *lastIndices;
 	FormatDesc *lastFormat;
+
+	bool optimizeDrawOrder;
+	bool optimizeVertexOrder;
+	uint vertexCacheSize;
+	DrawOrderStats drawOrderStats;
+
+	// Backing storage of the cached data when loaded with loadCompiled()
+	MappedFile *mappedFile;
+	ubyte *compiledData;
 };
 
 #endif // _MODEL_H_
@@ -22,6 +22,8 @@
 #ifndef _QUEUE_H_
 #define _QUEUE_H_
 
+#include "Allocator.h"
+
 template <class TYPE>
 struct QueueNode {
 	QueueNode <TYPE> *prev;
@@ -29,15 +31,17 @@ struct QueueNode {
 	TYPE object;
 };
 
+// Nodes are allocated with new unless an allocator is given, such as a MemoryPool of QueueNode size
 template <class TYPE>
 class Queue {
 public:
-	Queue(){
+	Queue(Allocator *nodeAllocator = NULL){
 		count = 0;
 		first = NULL;
 		last  = NULL;
 		curr  = NULL;
 		del   = NULL;
+		allocator = nodeAllocator;
 	}
 
 	~Queue(){
@@ -47,28 +51,28 @@ public:
 	unsigned int getCount() const { return count; }
 
 	void addFirst(const TYPE object){
-		QueueNode <TYPE> *node = new QueueNode <TYPE>;
+		QueueNode <TYPE> *node = newNode();
 		node->object = object;
 		insertNodeFirst(node);
 		count++;
 	}
 
 	void addLast(const TYPE object){
-		QueueNode <TYPE> *node = new QueueNode <TYPE>;
+		QueueNode <TYPE> *node = newNode();
 		node->object = object;
 		insertNodeLast(node);
 		count++;
 	}
 
 	void insertBeforeCurrent(const TYPE object){
-		QueueNode <TYPE> *node = new QueueNode <TYPE>;
+		QueueNode <TYPE> *node = newNode();
 		node->object = object;
 		insertNodeBefore(curr, node);
 		count++;
 	}
 
 	void insertAfterCurrent(const TYPE object){
-		QueueNode <TYPE> *node = new QueueNode <TYPE>;
+		QueueNode <TYPE> *node = newNode();
 		node->object = object;
 		insertNodeAfter(curr, node);
 		count++;
@@ -77,7 +81,7 @@ public:
 	bool removeCurrent(){
 		if (curr != NULL){
 			releaseNode(curr);
-			if (del) delete del;
+			deleteNode(del);
 			del = curr;
 			count--;
 		}
@@ -106,12 +110,12 @@ public:
 	TYPE getNextWrap() const { return ((curr->next != NULL)? curr->next : first)->object; }
 
 	void clear(){
-		delete del;
+		deleteNode(del);
 		del = NULL;
 		while (first){
 			curr = first;
 			first = first->next;
-			delete curr;
+			deleteNode(curr);
 		}
 		last = curr = NULL;
 		count = 0;
@@ -125,6 +129,22 @@ public:
 	}
 
 protected:
+	QueueNode <TYPE> *newNode(){
+		if (allocator) return new (allocator->allocate(sizeof(QueueNode <TYPE>))) QueueNode <TYPE>;
+		return new QueueNode <TYPE>;
+	}
+
+	void deleteNode(QueueNode <TYPE> *node){
+		if (allocator){
+			if (node){
+				node->~QueueNode();
+				allocator->release(node, sizeof(QueueNode <TYPE>));
+			}
+		} else {
+			delete node;
+		}
+	}
+
 	void insertNodeFirst(QueueNode <TYPE> *node){
 		if (first != NULL){
 			first->prev = node;
@@ -188,6 +208,7 @@ protected:
 
 	QueueNode <TYPE> *first, *last, *curr, *del;
 	unsigned int count;
+	Allocator *allocator;
 };
 
 #endif // _QUEUE_H_
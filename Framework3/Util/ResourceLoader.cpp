@@ -0,0 +1,428 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "ResourceLoader.h"
+#include "JobSystem.h"
+#include "../Imaging/TextureCache.h"
+#include <stdio.h>
+
+enum ResourceType {
+	RESOURCE_TEXTURE,
+	RESOURCE_TEXTURE_ARRAY,
+	RESOURCE_NORMAL_MAP,
+	RESOURCE_SHADER,
+};
+
+struct ResourceFile {
+	String name;
+	uint loadFlags;
+	bool isText;
+
+	Image image;
+	char *text;
+	bool loaded;
+
+	// Number of distinct requests using the file. A request may only modify the image in place if it's the only user.
+	uint nUsers;
+};
+
+struct ResourceRequest {
+	int type;
+	int *dest;
+	Array <uint> files;
+
+	bool useMipMaps;
+	SamplerStateID samplerState;
+	uint flags;
+	FORMAT destFormat;
+	float sZ, mipMapScaleZ;
+	const char **attributeNames;
+	int nAttributes;
+	String extra;
+	bool hasExtra;
+
+	// Index of an identical earlier request, or -1
+	int sameAs;
+
+	// Key of the texture cache entry, if the result can be cached
+	uint64 cacheKey;
+	bool cacheable;
+
+	// Prepared data. The image points into the file when the request didn't need a copy of its own.
+	Image *image;
+	Image *ownImage;
+	char *text;
+	bool prepared;
+};
+
+ResourceLoader::ResourceLoader(){
+}
+
+ResourceLoader::~ResourceLoader(){
+	clear();
+}
+
+uint ResourceLoader::addFile(const char *fileName, const uint loadFlags, const bool isText){
+	for (uint i = 0; i < files.getCount(); i++){
+		if (files[i]->loadFlags == loadFlags && files[i]->isText == isText && strcmp(files[i]->name, fileName) == 0) return i;
+	}
+
+	ResourceFile *file = new ResourceFile;
+	file->name = fileName;
+	file->loadFlags = loadFlags;
+	file->isText = isText;
+	file->text = NULL;
+	file->loaded = false;
+	file->nUsers = 0;
+
+	return files.add(file);
+}
+
+ResourceRequest *ResourceLoader::addRequest(const int type, int *dest){
+	ResourceRequest *request = new ResourceRequest;
+	request->type = type;
+	request->dest = dest;
+	request->useMipMaps = false;
+	request->samplerState = SS_NONE;
+	request->flags = 0;
+	request->destFormat = FORMAT_NONE;
+	request->sZ = 1.0f;
+	request->mipMapScaleZ = 2.0f;
+	request->attributeNames = NULL;
+	request->nAttributes = 0;
+	request->hasExtra = false;
+	request->sameAs = -1;
+	request->cacheable = false;
+	request->image = NULL;
+	request->ownImage = NULL;
+	request->text = NULL;
+	request->prepared = false;
+
+	requests.add(request);
+
+	return request;
+}
+
+static bool isSameRequest(const ResourceRequest *r0, const ResourceRequest *r1){
+	if (r0->type != r1->type || r0->useMipMaps != r1->useMipMaps || r0->samplerState != r1->samplerState || r0->flags != r1->flags) return false;
+	if (r0->destFormat != r1->destFormat || r0->sZ != r1->sZ || r0->mipMapScaleZ != r1->mipMapScaleZ) return false;
+
+	if (r0->files.getCount() != r1->files.getCount()) return false;
+	for (uint i = 0; i < r0->files.getCount(); i++){
+		if (r0->files[i] != r1->files[i]) return false;
+	}
+
+	if (r0->hasExtra != r1->hasExtra || (r0->hasExtra && strcmp(r0->extra, r1->extra) != 0)) return false;
+
+	if (r0->nAttributes != r1->nAttributes) return false;
+	for (int i = 0; i < r0->nAttributes; i++){
+		const char *a0 = r0->attributeNames[i];
+		const char *a1 = r1->attributeNames[i];
+		if (a0 != a1 && (a0 == NULL || a1 == NULL || strcmp(a0, a1) != 0)) return false;
+	}
+
+	return true;
+}
+
+static void addFileUsers(Array <ResourceFile *> &files, const ResourceRequest *request, const int count){
+	for (uint i = 0; i < request->files.getCount(); i++){
+		// An array may use the same file for several slices, which still only reads it
+		bool counted = false;
+		for (uint j = 0; j < i; j++){
+			if (request->files[j] == request->files[i]) counted = true;
+		}
+		if (!counted) files[request->files[i]]->nUsers += count;
+	}
+}
+
+static TextureProcessing getProcessing(const ResourceRequest *request){
+	TextureProcessing processing(request->useMipMaps, 1, (request->type == RESOURCE_TEXTURE_ARRAY)? request->files.getCount() : 1);
+	if (request->type == RESOURCE_NORMAL_MAP){
+		processing.normalMapFormat = request->destFormat;
+		processing.sZ = request->sZ;
+		processing.mipMapScaleZ = request->mipMapScaleZ;
+	}
+	return processing;
+}
+
+// Links the last request to an identical earlier one, or registers it as a user of its files
+static void resolveRequest(Array <ResourceFile *> &files, Array <ResourceRequest *> &requests){
+	uint last = requests.getCount() - 1;
+	ResourceRequest *request = requests[last];
+
+	for (uint i = 0; i < last; i++){
+		if (requests[i]->sameAs < 0 && isSameRequest(requests[i], request)){
+			request->sameAs = i;
+			return;
+		}
+	}
+
+	addFileUsers(files, request, 1);
+}
+
+void ResourceLoader::addTexture(TextureID *dest, const char *fileName, const bool useMipMaps, const SamplerStateID samplerState, uint flags){
+	ResourceRequest *request = addRequest(RESOURCE_TEXTURE, dest);
+	request->files.add(addFile(fileName, useMipMaps? 0 : DONT_LOAD_MIPMAPS, false));
+	request->useMipMaps = useMipMaps;
+	request->samplerState = samplerState;
+	request->flags = flags;
+
+	resolveRequest(files, requests);
+}
+
+void ResourceLoader::addTexture(TextureID *dest, const char **fileNames, const bool useMipMaps, const SamplerStateID samplerState, const int nArraySlices, uint flags){
+	ResourceRequest *request = addRequest(RESOURCE_TEXTURE_ARRAY, dest);
+	for (int i = 0; i < nArraySlices; i++){
+		// Slices are loaded with all their mipmaps, like Image::loadSlicedImage() does
+		request->files.add(addFile(fileNames[i], 0, false));
+	}
+	request->useMipMaps = useMipMaps;
+	request->samplerState = samplerState;
+	request->flags = flags;
+
+	resolveRequest(files, requests);
+}
+
+void ResourceLoader::addNormalMap(TextureID *dest, const char *fileName, const FORMAT destFormat, const bool useMipMaps, const SamplerStateID samplerState, float sZ, float mipMapScaleZ, uint flags){
+	ResourceRequest *request = addRequest(RESOURCE_NORMAL_MAP, dest);
+	request->files.add(addFile(fileName, useMipMaps? 0 : DONT_LOAD_MIPMAPS, false));
+	request->destFormat = destFormat;
+	request->useMipMaps = useMipMaps;
+	request->samplerState = samplerState;
+	request->sZ = sZ;
+	request->mipMapScaleZ = mipMapScaleZ;
+	request->flags = flags;
+
+	resolveRequest(files, requests);
+}
+
+void ResourceLoader::addShader(ShaderID *dest, const char *fileName, const char **attributeNames, const int nAttributes, const char *extra, const uint flags){
+	ResourceRequest *request = addRequest(RESOURCE_SHADER, dest);
+	request->files.add(addFile(fileName, 0, true));
+	request->attributeNames = attributeNames;
+	request->nAttributes = nAttributes;
+	if (extra){
+		request->extra = extra;
+		request->hasExtra = true;
+	}
+	request->flags = flags;
+
+	resolveRequest(files, requests);
+}
+
+void ResourceLoader::lookupCache(void *data, const uint start, const uint end){
+	ResourceLoader *loader = (ResourceLoader *) data;
+
+	for (uint i = start; i < end; i++){
+		ResourceRequest *request = loader->requests[i];
+		if (request->sameAs >= 0 || request->type == RESOURCE_SHADER) continue;
+
+		uint nFiles = request->files.getCount();
+		const char **fileNames = new const char *[nFiles];
+		for (uint j = 0; j < nFiles; j++){
+			fileNames[j] = loader->files[request->files[j]]->name;
+		}
+
+		request->cacheable = getTextureCacheKey(fileNames, getProcessing(request), request->cacheKey);
+		if (request->cacheable){
+			Image *img = new Image();
+			if (loadCachedTexture(*img, request->cacheKey)){
+				request->image = request->ownImage = img;
+				request->prepared = true;
+			} else {
+				delete img;
+			}
+		}
+		delete [] fileNames;
+	}
+}
+
+void ResourceLoader::loadFiles(void *data, const uint start, const uint end){
+	ResourceLoader *loader = (ResourceLoader *) data;
+
+	for (uint i = start; i < end; i++){
+		ResourceFile *file = loader->files[i];
+		if (file->nUsers == 0) continue;
+
+		if (file->isText){
+			FILE *f = fopen(file->name, "rb");
+			if (f){
+				fseek(f, 0, SEEK_END);
+				int length = ftell(f);
+				fseek(f, 0, SEEK_SET);
+
+				file->text = new char[length + 1];
+				file->loaded = (fread(file->text, 1, length, f) == size_t(length));
+				file->text[length] = '\0';
+				fclose(f);
+			}
+		} else {
+			// DDS pixels are mapped rather than read, so they only take memory once a request modifies them
+			file->loaded = file->image.loadImage(file->name, file->loadFlags | MAP_PIXELS);
+		}
+	}
+}
+
+void ResourceLoader::prepareRequests(void *data, const uint start, const uint end){
+	ResourceLoader *loader = (ResourceLoader *) data;
+
+	for (uint i = start; i < end; i++){
+		ResourceRequest *request = loader->requests[i];
+		if (request->sameAs >= 0 || request->prepared) continue;
+
+		bool loaded = true;
+		for (uint j = 0; j < request->files.getCount(); j++){
+			loaded &= loader->files[request->files[j]]->loaded;
+		}
+		if (!loaded) continue;
+
+		ResourceFile *file = loader->files[request->files[0]];
+		bool shared = (file->nUsers > 1);
+
+		Image *img = &file->image;
+		switch (request->type){
+		case RESOURCE_TEXTURE:
+			if (shared && (img->getFormat() == FORMAT_RGBE8 || (request->useMipMaps && img->getMipMapCount() <= 1))){
+				img = request->ownImage = new Image(*img);
+			}
+			request->prepared = processTexture(*img, getProcessing(request));
+			break;
+
+		case RESOURCE_TEXTURE_ARRAY:
+			{
+				uint nSlices = request->files.getCount();
+				const Image **slices = new const Image *[nSlices];
+				for (uint j = 0; j < nSlices; j++){
+					slices[j] = &loader->files[request->files[j]]->image;
+				}
+
+				img = request->ownImage = new Image();
+				if (img->assembleSlices(slices, 1, nSlices)){
+					request->prepared = processTexture(*img, getProcessing(request));
+				}
+				delete [] slices;
+			}
+			break;
+
+		case RESOURCE_NORMAL_MAP:
+			if (shared) img = request->ownImage = new Image(*img);
+			request->prepared = processTexture(*img, getProcessing(request));
+			break;
+
+		case RESOURCE_SHADER:
+			// The text gets split up in place, so each shader built from a file needs its own copy
+			if (shared){
+				request->text = new char[strlen(file->text) + 1];
+				strcpy(request->text, file->text);
+			} else {
+				request->text = file->text;
+				file->text = NULL;
+			}
+			request->prepared = true;
+			break;
+		}
+
+		request->image = img;
+
+		if (request->prepared && request->cacheable) saveCachedTexture(*img, request->cacheKey);
+	}
+}
+
+bool ResourceLoader::load(Renderer *renderer){
+	// Cached results first, then the files the other requests need, then the work that depends on them.
+	// Each file or request is a job of its own as they vary a lot in cost.
+	parallelFor(lookupCache, this, requests.getCount(), 1);
+	for (uint i = 0; i < requests.getCount(); i++){
+		if (requests[i]->prepared) addFileUsers(files, requests[i], -1);
+	}
+
+	parallelFor(loadFiles, this, files.getCount(), 1);
+	parallelFor(prepareRequests, this, requests.getCount(), 1);
+
+	bool result = true;
+	for (uint i = 0; i < requests.getCount(); i++){
+		ResourceRequest *request = requests[i];
+
+		int id;
+		if (request->sameAs >= 0){
+			id = *requests[request->sameAs]->dest;
+		} else if (request->type == RESOURCE_SHADER){
+			if (request->prepared){
+				ResourceFile *file = files[request->files[0]];
+				id = renderer->addShaderSource(request->text, file->name, request->attributeNames, request->nAttributes, request->hasExtra? (const char *) request->extra : NULL, request->flags);
+			} else {
+				ErrorMsg(String("Couldn't load \"") + files[request->files[0]]->name + "\"");
+				id = SHADER_NONE;
+			}
+		} else {
+			if (request->prepared){
+				id = renderer->addTexture(*request->image, request->samplerState, request->flags);
+			} else {
+				// Either some files couldn't be read, or the images didn't fit together or couldn't be converted
+				String str("Couldn't open:\n");
+				bool missing = false;
+				for (uint j = 0; j < request->files.getCount(); j++){
+					ResourceFile *file = files[request->files[j]];
+					if (!file->loaded){
+						str += file->name;
+						str += "\n";
+						missing = true;
+					}
+				}
+				if (!missing){
+					str = (request->type == RESOURCE_TEXTURE_ARRAY)? "Mismatching texture array slices:\n" : "Couldn't convert:\n";
+					for (uint j = 0; j < request->files.getCount(); j++){
+						str += files[request->files[j]]->name;
+						str += "\n";
+					}
+				}
+				ErrorMsg(str);
+				id = TEXTURE_NONE;
+			}
+		}
+
+		// TEXTURE_NONE and SHADER_NONE are the same
+		if (id == TEXTURE_NONE) result = false;
+		*request->dest = id;
+
+		// Release the memory as we go rather than having every image around until the end
+		delete request->ownImage;
+		request->ownImage = NULL;
+	}
+
+	clear();
+
+	return result;
+}
+
+void ResourceLoader::clear(){
+	for (uint i = 0; i < requests.getCount(); i++){
+		delete requests[i]->ownImage;
+		delete [] requests[i]->text;
+		delete requests[i];
+	}
+	for (uint i = 0; i < files.getCount(); i++){
+		delete [] files[i]->text;
+		delete files[i];
+	}
+	requests.reset();
+	files.reset();
+}
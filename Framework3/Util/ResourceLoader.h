@@ -0,0 +1,71 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _RESOURCELOADER_H_
+#define _RESOURCELOADER_H_
+
+#include "../Renderer.h"
+#include "String.h"
+
+struct ResourceFile;
+struct ResourceRequest;
+
+/*
+	Batches texture and shader loads. Requests are queued with the variable that receives the ID,
+	then load() reads and decodes all files and prepares the images (mipmaps, normal maps, array
+	assembly) on the job system. Only the final renderer calls are made on the calling thread.
+	Prepared images go through the texture cache, and files are only read for requests it misses.
+
+	Each file is only read once no matter how many requests use it, and requests that are identical
+	to an earlier one get the same ID without creating another resource. Attribute name arrays must
+	stay valid until load() returns.
+*/
+class ResourceLoader {
+public:
+	ResourceLoader();
+	~ResourceLoader();
+
+	void addTexture(TextureID *dest, const char *fileName, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, uint flags = 0);
+	void addTexture(TextureID *dest, const char **fileNames, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, const int nArraySlices = 1, uint flags = 0);
+	void addNormalMap(TextureID *dest, const char *fileName, const FORMAT destFormat, const bool useMipMaps, const SamplerStateID samplerState = SS_NONE, float sZ = 1.0f, float mipMapScaleZ = 2.0f, uint flags = 0);
+	void addShader(ShaderID *dest, const char *fileName, const char **attributeNames = NULL, const int nAttributes = 0, const char *extra = NULL, const uint flags = 0);
+
+	// Loads everything queued and clears the queue. Must be called from the thread that owns the renderer.
+	// Failed requests get TEXTURE_NONE / SHADER_NONE and make the function return false.
+	bool load(Renderer *renderer);
+	void clear();
+
+	uint getRequestCount() const { return requests.getCount(); }
+	uint getFileCount() const { return files.getCount(); }
+
+protected:
+	uint addFile(const char *fileName, const uint loadFlags, const bool isText);
+	ResourceRequest *addRequest(const int type, int *dest);
+
+	static void lookupCache(void *data, const uint start, const uint end);
+	static void loadFiles(void *data, const uint start, const uint end);
+	static void prepareRequests(void *data, const uint start, const uint end);
+
+	Array <ResourceFile *> files;
+	Array <ResourceRequest *> requests;
+};
+
+#endif // _RESOURCELOADER_H_
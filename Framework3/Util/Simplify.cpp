@@ -0,0 +1,320 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Simplify.h"
+#include "Array.h"
+#include "../Math/Vector.h"
+
+// Sum of area weighted squared distances to a set of planes, as a symmetric 4x4 matrix
+struct Quadric {
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+	double weight;
+};
+
+static void addPlane(Quadric &q, const vec3 &normal, const float offset, const double weight){
+	double a = normal.x, b = normal.y, c = normal.z, d = offset;
+
+	q.a2 += weight * a * a;
+	q.ab += weight * a * b;
+	q.ac += weight * a * c;
+	q.ad += weight * a * d;
+	q.b2 += weight * b * b;
+	q.bc += weight * b * c;
+	q.bd += weight * b * d;
+	q.c2 += weight * c * c;
+	q.cd += weight * c * d;
+	q.d2 += weight * d * d;
+	q.weight += weight;
+}
+
+static void addQuadric(Quadric &q, const Quadric &other){
+	double *dest = &q.a2;
+	const double *src = &other.a2;
+	for (uint i = 0; i < 11; i++){
+		dest[i] += src[i];
+	}
+}
+
+// Mean squared distance to the planes of both quadrics
+static float collapseError(const Quadric &q0, const Quadric &q1, const vec3 &pos){
+	double x = pos.x, y = pos.y, z = pos.z;
+	double error = 0;
+	double weight = q0.weight + q1.weight;
+
+	const Quadric *q[] = { &q0, &q1 };
+	for (uint i = 0; i < 2; i++){
+		error += x * x * q[i]->a2 + y * y * q[i]->b2 + z * z * q[i]->c2 + q[i]->d2
+		   + 2 * (x * y * q[i]->ab + x * z * q[i]->ac + y * z * q[i]->bc)
+		   + 2 * (x * q[i]->ad + y * q[i]->bd + z * q[i]->cd);
+	}
+
+	return (weight > 0 && error > 0)? float(error / weight) : 0.0f;
+}
+
+struct Collapse {
+	float error;
+	uint from;
+	uint to;
+};
+
+static int compareCollapses(const void *elem0, const void *elem1){
+	float e0 = ((const Collapse *) elem0)->error;
+	float e1 = ((const Collapse *) elem1)->error;
+
+	if (e0 < e1) return -1;
+	if (e0 > e1) return  1;
+	return 0;
+}
+
+// Triangles around each vertex
+static void buildAdjacency(const uint *indices, const uint nIndices, const uint nVertices, uint *adjacencyStart, uint *adjacency){
+	memset(adjacencyStart, 0, (nVertices + 1) * sizeof(uint));
+	for (uint i = 0; i < nIndices; i++){
+		adjacencyStart[indices[i] + 1]++;
+	}
+	for (uint v = 0; v < nVertices; v++){
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	}
+	for (uint i = 0; i < nIndices; i++){
+		adjacency[adjacencyStart[indices[i]]++] = i / 3;
+	}
+	for (uint v = nVertices; v > 0; v--){
+		adjacencyStart[v] = adjacencyStart[v - 1];
+	}
+	adjacencyStart[0] = 0;
+}
+
+static bool hasVertex(const uint *triangle, const uint v){
+	return (triangle[0] == v || triangle[1] == v || triangle[2] == v);
+}
+
+// Moving from onto to must not pinch the surface or turn any triangle over
+static bool canCollapse(const uint from, const uint to, const uint *indices, const float *positions, const uint stride,
+                        const uint *adjacencyStart, const uint *adjacency, const ubyte *removed, uint *mark, uint &stamp){
+	stamp++;
+	for (uint j = adjacencyStart[to]; j < adjacencyStart[to + 1]; j++){
+		if (removed[adjacency[j]]) continue;
+		const uint *triangle = indices + 3 * adjacency[j];
+		for (uint k = 0; k < 3; k++){
+			mark[triangle[k]] = stamp;
+		}
+	}
+
+	// The two may only share the neighbours across the triangles on the collapsed edge
+	uint nShared = 0, nEdgeTriangles = 0;
+	for (uint i = adjacencyStart[from]; i < adjacencyStart[from + 1]; i++){
+		if (removed[adjacency[i]]) continue;
+		const uint *triangle = indices + 3 * adjacency[i];
+		if (hasVertex(triangle, to)) nEdgeTriangles++;
+
+		for (uint k = 0; k < 3; k++){
+			uint w = triangle[k];
+			if (w != from && w != to && mark[w] == stamp){
+				mark[w] = 0;
+				nShared++;
+			}
+		}
+	}
+	if (nShared != nEdgeTriangles) return false;
+
+	const vec3 &dest = *(const vec3 *) (positions + to * stride);
+	for (uint i = adjacencyStart[from]; i < adjacencyStart[from + 1]; i++){
+		const uint *triangle = indices + 3 * adjacency[i];
+		if (removed[adjacency[i]] || hasVertex(triangle, to)) continue;
+
+		vec3 v[3], w[3];
+		for (uint k = 0; k < 3; k++){
+			v[k] = *(const vec3 *) (positions + triangle[k] * stride);
+			w[k] = (triangle[k] == from)? dest : v[k];
+		}
+		vec3 n0 = cross(v[1] - v[0], v[2] - v[0]);
+		vec3 n1 = cross(w[1] - w[0], w[2] - w[0]);
+
+		// Allow some rotation, but not enough to fold the surface onto itself
+		if (dot(n0, n1) <= 0.25f * length(n0) * length(n1)) return false;
+	}
+
+	return true;
+}
+
+uint simplifyTriangles(uint *destIndices, const uint *indices, const uint nIndices, const float *positions, const uint stride, const uint nVertices,
+                       const ubyte *locked, const uint targetIndices, const float maxError, float *resultError){
+	// Degenerate triangles have nothing to lose
+	uint count = 0;
+	for (uint i = 0; i + 2 < nIndices; i += 3){
+		uint a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		if (a != b && b != c && c != a){
+			destIndices[count++] = a;
+			destIndices[count++] = b;
+			destIndices[count++] = c;
+		}
+	}
+
+	Quadric *quadrics = new Quadric[nVertices];
+	memset(quadrics, 0, nVertices * sizeof(Quadric));
+	for (uint i = 0; i < count; i += 3){
+		const vec3 &v0 = *(const vec3 *) (positions + destIndices[i    ] * stride);
+		const vec3 &v1 = *(const vec3 *) (positions + destIndices[i + 1] * stride);
+		const vec3 &v2 = *(const vec3 *) (positions + destIndices[i + 2] * stride);
+
+		vec3 normal = cross(v1 - v0, v2 - v0);
+		float len = length(normal);
+		if (len > 0){
+			normal /= len;
+			float offset = -dot(normal, v0);
+			for (uint k = 0; k < 3; k++){
+				addPlane(quadrics[destIndices[i + k]], normal, offset, 0.5 * len);
+			}
+		}
+	}
+
+	uint *adjacencyStart = new uint[nVertices + 1];
+	uint *adjacency = new uint[count];
+	ubyte *removed = new ubyte[count / 3];
+	ubyte *vertexLocked = new ubyte[nVertices];
+	ubyte *touched = new ubyte[nVertices];
+	uint *mark = new uint[nVertices];
+	uint stamp = 0;
+	memset(mark, 0, nVertices * sizeof(uint));
+
+	if (locked){
+		memcpy(vertexLocked, locked, nVertices);
+	} else {
+		memset(vertexLocked, 0, nVertices);
+	}
+
+	// Lock the ends of edges that don't have exactly two triangles
+	buildAdjacency(destIndices, count, nVertices, adjacencyStart, adjacency);
+	for (uint v = 0; v < nVertices; v++){
+		for (uint i = adjacencyStart[v]; i < adjacencyStart[v + 1]; i++){
+			const uint *triangle = destIndices + 3 * adjacency[i];
+			for (uint k = 0; k < 3; k++){
+				uint w = triangle[k];
+				if (w <= v) continue;
+
+				uint nShared = 0;
+				for (uint j = adjacencyStart[v]; j < adjacencyStart[v + 1]; j++){
+					if (hasVertex(destIndices + 3 * adjacency[j], w)) nShared++;
+				}
+				if (nShared != 2){
+					vertexLocked[v] = 1;
+					vertexLocked[w] = 1;
+				}
+			}
+		}
+	}
+
+	const float maxErrorSq = maxError * maxError;
+	float errorSq = 0;
+
+	Array <Collapse> collapses;
+	while (count > targetIndices){
+		buildAdjacency(destIndices, count, nVertices, adjacencyStart, adjacency);
+
+		// Find the cheapest edge out of each vertex that may move
+		collapses.clear();
+		for (uint v = 0; v < nVertices; v++){
+			if (vertexLocked[v]) continue;
+
+			Collapse best;
+			best.error = FLT_MAX;
+			for (uint i = adjacencyStart[v]; i < adjacencyStart[v + 1]; i++){
+				const uint *triangle = destIndices + 3 * adjacency[i];
+				for (uint k = 0; k < 3; k++){
+					uint w = triangle[k];
+					if (w == v) continue;
+
+					float error = collapseError(quadrics[v], quadrics[w], *(const vec3 *) (positions + w * stride));
+					if (error < best.error){
+						best.error = error;
+						best.from = v;
+						best.to = w;
+					}
+				}
+			}
+			if (best.error < FLT_MAX && best.error <= maxErrorSq) collapses.add(best);
+		}
+		if (collapses.getCount() == 0) break;
+
+		qsort(collapses.getArray(), collapses.getCount(), sizeof(Collapse), compareCollapses);
+
+		// Apply the cheapest ones, leaving anything next to a collapse for the next round
+		memset(removed, 0, count / 3);
+		memset(touched, 0, nVertices);
+
+		uint nRemoved = 0;
+		const uint toRemove = (count - targetIndices + 2) / 3;
+		for (uint c = 0; c < collapses.getCount() && nRemoved < toRemove; c++){
+			uint from = collapses[c].from;
+			uint to = collapses[c].to;
+			if (touched[from] || touched[to]) continue;
+			if (!canCollapse(from, to, destIndices, positions, stride, adjacencyStart, adjacency, removed, mark, stamp)) continue;
+
+			for (uint i = adjacencyStart[from]; i < adjacencyStart[from + 1]; i++){
+				uint t = adjacency[i];
+				if (removed[t]) continue;
+
+				uint *triangle = destIndices + 3 * t;
+				if (hasVertex(triangle, to)){
+					removed[t] = 1;
+					nRemoved++;
+				} else {
+					for (uint k = 0; k < 3; k++){
+						if (triangle[k] == from) triangle[k] = to;
+					}
+				}
+			}
+			addQuadric(quadrics[to], quadrics[from]);
+
+			// Its neighbours' triangles are unchanged by the collapse, so only these two need to wait
+			touched[from] = 1;
+			touched[to] = 1;
+
+			if (collapses[c].error > errorSq) errorSq = collapses[c].error;
+		}
+		if (nRemoved == 0) break;
+
+		uint newCount = 0;
+		for (uint i = 0; i < count; i += 3){
+			if (!removed[i / 3]){
+				destIndices[newCount++] = destIndices[i];
+				destIndices[newCount++] = destIndices[i + 1];
+				destIndices[newCount++] = destIndices[i + 2];
+			}
+		}
+		count = newCount;
+	}
+
+	delete [] quadrics;
+	delete [] adjacencyStart;
+	delete [] adjacency;
+	delete [] removed;
+	delete [] vertexLocked;
+	delete [] touched;
+	delete [] mark;
+
+	if (resultError) *resultError = sqrtf(errorSq);
+
+	return count;
+}
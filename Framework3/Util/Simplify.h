@@ -0,0 +1,40 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include "../Platform.h"
+
+// Reduces a triangle list by collapsing edges in order of quadric error, as in "Surface
+// Simplification Using Quadric Error Metrics" by Garland and Heckbert. Vertices only ever move
+// onto one of their neighbours, so the result indexes the same vertex data. Triangles keep their
+// winding and the order of their corners, but a corner takes on the index of the vertex it moved
+// onto, so a vertex that was the last of only one triangle may become the last of several.
+// Vertices with a nonzero locked entry stay in place, and so do vertices on open or non-manifold
+// edges. Positions are read at positions + index * stride. Stops once the index count is down to
+// targetIndices or when the next collapse would move the surface more than maxError, in the root
+// mean square sense. The error reached is returned in resultError if it isn't NULL. Returns the
+// new index count.
+uint simplifyTriangles(uint *destIndices, const uint *indices, const uint nIndices, const float *positions, const uint stride, const uint nVertices,
+                       const ubyte *locked, const uint targetIndices, const float maxError, float *resultError = NULL);
+
+#endif // _SIMPLIFY_H_
@@ -25,55 +25,41 @@ struct TextureNode {
 	TextureNode(uint x, uint y, uint w, uint h){
 		left = right = NULL;
 
-		rect = new TextureRectangle;
-		rect->x = x;
-		rect->y = y;
-		rect->width = w;
-		rect->height = h;
-	}
-	~TextureNode(){
-		delete left;
-		delete right;
-		delete rect;
+		rect.x = x;
+		rect.y = y;
+		rect.width = w;
+		rect.height = h;
 	}
 
-	bool assignRectangle(TextureRectangle *rect);
+	bool assignRectangle(TextureRectangle *rect, Pool <TextureNode> &nodes);
 
 	TextureNode *left;
 	TextureNode *right;
 
-	TextureRectangle *rect;
+	// Free space while a leaf
+	TextureRectangle rect;
 };
 
-bool TextureNode::assignRectangle(TextureRectangle *newRect){
-	if (rect == NULL){
-		if (left->assignRectangle(newRect)) return true;
-		return right->assignRectangle(newRect);
+bool TextureNode::assignRectangle(TextureRectangle *newRect, Pool <TextureNode> &nodes){
+	if (left != NULL){
+		if (left->assignRectangle(newRect, nodes)) return true;
+		return right->assignRectangle(newRect, nodes);
 	} else {
-		if (newRect->width <= rect->width && newRect->height <= rect->height){
-			newRect->x = rect->x;
-			newRect->y = rect->y;
+		if (newRect->width <= rect.width && newRect->height <= rect.height){
+			newRect->x = rect.x;
+			newRect->y = rect.y;
 
-			left  = new TextureNode(rect->x, rect->y + newRect->height, newRect->width, rect->height - newRect->height);
-			right = new TextureNode(rect->x + newRect->width, rect->y, rect->width - newRect->width, rect->height);
+			left  = new (nodes.allocate(sizeof(TextureNode))) TextureNode(rect.x, rect.y + newRect->height, newRect->width, rect.height - newRect->height);
+			right = new (nodes.allocate(sizeof(TextureNode))) TextureNode(rect.x + newRect->width, rect.y, rect.width - newRect->width, rect.height);
 
-			delete rect;
-			rect = NULL;
 			return true;
 		}
 		return false;
 	}
 }
 
-TexturePacker::~TexturePacker(){
-	for (uint i = 0; i < rects.getCount(); i++){
-		delete rects[i];
-	}
-}
-
-
 void TexturePacker::addRectangle(uint width, uint height){
-	TextureRectangle *rect = new TextureRectangle;
+	TextureRectangle *rect = rectPool.newObject();
 
 	rect->width  = width;
 	rect->height = height;
@@ -113,22 +99,22 @@ bool TexturePacker::assignCoords(uint *width, uint *height, compareRectFunc comp
 
 	sortedRects.sort(compRectFunc);
 
-	TextureNode *top = new TextureNode(0, 0, *width, *height);
+	// Every assigned rectangle adds two nodes, all freed together with the pool
+	Pool <TextureNode> nodes(2 * sortedRects.getCount() + 1);
+	TextureNode *top = new (nodes.allocate(sizeof(TextureNode))) TextureNode(0, 0, *width, *height);
 
 	*width  = 0;
 	*height = 0;
 	for (uint i = 0; i < sortedRects.getCount(); i++){
-		if (top->assignRectangle(sortedRects[i])){
+		if (top->assignRectangle(sortedRects[i], nodes)){
 			uint x = sortedRects[i]->x + sortedRects[i]->width;
 			uint y = sortedRects[i]->y + sortedRects[i]->height;
 			if (x > *width ) *width  = x;
 			if (y > *height) *height = y;
 		} else {
-			delete top;
 			return false;
 		}
 	}
 
-	delete top;
 	return true;
 }
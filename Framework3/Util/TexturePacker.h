@@ -24,6 +24,7 @@
 
 #include "../Platform.h"
 #include "Array.h"
+#include "Allocator.h"
 
 struct TextureRectangle {
 	uint x, y;
@@ -40,8 +41,6 @@ int heightComp(TextureRectangle *const &elem0, TextureRectangle *const &elem1);
 
 class TexturePacker {
 public:
-	~TexturePacker();
-
 	void addRectangle(uint width, uint height);
 	bool assignCoords(uint *width, uint *height, compareRectFunc compRectFunc = originalAreaComp);
 
@@ -49,6 +48,8 @@ public:
 
 protected:
 	Array <TextureRectangle *> rects;
+	// Backs the rectangles, which go along with it
+	Pool <TextureRectangle> rectPool;
 };
 
 #endif // _TEXTUREPACKER_H_
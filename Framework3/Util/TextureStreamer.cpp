@@ -0,0 +1,108 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "TextureStreamer.h"
+
+struct StreamedTexture {
+	Image image;
+	TextureID texture;
+	int firstMipMap;
+};
+
+// Bytes in one level of all faces and slices
+static uint64 getLevelSize(const Image &img, const int level){
+	return uint64(img.getMipMappedSize(level, 1)) * img.getArraySize();
+}
+
+TextureStreamer::TextureStreamer(const uint64 budget){
+	this->budget = budget;
+	uploadedSize = 0;
+}
+
+TextureStreamer::~TextureStreamer(){
+	clear();
+}
+
+TextureID TextureStreamer::addTexture(Renderer *renderer, const char *fileName, const SamplerStateID samplerState, const int nInitialMipMaps, uint flags){
+	StreamedTexture *tex = new StreamedTexture;
+	if (!tex->image.loadImage(fileName, MAP_PIXELS)){
+		delete tex;
+		return TEXTURE_NONE;
+	}
+	if (tex->image.getMipMapCount() <= 1) tex->image.createMipMaps();
+
+	int nMipMaps = tex->image.getMipMapCount();
+	tex->firstMipMap = (nMipMaps > nInitialMipMaps)? nMipMaps - nInitialMipMaps : 0;
+	if ((tex->texture = renderer->addPartialTexture(tex->image, tex->firstMipMap, samplerState, flags)) == TEXTURE_NONE){
+		delete tex;
+		return TEXTURE_NONE;
+	}
+
+	for (int i = tex->firstMipMap; i < nMipMaps; i++){
+		uploadedSize += getLevelSize(tex->image, i);
+	}
+
+	TextureID texture = tex->texture;
+	if (tex->firstMipMap > 0){
+		textures.add(tex);
+	} else {
+		delete tex;
+	}
+
+	return texture;
+}
+
+bool TextureStreamer::update(Renderer *renderer, const uint64 maxBytes){
+	uint64 size = 0;
+	while (textures.getCount()){
+		// The texture with the smallest next level is the blurriest one
+		uint next = 0;
+		for (uint i = 1; i < textures.getCount(); i++){
+			if (getLevelSize(textures[i]->image, textures[i]->firstMipMap - 1) < getLevelSize(textures[next]->image, textures[next]->firstMipMap - 1)) next = i;
+		}
+
+		StreamedTexture *tex = textures[next];
+		uint64 levelSize = getLevelSize(tex->image, tex->firstMipMap - 1);
+		if (uploadedSize + levelSize > budget) break;
+		if (size > 0 && size + levelSize > maxBytes) break;
+
+		tex->firstMipMap--;
+		renderer->uploadMipMaps(tex->texture, tex->image, tex->firstMipMap);
+		uploadedSize += levelSize;
+		size += levelSize;
+
+		// Unmaps the file
+		if (tex->firstMipMap == 0){
+			delete tex;
+			textures.orderedRemove(next);
+		}
+	}
+
+	return (textures.getCount() > 0);
+}
+
+void TextureStreamer::clear(){
+	for (uint i = 0; i < textures.getCount(); i++){
+		delete textures[i];
+	}
+	textures.reset();
+	uploadedSize = 0;
+}
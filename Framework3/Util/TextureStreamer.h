@@ -0,0 +1,59 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _TEXTURESTREAMER_H_
+#define _TEXTURESTREAMER_H_
+
+#include "../Renderer.h"
+
+struct StreamedTexture;
+
+/*
+	Brings textures up from their smallest mipmaps. addTexture() maps the file and uploads only the smallest
+	levels, which is all that gets read from disk at that point. Each update() then uploads one more level of the
+	textures that have the fewest, for as long as the total stays within the budget. A texture's file stays
+	mapped until all its levels are uploaded.
+*/
+class TextureStreamer {
+public:
+	TextureStreamer(const uint64 budget);
+	~TextureStreamer();
+
+	// Returns TEXTURE_NONE if the file can't be loaded. Files that can't be mapped are read in full but still streamed,
+	// and files without mipmaps get them created.
+	TextureID addTexture(Renderer *renderer, const char *fileName, const SamplerStateID samplerState, const int nInitialMipMaps = 4, uint flags = 0);
+
+	// Uploads up to maxBytes worth of levels. Returns whether any level is still waiting, also if it doesn't fit the budget.
+	bool update(Renderer *renderer, const uint64 maxBytes);
+	// Stops streaming. The textures keep the levels they have.
+	void clear();
+
+	void setBudget(const uint64 bytes){ budget = bytes; }
+	uint64 getBudget() const { return budget; }
+	uint64 getUploadedSize() const { return uploadedSize; }
+
+protected:
+	Array <StreamedTexture *> textures;
+	uint64 budget;
+	uint64 uploadedSize;
+};
+
+#endif // _TEXTURESTREAMER_H_
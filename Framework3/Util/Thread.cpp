@@ -196,207 +196,3 @@ void broadcastCondition(Condition &condition){
 }
 
 #endif
-
-
-//#include <stdio.h>
-
-struct ThreadParam {
-	Thread *thread;
-	int threadInstance;
-};
-
-#ifdef _WIN32
-
-DWORD WINAPI threadStarter(void *param){
-//	((Thread *) startFunc)->mainFunc(0);
-
-	Thread *thread = ((ThreadParam *) param)->thread;
-	int instance = ((ThreadParam *) param)->threadInstance;
-
-	delete param;
-
-	thread->mainFunc(instance);
-
-	return 0;
-}
-
-void Thread::startThreads(const int threadCount){
-	nThreads = threadCount;
-
-	threadHandles = new HANDLE[threadCount];
-	threadIDs = new DWORD[threadCount];
-
-	for (int i = 0; i < threadCount; i++){
-		ThreadParam *param = new ThreadParam;
-		param->thread = this;
-		param->threadInstance = i;
-
-		threadHandles[i] = CreateThread(NULL, 0, threadStarter, param, 0, &threadIDs[i]);
-	}
-}
-
-void Thread::postMessage(const int thread, const int message, void *data, const int size){
-	int msg = WM_USER + message;
-
-	int start, end;
-	if (thread < 0){
-		start = 0;
-		end = nThreads;
-	} else {
-		start = thread;
-		end = start + 1;
-	}
-
-	for (int i = start; i < end; i++){
-		char *msgData = new char[size];
-		memcpy(msgData, data, size);
-
-		while (!PostThreadMessage(threadIDs[i], msg, size, (LPARAM) msgData)){
-			//printf("PostThreadMessage failed\n");
-			Sleep(1);
-		}
-	}
-}
-
-void Thread::mainFunc(const int thread){
-	MSG msg;
-	while (GetMessage(&msg, NULL, 0, 0) > 0){
-		processMessage(thread, msg.message - WM_USER, (void *) msg.lParam, (const int) msg.wParam);
-	}
-}
-
-void Thread::waitForExit(){
-	delete threadIDs;
-
-	//	WaitForSingleObject(threadHandle, INFINITE);
-	WaitForMultipleObjects(nThreads, threadHandles, TRUE, INFINITE);
-
-	delete threadHandles;
-}
-
-#else
-
-#include <string.h>
-
-void *threadStarter(void *param){
-	ThreadParam *tp = (ThreadParam *) param;
-
-	Thread *thread = tp->thread;
-	int instance = tp->threadInstance;
-
-	delete tp;
-
-	thread->mainFunc(instance);
-
-	return NULL;
-}
-
-void Thread::startThreads(const int threadCount){
-/*
-	first = last = NULL;
-
-	pthread_mutex_init(&mutex, NULL);
-	pthread_cond_init(&pending, NULL);
-
-	pthread_create(&thread, NULL, threadStarter, this);
-*/
-
-
-	nThreads = threadCount;
-
-	queues = new MessageQueue[threadCount];
-	threadHandles = new pthread_t[threadCount];
-
-	for (int i = 0; i < threadCount; i++){
-		queues[i].first = NULL;
-		queues[i].last  = NULL;
-		pthread_mutex_init(&queues[i].mutex, NULL);
-		pthread_cond_init(&queues[i].pending, NULL);
-
-		ThreadParam *param = new ThreadParam;
-		param->thread = this;
-		param->threadInstance = i;
-
-		pthread_create(&threadHandles[i], NULL, threadStarter, param);
-	}
-}
-
-void Thread::postMessage(const int thread, const int message, void *data, const int size){
-	int start, end;
-	if (thread < 0){
-		start = 0;
-		end = nThreads;
-	} else {
-		start = thread;
-		end = start + 1;
-	}
-
-	for (int i = start; i < end; i++){
-		MessageQueue *queue = queues + i;
-
-		pthread_mutex_lock(&queue->mutex);
-			Message *msg = new Message;
-			msg->message = message;
-			if (data){
-				msg->data = new char[size];
-				memcpy(msg->data, data, size);
-			} else {
-				msg->data = NULL;
-			}
-			msg->size = size;
-			msg->next = NULL;
-
-			if (queue->first == NULL){
-				queue->first = queue->last = msg;
-			} else {
-				queue->last->next = msg;
-				queue->last = msg;
-			}
-
-		pthread_mutex_unlock(&queue->mutex);
-		pthread_cond_signal(&queue->pending);
-	}
-}
-
-void Thread::mainFunc(const int thread){
-	bool done = false;
-	do {
-		Message *msg = getMessage(thread);
-		if (msg->message < 0){
-			done = true;
-		} else {
-			processMessage(thread, msg->message, msg->data, msg->size);
-		}
-
-		delete msg->data;
-		delete msg;
-	} while (!done);
-
-	pthread_mutex_destroy(&queues[thread].mutex);
-	pthread_cond_destroy(&queues[thread].pending);
-
-//	printf("Done\n");
-}
-
-void Thread::waitForExit(){
-	for (int i = 0; i < nThreads; i++){
-		pthread_join(threadHandles[i], NULL);
-	}
-}
-
-Message *Thread::getMessage(const int thread){
-	MessageQueue *queue = queues + thread;
-
-	pthread_mutex_lock(&queue->mutex);
-		while (queue->first == NULL){
-			pthread_cond_wait(&queue->pending, &queue->mutex);
-		}
-		Message *ret = queue->first;
-		queue->first = queue->first->next;
-		if (queue->first == NULL) queue->last = NULL;
-	pthread_mutex_unlock(&queue->mutex);
-
-	return ret;
-}
-
-#endif // !_WIN32
@@ -72,62 +72,4 @@ void waitCondition(Condition &condition, Mutex &mutex);
 void signalCondition(Condition &condition);
 void broadcastCondition(Condition &condition);
 
-
-#define ALL_THREADS (-1)
-
-#ifdef _WIN32
-
-#define THREAD_QUIT (WM_QUIT - WM_USER)
-
-#else
-
-#define THREAD_QUIT (-1)
-
-struct Message {
-	int message;
-	char *data;
-	int size;
-
-	Message *next;
-};
-
-struct MessageQueue {
-	Message *first, *last;
-
-	pthread_mutex_t mutex;
-	pthread_cond_t pending;
-};
-
-#endif
-
-class Thread {
-public:
-	Thread(){}
-	virtual ~Thread(){}
-
-	void startThreads(const int threadCount);
-	void postMessage(const int thread, const int message, void *data = NULL, const int size = 0);
-	void waitForExit();
-
-protected:
-	virtual void processMessage(const int thread, const int message, void *data, const int size) = 0;
-	void mainFunc(const int thread);
-
-	ThreadHandle *threadHandles;
-	int nThreads;
-
-#ifdef _WIN32
-	friend DWORD WINAPI threadStarter(void *param);
-	DWORD *threadIDs;
-
-#else
-	friend void *threadStarter(void *param);
-
-	Message *getMessage(const int thread);
-
-	MessageQueue *queues;
-
-#endif
-};
-
 #endif // _THREAD_H_
@@ -0,0 +1,449 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "Weld.h"
+#include "JobSystem.h"
+#include <math.h>
+#include <string.h>
+
+#define EMPTY_SLOT 0xFFFFFFFF
+
+struct WeldData {
+	const float *vertices;
+	uint nVertices;
+	uint nComponents;
+
+	// Comparison keys and their hashes, one row per vertex
+	uint *keys;
+	uint *hashes;
+
+	// Vertices grouped by partition, in ascending order within each group
+	uint partitionShift;
+	uint *partitionStart;
+	uint *partitionVertices;
+
+	// One open addressing table per partition, carved out of a single block
+	uint *tableStart;
+	uint *tables;
+
+	// Index of the first vertex equal to each vertex
+	uint *first;
+};
+
+static uint hashKey(const uint *key, const uint nComp){
+	uint hash = 0x811C9DC5;
+	for (uint c = 0; c < nComp; c++){
+		hash ^= key[c];
+		hash *= 0x01000193;
+		hash ^= hash >> 15;
+	}
+	hash *= 0x2C1B3C6D;
+	hash ^= hash >> 12;
+
+	return hash;
+}
+
+static void computeKeys(void *param, const uint start, const uint end){
+	WeldData *data = (WeldData *) param;
+	const uint nComp = data->nComponents;
+
+	for (uint i = start; i < end; i++){
+		const float *src = data->vertices + i * nComp;
+		uint *key = data->keys + i * nComp;
+
+		for (uint c = 0; c < nComp; c++){
+			// Make -0 and 0 the same
+			float f = src[c] + 0.0f;
+			memcpy(key + c, &f, sizeof(uint));
+		}
+
+		data->hashes[i] = hashKey(key, nComp);
+	}
+}
+
+static void weldPartitions(void *param, const uint start, const uint end){
+	WeldData *data = (WeldData *) param;
+	const uint nComp = data->nComponents;
+
+	for (uint p = start; p < end; p++){
+		uint *table = data->tables + data->tableStart[p];
+		uint mask = data->tableStart[p + 1] - data->tableStart[p] - 1;
+
+		for (uint v = data->partitionStart[p]; v < data->partitionStart[p + 1]; v++){
+			uint index = data->partitionVertices[v];
+			uint hash = data->hashes[index];
+			const uint *key = data->keys + index * nComp;
+
+			uint slot = hash & mask;
+			while (true){
+				uint other = table[slot];
+				if (other == EMPTY_SLOT){
+					table[slot] = index;
+					data->first[index] = index;
+					break;
+				}
+				if (data->hashes[other] == hash && memcmp(data->keys + other * nComp, key, nComp * sizeof(uint)) == 0){
+					data->first[index] = other;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	}
+}
+
+// Grid cell of a value, with the cells beyond the range of an int merged into the outermost ones and NaN in the lowest
+static uint gridCell(const float f, const float invCellSize){
+	float cell = floorf(f * invCellSize);
+	if (!(cell >= -2147483648.0f)) cell = -2147483648.0f;
+	if (cell > 2147483520.0f) cell = 2147483520.0f;
+
+	return (uint) (int) cell;
+}
+
+// Only the first few components go into the grid, which bounds the cells a vertex looks in to
+// 2^GRID_COMPONENTS. The rest are still compared, they just don't help to find the candidates.
+#define GRID_COMPONENTS 3
+
+// Partitions are made of coarse cells this many grid cells wide, hashed by their position
+#define COARSE_SHIFT 6
+#define BORDER_VERTEX 0xFFFFFFFF
+
+struct NearbyData {
+	const float *vertices;
+	uint nVertices;
+	uint nComponents;
+	uint nGridComponents;
+	float epsilon;
+	float invCellSize;
+
+	// Grid cells and their hashes, one row per vertex
+	uint *keys;
+	uint *hashes;
+	// Partition of each vertex, or BORDER_VERTEX if its range reaches into another coarse cell
+	uint *partitions;
+
+	uint partitionBits;
+	uint *partitionStart;
+	uint *partitionVertices;
+
+	// Unique vertices of each partition, in one open addressing table per partition
+	uint *tableStart;
+	uint *tables;
+
+	uint *first;
+};
+
+static uint coarsePartition(const NearbyData *data, const uint *key){
+	if (data->partitionBits == 0) return 0;
+
+	// The offset keeps the order of the cells, so that shifting merges neighbours
+	uint coarse[GRID_COMPONENTS];
+	for (uint c = 0; c < data->nGridComponents; c++){
+		coarse[c] = (key[c] ^ 0x80000000) >> COARSE_SHIFT;
+	}
+	return hashKey(coarse, data->nGridComponents) >> (32 - data->partitionBits);
+}
+
+static void computeNearbyKeys(void *param, const uint start, const uint end){
+	NearbyData *data = (NearbyData *) param;
+	const uint nComp = data->nComponents;
+	const uint nGrid = data->nGridComponents;
+
+	for (uint i = start; i < end; i++){
+		const float *src = data->vertices + i * nComp;
+		uint *key = data->keys + i * nGrid;
+
+		bool border = false;
+		for (uint c = 0; c < nGrid; c++){
+			key[c] = gridCell(src[c], data->invCellSize);
+
+			uint low  = gridCell(src[c] - data->epsilon, data->invCellSize) ^ 0x80000000;
+			uint high = gridCell(src[c] + data->epsilon, data->invCellSize) ^ 0x80000000;
+			if ((low >> COARSE_SHIFT) != (high >> COARSE_SHIFT)) border = true;
+		}
+		data->hashes[i] = hashKey(key, nGrid);
+		data->partitions[i] = border? BORDER_VERTEX : coarsePartition(data, key);
+	}
+}
+
+static bool isNearby(const NearbyData *data, const uint index, const uint other){
+	const float *src = data->vertices + index * data->nComponents;
+	const float *otherSrc = data->vertices + other * data->nComponents;
+
+	for (uint c = 0; c < data->nComponents; c++){
+		if (!(otherSrc[c] >= src[c] - data->epsilon && otherSrc[c] <= src[c] + data->epsilon)) return false;
+	}
+	return true;
+}
+
+// Looks for unique vertices within range of the vertex in one table, keeping the one with the lowest index in match
+static void findNearby(const NearbyData *data, const uint *table, const uint mask, const uint *probe, const uint hash, const uint index, uint &match){
+	const uint nGrid = data->nGridComponents;
+
+	for (uint slot = hash & mask; table[slot] != EMPTY_SLOT; slot = (slot + 1) & mask){
+		uint other = table[slot];
+		if (other > match || data->hashes[other] != hash || memcmp(data->keys + other * nGrid, probe, nGrid * sizeof(uint)) != 0) continue;
+
+		if (isNearby(data, index, other)) match = other;
+	}
+}
+
+static void insertUnique(const NearbyData *data, uint *table, const uint mask, const uint index){
+	uint slot = data->hashes[index] & mask;
+	while (table[slot] != EMPTY_SLOT) slot = (slot + 1) & mask;
+	table[slot] = index;
+}
+
+/*
+	Finds the unique vertex to weld to, looking in the cells that the range of the vertex covers.
+	Cells are four times epsilon wide, so the range covers at most two in each component, and only
+	components whose range reaches into the next cell add cells to look in, half of them on average.
+	Interior vertices only look in their own partition's table, border vertices in the table of the
+	partition of each cell as well as in the border table.
+*/
+static uint findMatch(const NearbyData *data, const uint index, const uint *borderTable, const uint borderMask){
+	const uint nGrid = data->nGridComponents;
+	const float *src = data->vertices + index * data->nComponents;
+
+	uint lowKey[GRID_COMPONENTS], highKey[GRID_COMPONENTS], splitComponents[GRID_COMPONENTS], probe[GRID_COMPONENTS];
+	uint nSplit = 0;
+	for (uint c = 0; c < nGrid; c++){
+		lowKey[c]  = gridCell(src[c] - data->epsilon, data->invCellSize);
+		highKey[c] = gridCell(src[c] + data->epsilon, data->invCellSize);
+		if (lowKey[c] != highKey[c]) splitComponents[nSplit++] = c;
+	}
+
+	uint match = EMPTY_SLOT;
+	for (uint side = 0; side < (1U << nSplit); side++){
+		for (uint c = 0; c < nGrid; c++){
+			probe[c] = lowKey[c];
+		}
+		for (uint k = 0; k < nSplit; k++){
+			if (side & (1U << k)) probe[splitComponents[k]] = highKey[splitComponents[k]];
+		}
+		uint hash = hashKey(probe, nGrid);
+
+		uint p = coarsePartition(data, probe);
+		const uint *table = data->tables + data->tableStart[p];
+		findNearby(data, table, data->tableStart[p + 1] - data->tableStart[p] - 1, probe, hash, index, match);
+
+		if (borderTable) findNearby(data, borderTable, borderMask, probe, hash, index, match);
+	}
+
+	return match;
+}
+
+// The range of an interior vertex lies within its coarse cell, so it can only weld to vertices in its own partition
+static void weldInterior(void *param, const uint start, const uint end){
+	NearbyData *data = (NearbyData *) param;
+
+	for (uint p = start; p < end; p++){
+		uint *table = data->tables + data->tableStart[p];
+		uint mask = data->tableStart[p + 1] - data->tableStart[p] - 1;
+
+		for (uint v = data->partitionStart[p]; v < data->partitionStart[p + 1]; v++){
+			uint index = data->partitionVertices[v];
+
+			uint match = findMatch(data, index, NULL, 0);
+			if (match == EMPTY_SLOT){
+				insertUnique(data, table, mask, index);
+				match = index;
+			}
+			data->first[index] = match;
+		}
+	}
+}
+
+/*
+	Welds each vertex to a unique vertex whose components all lie within epsilon of its own. Vertices
+	are grouped by coarse grid cell into partitions, and those whose range lies within their coarse
+	cell are welded in index order within their partition on the job system. The few vertices near
+	the border of a coarse cell are then welded in index order on this thread, against the unique
+	vertices of all partitions their range covers and the border vertices already made unique.
+*/
+static uint weldNearby(const float *vertices, const uint nVertices, const uint nComp, uint *remap, const float epsilon){
+	NearbyData data;
+	data.vertices = vertices;
+	data.nVertices = nVertices;
+	data.nComponents = nComp;
+	data.nGridComponents = (nComp < GRID_COMPONENTS)? nComp : GRID_COMPONENTS;
+	data.epsilon = epsilon;
+	data.invCellSize = 0.25f / epsilon;
+
+	data.partitionBits = 0;
+	while (data.partitionBits < 8 && (nVertices >> (data.partitionBits + 14)) > 0) data.partitionBits++;
+	uint nPartitions = 1 << data.partitionBits;
+
+	data.keys = new uint[nVertices * data.nGridComponents];
+	data.hashes = new uint[nVertices];
+	data.partitions = new uint[nVertices];
+	parallelFor(computeNearbyKeys, &data, nVertices, 4096);
+
+	data.partitionStart = new uint[nPartitions + 1];
+	data.partitionVertices = new uint[nVertices];
+	memset(data.partitionStart, 0, (nPartitions + 1) * sizeof(uint));
+
+	uint nBorder = 0;
+	for (uint i = 0; i < nVertices; i++){
+		if (data.partitions[i] == BORDER_VERTEX){
+			nBorder++;
+		} else {
+			data.partitionStart[data.partitions[i] + 1]++;
+		}
+	}
+	for (uint p = 0; p < nPartitions; p++){
+		data.partitionStart[p + 1] += data.partitionStart[p];
+	}
+
+	// Border vertices go last, in order
+	uint *fill = new uint[nPartitions + 1];
+	memcpy(fill, data.partitionStart, (nPartitions + 1) * sizeof(uint));
+	for (uint i = 0; i < nVertices; i++){
+		uint p = data.partitions[i];
+		data.partitionVertices[fill[(p == BORDER_VERTEX)? nPartitions : p]++] = i;
+	}
+	delete [] fill;
+
+	// Power of two tables kept at most half full
+	data.tableStart = new uint[nPartitions + 1];
+	data.tableStart[0] = 0;
+	for (uint p = 0; p < nPartitions; p++){
+		uint count = data.partitionStart[p + 1] - data.partitionStart[p];
+		uint size = 1;
+		while (size < 2 * count) size <<= 1;
+		data.tableStart[p + 1] = data.tableStart[p] + size;
+	}
+	data.tables = new uint[data.tableStart[nPartitions]];
+	memset(data.tables, 0xFF, data.tableStart[nPartitions] * sizeof(uint));
+
+	data.first = new uint[nVertices];
+	parallelFor(weldInterior, &data, nPartitions, 1);
+
+	uint borderSize = 1;
+	while (borderSize < 2 * nBorder) borderSize <<= 1;
+	uint *borderTable = new uint[borderSize];
+	memset(borderTable, 0xFF, borderSize * sizeof(uint));
+
+	for (uint v = data.partitionStart[nPartitions]; v < nVertices; v++){
+		uint index = data.partitionVertices[v];
+
+		uint match = findMatch(&data, index, borderTable, borderSize - 1);
+		if (match == EMPTY_SLOT){
+			insertUnique(&data, borderTable, borderSize - 1, index);
+			match = index;
+		}
+		data.first[index] = match;
+	}
+
+	// A border vertex may weld to a unique vertex after it, so the first vertex to use a unique vertex numbers it
+	memset(remap, 0xFF, nVertices * sizeof(uint));
+	uint count = 0;
+	for (uint i = 0; i < nVertices; i++){
+		uint first = data.first[i];
+		if (remap[first] == EMPTY_SLOT) remap[first] = count++;
+		remap[i] = remap[first];
+	}
+
+	delete [] borderTable;
+	delete [] data.keys;
+	delete [] data.hashes;
+	delete [] data.partitions;
+	delete [] data.partitionStart;
+	delete [] data.partitionVertices;
+	delete [] data.tableStart;
+	delete [] data.tables;
+	delete [] data.first;
+
+	return count;
+}
+
+uint weldVertices(const float *vertices, const uint nVertices, const uint nComponents, uint *remap, const float epsilon){
+	if (nVertices == 0) return 0;
+	if (epsilon > 0) return weldNearby(vertices, nVertices, nComponents, remap, epsilon);
+
+	WeldData data;
+	data.vertices = vertices;
+	data.nVertices = nVertices;
+	data.nComponents = nComponents;
+
+	data.keys = new uint[nVertices * nComponents];
+	data.hashes = new uint[nVertices];
+	parallelFor(computeKeys, &data, nVertices, 4096);
+
+	// Hash into partitions by the top bits so that each one can be welded on its own
+	uint partitionBits = 0;
+	while (partitionBits < 8 && (nVertices >> (partitionBits + 14)) > 0) partitionBits++;
+	uint nPartitions = 1 << partitionBits;
+	data.partitionShift = 32 - partitionBits;
+
+	data.partitionStart = new uint[nPartitions + 1];
+	data.partitionVertices = new uint[nVertices];
+	memset(data.partitionStart, 0, (nPartitions + 1) * sizeof(uint));
+
+	for (uint i = 0; i < nVertices; i++){
+		uint p = (partitionBits > 0)? data.hashes[i] >> data.partitionShift : 0;
+		data.partitionStart[p + 1]++;
+	}
+	for (uint p = 0; p < nPartitions; p++){
+		data.partitionStart[p + 1] += data.partitionStart[p];
+	}
+
+	uint *fill = new uint[nPartitions];
+	memcpy(fill, data.partitionStart, nPartitions * sizeof(uint));
+	for (uint i = 0; i < nVertices; i++){
+		uint p = (partitionBits > 0)? data.hashes[i] >> data.partitionShift : 0;
+		data.partitionVertices[fill[p]++] = i;
+	}
+	delete [] fill;
+
+	// Power of two tables kept at most half full
+	data.tableStart = new uint[nPartitions + 1];
+	data.tableStart[0] = 0;
+	for (uint p = 0; p < nPartitions; p++){
+		uint count = data.partitionStart[p + 1] - data.partitionStart[p];
+		uint size = 1;
+		while (size < 2 * count) size <<= 1;
+		data.tableStart[p + 1] = data.tableStart[p] + size;
+	}
+	data.tables = new uint[data.tableStart[nPartitions]];
+	memset(data.tables, 0xFF, data.tableStart[nPartitions] * sizeof(uint));
+
+	data.first = new uint[nVertices];
+	parallelFor(weldPartitions, &data, nPartitions, 1);
+
+	// Number the unique vertices in order of first appearance
+	uint count = 0;
+	for (uint i = 0; i < nVertices; i++){
+		uint first = data.first[i];
+		remap[i] = (first == i)? count++ : remap[first];
+	}
+
+	delete [] data.keys;
+	delete [] data.hashes;
+	delete [] data.partitionStart;
+	delete [] data.partitionVertices;
+	delete [] data.tableStart;
+	delete [] data.tables;
+	delete [] data.first;
+
+	return count;
+}
@@ -0,0 +1,36 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _WELD_H_
+#define _WELD_H_
+
+#include "../Platform.h"
+
+// Finds identical vertices in an array of nVertices * nComponents floats.
+// remap[i] receives the welded index of vertex i, and unique vertices are numbered
+// in the order they first appear. With epsilon > 0 a vertex is welded to a unique vertex
+// with every component within epsilon of its own, and no two unique vertices are
+// that close, otherwise they must match exactly. Both run on the job system, with
+// the same result for any number of workers.
+// Returns the number of unique vertices.
+uint weldVertices(const float *vertices, const uint nVertices, const uint nComponents, uint *remap, const float epsilon = 0.0f);
+
+#endif // _WELD_H_
@@ -0,0 +1,564 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "WorldChunks.h"
+
+#define WORLD_CHUNKS_MAGIC   MCHAR4('W', 'C', 'H', 'K')
+#define WORLD_CHUNKS_VERSION 1
+
+struct WorldChunksHeader {
+	uint32 magic;
+	uint32 version;
+	uint64 sourceHash;
+
+	uint32 nChunks;
+	uint32 vertexDataSize;
+};
+
+// Size of each node as written by BNode::write()
+#define BSP_NODE_FILE_SIZE (3 * sizeof(vec3) + sizeof(int))
+
+static bool seekFile(FILE *file, const uint64 offset){
+#ifdef _WIN32
+	return (_fseeki64(file, offset, SEEK_SET) == 0);
+#else
+	return (fseeko(file, offset, SEEK_SET) == 0);
+#endif
+}
+
+static uint64 tellFile(FILE *file){
+#ifdef _WIN32
+	return _ftelli64(file);
+#else
+	return ftello(file);
+#endif
+}
+
+struct CellTriangle {
+	int cell[3];
+	uint triangle;
+};
+
+static int cellTriangleComp(const void *elem0, const void *elem1){
+	const CellTriangle *t0 = (const CellTriangle *) elem0;
+	const CellTriangle *t1 = (const CellTriangle *) elem1;
+
+	for (int i = 0; i < 3; i++){
+		if (t0->cell[i] != t1->cell[i]) return (t0->cell[i] < t1->cell[i])? -1 : 1;
+	}
+	return (t0->triangle < t1->triangle)? -1 : (t0->triangle > t1->triangle);
+}
+
+static bool sameCell(const CellTriangle &t0, const CellTriangle &t1){
+	return (t0.cell[0] == t1.cell[0] && t0.cell[1] == t1.cell[1] && t0.cell[2] == t1.cell[2]);
+}
+
+bool saveWorldChunks(const char *fileName, const Model &world, const float cellSize, const ubyte *vertexData, const uint vertexDataSize, const uint64 sourceHash){
+	StreamID vertexStream = world.findStream(TYPE_VERTEX);
+	if (!world.isCompiled() || vertexStream < 0 || cellSize <= 0) return false;
+
+	const uint stride = world.getVertexSize();
+	const uint nTriangles = world.getIndexCount() / 3;
+	const ubyte *positions = world.getCompiledVertices() + world.getStreamOffset(vertexStream);
+	if (nTriangles == 0) return false;
+
+	// Sort the triangles into cells by centroid, keeping them in order within each cell
+	CellTriangle *cells = new CellTriangle[nTriangles];
+	for (uint t = 0; t < nTriangles; t++){
+		vec3 center = vec3(0.0f);
+		for (uint k = 0; k < 3; k++){
+			center += *(const vec3 *) (positions + stride * world.getCompiledIndex(3 * t + k));
+		}
+		center /= 3.0f * cellSize;
+
+		for (uint k = 0; k < 3; k++){
+			cells[t].cell[k] = (int) floorf(center[k]);
+		}
+		cells[t].triangle = t;
+	}
+	qsort(cells, nTriangles, sizeof(CellTriangle), cellTriangleComp);
+
+	uint nChunks = 1;
+	for (uint t = 1; t < nTriangles; t++){
+		if (!sameCell(cells[t], cells[t - 1])) nChunks++;
+	}
+
+	FILE *file = fopen(fileName, "wb");
+	if (file == NULL){
+		delete [] cells;
+		return false;
+	}
+
+	WorldChunksHeader header;
+	header.magic = WORLD_CHUNKS_MAGIC;
+	header.version = WORLD_CHUNKS_VERSION;
+	header.sourceHash = sourceHash;
+	header.nChunks = nChunks;
+	header.vertexDataSize = vertexDataSize;
+	fwrite(&header, sizeof(header), 1, file);
+
+	// The chunk table is filled in once everything is written
+	WorldChunk *chunks = new WorldChunk[nChunks]();
+	fwrite(chunks, sizeof(WorldChunk), nChunks, file);
+
+	uint *triangles = new uint[nTriangles];
+	Array <uint> vertexMap;
+
+	bool result = true;
+	uint first = 0;
+	for (uint c = 0; c < nChunks && result; c++){
+		uint count = 0;
+		do {
+			triangles[count] = cells[first + count].triangle;
+			count++;
+		} while (first + count < nTriangles && sameCell(cells[first + count], cells[first]));
+		first += count;
+
+		Model model;
+		if (!world.extract(&model, triangles, count, &vertexMap)){
+			result = false;
+			break;
+		}
+
+		WorldChunk &chunk = chunks[c];
+		chunk.offset = tellFile(file);
+		chunk.nTriangles = count;
+		chunk.nVertices = vertexMap.getCount();
+
+		// Bounds and collision from the triangles themselves rather than the cell, as they may stick out of it
+		const ubyte *chunkPositions = model.getCompiledVertices() + model.getStreamOffset(vertexStream);
+		chunk.boxMin = vec3(FLT_MAX);
+		chunk.boxMax = vec3(-FLT_MAX);
+
+		BSP bsp;
+		for (uint t = 0; t < count; t++){
+			vec3 v[3];
+			for (uint k = 0; k < 3; k++){
+				v[k] = *(const vec3 *) (chunkPositions + stride * model.getCompiledIndex(3 * t + k));
+				chunk.boxMin = min(chunk.boxMin, v[k]);
+				chunk.boxMax = max(chunk.boxMax, v[k]);
+			}
+			bsp.addTriangle(v[0], v[1], v[2]);
+		}
+		bsp.build();
+
+		result &= model.saveCompiled(file);
+		chunk.modelSize = uint32(tellFile(file) - chunk.offset);
+
+		if (vertexData){
+			for (uint i = 0; i < vertexMap.getCount(); i++){
+				fwrite(vertexData + vertexMap[i] * vertexDataSize, vertexDataSize, 1, file);
+			}
+			chunk.vertexDataSize = vertexMap.getCount() * vertexDataSize;
+		}
+
+		uint64 collisionOffset = tellFile(file);
+		result &= bsp.write(file);
+		chunk.collisionSize = uint32(tellFile(file) - collisionOffset);
+
+		chunk.memorySize = chunk.modelSize + chunk.vertexDataSize + uint32(chunk.collisionSize / BSP_NODE_FILE_SIZE) * sizeof(BNode);
+	}
+
+	if (result){
+		seekFile(file, sizeof(header));
+		fwrite(chunks, sizeof(WorldChunk), nChunks, file);
+		result = (ferror(file) == 0);
+	}
+	fclose(file);
+
+	delete [] triangles;
+	delete [] chunks;
+	delete [] cells;
+
+	return result;
+}
+
+/***************************************************************************************************/
+
+void loaderStarter(void *param){
+	((WorldStreamer *) param)->loaderLoop();
+}
+
+static float boxDistance(const vec3 &pos, const vec3 &boxMin, const vec3 &boxMax){
+	vec3 d = max(max(boxMin - pos, pos - boxMax), vec3(0.0f));
+	return length(d);
+}
+
+WorldStreamer::WorldStreamer(){
+	chunks = NULL;
+	vertexDataSize = 0;
+	drawRenderer = NULL;
+	file = NULL;
+	quit = false;
+	loaderIdle = true;
+
+	cameraPos = vec3(0.0f);
+	loadDistance = 1000.0f;
+	unloadDistance = 1500.0f;
+	memoryBudget = 64 * 1024 * 1024;
+	memoryUsed = 0;
+	peakMemory = 0;
+
+	createMutex(mutex);
+	createCondition(wake);
+	createCondition(idle);
+}
+
+WorldStreamer::~WorldStreamer(){
+	close();
+
+	deleteCondition(idle);
+	deleteCondition(wake);
+	deleteMutex(mutex);
+}
+
+bool WorldStreamer::open(const char *fileName, const uint64 sourceHash){
+	close();
+
+	if ((file = fopen(fileName, "rb")) == NULL) return false;
+
+	WorldChunksHeader header;
+	bool valid = (fread(&header, sizeof(header), 1, file) == 1);
+	valid = valid && header.magic == WORLD_CHUNKS_MAGIC && header.version == WORLD_CHUNKS_VERSION && header.nChunks > 0;
+	if (valid && sourceHash != 0 && header.sourceHash != sourceHash) valid = false;
+	if (valid){
+		chunkInfos.setCount(header.nChunks);
+		valid = (fread(chunkInfos.getArray(), sizeof(WorldChunk), header.nChunks, file) == header.nChunks);
+	}
+	if (!valid){
+		chunkInfos.reset();
+		fclose(file);
+		file = NULL;
+		return false;
+	}
+	vertexDataSize = header.vertexDataSize;
+
+	chunks = new StreamedChunk[header.nChunks];
+	memset(chunks, 0, header.nChunks * sizeof(StreamedChunk));
+	for (uint i = 0; i < header.nChunks; i++){
+		chunks[i].state = CHUNK_UNLOADED;
+	}
+
+	memoryUsed = 0;
+	peakMemory = 0;
+	quit = false;
+	loaderIdle = false;
+	loader = createThread(loaderStarter, this);
+
+	return true;
+}
+
+void WorldStreamer::close(){
+	if (file == NULL) return;
+
+	lockMutex(mutex);
+		quit = true;
+		signalCondition(wake);
+	unlockMutex(mutex);
+
+	waitOnThread(loader);
+	deleteThread(loader);
+
+	for (uint i = 0; i < chunkInfos.getCount(); i++){
+		freeChunk(i);
+	}
+	delete [] chunks;
+	chunks = NULL;
+	chunkInfos.reset();
+	drawRenderer = NULL;
+
+	fclose(file);
+	file = NULL;
+}
+
+void WorldStreamer::setLimits(const float loadDist, const float unloadDist, const uint64 budget){
+	lockMutex(mutex);
+		loadDistance = loadDist;
+		unloadDistance = max(loadDist, unloadDist);
+		memoryBudget = budget;
+		loaderIdle = false;
+		signalCondition(wake);
+	unlockMutex(mutex);
+}
+
+void WorldStreamer::setCameraPosition(const vec3 &position){
+	lockMutex(mutex);
+		cameraPos = position;
+		loaderIdle = false;
+		signalCondition(wake);
+	unlockMutex(mutex);
+}
+
+uint WorldStreamer::update(Renderer *renderer, const ShaderID shader){
+	if (file == NULL) return 0;
+
+	ASSERT(renderer == NULL || drawRenderer == NULL || renderer == drawRenderer);
+	if (renderer) drawRenderer = renderer;
+
+	timestamp now = getCurrentTime();
+
+	uint nChanged = 0;
+	for (uint i = 0; i < chunkInfos.getCount(); i++){
+		// Only this thread moves chunks out of these states, so the data can be used without holding the lock
+		lockMutex(mutex);
+			ChunkState state = chunks[i].state;
+		unlockMutex(mutex);
+
+		if (state == CHUNK_LOADED){
+			if (renderer){
+				chunks[i].model->makeDrawable(renderer, true, shader);
+				chunks[i].drawable = true;
+			}
+			chunks[i].resident = true;
+
+			lockMutex(mutex);
+				chunks[i].state = CHUNK_RESIDENT;
+			unlockMutex(mutex);
+			nChanged++;
+		} else if (state == CHUNK_EVICTING){
+			freeChunk(i);
+
+			lockMutex(mutex);
+				chunks[i].state = CHUNK_UNLOADED;
+				memoryUsed -= chunkInfos[i].memorySize;
+				// The freed memory may let the loader go on
+				loaderIdle = false;
+				signalCondition(wake);
+			unlockMutex(mutex);
+			nChanged++;
+		} else if (state == CHUNK_FAILED){
+			// A quarter of a second after the first failure, doubling up to half a minute
+			float delay = min(0.25f * (1 << min(chunks[i].failures - 1, 7U)), 30.0f);
+			if (getTimeDifference(chunks[i].failTime, now) >= delay){
+				lockMutex(mutex);
+					chunks[i].state = CHUNK_UNLOADED;
+					loaderIdle = false;
+					signalCondition(wake);
+				unlockMutex(mutex);
+				nChanged++;
+			}
+		}
+	}
+
+	return nChanged;
+}
+
+void WorldStreamer::waitIdle(Renderer *renderer, const ShaderID shader){
+	if (file == NULL) return;
+
+	do {
+		lockMutex(mutex);
+			while (!loaderIdle) waitCondition(idle, mutex);
+		unlockMutex(mutex);
+	} while (update(renderer, shader) > 0);
+}
+
+uint64 WorldStreamer::getResidentMemory() const {
+	lockMutex(mutex);
+		uint64 memory = memoryUsed;
+	unlockMutex(mutex);
+
+	return memory;
+}
+
+uint64 WorldStreamer::getPeakMemory() const {
+	lockMutex(mutex);
+		uint64 memory = peakMemory;
+	unlockMutex(mutex);
+
+	return memory;
+}
+
+bool WorldStreamer::intersects(const vec3 &v0, const vec3 &v1, vec3 *point) const {
+	vec3 end = v1;
+	bool hit = false;
+	for (uint i = 0; i < chunkInfos.getCount(); i++){
+		if (!chunks[i].resident || chunks[i].collision == NULL) continue;
+
+		// Shorten the segment to each hit so that the closest one is returned
+		vec3 p;
+		if (chunks[i].collision->intersects(v0, end, &p)){
+			end = p;
+			hit = true;
+		}
+	}
+	if (hit && point) *point = end;
+
+	return hit;
+}
+
+bool WorldStreamer::pushSphere(vec3 &pos, const float radius) const {
+	bool pushed = false;
+	for (uint i = 0; i < chunkInfos.getCount(); i++){
+		if (!chunks[i].resident || chunks[i].collision == NULL) continue;
+		if (boxDistance(pos, chunkInfos[i].boxMin, chunkInfos[i].boxMax) > radius) continue;
+
+		pushed |= chunks[i].collision->pushSphere(pos, radius);
+	}
+
+	return pushed;
+}
+
+void WorldStreamer::loaderLoop(){
+	lockMutex(mutex);
+	while (!quit){
+		int chunk = findWork();
+		if (chunk < 0){
+			loaderIdle = true;
+			broadcastCondition(idle);
+			waitCondition(wake, mutex);
+			continue;
+		}
+
+		// The chunk is ours while loading, so read it without holding the lock
+		unlockMutex(mutex);
+			bool loaded = loadChunk(chunk);
+		lockMutex(mutex);
+
+		if (loaded){
+			chunks[chunk].state = CHUNK_LOADED;
+			chunks[chunk].failures = 0;
+		} else {
+			chunks[chunk].state = CHUNK_FAILED;
+			chunks[chunk].failures++;
+			chunks[chunk].failTime = getCurrentTime();
+			memoryUsed -= chunkInfos[chunk].memorySize;
+		}
+	}
+	loaderIdle = true;
+	broadcastCondition(idle);
+	unlockMutex(mutex);
+}
+
+// Called with the lock held. Marks chunks to evict and returns a chunk to load, reserving its memory.
+int WorldStreamer::findWork(){
+	uint nChunks = chunkInfos.getCount();
+
+	int nearest = -1;
+	float nearestDist = loadDistance;
+	uint64 evicting = 0;
+	for (uint i = 0; i < nChunks; i++){
+		float dist = boxDistance(cameraPos, chunkInfos[i].boxMin, chunkInfos[i].boxMax);
+
+		if (chunks[i].state == CHUNK_RESIDENT && dist > unloadDistance){
+			chunks[i].state = CHUNK_EVICTING;
+		}
+		if (chunks[i].state == CHUNK_EVICTING){
+			evicting += chunkInfos[i].memorySize;
+		} else if (chunks[i].state == CHUNK_UNLOADED && dist <= nearestDist && chunkInfos[i].memorySize <= memoryBudget){
+			nearest = i;
+			nearestDist = dist;
+		}
+	}
+	if (nearest < 0) return -1;
+
+	uint64 size = chunkInfos[nearest].memorySize;
+	if (memoryUsed + size > memoryBudget + evicting){
+		uint64 needed = memoryUsed + size - memoryBudget;
+
+		// Make room by evicting chunks further away than this one, furthest first, unless it won't be enough anyway
+		uint64 available = evicting;
+		for (uint i = 0; i < nChunks; i++){
+			if (chunks[i].state == CHUNK_RESIDENT && boxDistance(cameraPos, chunkInfos[i].boxMin, chunkInfos[i].boxMax) > nearestDist){
+				available += chunkInfos[i].memorySize;
+			}
+		}
+		if (available < needed) return -1;
+
+		while (evicting < needed){
+			int furthest = -1;
+			float furthestDist = nearestDist;
+			for (uint i = 0; i < nChunks; i++){
+				if (chunks[i].state != CHUNK_RESIDENT) continue;
+
+				float dist = boxDistance(cameraPos, chunkInfos[i].boxMin, chunkInfos[i].boxMax);
+				if (dist > furthestDist){
+					furthest = i;
+					furthestDist = dist;
+				}
+			}
+			chunks[furthest].state = CHUNK_EVICTING;
+			evicting += chunkInfos[furthest].memorySize;
+		}
+	}
+
+	// The memory comes back once update() has freed the evicted chunks
+	if (memoryUsed + size > memoryBudget) return -1;
+
+	chunks[nearest].state = CHUNK_LOADING;
+	memoryUsed += size;
+	if (memoryUsed > peakMemory) peakMemory = memoryUsed;
+
+	return nearest;
+}
+
+bool WorldStreamer::loadChunk(const uint chunk){
+	const WorldChunk &info = chunkInfos[chunk];
+	StreamedChunk &dest = chunks[chunk];
+
+	if (!seekFile(file, info.offset)) return false;
+
+	ubyte *modelData = new ubyte[info.modelSize];
+	if (fread(modelData, 1, info.modelSize, file) != info.modelSize){
+		delete [] modelData;
+		return false;
+	}
+
+	dest.model = new Model();
+	if (!dest.model->loadCompiled(modelData, info.modelSize) || dest.model->getCompiledVertexCount() != info.nVertices){
+		delete dest.model;
+		dest.model = NULL;
+		return false;
+	}
+
+	if (info.vertexDataSize){
+		dest.vertexData = new ubyte[info.vertexDataSize];
+		if (fread(dest.vertexData, 1, info.vertexDataSize, file) != info.vertexDataSize){
+			freeChunk(chunk);
+			return false;
+		}
+	}
+
+	if (info.collisionSize){
+		dest.collision = new BSP();
+		if (!dest.collision->read(file)){
+			freeChunk(chunk);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void WorldStreamer::freeChunk(const uint chunk){
+	StreamedChunk &dest = chunks[chunk];
+
+	if (dest.drawable) dest.model->unmakeDrawable(drawRenderer);
+	delete dest.model;
+	delete [] dest.vertexData;
+	delete dest.collision;
+
+	dest.model = NULL;
+	dest.vertexData = NULL;
+	dest.collision = NULL;
+	dest.resident = false;
+	dest.drawable = false;
+}
@@ -0,0 +1,145 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef _WORLDCHUNKS_H_
+#define _WORLDCHUNKS_H_
+
+#include "Model.h"
+#include "BSP.h"
+#include "Thread.h"
+
+// A chunked world file holds a world model cut into grid cells, each stored as a compiled model
+// followed by its per-vertex data and its collision tree, so that chunks can be loaded on their own.
+struct WorldChunk {
+	vec3 boxMin;
+	vec3 boxMax;
+
+	uint64 offset;
+	uint32 modelSize;
+	uint32 vertexDataSize;
+	uint32 collisionSize;
+	// Memory used by the chunk once loaded
+	uint32 memorySize;
+
+	uint32 nTriangles;
+	uint32 nVertices;
+};
+
+// Splits the compiled world model into cells of cellSize by triangle centroid. vertexData holds
+// vertexDataSize bytes for each compiled vertex, such as material selection, and is split along.
+bool saveWorldChunks(const char *fileName, const Model &world, const float cellSize, const ubyte *vertexData = NULL, const uint vertexDataSize = 0, const uint64 sourceHash = 0);
+
+enum ChunkState {
+	CHUNK_UNLOADED,
+	CHUNK_LOADING,
+	CHUNK_LOADED,
+	CHUNK_RESIDENT,
+	CHUNK_EVICTING,
+	// Goes back to CHUNK_UNLOADED in update() once the retry delay is over
+	CHUNK_FAILED,
+};
+
+struct StreamedChunk {
+	Model *model;
+	ubyte *vertexData;
+	BSP *collision;
+
+	ChunkState state;
+	// As seen from the thread calling update(), which is the only one to use the data
+	bool resident;
+	// The model has buffers in the streamer's renderer
+	bool drawable;
+
+	// Failed loads in a row, each one doubling the wait before the next try
+	uint failures;
+	timestamp failTime;
+};
+
+// Pages chunks of a world file in and out on a background thread. Chunks closer to the camera than
+// loadDistance are loaded nearest first for as long as they fit within memoryBudget, evicting chunks
+// further away than the one to load to make room. Chunks beyond unloadDistance are always evicted.
+// Loaded chunks are only handed over in update(), which also frees the evicted ones, so everything
+// returned by the accessors below stays valid until the next update(). Chunks that fail to load are
+// tried again after a delay that doubles with each failure, up to half a minute.
+class WorldStreamer {
+public:
+	WorldStreamer();
+	~WorldStreamer();
+
+	bool open(const char *fileName, const uint64 sourceHash = 0);
+	// Releases the buffers of resident chunks in the renderer they were uploaded to, so that renderer
+	// must still be around when the streamer is closed or destroyed.
+	void close();
+
+	void setLimits(const float loadDist, const float unloadDist, const uint64 budget);
+	void setCameraPosition(const vec3 &position);
+
+	// Uploads newly loaded chunks and releases evicted ones. The renderer may be NULL to run without
+	// any rendering, but must otherwise be the same on every call until close(). Returns the number
+	// of chunks that came, went or are due to be tried again.
+	uint update(Renderer *renderer, const ShaderID shader = SHADER_NONE);
+	// Keeps updating until the loader has nothing left to do for the current camera position
+	void waitIdle(Renderer *renderer, const ShaderID shader = SHADER_NONE);
+
+	uint getChunkCount() const { return chunkInfos.getCount(); }
+	const WorldChunk &getChunkInfo(const uint chunk) const { return chunkInfos[chunk]; }
+	bool isResident(const uint chunk) const { return chunks[chunk].resident; }
+	Model *getModel(const uint chunk) const { return chunks[chunk].resident? chunks[chunk].model : NULL; }
+	const ubyte *getVertexData(const uint chunk) const { return chunks[chunk].resident? chunks[chunk].vertexData : NULL; }
+	const BSP *getCollision(const uint chunk) const { return chunks[chunk].resident? chunks[chunk].collision : NULL; }
+
+	// Memory of chunks loaded, being loaded or waiting to be freed
+	uint64 getResidentMemory() const;
+	uint64 getPeakMemory() const;
+
+	bool intersects(const vec3 &v0, const vec3 &v1, vec3 *point = NULL) const;
+	bool pushSphere(vec3 &pos, const float radius) const;
+
+protected:
+	friend void loaderStarter(void *param);
+	void loaderLoop();
+	int findWork();
+	bool loadChunk(const uint chunk);
+	void freeChunk(const uint chunk);
+
+	Array <WorldChunk> chunkInfos;
+	StreamedChunk *chunks;
+	uint vertexDataSize;
+	// Where the resident chunks have their buffers
+	Renderer *drawRenderer;
+
+	FILE *file;
+	ThreadHandle loader;
+	mutable Mutex mutex;
+	Condition wake;
+	Condition idle;
+	bool quit;
+	bool loaderIdle;
+
+	vec3 cameraPos;
+	float loadDistance;
+	float unloadDistance;
+	uint64 memoryBudget;
+	uint64 memoryUsed;
+	uint64 peakMemory;
+};
+
+#endif // _WORLDCHUNKS_H_
@@ -22,6 +22,7 @@
 #include "Resource.h"
 
 #include "../CPU.h"
+#include "../Util/JobSystem.h"
 #include "../BaseApp.h"
 #include <direct.h>
 
@@ -177,6 +178,7 @@ int WINAPI WinMain(HINSTANCE hThisInst, HINSTANCE hLastInst, LPSTR lpszCmdLine,
 
   app = CreateApp();
 	initCPU();
+	initJobSystem();
 
 	// Make sure we're running in the exe's path
 	char path[MAX_PATH];
@@ -345,5 +347,7 @@ int WINAPI WinMain(HINSTANCE hThisInst, HINSTANCE hLastInst, LPSTR lpszCmdLine,
 
 	delete app;
 
+	shutdownJobSystem();
+
 	return (int) msg.wParam;
 }
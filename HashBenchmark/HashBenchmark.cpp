@@ -0,0 +1,305 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Times Model::assemble() against the version built on Hash it replaced, and IndexHash against Hash
+	on keys built to collide under Hash's additive hash function. Also checks that both number keys
+	the same way, including when more keys come in than they were sized for.
+
+	Usage: HashBenchmark [size] [collisions]
+
+	The model is a size x size quad grid, 895 by default for 1.6M triangles, once with vertex and
+	texture coordinates only and once with the three tangent space streams added. Streams are welded
+	before timing, so only the indexing is measured, and the best of 5 runs is reported. The collision
+	test inserts that many index pairs, 16384 by default, which all hash to the same value in Hash.
+	Returns non-zero if any result differs.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Util/Model.h"
+#include "../Framework3/Util/Hash.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_RUNS 5
+
+class ReferenceModel : public Model {
+public:
+	// Model::assemble() as it was before IndexHash, but with malloc() to go with the realloc() at the end
+	uint oldAssemble(const StreamID *aStreams, const uint nStreams, float **destVertices, uint **destIndices, bool separateArrays){
+		uint i, j, nComp = getComponentCount(aStreams, nStreams);
+		for (i = 0; i < nStreams; i++){
+			optimizeStream(aStreams[i]);
+		}
+
+		if (separateArrays){
+			for (i = 0; i < nStreams; i++){
+				destVertices[i] = (float *) malloc(streams[aStreams[i]].nComponents * nIndices * sizeof(float));
+			}
+		} else {
+			*destVertices = (float *) malloc(nComp * nIndices * sizeof(float));
+		}
+		uint *iDest = *destIndices = new uint[nIndices];
+
+		uint *iIndex = new uint[nStreams];
+		Hash hash(nStreams, nIndices >> 3, nIndices);
+		for (j = 0; j < nIndices; j++){
+			for (i = 0; i < nStreams; i++){
+				iIndex[i] = streams[aStreams[i]].indices[j];
+			}
+
+			uint index;
+			if (!hash.insert(iIndex, &index)){
+				if (separateArrays){
+					for (i = 0; i < nStreams; i++){
+						uint nc = streams[aStreams[i]].nComponents;
+						float *dest = destVertices[i] + index * nc;
+						memcpy(dest, streams[aStreams[i]].vertices + streams[aStreams[i]].indices[j] * nc, nc * sizeof(float));
+					}
+				} else {
+					float *dest = *destVertices + index * nComp;
+					for (i = 0; i < nStreams; i++){
+						uint nc = streams[aStreams[i]].nComponents;
+						memcpy(dest, streams[aStreams[i]].vertices + streams[aStreams[i]].indices[j] * nc, nc * sizeof(float));
+						dest += nc;
+					}
+				}
+			}
+
+			*iDest++ = index;
+		}
+		delete [] iIndex;
+
+		if (separateArrays){
+			for (i = 0; i < nStreams; i++){
+				destVertices[i] = (float *) realloc(destVertices[i], hash.getCount() * streams[aStreams[i]].nComponents * sizeof(float));
+			}
+		} else {
+			*destVertices = (float *) realloc(*destVertices, hash.getCount() * nComp * sizeof(float));
+		}
+		return hash.getCount();
+	}
+};
+
+static void createGrid(Model &model, const uint size){
+	uint nVertices = (size + 1) * (size + 1);
+	uint nIndices = 6 * size * size;
+
+	vec3 *vertices = new vec3[nVertices];
+	vec2 *texCoords = new vec2[nVertices];
+	for (uint y = 0; y <= size; y++){
+		for (uint x = 0; x <= size; x++){
+			uint i = y * (size + 1) + x;
+			vertices[i] = vec3(float(x), 4.0f * sinf(x * 0.05f) * cosf(y * 0.07f), float(y));
+			texCoords[i] = vec2(x * 0.125f, y * 0.0625f);
+		}
+	}
+
+	uint *vertexIndices = new uint[nIndices];
+	uint *dest = vertexIndices;
+	for (uint y = 0; y < size; y++){
+		for (uint x = 0; x < size; x++){
+			uint i0 = y * (size + 1) + x;
+			uint i1 = i0 + size + 1;
+
+			*dest++ = i0;
+			*dest++ = i1;
+			*dest++ = i1 + 1;
+
+			*dest++ = i0;
+			*dest++ = i1 + 1;
+			*dest++ = i0 + 1;
+		}
+	}
+
+	uint *coordIndices = new uint[nIndices];
+	memcpy(coordIndices, vertexIndices, nIndices * sizeof(uint));
+
+	model.addStream(TYPE_VERTEX, 3, nVertices, (float *) vertices, vertexIndices, false);
+	model.addStream(TYPE_TEXCOORD, 2, nVertices, (float *) texCoords, coordIndices, false);
+	model.setIndexCount(nIndices);
+	model.addBatch(0, nIndices);
+}
+
+// Times both versions of assemble() on all streams of the model, returning false if they differ
+static bool benchmarkAssemble(ReferenceModel &model, float &oldTime, float &newTime){
+	uint nStreams = model.getStreamCount();
+	StreamID aStreams[8];
+	for (uint i = 0; i < nStreams; i++){
+		aStreams[i] = i;
+	}
+
+	float *vertices;
+	uint *indices;
+
+	// Weld the streams up front
+	model.assemble(aStreams, nStreams, &vertices, &indices, false);
+	delete [] vertices;
+	delete [] indices;
+
+	bool equal = true;
+	oldTime = newTime = 1e10f;
+	for (uint run = 0; run < N_RUNS; run++){
+		float *oldVertices;
+		uint *oldIndices;
+
+		timestamp start = getCurrentTime();
+		uint nOldVertices = model.oldAssemble(aStreams, nStreams, &oldVertices, &oldIndices, false);
+		float time = getTimeDifference(start, getCurrentTime());
+		if (time < oldTime) oldTime = time;
+
+		start = getCurrentTime();
+		uint nVertices = model.assemble(aStreams, nStreams, &vertices, &indices, false);
+		time = getTimeDifference(start, getCurrentTime());
+		if (time < newTime) newTime = time;
+
+		uint nComp = model.getComponentCount();
+		if (nVertices != nOldVertices ||
+			memcmp(indices, oldIndices, model.getIndexCount() * sizeof(uint)) != 0 ||
+			memcmp(vertices, oldVertices, nVertices * nComp * sizeof(float)) != 0) equal = false;
+
+		free(oldVertices);
+		delete [] oldIndices;
+		delete [] vertices;
+		delete [] indices;
+	}
+
+	return equal;
+}
+
+// Index pairs that all get the same value from Hash::insert()
+static void createCollidingKeys(uint *keys, const uint count){
+	for (uint i = 0; i < count; i++){
+		keys[2 * i] = i;
+		keys[2 * i + 1] = 0x12345678 - i * 2049;
+	}
+}
+
+// Inserts count keys of DIM ints into a table sized for capasity of them, twice, and checks that the
+// second time finds every key with the number it got the first time. Returns the time of the first pass.
+template <class HASH>
+static float insertKeys(HASH &hash, const uint *keys, const uint dim, const uint count, uint *indices, bool &valid){
+	timestamp start = getCurrentTime();
+	for (uint i = 0; i < count; i++){
+		if (hash.insert(keys + i * dim, indices + i)) valid = false;
+	}
+	float time = getTimeDifference(start, getCurrentTime());
+
+	for (uint i = 0; i < count; i++){
+		uint index;
+		if (!hash.insert(keys + i * dim, &index) || index != indices[i]) valid = false;
+	}
+	if (hash.getCount() != count) valid = false;
+
+	return time;
+}
+
+// Both tables have to number more keys than they were sized for the same way
+template <uint DIM>
+static bool checkGrowth(const uint count){
+	uint *keys = new uint[count * DIM];
+	for (uint i = 0; i < count * DIM; i++){
+		keys[i] = i * 2654435761U;
+	}
+
+	uint *indices = new uint[count];
+	uint *hashIndices = new uint[count];
+
+	bool valid = true;
+	{
+		IndexHash <DIM> hash(4);
+		insertKeys(hash, keys, DIM, count, indices, valid);
+	}
+	{
+		Hash hash(DIM, count >> 3, 4);
+		insertKeys(hash, keys, DIM, count, hashIndices, valid);
+	}
+	if (memcmp(indices, hashIndices, count * sizeof(uint)) != 0) valid = false;
+
+	delete [] keys;
+	delete [] indices;
+	delete [] hashIndices;
+
+	return valid;
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint size = (argc > 1)? atoi(argv[1]) : 895;
+	uint nCollisions = (argc > 2)? atoi(argv[2]) : 16384;
+
+	initJobSystem();
+
+	uint nFailures = 0;
+	if (!checkGrowth <2>(100000)) nFailures++;
+	if (!checkGrowth <4>(100000)) nFailures++;
+	if (!checkGrowth <8>(100000)) nFailures++;
+	if (nFailures > 0) printf("Tables sized too small numbered keys wrong\n");
+
+	ReferenceModel model;
+	createGrid(model, size);
+	printf("%u triangles, best of %u runs\n", model.getIndexCount() / 3, N_RUNS);
+	printf("%-20s %12s %12s %8s\n", "", "Hash", "IndexHash", "result");
+
+	for (uint tangents = 0; tangents < 2; tangents++){
+		if (tangents) model.computeTangentSpace();
+
+		float oldTime, newTime;
+		bool equal = benchmarkAssemble(model, oldTime, newTime);
+		if (!equal) nFailures++;
+
+		printf("assemble, %u streams %9.1f ms %9.1f ms %8s\n", model.getStreamCount(), oldTime * 1000.0f, newTime * 1000.0f, equal? "same" : "DIFFERS");
+	}
+
+	uint *keys = new uint[2 * nCollisions];
+	uint *indices = new uint[nCollisions];
+	uint *hashIndices = new uint[nCollisions];
+	createCollidingKeys(keys, nCollisions);
+
+	bool valid = true;
+	float oldTime, newTime;
+	{
+		Hash hash(2, nCollisions >> 3, nCollisions);
+		oldTime = insertKeys(hash, keys, 2, nCollisions, hashIndices, valid);
+	}
+	{
+		IndexHash <2> hash(nCollisions);
+		newTime = insertKeys(hash, keys, 2, nCollisions, indices, valid);
+	}
+	if (memcmp(indices, hashIndices, nCollisions * sizeof(uint)) != 0) valid = false;
+	if (!valid) nFailures++;
+
+	printf("%5u colliding keys %9.1f ms %9.1f ms %8s\n", nCollisions, oldTime * 1000.0f, newTime * 1000.0f, valid? "same" : "DIFFERS");
+
+	delete [] keys;
+	delete [] indices;
+	delete [] hashIndices;
+
+	shutdownJobSystem();
+
+	return (nFailures > 0)? 1 : 0;
+}
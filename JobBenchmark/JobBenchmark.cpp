@@ -0,0 +1,134 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Measures the overhead of the job system and how parallelFor() scales with the number of workers.
+
+	Usage: JobBenchmark [maxWorkers]
+
+	For 1, 2, 4 ... maxWorkers workers, cpuCount by default, it reports the best of 5 runs of:
+	  - creating, running and waiting for 100000 empty jobs, per job
+	  - a tree of 32767 jobs where each job adds two children, per job
+	  - parallelFor() over 1M elements with a trivial kernel, and with one 64 times heavier
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define N_ELEMENTS (1 << 20)
+#define TREE_DEPTH 14
+
+static void emptyJob(Job *job, void *data){
+}
+
+static uint treeDepths[1 << (TREE_DEPTH + 1)];
+static std::atomic <uint> nextNode;
+
+// Splits into two children until the depth runs out, without waiting for them
+static void treeJob(Job *job, void *data){
+	uint depth = *(uint *) data;
+	if (depth == 0) return;
+
+	for (uint i = 0; i < 2; i++){
+		uint *child = treeDepths + nextNode++;
+		*child = depth - 1;
+		runJob(createJob(treeJob, child, NULL, job));
+	}
+}
+
+struct KernelData {
+	float *values;
+	uint iterations;
+};
+
+static void kernel(void *data, const uint start, const uint end){
+	KernelData *kernelData = (KernelData *) data;
+
+	for (uint i = start; i < end; i++){
+		float v = kernelData->values[i];
+		for (uint k = 0; k < kernelData->iterations; k++){
+			v = sqrtf(v * v + 1.0f) * 0.999f;
+		}
+		kernelData->values[i] = v;
+	}
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint maxWorkers = (argc > 1)? atoi(argv[1]) : cpuCount;
+	if (maxWorkers < 1) maxWorkers = 1;
+
+	KernelData kernelData;
+	kernelData.values = new float[N_ELEMENTS];
+
+	printf("workers  empty job  tree job  parallelFor light  parallelFor heavy\n");
+	for (uint nWorkers = 1; nWorkers <= maxWorkers; nWorkers *= 2){
+		initJobSystem(nWorkers);
+
+		float best[4] = { 1e10f, 1e10f, 1e10f, 1e10f };
+		for (uint run = 0; run < 5; run++){
+			timestamp start = getCurrentTime();
+			JobCounter counter;
+			for (uint i = 0; i < 100000; i++){
+				runJob(createJob(emptyJob, NULL, &counter));
+			}
+			waitForCounter(&counter);
+			best[0] = fminf(best[0], getTimeDifference(start, getCurrentTime()) / 100000);
+
+			start = getCurrentTime();
+			nextNode = 1;
+			treeDepths[0] = TREE_DEPTH;
+			JobCounter treeCounter;
+			runJob(createJob(treeJob, treeDepths, &treeCounter));
+			waitForCounter(&treeCounter);
+			best[1] = fminf(best[1], getTimeDifference(start, getCurrentTime()) / ((1 << (TREE_DEPTH + 1)) - 1));
+
+			for (uint i = 0; i < N_ELEMENTS; i++){
+				kernelData.values[i] = float(i);
+			}
+
+			kernelData.iterations = 1;
+			start = getCurrentTime();
+			parallelFor(kernel, &kernelData, N_ELEMENTS, 4096);
+			best[2] = fminf(best[2], getTimeDifference(start, getCurrentTime()));
+
+			kernelData.iterations = 64;
+			start = getCurrentTime();
+			parallelFor(kernel, &kernelData, N_ELEMENTS, 4096);
+			best[3] = fminf(best[3], getTimeDifference(start, getCurrentTime()));
+		}
+
+		printf("%7u  %6.0f ns  %5.0f ns  %14.2f ms  %14.2f ms\n", nWorkers, best[0] * 1e9f, best[1] * 1e9f, best[2] * 1e3f, best[3] * 1e3f);
+
+		shutdownJobSystem();
+	}
+
+	delete [] kernelData.values;
+
+	return 0;
+}
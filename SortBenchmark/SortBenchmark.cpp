@@ -0,0 +1,213 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Times Array::sort(), stableSort() and parallelSort() on random, sorted, reversed, duplicate heavy
+	and batched input, next to the first element pivot quicksort Array::sort() used before, and checks
+	that every result is in order and that the stable sorts keep equal elements in their input order.
+
+	Usage: SortBenchmark [count] [oldCount] [workers]
+
+	Sorts count {key, index} pairs, 1M by default, with the best of 3 runs. The old quicksort recurses
+	once per element on sorted input, so it only runs up to oldCount elements, 20000 by default. The
+	batched input is nearly sorted in runs, as the triangles in Model::cleanUp() are. Before timing it
+	checks all sorts on every size up to 100 and on String elements. Returns non-zero on any failure.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Util/Array.h"
+#include "../Framework3/Util/String.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N_INPUTS 5
+#define N_RUNS 3
+
+struct Item {
+	int key;
+	uint index;
+};
+
+static int compareItems(const Item &item0, const Item &item1){
+	return item0.key - item1.key;
+}
+
+static int compareStrings(const String &string0, const String &string1){
+	return strcmp(string0, string1);
+}
+
+// The sort Array had before, for reference
+static void oldQuickSort(Item *list, const int p, const int r){
+	if (p < r){
+		int left = p;
+		for (int i = p + 1; i <= r; i++){
+			if (compareItems(list[i], list[p]) < 0){
+				left++;
+				Item temp = list[i];
+				list[i] = list[left];
+				list[left] = temp;
+			}
+		}
+		Item temp = list[p];
+		list[p] = list[left];
+		list[left] = temp;
+
+		oldQuickSort(list, p, left - 1);
+		oldQuickSort(list, left + 1, r);
+	}
+}
+
+static const char *inputNames[N_INPUTS] = { "random", "sorted", "reversed", "8 keys", "batches" };
+
+static uint randomState;
+static int nextRandom(){
+	randomState = randomState * 1664525 + 1013904223;
+	return int(randomState >> 8);
+}
+
+static void fill(Array <Item> &items, const uint count, const uint input){
+	randomState = 1;
+	items.clear();
+	for (uint i = 0; i < count; i++){
+		Item item;
+		item.index = i;
+		switch (input){
+			case 0: item.key = nextRandom() & 0xFFFFFF; break;
+			case 1: item.key = i; break;
+			case 2: item.key = count - i; break;
+			case 3: item.key = nextRandom() & 7; break;
+			// Batches of a thousand, with the odd item out of place
+			default: item.key = (i / 1000) + ((nextRandom() % 100 == 0)? nextRandom() % 16 : 0);
+		}
+		items.add(item);
+	}
+}
+
+static bool isSorted(const Array <Item> &items, const bool stable){
+	for (uint i = 1; i < items.getCount(); i++){
+		if (items[i - 1].key > items[i].key) return false;
+		if (stable && items[i - 1].key == items[i].key && items[i - 1].index > items[i].index) return false;
+	}
+	return true;
+}
+
+static uint checkSorts(){
+	uint nFailures = 0;
+
+	// Small sizes, with a tiny minRange so that parallelSort() splits merges too
+	Array <Item> items;
+	for (uint count = 0; count <= 100; count++){
+		for (uint input = 0; input < N_INPUTS; input++){
+			fill(items, count, input);
+			items.sort(compareItems);
+			if (!isSorted(items, false)) nFailures++;
+
+			fill(items, count, input);
+			items.stableSort(compareItems);
+			if (!isSorted(items, true)) nFailures++;
+
+			fill(items, count, input);
+			items.parallelSort(compareItems, 3);
+			if (!isSorted(items, true)) nFailures++;
+		}
+	}
+
+	// Elements that own memory
+	randomState = 1;
+	Array <String> strings;
+	for (uint i = 0; i < 20000; i++){
+		char str[64];
+		sprintf(str, "string number %d with some padding", nextRandom() % 5000);
+		strings.add(String(str));
+	}
+	Array <String> stableStrings(strings), parallelStrings(strings);
+	strings.sort(compareStrings);
+	stableStrings.stableSort(compareStrings);
+	parallelStrings.parallelSort(compareStrings, 100);
+	for (uint i = 1; i < strings.getCount(); i++){
+		if (compareStrings(strings[i - 1], strings[i]) > 0 || strcmp(strings[i], stableStrings[i]) != 0 || strcmp(strings[i], parallelStrings[i]) != 0){
+			nFailures++;
+			break;
+		}
+	}
+
+	return nFailures;
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint count = (argc > 1)? atoi(argv[1]) : 1000000;
+	uint oldCount = (argc > 2)? atoi(argv[2]) : 20000;
+	uint nWorkers = (argc > 3)? atoi(argv[3]) : 0;
+
+	initJobSystem(nWorkers);
+
+	uint nFailures = checkSorts();
+	if (nFailures > 0) printf("%u sorts out of order\n", nFailures);
+
+	printf("%u elements, %u workers, best of %u runs\n", count, getWorkerCount(), N_RUNS);
+	printf("%-9s %13s %13s %13s %13s\n", "input", "old sort", "sort", "stableSort", "parallelSort");
+
+	Array <Item> items;
+	for (uint input = 0; input < N_INPUTS; input++){
+		float best[4] = { 1e10f, 1e10f, 1e10f, 1e10f };
+		for (uint run = 0; run < N_RUNS; run++){
+			for (uint method = 0; method < 4; method++){
+				if (method == 0 && count > oldCount) continue;
+
+				fill(items, count, input);
+				timestamp start = getCurrentTime();
+				switch (method){
+					case 0: oldQuickSort(items.getArray(), 0, int(count) - 1); break;
+					case 1: items.sort(compareItems); break;
+					case 2: items.stableSort(compareItems); break;
+					case 3: items.parallelSort(compareItems); break;
+				}
+				float time = getTimeDifference(start, getCurrentTime());
+				if (time < best[method]) best[method] = time;
+
+				if (!isSorted(items, method >= 2)){
+					printf("%s sort %u out of order\n", inputNames[input], method);
+					nFailures++;
+				}
+			}
+		}
+
+		printf("%-9s", inputNames[input]);
+		for (uint method = 0; method < 4; method++){
+			if (best[method] < 1e10f){
+				printf(" %10.2f ms", best[method] * 1000.0f);
+			} else {
+				printf(" %13s", "-");
+			}
+		}
+		printf("\n");
+	}
+
+	shutdownJobSystem();
+
+	return (nFailures > 0)? 1 : 0;
+}
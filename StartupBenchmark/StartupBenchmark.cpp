@@ -0,0 +1,253 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Measures how long the SurfaceDecals resources take to load, with the renderer calls made one by
+	one as App::load() used to, and through a ResourceLoader. It runs headless with a renderer that
+	creates nothing and only hashes what it is given, which also checks that both ways end up
+	uploading exactly the same textures and shaders.
+
+	Usage: StartupBenchmark [workers] [runs]
+
+	Run it from the SurfaceDecals directory, where the application itself runs. File names match the
+	case of the files on disk. The texture cache is turned off, so every run decodes and processes
+	the files again.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Renderer.h"
+#include "../Framework3/Imaging/TextureCache.h"
+#include "../Framework3/Util/JobSystem.h"
+#include "../Framework3/Util/ResourceLoader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Records a hash of every texture and shader passed to it and creates nothing
+class NullRenderer : public Renderer {
+public:
+	NullRenderer(){
+		nextID = 0;
+	}
+
+	TextureID addTexture(Image &img, const SamplerStateID samplerState, uint flags){
+		record(img.getPixels(), img.getMipMappedSize(0, img.getMipMapCount()) * img.getArraySize());
+		int dimensions[4] = { img.getWidth(), img.getHeight(), img.getArraySize(), img.getFormat() };
+		record(dimensions, sizeof(dimensions));
+		return nextID++;
+	}
+	ShaderID addShader(const char *vsText, const char *gsText, const char *fsText, const int vsLine, const int gsLine, const int fsLine,
+		const char *header, const char *extra, const char *fileName, const char **attributeNames, const int nAttributes, const uint flags){
+		if (vsText) record(vsText, strlen(vsText));
+		if (gsText) record(gsText, strlen(gsText));
+		if (fsText) record(fsText, strlen(fsText));
+		if (extra) record(extra, strlen(extra));
+		return nextID++;
+	}
+	using Renderer::addTexture;
+	using Renderer::addShader;
+
+	TextureID addRenderTarget(const int width, const int height, const int depth, const int mipMapCount, const int arraySize, const FORMAT format, const int msaaSamples, const SamplerStateID samplerState, uint flags){ return nextID++; }
+	TextureID addRenderDepth(const int width, const int height, const int arraySize, const FORMAT format, const int msaaSamples, const SamplerStateID samplerState, uint flags){ return nextID++; }
+	bool resizeRenderTarget(const TextureID renderTarget, const int width, const int height, const int depth, const int mipMapCount, const int arraySize){ return true; }
+	bool generateMipMaps(const TextureID renderTarget){ return true; }
+	void removeTexture(const TextureID texture){}
+
+	VertexFormatID addVertexFormat(const FormatDesc *formatDesc, const uint nAttribs, const ShaderID shader){ return nextID++; }
+	VertexBufferID addVertexBuffer(const long size, const BufferAccess bufferAccess, const void *data){ return nextID++; }
+	void deleteVertexBuffer(VertexBufferID bufferID){}
+	IndexBufferID addIndexBuffer(const uint nIndices, const uint indexSize, const BufferAccess bufferAccess, const void *data){ return nextID++; }
+	void deleteIndexBuffer(IndexBufferID bufferID){}
+	bool updateVertexBuffer(const VertexBufferID vertexBuffer, const intptr offset, const long size, const void *data){ return true; }
+
+	SamplerStateID addSamplerState(const Filter filter, const AddressMode s, const AddressMode t, const AddressMode r, const float lod, const uint maxAniso, const int compareFunc, const float *border_color){ return nextID++; }
+	BlendStateID addBlendState(const int srcFactorRGB, const int destFactorRGB, const int srcFactorAlpha, const int destFactorAlpha, const int blendModeRGB, const int blendModeAlpha, const int mask, const bool alphaToCoverage){ return nextID++; }
+	DepthStateID addDepthState(const bool depthTest, const bool depthWrite, const int depthFunc, const bool stencilTest, const uint8 stencilReadMask, const uint8 stencilWriteMask,
+		const int stencilFuncFront, const int stencilFuncBack, const int stencilFailFront, const int stencilFailBack,
+		const int depthFailFront, const int depthFailBack, const int stencilPassFront, const int stencilPassBack){ return nextID++; }
+	RasterizerStateID addRasterizerState(const int cullMode, const int fillMode, const bool multiSample, const bool scissor, const float depthBias, const float slopeDepthBias){ return nextID++; }
+
+	void setTexture(const char *textureName, const TextureID texture){}
+	void setTexture(const char *textureName, const TextureID texture, const SamplerStateID samplerState){}
+	void setTextureSlice(const char *textureName, const TextureID texture, const int slice){}
+	void changeTexture(const uint imageUnit, const TextureID texture){}
+	void applyTextures(){}
+	void setSamplerState(const char *samplerName, const SamplerStateID samplerState){}
+	void applySamplerStates(){}
+	void setShaderConstantRaw(const char *name, const void *data, const int size){}
+	void applyConstants(){}
+
+	void changeRenderTargets(const TextureID *colorRTs, const uint nRenderTargets, const TextureID depthRT, const int depthSlice, const int *slices){}
+	void changeToMainFramebuffer(){}
+	void changeShader(const ShaderID shader){}
+	void changeVertexFormat(const VertexFormatID vertexFormat){}
+	void changeVertexBuffer(const int stream, const VertexBufferID vertexBuffer, const intptr offset){}
+	void changeIndexBuffer(const IndexBufferID indexBuffer){}
+	void changeBlendState(const BlendStateID blendState, const uint sampleMask){}
+	void changeDepthState(const DepthStateID depthState, const uint stencilRef){}
+	void changeRasterizerState(const RasterizerStateID rasterizerState){}
+
+	void changeShaderConstant1i(const char *name, const int constant){}
+	void changeShaderConstant1f(const char *name, const float constant){}
+	void changeShaderConstant2f(const char *name, const vec2 &constant){}
+	void changeShaderConstant3f(const char *name, const vec3 &constant){}
+	void changeShaderConstant4f(const char *name, const vec4 &constant){}
+	void changeShaderConstant3x3f(const char *name, const mat3 &constant){}
+	void changeShaderConstant4x4f(const char *name, const mat4 &constant){}
+	void changeShaderConstantArray1f(const char *name, const float *constant, const uint count){}
+	void changeShaderConstantArray2f(const char *name, const vec2 *constant, const uint count){}
+	void changeShaderConstantArray3f(const char *name, const vec3 *constant, const uint count){}
+	void changeShaderConstantArray4f(const char *name, const vec4 *constant, const uint count){}
+
+	void clear(const bool clearColor, const bool clearDepth, const bool clearStencil, const float *color, const float depth, const uint stencil){}
+	void drawArrays(const Primitives primitives, const int firstVertex, const int nVertices){}
+	void drawElements(const Primitives primitives, const int firstIndex, const int nIndices, const int firstVertex, const int nVertices){}
+	void setup2DMode(const float left, const float right, const float top, const float bottom){}
+	void drawPlain(const Primitives primitives, vec2 *vertices, const uint nVertices, const BlendStateID blendState, const DepthStateID depthState, const vec4 *color){}
+	void drawTextured(const Primitives primitives, TexVertex *vertices, const uint nVertices, const TextureID texture, const SamplerStateID samplerState, const BlendStateID blendState, const DepthStateID depthState, const vec4 *color){}
+	void flush(){}
+	void finish(){}
+
+	Array <uint64> uploads;
+
+protected:
+	void record(const void *data, const size_t size){
+		// FNV-1a
+		const ubyte *bytes = (const ubyte *) data;
+		uint64 hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < size; i++){
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		uploads.add(hash);
+	}
+
+	int nextID;
+};
+
+// The resources of App::load()
+static const char *attribs[] = { NULL, "textureCoord", "tangent", "binormal", "normal", "matWeight", "matIndices" };
+static const char *diffuseNames[] = { "../Textures/floor_wood_3.dds", "../Textures/brick01.dds", "../Textures/stone08.dds", "../Textures/StoneWall_1-4.dds", "../Textures/Leaves.dds", "../Textures/Brick02.dds" };
+static const char *bumpNames[] = { "../Textures/floor_wood_3Bump.dds", "../Textures/brick01Bump.dds", "../Textures/stone08Bump.dds", "../Textures/StoneWall_1-4Bump.dds", "../Textures/LeavesBump.dds", "../Textures/Brick02Bump.dds" };
+#define N_MATERIALS 4
+
+static bool loadSequential(Renderer *renderer){
+	if (renderer->addShader("depthOnly.shd") == SHADER_NONE) return false;
+	if (renderer->addShader("lightingColorOnly.shd") == SHADER_NONE) return false;
+	if (renderer->addShader("decal.shd") == SHADER_NONE) return false;
+	if (renderer->addShader("lightingMP.shd", attribs, elementsOf(attribs)) == SHADER_NONE) return false;
+	if (renderer->addShader("lightingMP_ambient.shd", attribs, elementsOf(attribs)) == SHADER_NONE) return false;
+	if (renderer->addShader("lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_MAT_DATA\n") == SHADER_NONE) return false;
+	if (renderer->addShader("lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_VERTEX_WEIGHTS\n") == SHADER_NONE) return false;
+	if (renderer->addShader("plainColor.shd", attribs, elementsOf(attribs)) == SHADER_NONE) return false;
+
+	if (renderer->addTexture(diffuseNames, true, SS_NONE, elementsOf(diffuseNames)) == TEXTURE_NONE) return false;
+	if (renderer->addTexture(bumpNames, true, SS_NONE, elementsOf(bumpNames)) == TEXTURE_NONE) return false;
+	if (renderer->addTexture("../Textures/DecalTest.dds", true, SS_NONE) == TEXTURE_NONE) return false;
+	if (renderer->addTexture("../Textures/Perlin.dds", true, SS_NONE) == TEXTURE_NONE) return false;
+	for (uint i = 0; i < N_MATERIALS; i++){
+		if (renderer->addTexture(diffuseNames[i], true, SS_NONE) == TEXTURE_NONE) return false;
+		if (renderer->addNormalMap(bumpNames[i], FORMAT_RGBA8, true, SS_NONE) == TEXTURE_NONE) return false;
+	}
+
+	return true;
+}
+
+static bool loadBatched(Renderer *renderer, uint *nFiles){
+	ShaderID shaders[8];
+	TextureID textures[4 + 2 * N_MATERIALS];
+
+	ResourceLoader loader;
+	loader.addShader(shaders + 0, "depthOnly.shd");
+	loader.addShader(shaders + 1, "lightingColorOnly.shd");
+	loader.addShader(shaders + 2, "decal.shd");
+	loader.addShader(shaders + 3, "lightingMP.shd", attribs, elementsOf(attribs));
+	loader.addShader(shaders + 4, "lightingMP_ambient.shd", attribs, elementsOf(attribs));
+	loader.addShader(shaders + 5, "lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_MAT_DATA\n");
+	loader.addShader(shaders + 6, "lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_VERTEX_WEIGHTS\n");
+	loader.addShader(shaders + 7, "plainColor.shd", attribs, elementsOf(attribs));
+
+	loader.addTexture(textures + 0, diffuseNames, true, SS_NONE, elementsOf(diffuseNames));
+	loader.addTexture(textures + 1, bumpNames, true, SS_NONE, elementsOf(bumpNames));
+	loader.addTexture(textures + 2, "../Textures/DecalTest.dds", true, SS_NONE);
+	loader.addTexture(textures + 3, "../Textures/Perlin.dds", true, SS_NONE);
+	for (uint i = 0; i < N_MATERIALS; i++){
+		loader.addTexture(textures + 4 + 2 * i, diffuseNames[i], true, SS_NONE);
+		loader.addNormalMap(textures + 5 + 2 * i, bumpNames[i], FORMAT_RGBA8, true, SS_NONE);
+	}
+	*nFiles = loader.getFileCount();
+
+	return loader.load(renderer);
+}
+
+static bool sameUploads(const Array <uint64> &a, const Array <uint64> &b){
+	if (a.getCount() != b.getCount()) return false;
+
+	for (uint i = 0; i < a.getCount(); i++){
+		if (a[i] != b[i]) return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint nWorkers = (argc > 1)? atoi(argv[1]) : 0;
+	uint nRuns = (argc > 2)? atoi(argv[2]) : 10;
+	if (nRuns < 1) nRuns = 1;
+
+	setTextureCacheDirectory(NULL);
+	initJobSystem(nWorkers);
+
+	float bestSequential = 1e10f, bestBatched = 1e10f;
+	uint nFiles = 0;
+	bool same = true;
+	for (uint run = 0; run < nRuns; run++){
+		NullRenderer sequential;
+		timestamp start = getCurrentTime();
+		if (!loadSequential(&sequential)){
+			printf("Loading one by one failed, run this from the SurfaceDecals directory\n");
+			return 1;
+		}
+		float time = getTimeDifference(start, getCurrentTime());
+		if (time < bestSequential) bestSequential = time;
+
+		NullRenderer batched;
+		start = getCurrentTime();
+		if (!loadBatched(&batched, &nFiles)){
+			printf("Loading through the ResourceLoader failed\n");
+			return 1;
+		}
+		time = getTimeDifference(start, getCurrentTime());
+		if (time < bestBatched) bestBatched = time;
+
+		same &= sameUploads(sequential.uploads, batched.uploads);
+	}
+
+	printf("%u workers, best of %u runs: one by one %.2f ms, ResourceLoader %.2f ms reading %u files\n", getWorkerCount(), nRuns, bestSequential * 1000.0f, bestBatched * 1000.0f, nFiles);
+	printf("Uploads %s\n", same? "identical" : "DIFFER");
+
+	shutdownJobSystem();
+
+	return same? 0 : 1;
+}
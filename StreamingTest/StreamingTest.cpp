@@ -0,0 +1,338 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Drives a WorldStreamer headless along a scripted camera path over a generated terrain and checks
+	what it keeps resident and how much memory it uses on the way.
+
+	Usage: StreamingTest [gridSize] [budgetFraction]
+
+	The terrain is a gridSize x gridSize quad height field, 256 by default, cut into chunks of 1000 units.
+	The camera loops around the world in 2000 steps. Every 100 steps the loader is allowed to catch up
+	and the test checks that:
+	  - no chunk beyond the unload distance is resident
+	  - every chunk within the load distance is resident, unless there wasn't room in the budget
+	  - the memory reported matches the resident chunks and the peak never went over the budget
+	  - the per-vertex data of each chunk lines up with its vertices
+	  - collision against the resident chunks finds the same ground as the whole terrain
+	The budget is the total size of the chunks times budgetFraction, 0.125 by default. It then breaks
+	one chunk in the file and checks that the others still load and that the broken one is tried
+	again with a growing delay rather than on every update. Returns non-zero if anything failed.
+*/
+
+#include "../Framework3/Util/WorldChunks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define WORLD_SIZE 20000.0f
+#define CELL_SIZE 1000.0f
+#define LOAD_DISTANCE 2500.0f
+#define UNLOAD_DISTANCE 3500.0f
+#define N_STEPS 2000
+
+static const char *fileName = "StreamingTest.wchk";
+
+// Lets the test see how the streamer tracks a chunk that fails to load
+class TestStreamer : public WorldStreamer {
+public:
+	uint getFailures(const uint chunk) const { return chunks[chunk].failures; }
+};
+
+static float terrainHeight(const float x, const float z){
+	return 40 * sinf(x * 0.003f) * cosf(z * 0.002f) + 10 * sinf(x * 0.02f + z * 0.013f);
+}
+
+static ubyte material(const vec3 &pos){
+	return ubyte(int(pos.x * 7 + pos.z * 13 + pos.y));
+}
+
+static float chunkDistance(const vec3 &pos, const WorldChunk &chunk){
+	vec3 d = max(max(chunk.boxMin - pos, pos - chunk.boxMax), vec3(0.0f));
+	return length(d);
+}
+
+static vec3 getVertex(const Model &model, const uint index){
+	return *(vec3 *) (model.getCompiledVertices() + model.getVertexSize() * index);
+}
+
+// Closest hit along the segment against every triangle of the model
+static bool intersectAll(const Model &model, const vec3 &v0, const vec3 &v1, vec3 *point){
+	vec3 dir = v1 - v0;
+	float closest = 2.0f;
+	for (uint i = 0; i < model.getIndexCount(); i += 3){
+		vec3 p0 = getVertex(model, model.getCompiledIndex(i));
+		vec3 e1 = getVertex(model, model.getCompiledIndex(i + 1)) - p0;
+		vec3 e2 = getVertex(model, model.getCompiledIndex(i + 2)) - p0;
+
+		vec3 p = cross(dir, e2);
+		float det = dot(e1, p);
+		if (fabsf(det) < 1e-12f) continue;
+
+		vec3 t = v0 - p0;
+		float u = dot(t, p) / det;
+		if (u < 0 || u > 1) continue;
+		vec3 q = cross(t, e1);
+		float v = dot(dir, q) / det;
+		if (v < 0 || u + v > 1) continue;
+
+		float d = dot(e2, q) / det;
+		if (d >= 0 && d < closest) closest = d;
+	}
+	if (closest > 1.0f) return false;
+
+	*point = v0 + closest * dir;
+	return true;
+}
+
+static void createTerrain(Model &model, const uint gridSize){
+	uint nVertices = (gridSize + 1) * (gridSize + 1);
+	float *vertices = new float[3 * nVertices];
+	uint *indices = new uint[6 * gridSize * gridSize];
+
+	for (uint z = 0; z <= gridSize; z++){
+		for (uint x = 0; x <= gridSize; x++){
+			float *dest = vertices + 3 * (z * (gridSize + 1) + x);
+			dest[0] = x * WORLD_SIZE / gridSize;
+			dest[2] = z * WORLD_SIZE / gridSize;
+			dest[1] = terrainHeight(dest[0], dest[2]);
+		}
+	}
+
+	uint nIndices = 0;
+	for (uint z = 0; z < gridSize; z++){
+		for (uint x = 0; x < gridSize; x++){
+			uint i = z * (gridSize + 1) + x;
+			indices[nIndices++] = i;
+			indices[nIndices++] = i + gridSize + 1;
+			indices[nIndices++] = i + 1;
+			indices[nIndices++] = i + 1;
+			indices[nIndices++] = i + gridSize + 1;
+			indices[nIndices++] = i + gridSize + 2;
+		}
+	}
+
+	model.setIndexCount(nIndices);
+	model.addStream(TYPE_VERTEX, 3, nVertices, vertices, indices, true);
+	model.addBatch(0, nIndices);
+	model.compile();
+}
+
+// Checks what's resident once the loader has caught up with the camera, returns the number of errors
+static uint checkResidency(const WorldStreamer &streamer, const Model &terrain, const vec3 &camera, const uint64 budget, uint *nResident){
+	uint nErrors = 0;
+	uint64 residentMemory = 0, largestMissing = 0;
+
+	*nResident = 0;
+	for (uint i = 0; i < streamer.getChunkCount(); i++){
+		const WorldChunk &info = streamer.getChunkInfo(i);
+		float dist = chunkDistance(camera, info);
+
+		if (streamer.isResident(i)){
+			(*nResident)++;
+			residentMemory += info.memorySize;
+			if (dist > UNLOAD_DISTANCE){
+				printf("Chunk %u is resident %.0f units away\n", i, dist);
+				nErrors++;
+			}
+
+			const Model *model = streamer.getModel(i);
+			const ubyte *vertexData = streamer.getVertexData(i);
+			for (uint k = 0; k < model->getCompiledVertexCount(); k++){
+				if (vertexData[k] != material(getVertex(*model, k))){
+					printf("Chunk %u vertex data doesn't line up with its vertices\n", i);
+					nErrors++;
+					break;
+				}
+			}
+		} else if (dist < LOAD_DISTANCE){
+			largestMissing = max(largestMissing, (uint64) info.memorySize);
+		}
+	}
+
+	if (streamer.getResidentMemory() != residentMemory){
+		printf("Resident memory reported as %llu bytes, the resident chunks use %llu\n", (unsigned long long) streamer.getResidentMemory(), (unsigned long long) residentMemory);
+		nErrors++;
+	}
+	if (largestMissing > 0 && residentMemory + largestMissing <= budget){
+		printf("A chunk within the load distance is missing with room for it in the budget\n");
+		nErrors++;
+	}
+	if (streamer.getPeakMemory() > budget){
+		printf("Peak memory %llu over the budget of %llu\n", (unsigned long long) streamer.getPeakMemory(), (unsigned long long) budget);
+		nErrors++;
+	}
+
+	// Straight down from the camera, which is always over a chunk within the load distance
+	vec3 down = camera - vec3(0, 1000, 0);
+	vec3 streamedHit, terrainHit;
+	bool streamed = streamer.intersects(camera, down, &streamedHit);
+	bool expected = intersectAll(terrain, camera, down, &terrainHit);
+	if (streamed != expected || (streamed && length(streamedHit - terrainHit) > 0.01f)){
+		printf("Collision at (%.0f, %.0f) doesn't match the terrain\n", camera.x, camera.z);
+		nErrors++;
+	}
+
+	return nErrors;
+}
+
+static uint runPath(const Model &terrain, const uint64 budget){
+	WorldStreamer streamer;
+	if (!streamer.open(fileName, 1)){
+		printf("Couldn't open %s\n", fileName);
+		return 1;
+	}
+	streamer.setLimits(LOAD_DISTANCE, UNLOAD_DISTANCE, budget);
+
+	uint nErrors = 0, nChanges = 0, maxResident = 0;
+	float updateTime = 0;
+	for (uint step = 0; step <= N_STEPS; step++){
+		float a = 2 * PI * step / N_STEPS;
+		vec3 camera(0.5f * WORLD_SIZE + 0.35f * WORLD_SIZE * cosf(a), 200, 0.5f * WORLD_SIZE + 0.35f * WORLD_SIZE * sinf(2 * a));
+
+		streamer.setCameraPosition(camera);
+		timestamp start = getCurrentTime();
+		nChanges += streamer.update(NULL);
+		updateTime += getTimeDifference(start, getCurrentTime());
+
+		if (step % 100 == 0){
+			streamer.waitIdle(NULL);
+
+			uint nResident;
+			nErrors += checkResidency(streamer, terrain, camera, budget, &nResident);
+			maxResident = max(maxResident, nResident);
+		}
+	}
+
+	printf("Budget %.2f MB: peak %.2f MB, at most %u chunks resident, %u loads and unloads, update %.1f us per step\n",
+		budget / 1048576.0f, streamer.getPeakMemory() / 1048576.0f, maxResident, nChanges, updateTime * 1e6f / (N_STEPS + 1));
+
+	return nErrors;
+}
+
+// Breaks the first chunk, then checks that the rest load and that it's retried with a backoff
+static uint runFailure(){
+	TestStreamer streamer;
+	if (!streamer.open(fileName)) return 1;
+	uint64 offset = streamer.getChunkInfo(0).offset;
+	streamer.close();
+
+	FILE *file = fopen(fileName, "r+b");
+	if (file == NULL) return 1;
+	uint32 junk[4] = { 0, 0, 0, 0 };
+	fseek(file, long(offset), SEEK_SET);
+	fwrite(junk, sizeof(junk), 1, file);
+	fclose(file);
+
+	if (!streamer.open(fileName)) return 1;
+	streamer.setLimits(1e10f, 1e10f, ~uint64(0));
+	streamer.waitIdle(NULL);
+
+	uint nErrors = 0;
+	uint64 residentMemory = 0;
+	for (uint i = 1; i < streamer.getChunkCount(); i++){
+		if (streamer.isResident(i)){
+			residentMemory += streamer.getChunkInfo(i).memorySize;
+		} else {
+			printf("Chunk %u didn't load next to a broken chunk\n", i);
+			nErrors++;
+		}
+	}
+	if (streamer.isResident(0)){
+		printf("The broken chunk loaded\n");
+		nErrors++;
+	}
+	if (streamer.getResidentMemory() != residentMemory){
+		printf("The broken chunk still holds memory\n");
+		nErrors++;
+	}
+
+	// Retries are due 0.25, 0.75 and 1.75 seconds after the first failure, so a little over two
+	// seconds of updates should see three or four failures in all, not one per update.
+	timestamp start = getCurrentTime();
+	uint nUpdates = 0;
+	while (getTimeDifference(start, getCurrentTime()) < 2.1f){
+		streamer.update(NULL);
+		streamer.waitIdle(NULL);
+		nUpdates++;
+		usleep(10000);
+	}
+	uint failures = streamer.getFailures(0);
+	printf("Broken chunk: %u failures in %u updates\n", failures, nUpdates);
+	if (failures < 3 || failures > 5){
+		printf("Expected 3 to 5 failures\n");
+		nErrors++;
+	}
+
+	return nErrors;
+}
+
+int main(int argc, char *argv[]){
+	initTime();
+
+	uint gridSize = (argc > 1)? atoi(argv[1]) : 256;
+	float budgetFraction = (argc > 2)? float(atof(argv[2])) : 0.125f;
+	if (gridSize < 2) gridSize = 2;
+
+	Model terrain;
+	createTerrain(terrain, gridSize);
+
+	// One byte of material per vertex, made from its position so it can be checked wherever it ends up
+	uint nVertices = terrain.getCompiledVertexCount();
+	ubyte *materials = new ubyte[nVertices];
+	for (uint i = 0; i < nVertices; i++){
+		materials[i] = material(getVertex(terrain, i));
+	}
+	bool saved = saveWorldChunks(fileName, terrain, CELL_SIZE, materials, 1, 1);
+	delete [] materials;
+	if (!saved){
+		printf("Couldn't write %s\n", fileName);
+		return 1;
+	}
+
+	WorldStreamer streamer;
+	if (streamer.open(fileName, 2)){
+		printf("A chunk file with a different source hash was accepted\n");
+		return 1;
+	}
+	if (!streamer.open(fileName, 1)){
+		printf("Couldn't open %s\n", fileName);
+		return 1;
+	}
+	uint64 total = 0;
+	for (uint i = 0; i < streamer.getChunkCount(); i++){
+		total += streamer.getChunkInfo(i).memorySize;
+	}
+	printf("%u triangles in %u chunks, %.2f MB in all\n", terrain.getIndexCount() / 3, streamer.getChunkCount(), total / 1048576.0f);
+	streamer.close();
+
+	uint nErrors = runPath(terrain, uint64(total * budgetFraction));
+	nErrors += runPath(terrain, total);
+	nErrors += runFailure();
+
+	remove(fileName);
+
+	printf("%u errors\n", nErrors);
+
+	return (nErrors > 0)? 1 : 0;
+}
@@ -28,6 +28,7 @@ BaseApp *CreateApp() { return new App(); }
 
 App::App()
 : m_depthRT(TEXTURE_NONE)
+, m_textureStreamer(64 << 20)
 {
 }
 
@@ -57,34 +58,73 @@ void App::moveCamera(const vec3 &dir)
 
 bool App::init()
 {
+  const char * mapFileName = "../Models/Room6/Map.obj";
+  const char * mapCacheName = "../Models/Room6/Map.cmdl";
+
   m_map = new SurfaceDecalModel();
-  if (!m_map->loadObj("../Models/Room6/Map.obj")){
-    delete m_map;
-    return false;
+
+  // Use the compiled map if it was built from the current source file with the current settings,
+  // otherwise rebuild it (if the source can't be hashed any compiled map is accepted). The settings
+  // cover everything below that changes the compiled output, with a version to bump when the way
+  // the map is compiled changes while they stay the same.
+  static const char mapSettings[] = "v3: flat tangents, draw order for a 16 entry vertex cache keeping the vertex order, half texcoords, byte frames";
+  uint64 mapHash = 0;
+  if (hashFile(mapFileName, mapHash))
+  {
+    mapHash = hashMemory(mapSettings, sizeof(mapSettings), mapHash);
+  }
+  if (!m_map->loadCompiled(mapCacheName, mapHash))
+  {
+    if (!m_map->loadObj(mapFileName)){
+      delete m_map;
+      return false;
+    }
+
+    m_map->computeTangentSpace(true);
+    m_map->cleanUp();
+
+    // Half float texture coordinates and byte tangent frames, expanded again in the lighting shaders
+    m_map->setVertexCompression(true, true);
+    m_map->changeAllGeneric(true);
+
+    // Triangle reordering keeps the provoking vertex of each triangle, but the vertex order has to stay
+    // as it is for the saved vertex material data to line up
+    m_map->setDrawOrderOptimization(true, false);
+    if (!m_map->compile())
+    {
+      delete m_map;
+      return false;
+    }
+    m_map->saveCompiled(mapCacheName, mapHash);
   }
 
-  m_map->computeTangentSpace(true);
-  m_map->cleanUp();
+  // Small clusters, as the map is only a few hundred triangles
+  m_map->buildClusters(16);
 
   {
-    Stream stream = m_map->getStream(m_map->findStream(TYPE_VERTEX));
-    vec3 *vertices = (vec3 *) stream.vertices;
-    uint *indices = stream.indices;
+    // Get the position offset in the compiled vertex
+    uint stride = m_map->getVertexSize();
+    const ubyte * vertices = m_map->getCompiledVertices() + m_map->getStreamOffset(m_map->findStream(TYPE_VERTEX));
     for (uint i = 0; i < m_map->getIndexCount(); i += 3){
+      const vec3 & v0 = *(const vec3 *) (vertices + stride * m_map->getCompiledIndex(i));
+      const vec3 & v1 = *(const vec3 *) (vertices + stride * m_map->getCompiledIndex(i + 1));
+      const vec3 & v2 = *(const vec3 *) (vertices + stride * m_map->getCompiledIndex(i + 2));
+
       // Add the triangle index as the collsion data
-      m_bsp.addTriangle(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]], (void*)(i / 3));
+      m_bsp.addTriangle(v0, v1, v2, (void*)(i / 3));
     }
 
     m_bsp.build();
   }
 
-  m_map->changeAllGeneric(true);
-
   // Create the render sphere model
   m_sphereModel = new Model();
   m_sphereModel->createSphere(3);
   m_sphereModel->cleanUp();
 
+  // Coarser spheres for when they are small on screen
+  m_sphereModel->buildLods(4);
+
   int tab = configDialog->addTab("Rendering");
   
   // Select the rendering tab as the active tab
@@ -239,21 +279,24 @@ bool App::load()
   if ((m_depthTex = renderer->addRenderTarget(width, height, FORMAT_RGB32F, m_pointSample)) == TEXTURE_NONE) return false;
   if ((m_screenMask = renderer->addRenderTarget(width, height, FORMAT_RGBA8, m_pointSample)) == TEXTURE_NONE) return false;
   
+  // Shaders and textures are read and processed on worker threads, only the final creation happens here
+  ResourceLoader loader;
+
   // Shaders
   const char *attribs[] = { NULL, "textureCoord", "tangent", "binormal", "normal", "matWeight", "matIndices" };
-  if ((m_depthOnly = renderer->addShader("depthOnly.shd")) == SHADER_NONE) return false;
+  loader.addShader(&m_depthOnly, "depthOnly.shd");
 
-  if ((m_lightingColorOnly = renderer->addShader("lightingColorOnly.shd")) == SHADER_NONE) return false;
+  loader.addShader(&m_lightingColorOnly, "lightingColorOnly.shd");
   
-  if ((m_decal = renderer->addShader("decal.shd")) == SHADER_NONE) return false;
-  if ((m_lightingMP = renderer->addShader("lightingMP.shd", attribs, elementsOf(attribs))) == SHADER_NONE) return false;
-  if ((m_lightingMP_ambient = renderer->addShader("lightingMP_ambient.shd", attribs, elementsOf(attribs))) == SHADER_NONE) return false;
+  loader.addShader(&m_decal, "decal.shd");
+  loader.addShader(&m_lightingMP, "lightingMP.shd", attribs, elementsOf(attribs));
+  loader.addShader(&m_lightingMP_ambient, "lightingMP_ambient.shd", attribs, elementsOf(attribs));
 
   // Debug shaders
-  if ((m_debugMatData = renderer->addShader("lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_MAT_DATA\n")) == SHADER_NONE) return false;
-  if ((m_debugVertexWeights = renderer->addShader("lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_VERTEX_WEIGHTS\n")) == SHADER_NONE) return false;
+  loader.addShader(&m_debugMatData, "lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_MAT_DATA\n");
+  loader.addShader(&m_debugVertexWeights, "lightingMP_ambient.shd", attribs, elementsOf(attribs), "#define DEBUG_VERTEX_WEIGHTS\n");
   
-  if ((m_colorOnly = renderer->addShader("PlainColor.shd", attribs, elementsOf(attribs))) == SHADER_NONE) return false;
+  loader.addShader(&m_colorOnly, "PlainColor.shd", attribs, elementsOf(attribs));
 
   const char * diffuseTexArrayNames[] =
   {
@@ -265,7 +308,7 @@ bool App::load()
    "../Textures/Brick02.dds",
   };
 
-  if ((m_texArray = renderer->addTexture  (diffuseTexArrayNames, true, m_trilinearAniso, elementsOf(diffuseTexArrayNames))) == SHADER_NONE) return false;
+  loader.addTexture(&m_texArray, diffuseTexArrayNames, true, m_trilinearAniso, elementsOf(diffuseTexArrayNames));
 
 
   const char * bumpTexArrayNames[] =
@@ -278,31 +321,33 @@ bool App::load()
    "../Textures/Brick02Bump.dds",
   };
 
-  if ((m_bumpTexArray = renderer->addTexture  (bumpTexArrayNames, true, m_trilinearAniso, elementsOf(bumpTexArrayNames))) == SHADER_NONE) return false;
+  loader.addTexture(&m_bumpTexArray, bumpTexArrayNames, true, m_trilinearAniso, elementsOf(bumpTexArrayNames));
 
-  if ((m_decalTex = renderer->addTexture ("../Textures/decaltest.dds", true, m_trilinearAnisoClamp)) == SHADER_NONE) return false;
+  loader.addTexture(&m_decalTex, "../Textures/decaltest.dds", true, m_trilinearAnisoClamp);
 
-  if ((m_perlin = renderer->addTexture ("../Textures/Perlin.dds", true, m_trilinearAniso)) == SHADER_NONE) return false;
+  loader.addTexture(&m_perlin, "../Textures/Perlin.dds", true, m_trilinearAniso);
 
-  // Textures
-  if ((base[0] = renderer->addTexture  ("../Textures/floor_wood_3.dds",                   true, m_trilinearAniso)) == SHADER_NONE) return false;
-  if ((bump[0] = renderer->addNormalMap("../Textures/floor_wood_3Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso)) == SHADER_NONE) return false;
+  // Textures. The base textures start out with their smallest mipmaps and the rest is streamed in by drawFrame().
+  if ((base[0] = m_textureStreamer.addTexture(renderer, "../Textures/floor_wood_3.dds", m_trilinearAniso)) == TEXTURE_NONE) return false;
+  loader.addNormalMap(&bump[0], "../Textures/floor_wood_3Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso);
   parallax[0] = 0.04f;
 
-  if ((base[1] = renderer->addTexture  ("../Textures/brick01.dds",                   true, m_trilinearAniso)) == SHADER_NONE) return false;
-  if ((bump[1] = renderer->addNormalMap("../Textures/brick01Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso)) == SHADER_NONE) return false;
+  if ((base[1] = m_textureStreamer.addTexture(renderer, "../Textures/brick01.dds", m_trilinearAniso)) == TEXTURE_NONE) return false;
+  loader.addNormalMap(&bump[1], "../Textures/brick01Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso);
   parallax[1] = 0.04f;
 
-  if ((base[2] = renderer->addTexture  ("../Textures/stone08.dds",                   true, m_trilinearAniso)) == SHADER_NONE) return false;
-  if ((bump[2] = renderer->addNormalMap("../Textures/stone08Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso)) == SHADER_NONE) return false;
+  if ((base[2] = m_textureStreamer.addTexture(renderer, "../Textures/stone08.dds", m_trilinearAniso)) == TEXTURE_NONE) return false;
+  loader.addNormalMap(&bump[2], "../Textures/stone08Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso);
   parallax[2] = 0.04f;
 
-  if ((base[3] = renderer->addTexture  ("../Textures/StoneWall_1-4.dds",                   true, m_trilinearAniso)) == SHADER_NONE) return false;
-  if ((bump[3] = renderer->addNormalMap("../Textures/StoneWall_1-4Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso)) == SHADER_NONE) return false;
+  if ((base[3] = m_textureStreamer.addTexture(renderer, "../Textures/StoneWall_1-4.dds", m_trilinearAniso)) == TEXTURE_NONE) return false;
+  loader.addNormalMap(&bump[3], "../Textures/StoneWall_1-4Bump.dds", FORMAT_RGBA8, true, m_trilinearAniso);
   parallax[3] = 0.03f;
   parallax[4] = 0.02f;
   parallax[5] = 0.01f;
 
+  if (!loader.load(renderer)) return false;
+
   // Blendstates
   if ((m_blendAdd = renderer->addBlendState(ONE, ONE)) == BS_NONE) return false;
   if ((m_noColorWrite = renderer->addBlendState(ONE, ZERO, BM_ADD, NONE)) == BS_NONE) return false;
@@ -319,6 +364,7 @@ bool App::load()
 
 void App::unload()
 {
+  m_textureStreamer.clear();
 }
 
 
@@ -336,7 +382,7 @@ void App::drawDecalMask()
   renderer->setRasterizerState(cullBack);
   renderer->apply();
 
-  m_map->draw(renderer);
+  DrawMap();
 
   // Render to the screen mask texture
   renderer->changeRenderTarget(m_screenMask, m_depthRT);
@@ -367,7 +413,7 @@ void App::drawDecalMask()
       //renderer->setShaderConstant4x4f("ScreenToLocal", m_decals[i].m_matrix * viewProjInv);
       renderer->applyConstants();
 
-      m_sphereModel->draw(renderer);
+      m_sphereModel->drawLod(renderer, m_sphereModel->selectLod(GetProjectedRadius(m_decals[i].m_position, m_decals[i].m_radius)));
     }
   }
 
@@ -413,7 +459,7 @@ void App::drawLightingMPAmbient()
   SetDebugShaderConstants();
   renderer->applyConstants();
 
-  m_map->draw(renderer);
+  DrawMap();
 }
 
 
@@ -448,7 +494,7 @@ void App::drawLightingMP()
         //renderer->setShaderConstant1f("invRadius", 1.0f / lightDataArray[i].size);
         //renderer->applyConstants();
     
-        m_map->drawBatch(renderer, k);
+        DrawMapBatch(k);
       }
     }
     glDisable(GL_SCISSOR_TEST);
@@ -456,6 +502,40 @@ void App::drawLightingMP()
 
 }
 
+void App::CullMap()
+{
+  Frustum frustum;
+  frustum.loadFrustum(m_projectionMatrix * m_modelviewMatrix);
+
+  // Every pass drawing the map culls back faces, so clusters facing away from the camera can go too
+  m_mapRanges.clear();
+  m_mapBatchRanges.clear();
+  for (uint i = 0; i < m_map->getBatchCount(); i++)
+  {
+    m_mapBatchRanges.add(m_mapRanges.getCount());
+    m_map->cullBatch(i, frustum, &camPos, m_mapRanges);
+  }
+  m_mapBatchRanges.add(m_mapRanges.getCount());
+}
+
+
+void App::DrawMap()
+{
+  for (uint i = 0; i < m_map->getBatchCount(); i++)
+  {
+    DrawMapBatch(i);
+  }
+}
+
+
+void App::DrawMapBatch(uint a_batch)
+{
+  for (uint i = m_mapBatchRanges[a_batch]; i < m_mapBatchRanges[a_batch + 1]; i++)
+  {
+    m_map->drawSubBatch(renderer, a_batch, m_mapRanges[i].first, m_mapRanges[i].count);
+  }
+}
+
 void App::UpdateDecals()
 {
   //Loop over all decals and remove expired ones
@@ -472,6 +552,9 @@ void App::UpdateDecals()
 
 void App::drawFrame()
 {
+  // Upload a few more base texture mipmaps
+  m_textureStreamer.update(renderer, 1 << 20);
+
   // Update and load the modelview and projection matrices
   m_projectionMatrix = perspectiveMatrixX(1.5f, width, height, 5, 4000);
   m_modelviewMatrix = rotateXY(-wx, -wy) * translate(-camPos);
@@ -482,6 +565,8 @@ void App::drawFrame()
   glMatrixMode(GL_MODELVIEW);
   glLoadMatrixf(value_ptr(m_modelviewMatrix));
 
+  CullMap();
+
   // Update the decals for time
   UpdateDecals();
 
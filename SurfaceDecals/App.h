@@ -23,7 +23,11 @@
 #include "../Framework3/OpenGL/OpenGLApp.h"
 #include "../Framework3/Util/Model.h"
 #include "../Framework3/Util/BSP.h"
+#include "../Framework3/Util/MappedFile.h"
+#include "../Framework3/Util/ResourceLoader.h"
+#include "../Framework3/Util/TextureStreamer.h"
 #include "../Framework3/Math/Scissor.h"
+#include "../Framework3/Math/Frustum.h"
 
 #include "SurfaceDecalModel.h"
 
@@ -73,6 +77,8 @@ protected:
   mat4 m_modelviewMatrix;    //!< The current frame's modelview matrix
 
   SurfaceDecalModel * m_map; //!< The rendering map
+  Array <DrawRange> m_mapRanges;   //!< The map index ranges that survive culling this frame
+  Array <uint> m_mapBatchRanges;   //!< The first range of each map batch (and the range count)
   BSP m_bsp;                 //!< The collision bsp 
 
   Model * m_sphereModel;     //!< Editor sphere model
@@ -91,6 +97,8 @@ protected:
   TextureID m_perlin;            //!< The perlin noise texture
   TextureID m_decalTex;          //!< Th decal texture
 
+  TextureStreamer m_textureStreamer; //!< Streams in the larger mipmaps of the base textures
+
   TextureID m_texArray;          //!< The main diffuse texture array
   TextureID m_bumpTexArray;      //!< The main bump texture array
 
@@ -115,8 +123,16 @@ protected:
 
   // Get the triangle collision for the specified x,y screen coordinates
   bool GetCollisionTriangle(const int a_x, const int a_y, vec3 & a_colPoint, const BTri *& a_colTriangle);
+
+  // Get the radius in pixels of the passed sphere on screen (FLT_MAX if the camera is inside or close)
+  float GetProjectedRadius(const vec3 & a_pos, float a_radius) const;
   void UpdateDecals();
 
+  // Cull the map clusters against the current view, then draw what is left
+  void CullMap();
+  void DrawMap();
+  void DrawMapBatch(uint a_batch);
+
   // Position light editor methods
   bool GetSpherePosition(const int x, const int y);
   void PaintWeights(const vec3 & a_spherePos, float a_sphereSize, bool a_add);
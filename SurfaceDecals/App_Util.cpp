@@ -108,10 +108,22 @@ bool App::GetCollisionTriangle(const int a_x, const int a_y, vec3 & a_colPoint,
 }
 
 
+float App::GetProjectedRadius(const vec3 & a_pos, float a_radius) const
+{
+  float viewZ = (m_modelviewMatrix * vec4(a_pos, 1.0f)).z;
+  if(viewZ <= a_radius)
+  {
+    return FLT_MAX;
+  }
+
+  return a_radius * m_projectionMatrix[0][0] * 0.5f * width / viewZ;
+}
+
+
 void App::PaintWeights(const vec3 & a_spherePos, float a_sphereSize, bool a_add)
 {
-  // Get all the vertices in the sphere area
-  Array<uint> indices;
+  // Get all the vertices in the sphere area (kept on the stack, as this runs every frame while painting)
+  SmallArray<uint, 128> indices;
   m_map->GetSphereVertices(a_spherePos, a_sphereSize, indices);
   for(uint i = 0; i < indices.getCount(); i++)
   {
@@ -465,7 +477,7 @@ void App::drawFrameEditor()
   renderer->applyConstants();
 
   // Draw a sphere the radius of the light
-  m_sphereModel->draw(renderer);
+  m_sphereModel->drawLod(renderer, m_sphereModel->selectLod(GetProjectedRadius(s_editorData.m_editSpherePos, s_editorData.m_editSphereSize)));
 
   // Draw text data to the screen 
 	renderer->setup2DMode(0, (float) width, 0, (float) height);
@@ -108,12 +108,13 @@ void SurfaceDecalModel::GetSphereVertices(const vec3 & a_pos, float a_radius, Ar
 {
   a_retVertexIndices.clear();
 
-  // Get the number of vertices and stride
-  uint componentCount = getComponentCount();
+  // Get the vertex stride and where the position is in each vertex
+  uint vertexSize = getVertexSize();
+  StreamID vertexStream = findStream(TYPE_VERTEX);
 
   if(lastVertexCount <= 0 ||
      !lastVertices ||
-     componentCount < 3)
+     vertexStream < 0)
   {
     return;
   }
@@ -121,10 +122,9 @@ void SurfaceDecalModel::GetSphereVertices(const vec3 & a_pos, float a_radius, Ar
   float radiusSquared = a_radius * a_radius;
 
   // Loop for all vertices
-  const float *currVertex = lastVertices;
+  const ubyte *currVertex = lastVertices + getStreamOffset(vertexStream);
   for(uint i = 0; i < lastVertexCount; i++)
   {
-    // Assume the first 3 are the position
     const vec3 * testVertex = (const vec3*)currVertex;
 
     // If within the sphere
@@ -135,7 +135,7 @@ void SurfaceDecalModel::GetSphereVertices(const vec3 & a_pos, float a_radius, Ar
     }
 
     // Go to next vertex
-    currVertex += componentCount;
+    currVertex += vertexSize;
   }
 }
 
@@ -290,13 +290,9 @@ uint SurfaceDecalModel::makeDrawable(Renderer *renderer, const bool useCache, co
   // Create the new vertex format with the extra vertex buffer
 	FormatDesc *format = new FormatDesc[streams.getCount() + 2];
   {
-	  uint i = 0;
-    for (; i < streams.getCount(); i++){
-		  format[i].stream = 0;
-		  format[i].type   = streams[i].type;
-		  format[i].format = FORMAT_FLOAT;
-		  format[i].size   = streams[i].nComponents;
-	  }
+    // Same layout as the base model for the first stream
+    getDrawFormat(format);
+	  uint i = streams.getCount();
 
 	  format[i].stream = 1;
 	  format[i].type   = TYPE_GENERIC;
@@ -348,10 +344,12 @@ void SurfaceDecalModel::unmakeDrawable(Renderer *renderer)
 {
   Model::unmakeDrawable(renderer);
 
-  // Delete vertex format
-
-  // Delete vertex buffer
-
+  // The vertex format stays, as there is no deleting them
+  if (m_secondVertexBuffer != VB_NONE)
+  {
+    renderer->deleteVertexBuffer(m_secondVertexBuffer);
+    m_secondVertexBuffer = VB_NONE;
+  }
 }
 
 
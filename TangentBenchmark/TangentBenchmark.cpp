@@ -0,0 +1,305 @@
+
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Times Model::computeTangentSpace() on a height field of about a million triangles, flat and smooth,
+	next to the serial version it replaced, and checks that both give the same tangent space.
+
+	Usage: TangentBenchmark [size] [workers]
+
+	The height field is size x size quads, 708 by default for 1002528 triangles, with texture
+	coordinates stretched differently along each axis. Both versions get a copy of the same model and
+	the best of 5 runs is reported, along with the part of it both spend in Model::assemble(). The new
+	version normalizes four triangles at a time with SSE, so it may differ from the old one in the last
+	bits; any component off by more than 1e-5 or any index that differs is a failure. Returns non-zero
+	on failure.
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Util/Model.h"
+#include "../Framework3/Util/JobSystem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_RUNS 5
+
+static void oldTangentVectors(const vec3 &v0, const vec3 &v1, const vec3 &v2, const vec2 &t0, const vec2 &t1, const vec2 &t2, vec3 &sdir, vec3 &tdir, vec3 &normal){
+	vec3 dv0 = v1 - v0;
+	vec3 dv1 = v2 - v0;
+
+	vec2 dt0 = t1 - t0;
+	vec2 dt1 = t2 - t0;
+
+	float r = 1.0f / (dt0.x * dt1.y - dt1.x * dt0.y);
+	sdir = vec3(dt1.y * dv0.x - dt0.y * dv1.x, dt1.y * dv0.y - dt0.y * dv1.y, dt1.y * dv0.z - dt0.y * dv1.z) * r;
+	tdir = vec3(dt0.x * dv1.x - dt1.x * dv0.x, dt0.x * dv1.y - dt1.x * dv0.y, dt0.x * dv1.z - dt1.x * dv0.z) * r;
+	normal = normalize(cross(dv0, dv1));
+}
+
+class ReferenceModel : public Model {
+public:
+	// Both versions start by assembling the vertex and texture coordinate streams, which takes most of the time
+	float timeAssemble(){
+		StreamID streams[2] = { findStream(TYPE_VERTEX), findStream(TYPE_TEXCOORD) };
+
+		float *vertexArrays[2];
+		uint *indices;
+
+		timestamp start = getCurrentTime();
+		assemble(streams, 2, vertexArrays, &indices, true);
+		float time = getTimeDifference(start, getCurrentTime());
+
+		delete [] vertexArrays[0];
+		delete [] vertexArrays[1];
+		delete [] indices;
+
+		return time;
+	}
+
+	// Model::computeTangentSpace() as it was before it went parallel
+	bool oldComputeTangentSpace(const bool flat){
+		StreamID streams[2] = { findStream(TYPE_VERTEX), findStream(TYPE_TEXCOORD) };
+
+		if (streams[0] < 0 || streams[1] < 0) return false;
+
+		float *vertexArrays[2];
+		uint *indices;
+
+		uint nVertices = assemble(streams, 2, vertexArrays, &indices, true);
+
+		vec3 *vertices  = (vec3 *) vertexArrays[0];
+		vec2 *texCoords = (vec2 *) vertexArrays[1];
+
+		if (flat){
+			uint nFaces = nIndices / 3;
+
+			vec3 *tangents  = new vec3[nFaces];
+			vec3 *binormals = new vec3[nFaces];
+			vec3 *normals   = new vec3[nFaces];
+
+			uint *indicesS = new uint[nIndices];
+			uint *indicesT = new uint[nIndices];
+			uint *indicesN = new uint[nIndices];
+
+			for (uint i = 0; i < nFaces; i++){
+				vec3 v0 = vertices[indices[3 * i    ]];
+				vec3 v1 = vertices[indices[3 * i + 1]];
+				vec3 v2 = vertices[indices[3 * i + 2]];
+
+				vec2 t0 = texCoords[indices[3 * i    ]];
+				vec2 t1 = texCoords[indices[3 * i + 1]];
+				vec2 t2 = texCoords[indices[3 * i + 2]];
+
+				vec3 sdir, tdir, normal;
+				oldTangentVectors(v0, v1, v2, t0, t1, t2, sdir, tdir, normal);
+
+				tangents [i] = normalize(sdir);
+				binormals[i] = normalize(tdir);
+				normals  [i] = normal;
+
+				indicesS[3 * i] = indicesS[3 * i + 1] = indicesS[3 * i + 2] = i;
+				indicesT[3 * i] = indicesT[3 * i + 1] = indicesT[3 * i + 2] = i;
+				indicesN[3 * i] = indicesN[3 * i + 1] = indicesN[3 * i + 2] = i;
+			}
+
+			addStream(TYPE_TANGENT,  3, nFaces, (float *) tangents,  indicesS, false);
+			addStream(TYPE_BINORMAL, 3, nFaces, (float *) binormals, indicesT, false);
+			addStream(TYPE_NORMAL,   3, nFaces, (float *) normals,   indicesN, false);
+
+			delete [] indices;
+
+		} else {
+			vec3 *tangents  = new vec3[nVertices];
+			vec3 *binormals = new vec3[nVertices];
+			vec3 *normals   = new vec3[nVertices];
+
+			for (uint j = 0; j < nVertices; j++){
+				tangents[j] = binormals[j] = normals[j] = vec3(0, 0, 0);
+			}
+
+			for (uint i = 0; i < nIndices; i += 3){
+				vec3 v0 = vertices[indices[i    ]];
+				vec3 v1 = vertices[indices[i + 1]];
+				vec3 v2 = vertices[indices[i + 2]];
+
+				vec2 t0 = texCoords[indices[i    ]];
+				vec2 t1 = texCoords[indices[i + 1]];
+				vec2 t2 = texCoords[indices[i + 2]];
+
+				vec3 sdir, tdir, normal;
+				oldTangentVectors(v0, v1, v2, t0, t1, t2, sdir, tdir, normal);
+
+				sdir = normalize(sdir);
+				tdir = normalize(tdir);
+
+				for (uint k = 0; k < 3; k++){
+					tangents [indices[i + k]] += sdir;
+					binormals[indices[i + k]] += tdir;
+					normals  [indices[i + k]] += normal;
+				}
+			}
+
+			for (uint j = 0; j < nVertices; j++){
+				tangents [j] = normalize(tangents [j]);
+				binormals[j] = normalize(binormals[j]);
+				normals  [j] = normalize(normals  [j]);
+			}
+
+			uint *indicesS = new uint[nIndices];
+			uint *indicesT = new uint[nIndices];
+			memcpy(indicesS, indices, nIndices * sizeof(uint));
+			memcpy(indicesT, indices, nIndices * sizeof(uint));
+
+			addStream(TYPE_TANGENT,  3, nVertices, (float *) tangents,  indicesS, false);
+			addStream(TYPE_BINORMAL, 3, nVertices, (float *) binormals, indicesT, false);
+			addStream(TYPE_NORMAL,   3, nVertices, (float *) normals,   indices,  false);
+		}
+
+		delete [] vertices;
+		delete [] texCoords;
+
+		return true;
+	}
+};
+
+static void createHeightField(Model &model, const uint size){
+	uint nVertices = (size + 1) * (size + 1);
+	uint nIndices = 6 * size * size;
+
+	vec3 *vertices = new vec3[nVertices];
+	vec2 *texCoords = new vec2[nVertices];
+	for (uint y = 0; y <= size; y++){
+		for (uint x = 0; x <= size; x++){
+			uint i = y * (size + 1) + x;
+			vertices[i] = vec3(float(x), 8.0f * sinf(x * 0.05f) * cosf(y * 0.07f) + 0.5f * sinf(x * 0.9f + y * 1.3f), float(y));
+			texCoords[i] = vec2(x * 0.125f, y * 0.0625f);
+		}
+	}
+
+	uint *vertexIndices = new uint[nIndices];
+	uint *dest = vertexIndices;
+	for (uint y = 0; y < size; y++){
+		for (uint x = 0; x < size; x++){
+			uint i0 = y * (size + 1) + x;
+			uint i1 = i0 + size + 1;
+
+			*dest++ = i0;
+			*dest++ = i1;
+			*dest++ = i1 + 1;
+
+			*dest++ = i0;
+			*dest++ = i1 + 1;
+			*dest++ = i0 + 1;
+		}
+	}
+
+	uint *coordIndices = new uint[nIndices];
+	memcpy(coordIndices, vertexIndices, nIndices * sizeof(uint));
+
+	model.addStream(TYPE_VERTEX, 3, nVertices, (float *) vertices, vertexIndices, false);
+	model.addStream(TYPE_TEXCOORD, 2, nVertices, (float *) texCoords, coordIndices, false);
+	model.setIndexCount(nIndices);
+	model.addBatch(0, nIndices);
+}
+
+// Returns the largest difference between the streams of the two models, or a negative value if they don't line up
+static float compareModels(const Model &model0, const Model &model1){
+	if (model0.getIndexCount() != model1.getIndexCount() || model0.getStreamCount() != model1.getStreamCount()) return -1.0f;
+
+	float maxDiff = 0;
+	for (uint i = 0; i < model0.getStreamCount(); i++){
+		const Stream &stream0 = model0.getStream(i);
+		const Stream &stream1 = model1.getStream(i);
+
+		if (stream0.type != stream1.type || stream0.nVertices != stream1.nVertices || stream0.nComponents != stream1.nComponents) return -1.0f;
+		if (memcmp(stream0.indices, stream1.indices, model0.getIndexCount() * sizeof(uint)) != 0) return -1.0f;
+
+		for (uint j = 0; j < stream0.nVertices * stream0.nComponents; j++){
+			float diff = fabsf(stream0.vertices[j] - stream1.vertices[j]);
+			// Also catches NaNs
+			if (!(diff <= maxDiff)) maxDiff = diff;
+		}
+	}
+
+	return maxDiff;
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	uint size = (argc > 1)? atoi(argv[1]) : 708;
+	uint nWorkers = (argc > 2)? atoi(argv[2]) : 0;
+
+	initJobSystem(nWorkers);
+
+	Model source;
+	createHeightField(source, size);
+
+	printf("%u triangles, %u vertices, %u workers, best of %u runs\n", source.getIndexCount() / 3, source.getStream(0).nVertices, getWorkerCount(), N_RUNS);
+	printf("%-7s %12s %12s %12s %8s %12s\n", "mode", "assemble", "old", "new", "speedup", "difference");
+
+	uint nFailures = 0;
+	for (uint flat = 0; flat < 2; flat++){
+		float assembleTime = 1e10f, oldTime = 1e10f, newTime = 1e10f;
+		float diff = 0;
+		for (uint run = 0; run < N_RUNS; run++){
+			ReferenceModel reference;
+			reference.copy(&source);
+			float time = reference.timeAssemble();
+			if (time < assembleTime) assembleTime = time;
+
+			timestamp start = getCurrentTime();
+			reference.oldComputeTangentSpace(flat != 0);
+			time = getTimeDifference(start, getCurrentTime());
+			if (time < oldTime) oldTime = time;
+
+			// Only one result at a time, so that both versions start out with the same memory in use
+			Model result;
+			result.copy(&reference);
+			reference.clear();
+
+			Model model;
+			model.copy(&source);
+			start = getCurrentTime();
+			model.computeTangentSpace(flat != 0);
+			time = getTimeDifference(start, getCurrentTime());
+			if (time < newTime) newTime = time;
+
+			diff = compareModels(model, result);
+		}
+
+		printf("%-7s %9.1f ms %9.1f ms %9.1f ms %7.2fx", flat? "flat" : "smooth", assembleTime * 1000.0f, oldTime * 1000.0f, newTime * 1000.0f, oldTime / newTime);
+		if (diff >= 0 && diff <= 1e-5f){
+			printf(" %12g\n", diff);
+		} else {
+			printf(" %12s\n", (diff < 0)? "MISMATCH" : "TOO LARGE");
+			nFailures++;
+		}
+	}
+
+	shutdownJobSystem();
+
+	return (nFailures > 0)? 1 : 0;
+}
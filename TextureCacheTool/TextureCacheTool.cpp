@@ -0,0 +1,222 @@
+
+/* * * * * * * * * * * * * Author's note * * * * * * * * * * * *\
+*   _       _   _       _   _       _   _       _     _ _ _ _   *
+*  |_|     |_| |_|     |_| |_|_   _|_| |_|     |_|  _|_|_|_|_|  *
+*  |_|_ _ _|_| |_|     |_| |_|_|_|_|_| |_|     |_| |_|_ _ _     *
+*  |_|_|_|_|_| |_|     |_| |_| |_| |_| |_|     |_|   |_|_|_|_   *
+*  |_|     |_| |_|_ _ _|_| |_|     |_| |_|_ _ _|_|  _ _ _ _|_|  *
+*  |_|     |_|   |_|_|_|   |_|     |_|   |_|_|_|   |_|_|_|_|    *
+*                                                               *
+*                     http://www.humus.name                     *
+*                                                                *
+* This file is a part of the work done by Humus. You are free to   *
+* use the code in any way you like, modified, unmodified or copied   *
+* into your own work. However, I expect you to respect these points:  *
+*  - If you use this file and its contents unmodified, or use a major *
+*    part of this file, please credit the author and leave this note. *
+*  - For use in anything commercial, please request my approval.     *
+*  - Share your work and ideas too as much as you can.             *
+*                                                                *
+\* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+	Fills the texture cache ahead of time, so applications find every processed texture there on their first run.
+
+	Usage: TextureCacheTool [options and paths]
+
+	Paths are files or directories, which are searched recursively for images. Options apply to the paths that
+	follow them, so one run can cache the same directory in several ways:
+
+	  -cache <directory>    Cache directory, "../TextureCache/" by default
+	  -mipmaps / -nomips    Whether the textures are used with mipmaps, which is the default
+	  -normalmap <format> [sZ] [mipMapScaleZ]
+	                        Cache the images as normal maps built from height maps, as Renderer::addNormalMap()
+	  -texture              Cache the images as plain textures again
+
+	Without any paths "../Textures" is cached as plain textures with mipmaps.
+
+	Example: TextureCacheTool ../Textures -normalmap RGBA8 ../Textures/brick01Bump.dds ../Textures/stone08Bump.dds
+*/
+
+#include "../Framework3/CPU.h"
+#include "../Framework3/Imaging/TextureCache.h"
+#include "../Framework3/Util/Array.h"
+#include "../Framework3/Util/JobSystem.h"
+#include "../Framework3/Util/String.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#ifndef _WIN32
+#  include <dirent.h>
+#  include <sys/stat.h>
+#endif
+
+struct CacheTask {
+	String fileName;
+	TextureProcessing processing;
+};
+
+struct CacheJob {
+	Array <CacheTask> tasks;
+
+	std::atomic <uint> nAdded;
+	std::atomic <uint> nPresent;
+	std::atomic <uint> nSkipped;
+	std::atomic <uint> nFailed;
+};
+
+static bool isImageFile(const char *fileName){
+	static const char *extensions[] = { ".dds", ".htex", ".hdr", ".jpg", ".jpeg", ".png", ".tga", ".bmp", ".pcx" };
+
+	const char *extension = strrchr(fileName, '.');
+	if (extension == NULL) return false;
+
+	for (uint i = 0; i < elementsOf(extensions); i++){
+		if (stricmp(extension, extensions[i]) == 0) return true;
+	}
+	return false;
+}
+
+static void addTask(CacheJob &job, const char *fileName, const TextureProcessing &processing){
+	CacheTask task;
+	task.fileName = fileName;
+	task.processing = processing;
+	job.tasks.add(task);
+}
+
+// Adds the images in the directory and all its subdirectories. Returns false if path isn't a directory.
+static bool addDirectory(CacheJob &job, const char *path, const TextureProcessing &processing){
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA(String(path) + "/*", &data);
+	if (find == INVALID_HANDLE_VALUE) return false;
+
+	do {
+		if (strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0) continue;
+
+		String name = String(path) + "/" + data.cFileName;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY){
+			addDirectory(job, name, processing);
+		} else if (isImageFile(name)){
+			addTask(job, name, processing);
+		}
+	} while (FindNextFileA(find, &data));
+
+	FindClose(find);
+#else
+	DIR *dir = opendir(path);
+	if (dir == NULL) return false;
+
+	dirent *entry;
+	while ((entry = readdir(dir)) != NULL){
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+		String name = String(path) + "/" + entry->d_name;
+		struct stat st;
+		if (stat(name, &st) != 0) continue;
+
+		if (S_ISDIR(st.st_mode)){
+			addDirectory(job, name, processing);
+		} else if (isImageFile(name)){
+			addTask(job, name, processing);
+		}
+	}
+
+	closedir(dir);
+#endif
+
+	return true;
+}
+
+static void cacheTextures(void *data, const uint start, const uint end){
+	CacheJob *job = (CacheJob *) data;
+
+	for (uint i = start; i < end; i++){
+		const CacheTask &task = job->tasks[i];
+		const char *fileName = task.fileName;
+
+		uint64 key;
+		if (!getTextureCacheKey(&fileName, task.processing, key)){
+			// Either unreadable, which loading will tell, or already usable as it is
+			job->nSkipped++;
+			continue;
+		}
+
+		Image img;
+		if (loadCachedTexture(img, key)){
+			job->nPresent++;
+			continue;
+		}
+
+		uint flags = task.processing.useMipMaps? MAP_PIXELS : MAP_PIXELS | DONT_LOAD_MIPMAPS;
+		if (img.loadImage(fileName, flags) && processTexture(img, task.processing) && saveCachedTexture(img, key)){
+			printf("Cached %s\n", fileName);
+			job->nAdded++;
+		} else {
+			printf("Failed %s\n", fileName);
+			job->nFailed++;
+		}
+	}
+}
+
+int main(int argc, char *argv[]){
+	initCPU();
+	initTime();
+
+	CacheJob job;
+	job.nAdded = 0;
+	job.nPresent = 0;
+	job.nSkipped = 0;
+	job.nFailed = 0;
+
+	TextureProcessing processing;
+	bool hasPaths = false;
+
+	for (int i = 1; i < argc; i++){
+		const char *arg = argv[i];
+
+		if (strcmp(arg, "-cache") == 0 && i + 1 < argc){
+			setTextureCacheDirectory(argv[++i]);
+		} else if (strcmp(arg, "-mipmaps") == 0){
+			processing.useMipMaps = true;
+		} else if (strcmp(arg, "-nomips") == 0){
+			processing.useMipMaps = false;
+		} else if (strcmp(arg, "-normalmap") == 0 && i + 1 < argc){
+			processing.normalMapFormat = getFormatFromString(argv[++i]);
+			if (processing.normalMapFormat == FORMAT_NONE){
+				printf("Unknown format \"%s\"\n", argv[i]);
+				return 1;
+			}
+			processing.sZ = 1.0f;
+			processing.mipMapScaleZ = 2.0f;
+			if (i + 1 < argc && sscanf(argv[i + 1], "%f", &processing.sZ) == 1) i++;
+			if (i + 1 < argc && sscanf(argv[i + 1], "%f", &processing.mipMapScaleZ) == 1) i++;
+		} else if (strcmp(arg, "-texture") == 0){
+			processing.normalMapFormat = FORMAT_NONE;
+		} else if (arg[0] == '-'){
+			printf("Unknown option \"%s\"\n", arg);
+			return 1;
+		} else {
+			if (!addDirectory(job, arg, processing)) addTask(job, arg, processing);
+			hasPaths = true;
+		}
+	}
+
+	if (!hasPaths) addDirectory(job, "../Textures", processing);
+
+	timestamp startTime = getCurrentTime();
+
+	// One job per file, as they vary a lot in cost. The processing of a large file spreads across the workers too.
+	initJobSystem();
+	parallelFor(cacheTextures, &job, job.tasks.getCount(), 1);
+	shutdownJobSystem();
+
+	float time = getTimeDifference(startTime, getCurrentTime());
+
+	printf("%u added, %u already cached, %u not needing the cache, %u failed in %.2f seconds\n",
+		job.nAdded.load(), job.nPresent.load(), job.nSkipped.load(), job.nFailed.load(), time);
+
+	return (job.nFailed > 0)? 1 : 0;
+}